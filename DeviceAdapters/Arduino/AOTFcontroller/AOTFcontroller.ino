@@ -68,6 +68,26 @@
  *   set with function 11.  Any input character (which will be processed) will stop 
  *   the pattern generation.
  *   Controller will retun 12.
+ *
+ * Set all digital patterns for triggered mode at once: 13nd...
+ *   Where n is the number of patterns (up to 12), followed by n digital patterns.
+ *   Replaces command 5 for each pattern followed by command 6.
+ *   Controller will return 13n, or 13 followed by 0 if n is too large.
+ *
+ * Set analogue sequence: 14xnvv...
+ *   Where x is the output channel (0 or 1), n the number of values (up to 64),
+ *   followed by n values in the 12-bit format of command 3.
+ *   Controller will return 14xn, or 14x followed by 0 if n is too large.
+ *
+ * Start analogue sequence: 15x
+ *   Where x is the output channel.  The values set with command 14 will appear
+ *   on the output, one per trigger, using the same trigger input and edges as
+ *   trigger mode.  The sequence is repeated after the last value.  Can run
+ *   together with trigger mode (command 8).
+ *   Controller will return 15x
+ *
+ * Stop analogue sequence: 16x
+ *   Controller will return 16x
  * 
  * Start blanking Mode: 20
  *   In blanking mode, zeroes will be written on the output pins when the trigger pin
@@ -104,7 +124,7 @@
  *   Get Number of digital patterns
  */
  
-   unsigned int version_ = 2;
+   unsigned int version_ = 3;
    
    // pin on which to receive the trigger (2 and 3 can be used with interrupts, although this code does not use interrupts)
    int inPin_ = 2;
@@ -132,6 +152,13 @@
    bool blankOnHigh_ = false;
    bool triggerMode_ = false;
    boolean triggerState_ = false;
+
+   const int DASEQUENCELENGTH = 64;
+   // analogue sequences, per channel, as msb/lsb pairs
+   byte daSequence_[2][DASEQUENCELENGTH][2];
+   int daSequenceLength_[2] = {0, 0};
+   int daSequenceNr_[2] = {0, 0};
+   bool daSequenceOn_[2] = {false, false};
  
  void setup() {
    // Higher speeds do not appear to be reliable
@@ -303,6 +330,80 @@
          }
          break;
 
+       // Sets all digital patterns in one transfer
+       case 13:
+         if (waitForSerial(timeOut_)) {
+           int pL = Serial.read();
+           if (pL > SEQUENCELENGTH) {
+             Serial.write( byte(13));
+             Serial.write( byte(0));
+             break;
+           }
+           int i = 0;
+           for (; i < pL && waitForSerial(timeOut_); i++) {
+             triggerPattern_[i] = Serial.read() & B00111111;
+           }
+           if (i == pL) {
+             patternLength_ = pL;
+             Serial.write( byte(13));
+             Serial.write( patternLength_);
+           }
+         }
+         break;
+
+       // Sets the analogue sequence of a channel in one transfer
+       case 14:
+         if (waitForSerial(timeOut_)) {
+           int channel = Serial.read() == 0 ? 0 : 1;
+           if (waitForSerial(timeOut_)) {
+             int length = Serial.read();
+             if (length > DASEQUENCELENGTH) {
+               Serial.write( byte(14));
+               Serial.write( channel);
+               Serial.write( byte(0));
+               break;
+             }
+             int i = 0;
+             for (; i < 2 * length && waitForSerial(timeOut_); i++) {
+               daSequence_[channel][i / 2][i % 2] = Serial.read();
+             }
+             if (i == 2 * length) {
+               daSequenceLength_[channel] = length;
+               Serial.write( byte(14));
+               Serial.write( channel);
+               Serial.write( length);
+             }
+           }
+         }
+         break;
+
+       // Starts the analogue sequence of a channel
+       case 15:
+         if (waitForSerial(timeOut_)) {
+           int channel = Serial.read() == 0 ? 0 : 1;
+           if (daSequenceLength_[channel] > 0) {
+             if (!triggerMode_ && !daSequenceOn_[0] && !daSequenceOn_[1]) {
+               triggerNr_ = 0;
+               triggerState_ = digitalRead(inPin_) == HIGH;
+             }
+             daSequenceNr_[channel] = 0;
+             daSequenceOn_[channel] = true;
+             Serial.write( byte(15));
+             Serial.write( channel);
+           }
+         }
+         break;
+
+       // Stops the analogue sequence of a channel
+       case 16:
+         if (waitForSerial(timeOut_)) {
+           int channel = Serial.read() == 0 ? 0 : 1;
+           daSequenceOn_[channel] = false;
+           Serial.write( byte(16));
+           Serial.write( channel);
+         }
+         break;
+
        // Blanks output based on TTL input
        case 20:
          blanking_ = true;
@@ -378,28 +479,40 @@
     }
     
     // In trigger mode, we will blank even if blanking is not on..
-    if (triggerMode_) {
+    if (triggerMode_ || daSequenceOn_[0] || daSequenceOn_[1]) {
       boolean tmp = PIND & inPinBit_;
       if (tmp != triggerState_) {
         if (blankOnHigh_ && tmp ) {
-          PORTB = 0;
+          if (triggerMode_)
+            PORTB = 0;
         }
         else if (!blankOnHigh_ && !tmp ) {
-          PORTB = 0;
+          if (triggerMode_)
+            PORTB = 0;
         }
         else { 
           if (triggerNr_ >=0) {
-            PORTB = triggerPattern_[sequenceNr_];
-            sequenceNr_++;
-            if (sequenceNr_ >= patternLength_)
-              sequenceNr_ = 0;
+            if (triggerMode_) {
+              PORTB = triggerPattern_[sequenceNr_];
+              sequenceNr_++;
+              if (sequenceNr_ >= patternLength_)
+                sequenceNr_ = 0;
+            }
+            for (int c = 0; c < 2; c++) {
+              if (daSequenceOn_[c]) {
+                int n = daSequenceNr_[c];
+                analogueOut(c, daSequence_[c][n][0], daSequence_[c][n][1]);
+                daSequenceNr_[c] = (n + 1 < daSequenceLength_[c]) ? n + 1 : 0;
+              }
+            }
           }
           triggerNr_++;
         }
         
         triggerState_ = tmp;       
       }  
-    } else if (blanking_) {
+    }
+    if (!triggerMode_ && blanking_) {
       if (blankOnHigh_) {
         if (! (PIND & inPinBit_))
           PORTB = currentPattern_;
@@ -33,7 +33,9 @@ const char* g_DeviceNameArduinoInput = "Arduino-Input";
 
 // Global info about the state of the Arduino.  This should be folded into a class
 const int g_Min_MMVersion = 1;
-const int g_Max_MMVersion = 2;
+const int g_Max_MMVersion = 3;
+// first firmware version with batched sequence upload and analogue sequences
+const int g_Min_SequenceVersion = 3;
 const char* g_versionProp = "Version";
 const char* g_normalLogicString = "Normal";
 const char* g_invertedLogicString = "Inverted";
@@ -320,6 +322,23 @@ int CArduinoHub::Shutdown()
    return DEVICE_OK;
 }
 
+// Reads an answer of known length.  Expects the caller to guard the port.
+int CArduinoHub::ReadAnswerH(unsigned char* answer, unsigned len, double timeoutMs)
+{
+   MM::MMTime startTime = GetCurrentMMTime();
+   unsigned long bytesRead = 0;
+   while ((bytesRead < len) && ( (GetCurrentMMTime() - startTime).getMsec() < timeoutMs)) {
+      unsigned long br;
+      int ret = ReadFromComPortH(answer + bytesRead, len - bytesRead, br);
+      if (ret != DEVICE_OK)
+         return ret;
+      bytesRead += br;
+   }
+   if (bytesRead < len)
+      return ERR_COMMUNICATION;
+   return DEVICE_OK;
+}
+
 int CArduinoHub::OnPort(MM::PropertyBase* pProp, MM::ActionType pAct)
 {
    if (pAct == MM::BeforeGet)
@@ -561,8 +580,13 @@ int CArduinoSwitch::LoadSequence(unsigned size, unsigned char* seq)
    if (!hub || !hub->IsPortAvailable())
       return ERR_NO_PORT_SET;
 
+   MMThreadGuard myLock(hub->GetLock());
+
    hub->PurgeComPortH();
 
+   if (hub->GetFirmwareVersion() >= g_Min_SequenceVersion)
+      return LoadSequenceBatched(hub, size, seq);
+
    for (unsigned i=0; i < size; i++)
    {
       unsigned char value = seq[i];
@@ -618,6 +642,35 @@ int CArduinoSwitch::LoadSequence(unsigned size, unsigned char* seq)
    return DEVICE_OK;
 }
 
+// Sends all patterns in a single transfer (command 13).  Expects the caller
+// to guard and purge the port.
+int CArduinoSwitch::LoadSequenceBatched(CArduinoHub* hub, unsigned size, unsigned char* seq)
+{
+   std::vector<unsigned char> command(2 + size);
+   command[0] = 13;
+   command[1] = (unsigned char) size;
+   for (unsigned i=0; i < size; i++)
+   {
+      unsigned char value = 63 & seq[i];
+      if (hub->IsLogicInverted())
+         value = ~value;
+      command[2 + i] = value;
+   }
+
+   int ret = hub->WriteToComPortH(&command[0], (unsigned) command.size());
+   if (ret != DEVICE_OK)
+      return ret;
+
+   unsigned char answer[2];
+   ret = hub->ReadAnswerH(answer, 2, 250);
+   if (ret != DEVICE_OK)
+      return ret;
+   if (answer[0] != 13 || answer[1] != size)
+      return ERR_COMMUNICATION;
+
+   return DEVICE_OK;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Action handlers
 ///////////////////////////////////////////////////////////////////////////////
@@ -997,7 +1050,8 @@ CArduinoDA::CArduinoDA(int channel) :
       gatedVolts_(0.0),
       channel_(channel), 
       maxChannel_(2),
-      gateOpen_(true)
+      gateOpen_(true),
+      sequenceable_(false)
 {
    InitializeDefaultErrorMessages();
 
@@ -1067,6 +1121,8 @@ int CArduinoDA::Initialize()
       return nRet;
    SetPropertyLimits("Volts", minV_, maxV_);
 
+   sequenceable_ = hub->GetFirmwareVersion() >= g_Min_SequenceVersion;
+
    nRet = UpdateStatus();
    if (nRet != DEVICE_OK)
       return nRet;
@@ -1120,9 +1176,14 @@ int CArduinoDA::WriteToPort(unsigned long value)
 }
 
 
+long CArduinoDA::VoltsToValue(double volts) const
+{
+   return (long) ( (volts - minV_) / maxV_ * 4095);
+}
+
 int CArduinoDA::WriteSignal(double volts)
 {
-   long value = (long) ( (volts - minV_) / maxV_ * 4095);
+   long value = VoltsToValue(volts);
 
    std::ostringstream os;
     os << "Volts: " << volts << " Max Voltage: " << maxV_ << " digital value: " << value;
@@ -1157,6 +1218,105 @@ int CArduinoDA::SetGateOpen(bool open)
 
 }
 
+int CArduinoDA::ClearDASequence()
+{
+   sequence_.clear();
+   return DEVICE_OK;
+}
+
+int CArduinoDA::AddToDASequence(double voltage)
+{
+   if (!sequenceable_)
+      return DEVICE_UNSUPPORTED_COMMAND;
+   if (sequence_.size() >= NUMSEQUENCEVALUES)
+      return DEVICE_SEQUENCE_TOO_LARGE;
+
+   sequence_.push_back(VoltsToValue(voltage));
+   return DEVICE_OK;
+}
+
+// Uploads the whole sequence in a single transfer (command 14)
+int CArduinoDA::SendDASequence()
+{
+   if (!sequenceable_)
+      return DEVICE_UNSUPPORTED_COMMAND;
+
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   if (!hub || !hub->IsPortAvailable())
+      return ERR_NO_PORT_SET;
+
+   MMThreadGuard myLock(hub->GetLock());
+
+   hub->PurgeComPortH();
+
+   std::vector<unsigned char> command(3 + 2 * sequence_.size());
+   command[0] = 14;
+   command[1] = (unsigned char) (channel_ -1);
+   command[2] = (unsigned char) sequence_.size();
+   for (unsigned i=0; i < sequence_.size(); i++)
+   {
+      command[3 + 2 * i] = (unsigned char) (sequence_[i] / 256L);
+      command[4 + 2 * i] = (unsigned char) (sequence_[i] & 255);
+   }
+
+   int ret = hub->WriteToComPortH(&command[0], (unsigned) command.size());
+   if (ret != DEVICE_OK)
+      return ret;
+
+   unsigned char answer[3];
+   ret = hub->ReadAnswerH(answer, 3, 2500);
+   if (ret != DEVICE_OK)
+      return ret;
+   if (answer[0] != 14 || answer[2] != sequence_.size())
+      return ERR_COMMUNICATION;
+
+   return DEVICE_OK;
+}
+
+int CArduinoDA::StartDASequence()
+{
+   if (!sequenceable_)
+      return DEVICE_UNSUPPORTED_COMMAND;
+   return SendSequenceCommand(15);
+}
+
+int CArduinoDA::StopDASequence()
+{
+   if (!sequenceable_)
+      return DEVICE_UNSUPPORTED_COMMAND;
+   return SendSequenceCommand(16);
+}
+
+// Sends a start (15) or stop (16) command for this channel
+int CArduinoDA::SendSequenceCommand(unsigned char cmd)
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   if (!hub || !hub->IsPortAvailable())
+      return ERR_NO_PORT_SET;
+
+   MMThreadGuard myLock(hub->GetLock());
+
+   hub->PurgeComPortH();
+
+   unsigned char command[2];
+   command[0] = cmd;
+   command[1] = (unsigned char) (channel_ -1);
+   int ret = hub->WriteToComPortH((const unsigned char*) command, 2);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   unsigned char answer[2];
+   ret = hub->ReadAnswerH(answer, 2, 250);
+   if (ret != DEVICE_OK)
+      return ret;
+   if (answer[0] != cmd)
+      return ERR_COMMUNICATION;
+
+   hub->SetTimedOutput(false);
+
+   return DEVICE_OK;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Action handlers
 ///////////////////////////////////////////////////////////////////////////////
@@ -1173,6 +1333,38 @@ int CArduinoDA::OnVolts(MM::PropertyBase* pProp, MM::ActionType eAct)
       pProp->Get(volts);
       return SetSignal(volts);
    }
+   else if (eAct == MM::IsSequenceable)
+   {
+      if (sequenceable_)
+         pProp->SetSequenceable(NUMSEQUENCEVALUES);
+      else
+         pProp->SetSequenceable(0);
+   }
+   else if (eAct == MM::AfterLoadSequence)
+   {
+      std::vector<std::string> sequence = pProp->GetSequence();
+      if (sequence.size() > NUMSEQUENCEVALUES)
+         return DEVICE_SEQUENCE_TOO_LARGE;
+      ClearDASequence();
+      for (unsigned int i=0; i < sequence.size(); i++)
+      {
+         std::istringstream is(sequence[i]);
+         double volts;
+         is >> volts;
+         int ret = AddToDASequence(volts);
+         if (ret != DEVICE_OK)
+            return ret;
+      }
+      return SendDASequence();
+   }
+   else if (eAct == MM::StartSequence)
+   {
+      return StartDASequence();
+   }
+   else if (eAct == MM::StopSequence)
+   {
+      return StopDASequence();
+   }
 
    return DEVICE_OK;
 }
@@ -20,6 +20,7 @@
 #include "../../MMDevice/DeviceBase.h"
 #include <string>
 #include <map>
+#include <vector>
 
 //////////////////////////////////////////////////////////////////////////////
 // Error codes
@@ -68,6 +69,8 @@ public:
    {
       return ReadFromComPort(port_.c_str(), answer, maxLen, bytesRead);
    }
+   int ReadAnswerH(unsigned char* answer, unsigned len, double timeoutMs);
+   int GetFirmwareVersion() {return version_;}
    static MMThreadLock& GetLock() {return lock_;}
    void SetShutterState(unsigned state) {shutterState_ = state;}
    void SetSwitchState(unsigned state) {switchState_ = state;}
@@ -158,6 +161,7 @@ private:
    int WriteToPort(long lnValue);
    int ClosePort();
    int LoadSequence(unsigned size, unsigned char* seq);
+   int LoadSequenceBatched(CArduinoHub* hub, unsigned size, unsigned char* seq);
 
    unsigned pattern_[NUMPATTERNS];
    unsigned delay_[NUMPATTERNS];
@@ -191,7 +195,14 @@ public:
    int GetSignal(double& volts) {volts_ = volts; return DEVICE_UNSUPPORTED_COMMAND;}     
    int GetLimits(double& minVolts, double& maxVolts) {minVolts = minV_; maxVolts = maxV_; return DEVICE_OK;}
    
-   int IsDASequenceable(bool& isSequenceable) const {isSequenceable = false; return DEVICE_OK;}
+   // Sequences need firmware version 3 or later
+   int IsDASequenceable(bool& isSequenceable) const {isSequenceable = sequenceable_; return DEVICE_OK;}
+   int GetDASequenceMaxLength(long& nrEvents) const {nrEvents = NUMSEQUENCEVALUES; return DEVICE_OK;}
+   int StartDASequence();
+   int StopDASequence();
+   int ClearDASequence();
+   int AddToDASequence(double voltage);
+   int SendDASequence();
 
    // action interface
    // ----------------
@@ -200,8 +211,12 @@ public:
    int OnChannel(MM::PropertyBase* pProp, MM::ActionType eAct);
 
 private:
+   static const unsigned int NUMSEQUENCEVALUES = 64;
+
    int WriteToPort(unsigned long lnValue);
    int WriteSignal(double volts);
+   long VoltsToValue(double volts) const;
+   int SendSequenceCommand(unsigned char command);
 
    bool initialized_;
    bool busy_;
@@ -212,6 +227,8 @@ private:
    unsigned channel_;
    unsigned maxChannel_;
    bool gateOpen_;
+   bool sequenceable_;
+   std::vector<long> sequence_;
    std::string name_;
 };
 
@@ -0,0 +1,497 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ArduinoSimulator.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Simulates an Arduino running the AOTFcontroller firmware on a
+//                pseudo terminal, for testing the Arduino adapter without
+//                hardware (POSIX only)
+// COPYRIGHT:     Micro-Manager contributors, 2026
+// LICENSE:       LGPL
+//
+// BUILD:         g++ -o arduino_simulator ArduinoSimulator.cpp -lutil
+//
+// USAGE:         arduino_simulator [-t triggerPeriodMs] [-l link]
+//
+//                Prints the name of the serial port to use (the pty slave),
+//                and optionally makes a symbolic link to it.  The trigger
+//                input (pin 2) is pulsed every triggerPeriodMs, or once on
+//                SIGUSR1.  Every change of the digital (PORTB) or analogue
+//                outputs is printed as "D <pattern>" or "A<channel> <value>".
+//
+
+#include <errno.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+namespace
+{
+   const unsigned int version = 3;
+   const int SEQUENCELENGTH = 12;
+   const int DASEQUENCELENGTH = 64;
+   const double pulseLengthS = 0.005;
+
+   volatile sig_atomic_t g_pulseRequested = 0;
+
+   void OnSigUsr1(int)
+   {
+      g_pulseRequested = 1;
+   }
+
+   double Now()
+   {
+      timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      return ts.tv_sec + ts.tv_nsec * 1e-9;
+   }
+}
+
+
+// State of the firmware, following AOTFcontroller.ino
+class Firmware
+{
+public:
+   Firmware() :
+      portB_(0), currentPattern_(0), patternLength_(0), repeatPattern_(0),
+      triggerNr_(0), sequenceNr_(0), skipTriggers_(0), blanking_(false),
+      blankOnHigh_(false), triggerMode_(false), triggerState_(false),
+      input_(false)
+   {
+      memset(triggerPattern_, 0, sizeof(triggerPattern_));
+      memset(daSequence_, 0, sizeof(daSequence_));
+      for (int c = 0; c < 2; c++)
+      {
+         daValue_[c] = 0;
+         daSequenceLength_[c] = 0;
+         daSequenceNr_[c] = 0;
+         daSequenceOn_[c] = false;
+      }
+   }
+
+   // Executes the command at the start of in, if complete.  Returns the
+   // number of bytes used, or 0 if more bytes are needed.
+   size_t Execute(const std::vector<unsigned char>& in, std::string& out)
+   {
+      size_t n = in.size();
+      if (n == 0)
+         return 0;
+
+      switch (in[0])
+      {
+      case 1:
+         if (n < 2) return 0;
+         currentPattern_ = in[1] & 0x3f;
+         if (!blanking_)
+            SetPortB(currentPattern_);
+         out += (char) 1;
+         return 2;
+
+      case 2:
+         out += (char) 2;
+         out += (char) portB_;
+         return 1;
+
+      case 3:
+         if (n < 4) return 0;
+         AnalogueOut(in[1], in[2] & 0x0f, in[3]);
+         out += (char) 3;
+         out += (char) in[1];
+         out += (char) (in[2] & 0x0f);
+         out += (char) in[3];
+         return 4;
+
+      case 5:
+         if (n < 3) return 0;
+         if (in[1] < SEQUENCELENGTH)
+         {
+            triggerPattern_[in[1]] = in[2] & 0x3f;
+            out += (char) 5;
+            out += (char) in[1];
+            out += (char) triggerPattern_[in[1]];
+         }
+         else
+            out += "n:";
+         return 3;
+
+      case 6:
+         if (n < 2) return 0;
+         if (in[1] <= SEQUENCELENGTH)
+         {
+            patternLength_ = in[1];
+            out += (char) 6;
+            out += (char) patternLength_;
+         }
+         return 2;
+
+      case 7:
+         if (n < 2) return 0;
+         skipTriggers_ = in[1];
+         out += (char) 7;
+         out += (char) skipTriggers_;
+         return 2;
+
+      case 8:
+         if (patternLength_ > 0)
+         {
+            sequenceNr_ = 0;
+            triggerNr_ = -skipTriggers_;
+            triggerState_ = input_;
+            SetPortB(0);
+            out += (char) 8;
+            triggerMode_ = true;
+         }
+         return 1;
+
+      case 9:
+         triggerMode_ = false;
+         SetPortB(0);
+         out += (char) 9;
+         out += (char) triggerNr_;
+         return 1;
+
+      case 10:
+         if (n < 4) return 0;
+         out += (char) 10;
+         out += (char) in[1];
+         return 4;
+
+      case 11:
+         if (n < 2) return 0;
+         repeatPattern_ = in[1];
+         out += (char) 11;
+         out += (char) repeatPattern_;
+         return 2;
+
+      case 12:
+         // timed output is not simulated
+         if (patternLength_ > 0)
+            out += (char) 12;
+         return 1;
+
+      case 13:
+      {
+         if (n < 2) return 0;
+         int length = in[1];
+         if (length > SEQUENCELENGTH)
+         {
+            out += (char) 13;
+            out += (char) 0;
+            return 2;
+         }
+         if (n < (size_t) (2 + length)) return 0;
+         for (int i = 0; i < length; i++)
+            triggerPattern_[i] = in[2 + i] & 0x3f;
+         patternLength_ = length;
+         out += (char) 13;
+         out += (char) length;
+         return 2 + length;
+      }
+
+      case 14:
+      {
+         if (n < 3) return 0;
+         int channel = in[1] == 0 ? 0 : 1;
+         int length = in[2];
+         if (length > DASEQUENCELENGTH)
+         {
+            out += (char) 14;
+            out += (char) channel;
+            out += (char) 0;
+            return 3;
+         }
+         if (n < (size_t) (3 + 2 * length)) return 0;
+         for (int i = 0; i < length; i++)
+         {
+            daSequence_[channel][i][0] = in[3 + 2 * i];
+            daSequence_[channel][i][1] = in[4 + 2 * i];
+         }
+         daSequenceLength_[channel] = length;
+         out += (char) 14;
+         out += (char) channel;
+         out += (char) length;
+         return 3 + 2 * length;
+      }
+
+      case 15:
+      {
+         if (n < 2) return 0;
+         int channel = in[1] == 0 ? 0 : 1;
+         if (daSequenceLength_[channel] > 0)
+         {
+            if (!triggerMode_ && !daSequenceOn_[0] && !daSequenceOn_[1])
+            {
+               triggerNr_ = 0;
+               triggerState_ = input_;
+            }
+            daSequenceNr_[channel] = 0;
+            daSequenceOn_[channel] = true;
+            out += (char) 15;
+            out += (char) channel;
+         }
+         return 2;
+      }
+
+      case 16:
+      {
+         if (n < 2) return 0;
+         int channel = in[1] == 0 ? 0 : 1;
+         daSequenceOn_[channel] = false;
+         out += (char) 16;
+         out += (char) channel;
+         return 2;
+      }
+
+      case 20:
+         blanking_ = true;
+         out += (char) 20;
+         return 1;
+
+      case 21:
+         blanking_ = false;
+         out += (char) 21;
+         return 1;
+
+      case 22:
+         if (n < 2) return 0;
+         blankOnHigh_ = in[1] == 0;
+         out += (char) 22;
+         return 2;
+
+      case 30:
+         out += "MM-Ard\r\n";
+         return 1;
+
+      case 31:
+      {
+         char buf[16];
+         snprintf(buf, sizeof(buf), "%u\r\n", version);
+         out += buf;
+         return 1;
+      }
+
+      case 40:
+         out += (char) 40;
+         out += (char) 0x3f;
+         return 1;
+
+      case 41:
+         if (n < 2) return 0;
+         if (in[1] <= 5)
+         {
+            out += (char) 41;
+            out += (char) in[1];
+            out += (char) 0;
+            out += (char) 0;
+         }
+         return 2;
+
+      case 42:
+         if (n < 3) return 0;
+         out += (char) 42;
+         out += (char) in[1];
+         if (in[2] <= 1)
+            out += (char) in[2];
+         return 3;
+
+      default:
+         // unknown bytes are ignored, as by the firmware
+         return 1;
+      }
+   }
+
+   // Same as the end of loop() in the firmware
+   void Poll(bool input)
+   {
+      input_ = input;
+      if (triggerMode_ || daSequenceOn_[0] || daSequenceOn_[1])
+      {
+         if (input != triggerState_)
+         {
+            bool blank = (blankOnHigh_ && input) || (!blankOnHigh_ && !input);
+            if (blank)
+            {
+               if (triggerMode_)
+                  SetPortB(0);
+            }
+            else
+            {
+               if (triggerNr_ >= 0)
+               {
+                  if (triggerMode_)
+                  {
+                     SetPortB(triggerPattern_[sequenceNr_]);
+                     sequenceNr_++;
+                     if (sequenceNr_ >= patternLength_)
+                        sequenceNr_ = 0;
+                  }
+                  for (int c = 0; c < 2; c++)
+                  {
+                     if (daSequenceOn_[c])
+                     {
+                        int i = daSequenceNr_[c];
+                        AnalogueOut(c, daSequence_[c][i][0], daSequence_[c][i][1]);
+                        daSequenceNr_[c] = (i + 1 < daSequenceLength_[c]) ? i + 1 : 0;
+                     }
+                  }
+               }
+               triggerNr_++;
+            }
+            triggerState_ = input;
+         }
+      }
+      if (!triggerMode_ && blanking_)
+      {
+         bool blank = blankOnHigh_ ? input : !input;
+         SetPortB(blank ? 0 : currentPattern_);
+      }
+   }
+
+private:
+   void SetPortB(unsigned char pattern)
+   {
+      if (pattern != portB_)
+      {
+         portB_ = pattern;
+         printf("D %u\n", (unsigned) pattern);
+         fflush(stdout);
+      }
+   }
+
+   void AnalogueOut(int channel, unsigned char msb, unsigned char lsb)
+   {
+      int c = channel == 0 ? 0 : 1;
+      daValue_[c] = (msb & 0x0f) * 256 + lsb;
+      printf("A%d %u\n", c, daValue_[c]);
+      fflush(stdout);
+   }
+
+   unsigned char portB_;
+   unsigned char currentPattern_;
+   unsigned char triggerPattern_[SEQUENCELENGTH];
+   int patternLength_;
+   unsigned char repeatPattern_;
+   long triggerNr_;
+   long sequenceNr_;
+   int skipTriggers_;
+   bool blanking_;
+   bool blankOnHigh_;
+   bool triggerMode_;
+   bool triggerState_;
+   bool input_;
+   unsigned char daSequence_[2][DASEQUENCELENGTH][2];
+   unsigned daValue_[2];
+   int daSequenceLength_[2];
+   int daSequenceNr_[2];
+   bool daSequenceOn_[2];
+};
+
+
+static void Send(int fd, const std::string& text)
+{
+   size_t done = 0;
+   while (done < text.size())
+   {
+      ssize_t n = write(fd, text.data() + done, text.size() - done);
+      if (n < 0)
+      {
+         if (errno == EINTR || errno == EAGAIN)
+            continue;
+         return;
+      }
+      done += n;
+   }
+}
+
+
+int main(int argc, char* argv[])
+{
+   double triggerPeriodS = 0;
+   const char* link = 0;
+
+   int opt;
+   while ((opt = getopt(argc, argv, "t:l:")) != -1)
+   {
+      switch (opt)
+      {
+      case 't': triggerPeriodS = atof(optarg) / 1000.0; break;
+      case 'l': link = optarg; break;
+      default:
+         fprintf(stderr, "usage: %s [-t triggerPeriodMs] [-l link]\n", argv[0]);
+         return 1;
+      }
+   }
+
+   int master, slave;
+   char name[256];
+   if (openpty(&master, &slave, name, 0, 0) != 0)
+   {
+      perror("openpty");
+      return 1;
+   }
+
+   termios tio;
+   tcgetattr(slave, &tio);
+   cfmakeraw(&tio);
+   tcsetattr(slave, TCSANOW, &tio);
+
+   if (link != 0)
+   {
+      unlink(link);
+      if (symlink(name, link) != 0)
+      {
+         perror("symlink");
+         return 1;
+      }
+   }
+   printf("%s\n", name);
+   fflush(stdout);
+
+   signal(SIGUSR1, OnSigUsr1);
+
+   Firmware firmware;
+   std::vector<unsigned char> in;
+   double pulseEnd = 0, nextPulse = Now() + triggerPeriodS;
+   for (;;)
+   {
+      pollfd pfd;
+      pfd.fd = master;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      if (poll(&pfd, 1, 1) > 0 && (pfd.revents & POLLIN))
+      {
+         unsigned char buf[1024];
+         ssize_t n = read(master, buf, sizeof(buf));
+         if (n > 0)
+            in.insert(in.end(), buf, buf + n);
+      }
+
+      std::string out;
+      size_t used;
+      while ((used = firmware.Execute(in, out)) > 0)
+         in.erase(in.begin(), in.begin() + used);
+      Send(master, out);
+
+      double now = Now();
+      if (g_pulseRequested)
+      {
+         g_pulseRequested = 0;
+         pulseEnd = now + pulseLengthS;
+      }
+      if (triggerPeriodS > 0 && now >= nextPulse)
+      {
+         nextPulse = now + triggerPeriodS;
+         pulseEnd = now + pulseLengthS;
+      }
+      firmware.Poll(now < pulseEnd);
+   }
+}
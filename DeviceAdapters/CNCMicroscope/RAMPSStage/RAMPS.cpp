@@ -42,6 +42,12 @@ const char* g_YAccelerationProp = "Acceleration Y";
 const char* g_ZAccelerationProp = "Acceleration Z";
 const char* g_SettleTimeProp = "Settle Time";
 
+// Marlin buffers BUFSIZE (4) commands; more unacknowledged commands could
+// overrun its serial input buffer.
+const long g_MaxCommandsInFlight = 4;
+// How long synchronous commands wait for the queued ones to be acknowledged
+const double g_QueueTimeoutMs = 30000.;
+
 ///////////////////////////////////////////////////////////////////////////////
 // Exported MMDevice API
 ///////////////////////////////////////////////////////////////////////////////
@@ -110,7 +116,14 @@ RAMPSHub::RAMPSHub():
     acceleration_x_(10),
 	acceleration_y_(10),
 	acceleration_z_(10),
-    sent_busy_(false)
+    inFlight_(0),
+    synchronous_(false),
+    positionValid_(false),
+    idle_(true),
+    idleCheckSent_(false),
+    streaming_(false),
+    stopStreaming_(false),
+    streamThread_(0)
 {
   CPropertyAction* pAct  = new CPropertyAction(this, &RAMPSHub::OnPort);
   CreateProperty(MM::g_Keyword_Port, "Undefined", MM::String, false, pAct, true);
@@ -199,33 +212,50 @@ int RAMPSHub::Initialize()
   return DEVICE_OK;
 }
 
-int RAMPSHub::Shutdown() {initialized_ = false; return DEVICE_OK;};
+int RAMPSHub::Shutdown() {
+  StopStreamThread();
+  initialized_ = false;
+  return DEVICE_OK;
+};
 
+/*
+ * Does not block.  While commands are in flight the stage is busy.  Once
+ * all are acknowledged, the stage is busy until the moves should have
+ * finished (estimated from velocity and acceleration); then a single M400
+ * confirms that the planner is empty.
+ */
 bool RAMPSHub::Busy() {
-  if (!sent_busy_) {
-    int ret = SendCommand("M400");
-    if (ret != DEVICE_OK) {
-      LogMessage("error requesting dwell.");
-      return true;
-    }
-    sent_busy_ = true;
+  MMThreadGuard guard(queueLock_);
+  int ret = Pump();
+  if (ret != DEVICE_OK) {
+    LogMessage("error reading acknowledgements.");
+    return true;
   }
 
-  std::string answer;
-  int ret = ReadResponse(answer, 30000);
-  if (ret != DEVICE_OK) {
+  if (inFlight_ > 0 || !pending_.empty()) {
     status_ = "Busy";
     return true;
   }
-  if (!answer.compare("ok")) {
-    LogMessage(std::string("busy expected OK, didn't get it."));
-    LogMessage(answer);
-    return true;
+  if (idle_)
+    return false;
+  if (idleCheckSent_) {
+    // the M400 has been acknowledged
+    idleCheckSent_ = false;
+    idle_ = true;
+    status_ = "Idle";
+    return false;
   }
+  if (GetCurrentMMTime() < motionEnd_)
+    return true;
 
-  sent_busy_ = false;
-  status_ = "Idle";
-  return false;
+  ret = SetCommandComPortH("M400", "\r");
+  if (ret != DEVICE_OK) {
+    LogMessage("error requesting dwell.");
+    return true;
+  }
+  ++inFlight_;
+  idleCheckSent_ = true;
+  return true;
 }
 
 
@@ -337,53 +367,279 @@ int RAMPSHub::OnCommand(MM::PropertyBase* pProp, MM::ActionType pAct)
   return DEVICE_OK;
 }
 
+/*
+ * Sends a command whose replies are read with ReadResponse.  Waits until
+ * the queued commands are acknowledged, so that the replies can not be
+ * mixed up with theirs.
+ */
 int RAMPSHub::SendCommand(std::string command, std::string terminator) 
 {
   if(!portAvailable_)
     return ERR_NO_PORT_SET;
-  // needs a lock because the other Thread will also use this function
-  MMThreadGuard(this->executeLock_);
-  int ret = DEVICE_OK;
+  int ret = WaitForQueue(g_QueueTimeoutMs);
+  if (ret != DEVICE_OK)
+    return ret;
 
+  MMThreadGuard guard(queueLock_);
+  replies_.clear();
+  synchronous_ = true;
   ret = SetCommandComPortH(command.c_str(), terminator.c_str());
-  std::ostringstream retss;
-  retss << ret;
   if (ret != DEVICE_OK)
   {
     LogMessage("command write fail");
     return ret;
   }
+  ++inFlight_;
   return ret;
 }
 
 
 int RAMPSHub::ReadResponse(std::string &returnString, float timeout)
 {
-  char answer[MM::MaxStrLength];
-  GetCoreCallback()->GetDeviceProperty(port_.c_str(), "AnswerTimeout", answer);
+  MM::MMTime deadline = GetCurrentMMTime() + MM::MMTime(timeout * 1000.0);
+  for (;;)
+  {
+    {
+      MMThreadGuard guard(queueLock_);
+      int ret = Pump();
+      if (ret != DEVICE_OK)
+      {
+        LogMessage(std::string("answer get error!_"));
+        return ret;
+      }
+      if (!replies_.empty())
+      {
+        returnString = replies_.front();
+        replies_.pop_front();
+        return DEVICE_OK;
+      }
+    }
+    if (GetCurrentMMTime() > deadline)
+    {
+      LogMessage(std::string("answer get error!_"));
+      return DEVICE_SERIAL_TIMEOUT;
+    }
+    CDeviceUtils::SleepMs(1);
+  }
+}
 
-  SetAnswerTimeoutMs(timeout); //for normal command
-  MMThreadGuard(this->executeLock_);
 
-  std::string an;
-  try
+int RAMPSHub::QueueCommand(const std::string& command)
+{
+  if(!portAvailable_)
+    return ERR_NO_PORT_SET;
+  MMThreadGuard guard(queueLock_);
+  if (synchronous_) {
+    replies_.clear();
+    synchronous_ = false;
+  }
+  pending_.push_back(command);
+  idle_ = false;
+  idleCheckSent_ = false;
+  return Pump();
+}
+
+
+int RAMPSHub::MoveXY(double x, double y)
+{
+  char buff[100];
+  sprintf(buff, "G0 X%f Y%f", x, y);
+  int ret = QueueCommand(buff);
+  if (ret != DEVICE_OK)
+    return ret;
+  NoteMove(x, y, MPos[2]);
+  return DEVICE_OK;
+}
+
+
+int RAMPSHub::MoveZ(double z)
+{
+  char buff[100];
+  sprintf(buff, "G0 Z%f", z);
+  int ret = QueueCommand(buff);
+  if (ret != DEVICE_OK)
+    return ret;
+  NoteMove(MPos[0], MPos[1], z);
+  return DEVICE_OK;
+}
+
+
+/*
+ * Estimates when the move from the last queued position ends, assuming a
+ * trapezoidal velocity profile on each axis.
+ */
+void RAMPSHub::NoteMove(double x, double y, double z)
+{
+  const double target[3] = {x, y, z};
+  const double velocity[3] = {velocity_x_, velocity_y_, velocity_z_};
+  const double acceleration[3] = {acceleration_x_, acceleration_y_, acceleration_z_};
+  double seconds = 0.0;
+  for (int i = 0; i < 3; ++i) {
+    double distance = fabs(target[i] - MPos[i]);
+    double v = velocity[i];
+    double a = acceleration[i];
+    if (distance == 0.0 || v <= 0.0 || a <= 0.0)
+      continue;
+    double t;
+    if (distance >= v * v / a)
+      t = distance / v + v / a;
+    else
+      t = 2.0 * sqrt(distance / a);
+    seconds = std::max(seconds, t);
+  }
+
+  MMThreadGuard guard(queueLock_);
+  MPos[0] = x;
+  MPos[1] = y;
+  MPos[2] = z;
+  MM::MMTime now = GetCurrentMMTime();
+  if (motionEnd_ < now)
+    motionEnd_ = now;
+  motionEnd_ = motionEnd_ + MM::MMTime(seconds * 1e6);
+}
+
+
+int RAMPSHub::Pump()
+{
+  unsigned char buf[256];
+  unsigned long read;
+  do
   {
+    read = 0;
+    int ret = ReadFromComPortH(buf, sizeof(buf), read);
+    if (ret != DEVICE_OK)
+      return ret;
+    partialLine_.append((const char*)buf, read);
+  } while (read == sizeof(buf));
+
+  std::string::size_type end;
+  while ((end = partialLine_.find('\n')) != std::string::npos)
+  {
+    std::string line = partialLine_.substr(0, end);
+    partialLine_.erase(0, end + 1);
+    if (!line.empty() && line[line.length() - 1] == '\r')
+      line.erase(line.length() - 1);
+    if (line.empty())
+      continue;
+    // Every command is acknowledged with a line starting with "ok"
+    if (line.compare(0, 2, "ok") == 0 && inFlight_ > 0)
+      --inFlight_;
+    if (synchronous_)
+      replies_.push_back(line);
+  }
 
-    int ret = GetSerialAnswerComPortH(an,"\n");
+  while (!pending_.empty() && inFlight_ < g_MaxCommandsInFlight)
+  {
+    int ret = SetCommandComPortH(pending_.front().c_str(), "\r");
     if (ret != DEVICE_OK)
-    {
-      LogMessage(std::string("answer get error!_"));
       return ret;
+    pending_.pop_front();
+    ++inFlight_;
+  }
+
+  if (pending_.empty() && inFlight_ == 0)
+    streaming_ = false;
+  return DEVICE_OK;
+}
+
+
+int RAMPSHub::WaitForQueue(double timeoutMs)
+{
+  MM::MMTime deadline = GetCurrentMMTime() + MM::MMTime(timeoutMs * 1000.0);
+  for (;;)
+  {
+    {
+      MMThreadGuard guard(queueLock_);
+      int ret = Pump();
+      if (ret != DEVICE_OK)
+        return ret;
+      if (pending_.empty() && inFlight_ == 0)
+        return DEVICE_OK;
+      // a streamed sequence waits for triggers
+      if (streaming_)
+        return ERR_STAGE_MOVING;
+      if (GetCurrentMMTime() > deadline)
+      {
+        LogMessage("Commands were not acknowledged, clearing the queue.");
+        pending_.clear();
+        inFlight_ = 0;
+        return DEVICE_SERIAL_TIMEOUT;
+      }
     }
-    returnString = an;
+    CDeviceUtils::SleepMs(1);
   }
-  catch(...)
+}
+
+
+int RAMPSHub::StartStreaming()
+{
+  StopStreamThread();
+
+  MMThreadGuard guard(queueLock_);
+  if (pending_.empty() && inFlight_ == 0)
+    return DEVICE_OK;
+  streaming_ = true;
+  stopStreaming_ = false;
+  streamThread_ = new StreamThread(this);
+  streamThread_->activate();
+  return DEVICE_OK;
+}
+
+
+int RAMPSHub::StreamLoop()
+{
+  for (;;)
   {
-    LogMessage("Exception in receive response!");
-    GetCoreCallback()->SetDeviceProperty(port_.c_str(), "AnswerTimeout", answer);
-    return DEVICE_ERR;
+    {
+      MMThreadGuard guard(queueLock_);
+      if (stopStreaming_ || pending_.empty())
+        break;
+      int ret = Pump();
+      if (ret != DEVICE_OK)
+      {
+        LogMessage("Streaming commands failed.");
+        return ret;
+      }
+    }
+    CDeviceUtils::SleepMs(1);
   }
-  GetCoreCallback()->SetDeviceProperty(port_.c_str(), "AnswerTimeout", answer);
+  return 0;
+}
+
+
+void RAMPSHub::StopStreamThread()
+{
+  if (streamThread_ == 0)
+    return;
+  {
+    MMThreadGuard guard(queueLock_);
+    stopStreaming_ = true;
+  }
+  streamThread_->wait();
+  delete streamThread_;
+  streamThread_ = 0;
+}
+
+
+/*
+ * Commands that the controller has already received are not recalled; M410
+ * stops the moves that are planned.  The position is read back afterwards.
+ */
+int RAMPSHub::StopMotion()
+{
+  StopStreamThread();
+
+  MMThreadGuard guard(queueLock_);
+  pending_.clear();
+  streaming_ = false;
+  int ret = SetCommandComPortH("M410", "\r");
+  if (ret != DEVICE_OK)
+    return ret;
+  ++inFlight_;
+  positionValid_ = false;
+  idle_ = false;
+  idleCheckSent_ = false;
+  motionEnd_ = GetCurrentMMTime();
   return DEVICE_OK;
 }
 
@@ -473,14 +729,24 @@ Type stringToNum(const std::string& str)
 }
 
 int RAMPSHub::GetXYPosition(double *x, double *y) {
-  GetStatus();
+  if (!positionValid_)
+    GetStatus();
+  MMThreadGuard guard(queueLock_);
   *x = MPos[0];
   *y = MPos[1];
   return DEVICE_OK;
 }
 
+int RAMPSHub::GetZPosition(double *z) {
+  if (!positionValid_)
+    GetStatus();
+  MMThreadGuard guard(queueLock_);
+  *z = MPos[2];
+  return DEVICE_OK;
+}
+
 std::string RAMPSHub::GetState() {
-  GetStatus();
+  Busy();
   return status_;
 }
 
@@ -491,11 +757,9 @@ int RAMPSHub::GetStatus()
   if(!portAvailable_)
     return ERR_NO_PORT_SET;
 
-  if (Busy()) return ERR_STAGE_MOVING;
-
   int ret = DEVICE_OK;
 
-  PurgeComPortH();
+  // M114 reports the position of the last planned move
   ret = SendCommand("M114");
   if (ret != DEVICE_OK)
   {
@@ -515,6 +779,7 @@ int RAMPSHub::GetStatus()
     LogMessage("device error.");
     return DEVICE_ERR;
   }
+  MMThreadGuard guard(queueLock_);
   std::vector<std::string> spl;
   spl = split(an, ' ');
   for (std::vector<std::string>::iterator i = spl.begin(); i != spl.end(); ++i) {
@@ -533,6 +798,7 @@ int RAMPSHub::GetStatus()
       MPos[2] = stringToNum<double>(spl2[1]);
     }
   }
+  positionValid_ = true;
   ret = ReadResponse(an);
   if (ret != DEVICE_OK)
   {
@@ -572,7 +838,17 @@ int RAMPSHub::GetSerialAnswerComPortH (std::string& ans,  const char* term)
   return GetSerialAnswer(port_.c_str(),term,ans);
 }
 
-int RAMPSHub::PurgeComPortH() {return PurgeComPort(port_.c_str());}
+int RAMPSHub::PurgeComPortH()
+{
+  // Acknowledgements of queued commands must not be purged
+  int ret = WaitForQueue(g_QueueTimeoutMs);
+  if (ret != DEVICE_OK)
+    return ret;
+  MMThreadGuard guard(queueLock_);
+  partialLine_.clear();
+  replies_.clear();
+  return PurgeComPort(port_.c_str());
+}
 int RAMPSHub::WriteToComPortH(const unsigned char* command, unsigned len) {return WriteToComPort(port_.c_str(), command, len);}
 
 int RAMPSHub::OnSettleTime(MM::PropertyBase* pProp, MM::ActionType eAct)
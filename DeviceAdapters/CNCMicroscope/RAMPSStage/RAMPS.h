@@ -21,6 +21,7 @@ limitations under the License.
 #include "DeviceThreads.h"
 #include <string>
 #include <map>
+#include <deque>
 #include <algorithm>
 
 //////////////////////////////////////////////////////////////////////////////
@@ -88,14 +89,44 @@ class RAMPSHub : public HubBase<RAMPSHub>
   int GetSerialAnswerComPortH (std::string& ans,  const char* term);
   int GetStatus();
   int GetXYPosition(double *x, double *y);
+  int GetZPosition(double *z);
   std::string GetState();
   int GetControllerVersion(std::string& version);
 
+  // Motion queue
+  // ------------
+  // Moves are not acknowledged with an M400 barrier.  They are queued and
+  // written to the controller as soon as it has acknowledged ("ok") enough
+  // of the earlier commands, so that a bounded number of commands is in
+  // flight at any time.  Positions are tracked from the queued moves (in mm).
+  int QueueCommand(const std::string& command);
+  int MoveXY(double x, double y);
+  int MoveZ(double z);
+  // Keeps writing the queued commands from a thread until all are sent
+  int StartStreaming();
+  // Discards the commands that were not sent yet and stops the axes
+  int StopMotion();
+
  private:
+  class StreamThread : public MMDeviceThreadBase
+  {
+   public:
+    StreamThread(RAMPSHub* hub) : hub_(hub) {}
+    int svc() { return hub_->StreamLoop(); }
+   private:
+    RAMPSHub* hub_;
+  };
+
+  // Reads acknowledgements and writes queued commands; queueLock_ held
+  int Pump();
+  int WaitForQueue(double timeoutMs);
+  int StreamLoop();
+  void StopStreamThread();
+  void NoteMove(double x, double y, double z);
+
   void GetPeripheralInventory();
   std::vector<std::string> peripherals_;
   bool initialized_;
-  bool sent_busy_;
   std::string version_;
   MMThreadLock lock_;
   MMThreadLock executeLock_;
@@ -109,6 +140,21 @@ class RAMPSHub : public HubBase<RAMPSHub>
   long settle_time_;
   double velocity_x_, velocity_y_, velocity_z_;
   double acceleration_x_, acceleration_y_, acceleration_z_;
+
+  MMThreadLock queueLock_;
+  std::deque<std::string> pending_;
+  long inFlight_;
+  std::string partialLine_;
+  // replies are only kept for commands sent with SendCommand
+  bool synchronous_;
+  std::deque<std::string> replies_;
+  bool positionValid_;
+  MM::MMTime motionEnd_;
+  bool idle_;
+  bool idleCheckSent_;
+  bool streaming_;
+  bool stopStreaming_;
+  StreamThread* streamThread_;
 };
 
 
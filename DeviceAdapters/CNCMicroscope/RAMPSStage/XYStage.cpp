@@ -20,8 +20,13 @@ limitations under the License.
 #include "XYStage.h"
 
 #include <boost/lexical_cast.hpp>
+#include <sstream>
 
 const char* g_StepSizeProp = "Step Size";
+const char* g_SequenceTriggerPinProp = "Sequence Trigger Pin";
+// The path is streamed to the controller, so its length is not limited by
+// the controller's memory.
+const long g_MaxSequenceLength = 10000;
 
 ///////////////////////////////////////////////////////////////////////////////
 // RAMPSXYStage implementation
@@ -35,7 +40,8 @@ RAMPSXYStage::RAMPSXYStage() :
     initialized_(false),
     lowerLimit_( - 20000.0),
     upperLimit_(20000.0),
-	status_("")
+	status_(""),
+    sequenceTriggerPin_(-1)
 {
   InitializeDefaultErrorMessages();
 
@@ -89,6 +95,12 @@ int RAMPSXYStage::Initialize()
   CPropertyAction* pAct = new CPropertyAction (this, &RAMPSXYStage::OnStepSize);
   CreateProperty(g_StepSizeProp, CDeviceUtils::ConvertToString(stepSize_um_), MM::Float, false, pAct);
 
+  // Arduino pin the camera trigger output is connected to; -1 disables
+  // sequencing
+  pAct = new CPropertyAction (this, &RAMPSXYStage::OnSequenceTriggerPin);
+  CreateProperty(g_SequenceTriggerPinProp, CDeviceUtils::ConvertToString(sequenceTriggerPin_), MM::Integer, false, pAct);
+  SetPropertyLimits(g_SequenceTriggerPinProp, -1, 69);
+
   // Update lower and upper limits.  These values are cached, so if they change during a session, the adapter will need to be re-initialized
   ret = UpdateStatus();
   if (ret != DEVICE_OK)
@@ -117,34 +129,22 @@ bool RAMPSXYStage::Busy()
 
 double RAMPSXYStage::GetStepSize() {return stepSize_um_;}
 
+/*
+ * The move is queued behind the ones still in progress.
+ */
 int RAMPSXYStage::SetPositionSteps(long x, long y)
 {
   RAMPSHub* pHub = static_cast<RAMPSHub*>(GetParentHub());
-  std::string status = pHub->GetState();
-  if (pHub->Busy()) {
-      return ERR_STAGE_MOVING;
-  }
 
   posX_um_ = x * stepSize_um_;
   posY_um_ = y * stepSize_um_;
 
   // TODO(dek): if no position change, don't send new position.
-  char buff[100];
-  sprintf(buff, "G0 X%f Y%f", posX_um_/1000., posY_um_/1000.);
-  std::string buffAsStdStr = buff;
-  int ret = pHub->SendCommand(buffAsStdStr);
-  if (ret != DEVICE_OK)
-    return ret;
-
-  std::string answer;
-  ret = pHub->ReadResponse(answer, 1000);
+  int ret = pHub->MoveXY(posX_um_/1000., posY_um_/1000.);
   if (ret != DEVICE_OK) {
 	  LogMessage("Error sending XY move.");
 	  return ret;
   }
-  if (!answer.compare("ok")) {
-	  LogMessage("Failed to get ok response to XY move.");
-  }
   ret = OnXYStagePositionChanged(posX_um_, posY_um_);
   if (ret != DEVICE_OK)
     return ret;
@@ -152,10 +152,16 @@ int RAMPSXYStage::SetPositionSteps(long x, long y)
   return DEVICE_OK;
 }
 
+/*
+ * Returns the target of the last queued move.
+ */
 int RAMPSXYStage::GetPositionSteps(long& x, long& y)
 {
   RAMPSHub* pHub = static_cast<RAMPSHub*>(GetParentHub());
-  pHub->GetStatus();
+  double xMm, yMm;
+  pHub->GetXYPosition(&xMm, &yMm);
+  posX_um_ = xMm * 1000.;
+  posY_um_ = yMm * 1000.;
   x = (long)(posX_um_ / stepSize_um_);
   y = (long)(posY_um_ / stepSize_um_);
   return DEVICE_OK;
@@ -183,11 +189,11 @@ int RAMPSXYStage::Home() {
     LogMessage("error getting response to homing command.");
     return ret;
   }
-  if (!answer.compare("ok")) {
+  if (answer.compare(0, 2, "ok") != 0) {
     LogMessage("Homing command: expected ok.");
     return DEVICE_ERR;
   }
-  return DEVICE_OK;
+  return pHub->GetStatus();
 }
 
 int RAMPSXYStage::SetOrigin() {
@@ -211,14 +217,17 @@ int RAMPSXYStage::SetAdapterOriginUm(double x, double y) {
     LogMessage("error getting response to origin command.");
     return ret;
   }
-  if (!answer.compare("ok")) {
+  if (answer.compare(0, 2, "ok") != 0) {
     LogMessage("Origin command: expected ok.");
     return DEVICE_ERR;
   }
-  return DEVICE_OK;
+  return pHub->GetStatus();
 }
 
-int RAMPSXYStage::Stop() { return DEVICE_OK; }
+int RAMPSXYStage::Stop() {
+  RAMPSHub* pHub = static_cast<RAMPSHub*>(GetParentHub());
+  return pHub->StopMotion();
+}
 
 int RAMPSXYStage::GetLimitsUm(double& xMin, double& xMax, double& yMin, double& yMax)
 {
@@ -234,7 +243,121 @@ double RAMPSXYStage::GetStepSizeXUm() { return stepSize_um_; }
 double RAMPSXYStage::GetStepSizeYUm() { return stepSize_um_; }
 int RAMPSXYStage::Move(double /*vx*/, double /*vy*/) {return DEVICE_OK;}
 
-int RAMPSXYStage::IsXYStageSequenceable(bool& isSequenceable) const {isSequenceable = true; return DEVICE_OK;}
+int RAMPSXYStage::IsXYStageSequenceable(bool& isSequenceable) const
+{
+  isSequenceable = sequenceTriggerPin_ >= 0;
+  return DEVICE_OK;
+}
+
+int RAMPSXYStage::GetXYStageSequenceMaxLength(long& nrEvents) const
+{
+  nrEvents = g_MaxSequenceLength;
+  return DEVICE_OK;
+}
+
+int RAMPSXYStage::ClearXYStageSequence()
+{
+  sequenceX_.clear();
+  sequenceY_.clear();
+  return DEVICE_OK;
+}
+
+int RAMPSXYStage::AddToXYStageSequence(double positionX, double positionY)
+{
+  if (sequenceTriggerPin_ < 0)
+    return DEVICE_UNSUPPORTED_COMMAND;
+  if ((long)sequenceX_.size() >= g_MaxSequenceLength)
+    return DEVICE_SEQUENCE_TOO_LARGE;
+
+  sequenceX_.push_back(positionX);
+  sequenceY_.push_back(positionY);
+  return DEVICE_OK;
+}
+
+/*
+ * Converts the sequence to controller coordinates.  Nothing is sent yet:
+ * the path is streamed to the controller once the sequence is started.
+ */
+int RAMPSXYStage::SendXYStageSequence()
+{
+  if (sequenceTriggerPin_ < 0)
+    return DEVICE_UNSUPPORTED_COMMAND;
+
+  // The origin set by Micro-Manager is only known through the current
+  // position in microns and in steps.
+  long xSteps, ySteps;
+  int ret = GetPositionSteps(xSteps, ySteps);
+  if (ret != DEVICE_OK)
+    return ret;
+  double xUm, yUm;
+  ret = GetPositionUm(xUm, yUm);
+  if (ret != DEVICE_OK)
+    return ret;
+
+  bool mirrorX, mirrorY;
+  GetOrientation(mirrorX, mirrorY);
+  long originX = mirrorX ? xSteps + nint(xUm / stepSize_um_) : xSteps - nint(xUm / stepSize_um_);
+  long originY = mirrorY ? ySteps + nint(yUm / stepSize_um_) : ySteps - nint(yUm / stepSize_um_);
+
+  pathX_.clear();
+  pathY_.clear();
+  for (size_t i = 0; i < sequenceX_.size(); ++i)
+  {
+    long x = mirrorX ? originX - nint(sequenceX_[i] / stepSize_um_) : originX + nint(sequenceX_[i] / stepSize_um_);
+    long y = mirrorY ? originY - nint(sequenceY_[i] / stepSize_um_) : originY + nint(sequenceY_[i] / stepSize_um_);
+    pathX_.push_back(x * stepSize_um_ / 1000.);
+    pathY_.push_back(y * stepSize_um_ / 1000.);
+  }
+  return DEVICE_OK;
+}
+
+/*
+ * Moves to the first position at once.  Every following position is
+ * approached once the trigger input has gone high and low again, i.e. at
+ * the end of the exposure.  M226 makes the controller wait for the pin;
+ * the hub keeps the controller's queue filled while the path is streamed.
+ */
+int RAMPSXYStage::StartXYStageSequence()
+{
+  if (sequenceTriggerPin_ < 0)
+    return DEVICE_UNSUPPORTED_COMMAND;
+  if (pathX_.empty())
+    return DEVICE_OK;
+
+  RAMPSHub* pHub = static_cast<RAMPSHub*>(GetParentHub());
+  std::ostringstream waitHigh, waitLow;
+  waitHigh << "M226 P" << sequenceTriggerPin_ << " S1";
+  waitLow << "M226 P" << sequenceTriggerPin_ << " S0";
+
+  int ret = pHub->MoveXY(pathX_[0], pathY_[0]);
+  for (size_t i = 1; i < pathX_.size() && ret == DEVICE_OK; ++i)
+  {
+    ret = pHub->QueueCommand(waitHigh.str());
+    if (ret == DEVICE_OK)
+      ret = pHub->QueueCommand(waitLow.str());
+    if (ret == DEVICE_OK)
+      ret = pHub->MoveXY(pathX_[i], pathY_[i]);
+  }
+  if (ret != DEVICE_OK)
+  {
+    pHub->StopMotion();
+    return ret;
+  }
+  return pHub->StartStreaming();
+}
+
+/*
+ * Up to four commands have already been received by the controller; they
+ * run on the next triggers.
+ */
+int RAMPSXYStage::StopXYStageSequence()
+{
+  if (sequenceTriggerPin_ < 0)
+    return DEVICE_UNSUPPORTED_COMMAND;
+
+  RAMPSHub* pHub = static_cast<RAMPSHub*>(GetParentHub());
+  return pHub->StopMotion();
+}
 
 
 
@@ -260,6 +383,31 @@ int RAMPSXYStage::OnStepSize(MM::PropertyBase* pProp, MM::ActionType eAct)
 }
 
 
+void RAMPSXYStage::GetOrientation(bool& mirrorX, bool& mirrorY)
+{
+  // copied from DeviceBase.h
+  char val[MM::MaxStrLength];
+  GetProperty(MM::g_Keyword_Transpose_MirrorX, val);
+  mirrorX = strcmp(val, "1") == 0;
+  GetProperty(MM::g_Keyword_Transpose_MirrorY, val);
+  mirrorY = strcmp(val, "1") == 0;
+}
+
+int RAMPSXYStage::OnSequenceTriggerPin(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+  if (eAct == MM::BeforeGet)
+  {
+    pProp->Set(sequenceTriggerPin_);
+  }
+  else if (eAct == MM::AfterSet)
+  {
+    pProp->Get(sequenceTriggerPin_);
+  }
+
+  return DEVICE_OK;
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // Action handlers
 ///////////////////////////////////////////////////////////////////////////////
@@ -19,6 +19,7 @@ limitations under the License.
 
 #include "DeviceBase.h"
 #include "DeviceThreads.h"
+#include <vector>
 
 class RAMPSXYStage : public CXYStageBase<RAMPSXYStage>
 {
@@ -65,6 +66,12 @@ class RAMPSXYStage : public CXYStageBase<RAMPSXYStage>
   int Move(double /*vx*/, double /*vy*/);
 
   int IsXYStageSequenceable(bool& isSequenceable) const;
+  int GetXYStageSequenceMaxLength(long& nrEvents) const;
+  int StartXYStageSequence();
+  int StopXYStageSequence();
+  int ClearXYStageSequence();
+  int AddToXYStageSequence(double positionX, double positionY);
+  int SendXYStageSequence();
 
 
   // action interface
@@ -72,8 +79,11 @@ class RAMPSXYStage : public CXYStageBase<RAMPSXYStage>
   int OnPosition(MM::PropertyBase* pProp, MM::ActionType eAct);
 
   int OnStepSize(MM::PropertyBase* pProp, MM::ActionType eAct);
+  int OnSequenceTriggerPin(MM::PropertyBase* pProp, MM::ActionType eAct);
 
  private:
+  void GetOrientation(bool& mirrorX, bool& mirrorY);
+
   double stepSize_um_;
   double posX_um_;
   double posY_um_;
@@ -82,6 +92,12 @@ class RAMPSXYStage : public CXYStageBase<RAMPSXYStage>
   double upperLimit_;
   bool is_moving_;
   std::string status_;
+  long sequenceTriggerPin_;
+  std::vector<double> sequenceX_;
+  std::vector<double> sequenceY_;
+  // the sequence in controller coordinates [mm]
+  std::vector<double> pathX_;
+  std::vector<double> pathY_;
 };
 
 #endif // _RAMPS_XYSTAGE_H_
@@ -128,29 +128,15 @@ double RAMPSZStage::GetStepSize() const {
 int RAMPSZStage::SetPositionSteps(long steps)
 {
   RAMPSHub* pHub = static_cast<RAMPSHub*>(GetParentHub());
-  if (pHub->Busy()) {
-      return ERR_STAGE_MOVING;
-  }
 
   posZ_um_ = steps * stepSize_um_;
 
-  char buff[100];
-  sprintf(buff, "G0 Z%f", posZ_um_/1000.);
-  std::string buffAsStdStr = buff;
-  int ret = pHub->SendCommand(buffAsStdStr);
-  if (ret != DEVICE_OK)
-    return ret;
-
-  
-  std::string answer;
-  ret = pHub->ReadResponse(answer, 1000);
+  // queued behind the moves still in progress
+  int ret = pHub->MoveZ(posZ_um_/1000.);
   if (ret != DEVICE_OK) {
 	  LogMessage("Error sending Z move.");
 	  return ret;
   }
-  if (!answer.compare("ok")) {
-	  LogMessage("Failed to get ok response to Z move.");
-  }
   ret = OnStagePositionChanged(posZ_um_);
   if (ret != DEVICE_OK)
     return ret;
@@ -159,15 +145,16 @@ int RAMPSZStage::SetPositionSteps(long steps)
 }
 
 /*
- * Requests current z postion from the controller.  This function does the actual communication
+ * Returns the z position of the last queued move
  */
 int RAMPSZStage::GetPositionSteps(long& steps)
 {
   RAMPSHub* pHub = static_cast<RAMPSHub*>(GetParentHub());
-  pHub->GetStatus();
+  double zMm;
+  pHub->GetZPosition(&zMm);
+  posZ_um_ = zMm * 1000.;
   steps = (long)(posZ_um_ / stepSize_um_);
 
-  // TODO(dek): implement status to get Z position
   return DEVICE_OK;
 }
 
@@ -185,11 +172,11 @@ int RAMPSZStage::Home() {
     LogMessage("error getting response to homing command.");
     return ret;
   }
-  if (!answer.compare("ok")) {
+  if (answer.compare(0, 2, "ok") != 0) {
     LogMessage("Homing command: expected ok.");
     return DEVICE_ERR;
   }
-  return DEVICE_OK;
+  return pHub->GetStatus();
 }
 
 int RAMPSZStage::SetOrigin() {
@@ -212,11 +199,11 @@ int RAMPSZStage::SetAdapterOriginUm(double z) {
     LogMessage("error getting response to origin command.");
     return ret;
   }
-  if (!answer.compare("ok")) {
+  if (answer.compare(0, 2, "ok") != 0) {
     LogMessage("origin command: expected ok.");
     return DEVICE_ERR;
   }
-  return DEVICE_OK;
+  return pHub->GetStatus();
 }
 
 int RAMPSZStage::GetLimits(double& lower, double& upper)
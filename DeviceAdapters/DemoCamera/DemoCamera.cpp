@@ -66,8 +66,9 @@ const char* g_PixelType_32bit = "32bit";  // floating point greyscale
 const char* g_Sine_Wave = "Artificial Waves";
 const char* g_Norm_Noise = "Noise";
 const char* g_Color_Test = "Color Test Pattern";
+const char* g_Fast_Noise = "Fast Noise";
 
-enum { MODE_ARTIFICIAL_WAVES, MODE_NOISE, MODE_COLOR_TEST };
+enum { MODE_ARTIFICIAL_WAVES, MODE_NOISE, MODE_COLOR_TEST, MODE_FAST_NOISE };
 
 ///////////////////////////////////////////////////////////////////////////////
 // Exported MMDevice API
@@ -246,7 +247,10 @@ CDemoCamera::CDemoCamera() :
    imgManpl_(0),
    pcf_(1.0),
    photonFlux_(50.0),
-   readNoise_(2.5)
+   readNoise_(2.5),
+   noiseFrameNr_(0),
+   generatorThreads_(1),
+   framePoolSize_(0)
 {
    memset(testProperty_,0,sizeof(testProperty_));
 
@@ -500,6 +504,7 @@ int CDemoCamera::Initialize()
    AddAllowedValue(propName.c_str(), g_Sine_Wave);
    AddAllowedValue(propName.c_str(), g_Norm_Noise);
    AddAllowedValue(propName.c_str(), g_Color_Test);
+   AddAllowedValue(propName.c_str(), g_Fast_Noise);
 
    // Photon Conversion Factor for Noise type camera
    pAct = new CPropertyAction(this, &CDemoCamera::OnPCF);
@@ -519,6 +524,17 @@ int CDemoCamera::Initialize()
    CreateFloatProperty(propName.c_str(), photonFlux_, false, pAct);
    SetPropertyLimits(propName.c_str(), 2.0, 5000.0);
 
+   // Number of threads generating "Fast Noise" images
+   pAct = new CPropertyAction(this, &CDemoCamera::OnGeneratorThreads);
+   CreateIntegerProperty("GeneratorThreads", generatorThreads_, false, pAct);
+   SetPropertyLimits("GeneratorThreads", 1, 16);
+
+   // Number of images generated ahead of a sequence acquisition and then
+   // sent repeatedly (0 generates every image)
+   pAct = new CPropertyAction(this, &CDemoCamera::OnFramePoolSize);
+   CreateIntegerProperty("FramePoolSize", framePoolSize_, false, pAct);
+   SetPropertyLimits("FramePoolSize", 0, 256);
+
    // Simulate application crash
    pAct = new CPropertyAction(this, &CDemoCamera::OnCrash);
    CreateStringProperty("SimulateCrash", "", false, pAct);
@@ -1066,6 +1082,7 @@ int CDemoCamera::StartSequenceAcquisition(long numImages, double interval_ms, bo
       return ret;
    sequenceStartTime_ = GetCurrentMMTime();
    imageCounter_ = 0;
+   BuildFramePool();
    thd_->Start(numImages,interval_ms);
    stopOnOverflow_ = stopOnOverflow;
    return DEVICE_OK;
@@ -1097,7 +1114,21 @@ int CDemoCamera::InsertImage()
    MMThreadGuard g(imgPixelsLock_);
 
    const unsigned char* pI;
-   pI = GetImageBuffer();
+   if (framePool_.empty())
+   {
+      pI = GetImageBuffer();
+   }
+   else
+   {
+      // Pooled images are identical every framePool_.size() images; stamp
+      // the image number into the first 4 bytes so that each is unique
+      std::vector<unsigned char>& frame =
+         framePool_[(imageCounter_ - 1) % framePool_.size()];
+      uint32_t stamp = static_cast<uint32_t>(imageCounter_);
+      for (unsigned i = 0; i < 4 && i < frame.size(); ++i)
+         frame[i] = static_cast<unsigned char>(stamp >> (8 * i));
+      pI = &frame[0];
+   }
 
    unsigned int w = GetImageWidth();
    unsigned int h = GetImageHeight();
@@ -1136,7 +1167,7 @@ int CDemoCamera::RunSequenceOnThread(MM::MMTime startTime)
 
    double exposure = GetSequenceExposure();
 
-   if (!fastImage_)
+   if (!fastImage_ && framePool_.empty())
    {
       GenerateSyntheticImage(img_, exposure);
    }
@@ -1169,6 +1200,10 @@ void CDemoCamera::OnThreadExiting() throw()
    try
    {
       LogMessage(g_Msg_SEQUENCE_ACQUISITION_THREAD_EXITING);
+      {
+         MMThreadGuard g(imgPixelsLock_);
+         std::vector<std::vector<unsigned char> >().swap(framePool_);
+      }
       GetCoreCallback()?GetCoreCallback()->AcqFinished(this,0):DEVICE_OK;
    }
    catch(...)
@@ -1404,34 +1439,7 @@ int CDemoCamera::OnPixelType(MM::PropertyBase* pProp, MM::ActionType eAct)
       break;
    case MM::BeforeGet:
       {
-         long bytesPerPixel = GetImageBytesPerPixel();
-         if (bytesPerPixel == 1)
-         {
-         	pProp->Set(g_PixelType_8bit);
-         }
-         else if (bytesPerPixel == 2)
-         {
-         	pProp->Set(g_PixelType_16bit);
-         }
-         else if (bytesPerPixel == 4)
-         {
-            if (nComponents_ == 4)
-            {
-			   pProp->Set(g_PixelType_32bitRGB);
-            }
-            else if (nComponents_ == 1)
-            {
-               pProp->Set(::g_PixelType_32bit);
-            }
-         }
-         else if (bytesPerPixel == 8)
-         {
-            pProp->Set(g_PixelType_64bitRGB);
-         }
-		 else
-         {
-            pProp->Set(g_PixelType_8bit);
-         }
+         pProp->Set(GetPixelTypeName());
          ret = DEVICE_OK;
       } break;
    default:
@@ -1440,6 +1448,25 @@ int CDemoCamera::OnPixelType(MM::PropertyBase* pProp, MM::ActionType eAct)
    return ret; 
 }
 
+/**
+* Returns the current pixel type, without going through the property (which
+* is too slow to do for every image).
+*/
+const char* CDemoCamera::GetPixelTypeName() const
+{
+   switch (img_.Depth())
+   {
+      case 2:
+         return g_PixelType_16bit;
+      case 4:
+         return nComponents_ == 4 ? g_PixelType_32bitRGB : g_PixelType_32bit;
+      case 8:
+         return g_PixelType_64bitRGB;
+      default:
+         return g_PixelType_8bit;
+   }
+}
+
 /**
 * Handles "BitDepth" property.
 */
@@ -1603,6 +1630,34 @@ int CDemoCamera::OnFastImage(MM::PropertyBase* pProp, MM::ActionType eAct)
    return DEVICE_OK;
 }
 
+int CDemoCamera::OnGeneratorThreads(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::AfterSet)
+   {
+      pProp->Get(generatorThreads_);
+   }
+   else if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(generatorThreads_);
+   }
+   return DEVICE_OK;
+}
+
+int CDemoCamera::OnFramePoolSize(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::AfterSet)
+   {
+      if (IsCapturing())
+         return DEVICE_CAMERA_BUSY_ACQUIRING;
+      pProp->Get(framePoolSize_);
+   }
+   else if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(framePoolSize_);
+   }
+   return DEVICE_OK;
+}
+
 int CDemoCamera::OnSaturatePixels(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
    if (eAct == MM::AfterSet)
@@ -1849,6 +1904,9 @@ int CDemoCamera::OnMode(MM::PropertyBase* pProp, MM::ActionType eAct)
          case MODE_COLOR_TEST:
             val = g_Color_Test;
             break;
+         case MODE_FAST_NOISE:
+            val = g_Fast_Noise;
+            break;
          default:
             val = g_Sine_Wave;
             break;
@@ -1866,6 +1924,10 @@ int CDemoCamera::OnMode(MM::PropertyBase* pProp, MM::ActionType eAct)
       {
          mode_ = MODE_COLOR_TEST;
       }
+      else if (val == g_Fast_Noise)
+      {
+         mode_ = MODE_FAST_NOISE;
+      }
       else
       {
          mode_ = MODE_ARTIFICIAL_WAVES;
@@ -2034,11 +2096,19 @@ void CDemoCamera::GenerateSyntheticImage(ImgBuffer& img, double exp)
       if (GenerateColorTestPattern(img))
          return;
    }
+   else if (mode_ == MODE_FAST_NOISE)
+   {
+      if (GenerateFastNoise(img, exp))
+      {
+         if (imgManpl_ != 0)
+         {
+            imgManpl_->ChangePixels(img);
+         }
+         return;
+      }
+   }
 
-	//std::string pixelType;
-	char buf[MM::MaxStrLength];
-   GetProperty(MM::g_Keyword_PixelType, buf);
-   std::string pixelType(buf);
+   const std::string pixelType(GetPixelTypeName());
 
 	if (img.Height() == 0 || img.Width() == 0 || img.Depth() == 0)
       return;
@@ -2065,7 +2135,16 @@ void CDemoCamera::GenerateSyntheticImage(ImgBuffer& img, double exp)
    static unsigned long dbgBufferSize = 0;
    static long iseq = 1;
 
- 
+   // Expand sin(rowPhase + columnPhase) as
+   // sin(rowPhase) cos(columnPhase) + cos(rowPhase) sin(columnPhase), so that
+   // sin() and cos() are only evaluated per row and per column, not per pixel
+   std::vector<double> colSin(imgWidth), colCos(imgWidth);
+   for (unsigned col = 0; col < imgWidth; ++col)
+   {
+      double colPhase = (2.0 * lSinePeriod * col) / lPeriod;
+      colSin[col] = sin(colPhase);
+      colCos[col] = cos(colPhase);
+   }
 
 	// for integer images: bitDepth_ is 8, 10, 12, 16 i.e. it is depth per component
    long maxValue = (1L << bitDepth_)-1;
@@ -2084,10 +2163,12 @@ void CDemoCamera::GenerateSyntheticImage(ImgBuffer& img, double exp)
       unsigned char* pBuf = const_cast<unsigned char*>(img.GetPixels());
       for (j=0; j<img.Height(); j++)
       {
+         const double rowSin = sin(dPhase_ + dLinePhase);
+         const double rowCos = cos(dPhase_ + dLinePhase);
          for (k=0; k<imgWidth; k++)
          {
             long lIndex = imgWidth*j + k;
-            unsigned char val = (unsigned char) (g_IntensityFactor_ * min(255.0, (pedestal + dAmp * sin(dPhase_ + dLinePhase + (2.0 * lSinePeriod * k) / lPeriod))));
+            unsigned char val = (unsigned char) (g_IntensityFactor_ * min(255.0, (pedestal + dAmp * (rowSin * colCos[k] + rowCos * colSin[k]))));
             if (val > maxDrawnVal) {
                 maxDrawnVal = val;
             }
@@ -2117,10 +2198,12 @@ void CDemoCamera::GenerateSyntheticImage(ImgBuffer& img, double exp)
       unsigned short* pBuf = (unsigned short*) const_cast<unsigned char*>(img.GetPixels());
       for (j=0; j<img.Height(); j++)
       {
+         const double rowSin = sin(dPhase_ + dLinePhase);
+         const double rowCos = cos(dPhase_ + dLinePhase);
          for (k=0; k<imgWidth; k++)
          {
             long lIndex = imgWidth*j + k;
-            unsigned short val = (unsigned short) (g_IntensityFactor_ * min((double)maxValue, pedestal + dAmp16 * sin(dPhase_ + dLinePhase + (2.0 * lSinePeriod * k) / lPeriod)));
+            unsigned short val = (unsigned short) (g_IntensityFactor_ * min((double)maxValue, pedestal + dAmp16 * (rowSin * colCos[k] + rowCos * colSin[k])));
             if (val > maxDrawnVal) {
                 maxDrawnVal = val;
             }
@@ -2152,10 +2235,12 @@ void CDemoCamera::GenerateSyntheticImage(ImgBuffer& img, double exp)
       // static unsigned int j2;
       for (j=0; j<img.Height(); j++)
       {
+         const double rowSin = sin(dPhase_ + dLinePhase);
+         const double rowCos = cos(dPhase_ + dLinePhase);
          for (k=0; k<imgWidth; k++)
          {
             long lIndex = imgWidth*j + k;
-            double value =  (g_IntensityFactor_ * min(255.0, (pedestal + dAmp * sin(dPhase_ + dLinePhase + (2.0 * lSinePeriod * k) / lPeriod))));
+            double value =  (g_IntensityFactor_ * min(255.0, (pedestal + dAmp * (rowSin * colCos[k] + rowCos * colSin[k]))));
             if (value > maxDrawnVal) {
                 maxDrawnVal = value;
             }
@@ -2219,19 +2304,25 @@ void CDemoCamera::GenerateSyntheticImage(ImgBuffer& img, double exp)
 
       for (j=0; j<img.Height(); j++)
       {
+         const double rowSin = sin(dPhase_ + dLinePhase);
+         const double rowCos = cos(dPhase_ + dLinePhase);
+         const double rowSin2 = sin(dPhase_ + dLinePhase*2);
+         const double rowCos2 = cos(dPhase_ + dLinePhase*2);
+         const double rowSin4 = sin(dPhase_ + dLinePhase*4);
+         const double rowCos4 = cos(dPhase_ + dLinePhase*4);
          unsigned char theBytes[4];
          for (k=0; k<imgWidth; k++)
          {
             long lIndex = imgWidth*j + k;
-            unsigned char value0 =   (unsigned char) min(255.0, (pedestal + dAmp * sin(dPhase_ + dLinePhase + (2.0 * lSinePeriod * k) / lPeriod)));
+            unsigned char value0 =   (unsigned char) min(255.0, (pedestal + dAmp * (rowSin * colCos[k] + rowCos * colSin[k])));
             theBytes[3] = value0;
             if( NULL != pTmpBuffer)
                pTmp2[1] = value0;
-            unsigned char value1 =   (unsigned char) min(255.0, (pedestal + dAmp * sin(dPhase_ + dLinePhase*2 + (2.0 * lSinePeriod * k) / lPeriod)));
+            unsigned char value1 =   (unsigned char) min(255.0, (pedestal + dAmp * (rowSin2 * colCos[k] + rowCos2 * colSin[k])));
             theBytes[2] = value1;
             if( NULL != pTmpBuffer)
                pTmp2[2] = value1;
-            unsigned char value2 = (unsigned char) min(255.0, (pedestal + dAmp * sin(dPhase_ + dLinePhase*4 + (2.0 * lSinePeriod * k) / lPeriod)));
+            unsigned char value2 = (unsigned char) min(255.0, (pedestal + dAmp * (rowSin4 * colCos[k] + rowCos4 * colSin[k])));
             theBytes[1] = value2;
 
             if( NULL != pTmpBuffer){
@@ -2270,12 +2361,18 @@ void CDemoCamera::GenerateSyntheticImage(ImgBuffer& img, double exp)
       unsigned long long * pBuf = (unsigned long long*) rawBuf;
       for (j=0; j<img.Height(); j++)
       {
+         const double rowSin = sin(dPhase_ + dLinePhase);
+         const double rowCos = cos(dPhase_ + dLinePhase);
+         const double rowSin2 = sin(dPhase_ + dLinePhase*2);
+         const double rowCos2 = cos(dPhase_ + dLinePhase*2);
+         const double rowSin4 = sin(dPhase_ + dLinePhase*4);
+         const double rowCos4 = cos(dPhase_ + dLinePhase*4);
          for (k=0; k<imgWidth; k++)
          {
             long lIndex = imgWidth*j + k;
-            unsigned long long value0 = (unsigned short) min(maxPixelValue, (pedestal + dAmp16 * sin(dPhase_ + dLinePhase + (2.0 * lSinePeriod * k) / lPeriod)));
-            unsigned long long value1 = (unsigned short) min(maxPixelValue, (pedestal + dAmp16 * sin(dPhase_ + dLinePhase*2 + (2.0 * lSinePeriod * k) / lPeriod)));
-            unsigned long long value2 = (unsigned short) min(maxPixelValue, (pedestal + dAmp16 * sin(dPhase_ + dLinePhase*4 + (2.0 * lSinePeriod * k) / lPeriod)));
+            unsigned long long value0 = (unsigned short) min(maxPixelValue, (pedestal + dAmp16 * (rowSin * colCos[k] + rowCos * colSin[k])));
+            unsigned long long value1 = (unsigned short) min(maxPixelValue, (pedestal + dAmp16 * (rowSin2 * colCos[k] + rowCos2 * colSin[k])));
+            unsigned long long value2 = (unsigned short) min(maxPixelValue, (pedestal + dAmp16 * (rowSin4 * colCos[k] + rowCos4 * colSin[k])));
             unsigned long long tval = value0+(value1<<16)+(value2<<32);
             if (tval > maxDrawnVal) {
                 maxDrawnVal = static_cast<double>(tval);
@@ -2478,6 +2575,46 @@ bool CDemoCamera::GenerateColorTestPattern(ImgBuffer& img)
 }
 
 
+/**
+* Generates offset plus read and shot noise, like MODE_NOISE, but fast enough
+* to produce images at the data rates of fast sCMOS cameras. Only 8- and
+* 16-bit images are supported; returns false for other pixel types.
+* Must be called with imgPixelsLock_ held.
+*/
+bool CDemoCamera::GenerateFastNoise(ImgBuffer& img, double exp)
+{
+   if (!noiseGenerator_.IsSupportedDepth(img.Depth()))
+      return false;
+
+   double offset = GetBitDepth() > 8 ? 100.0 : 10.0;
+   noiseGenerator_.Configure(img.Width(), img.Height(), img.Depth(),
+         GetBitDepth(), offset, readNoise_ / pcf_, photonFlux_ * exp, pcf_);
+   noiseGenerator_.Fill(img.GetPixelsRW(), noiseFrameNr_++,
+         static_cast<unsigned>(generatorThreads_));
+   return true;
+}
+
+/**
+* Generates framePoolSize_ images for the upcoming sequence acquisition,
+* which then cycles through them instead of generating each image.
+*/
+void CDemoCamera::BuildFramePool()
+{
+   std::vector<std::vector<unsigned char> >().swap(framePool_);
+   if (framePoolSize_ <= 0)
+      return;
+
+   double exposure = GetSequenceExposure();
+   framePool_.resize(framePoolSize_);
+   for (long i = 0; i < framePoolSize_; ++i)
+   {
+      GenerateSyntheticImage(img_, exposure);
+      MMThreadGuard g(imgPixelsLock_);
+      framePool_[i].assign(img_.GetPixels(),
+            img_.GetPixels() + GetImageBufferSize());
+   }
+}
+
 void CDemoCamera::TestResourceLocking(const bool recurse)
 {
    if(recurse)
@@ -2489,9 +2626,7 @@ void CDemoCamera::TestResourceLocking(const bool recurse)
 */
 void CDemoCamera::AddBackgroundAndNoise(ImgBuffer& img, double mean, double stdDev)
 { 
-	char buf[MM::MaxStrLength];
-   GetProperty(MM::g_Keyword_PixelType, buf);
-	std::string pixelType(buf);
+   const std::string pixelType(GetPixelTypeName());
 
    int maxValue = 1 << GetBitDepth();
    long nrPixels = img.Width() * img.Height();
@@ -2541,9 +2676,7 @@ void CDemoCamera::AddBackgroundAndNoise(ImgBuffer& img, double mean, double stdD
 */
 void CDemoCamera::AddSignal(ImgBuffer& img, double photonFlux, double exp, double cf)
 { 
-	char buf[MM::MaxStrLength];
-   GetProperty(MM::g_Keyword_PixelType, buf);
-	std::string pixelType(buf);
+   const std::string pixelType(GetPixelTypeName());
 
    int maxValue = (1 << GetBitDepth()) -1;
    long nrPixels = img.Width() * img.Height();
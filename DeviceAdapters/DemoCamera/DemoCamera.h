@@ -33,6 +33,7 @@
 #include "../../MMDevice/DeviceBase.h"
 #include "../../MMDevice/ImgBuffer.h"
 #include "../../MMDevice/DeviceThreads.h"
+#include "NoiseGenerator.h"
 #include <string>
 #include <map>
 #include <algorithm>
@@ -199,6 +200,8 @@ public:
    int OnPCF(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnPhotonFlux(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnReadNoise(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnGeneratorThreads(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnFramePoolSize(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnCrash(MM::PropertyBase* pProp, MM::ActionType eAct);
 
    // Special public DemoCamera methods
@@ -218,6 +221,9 @@ private:
    void GenerateEmptyImage(ImgBuffer& img);
    void GenerateSyntheticImage(ImgBuffer& img, double exp);
    bool GenerateColorTestPattern(ImgBuffer& img);
+   bool GenerateFastNoise(ImgBuffer& img, double exp);
+   void BuildFramePool();
+   const char* GetPixelTypeName() const;
    int ResizeImageBuffer();
 
    static const double nominalPixelSizeUm_;
@@ -274,6 +280,11 @@ private:
    double pcf_;
    double photonFlux_;
    double readNoise_;
+   NoiseGenerator noiseGenerator_;
+   uint32_t noiseFrameNr_;
+   long generatorThreads_;
+   long framePoolSize_;
+   std::vector<std::vector<unsigned char> > framePool_;
 };
 
 class MySequenceThread : public MMDeviceThreadBase
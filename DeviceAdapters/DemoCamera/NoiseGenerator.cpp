@@ -0,0 +1,328 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          NoiseGenerator.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Fast synthetic noise images for the demo camera, intended
+//                for load testing the acquisition pipeline at high data
+//                rates.
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "NoiseGenerator.h"
+
+#include <boost/bind.hpp>
+
+#include <math.h>
+#include <string.h>
+
+
+namespace {
+
+// Above this mean photon count, shot noise uses the Gaussian approximation
+const double g_MaxTabulatedPoissonMean = 12.0;
+
+// The Poisson lookup starts from a guess indexed by the top bits of the
+// uniform value, so that the search rarely takes more than one step
+const unsigned g_PoissonGuideBits = 10;
+
+// The sum of the four bytes of a uniform 32-bit value has mean 4 * 127.5
+// and standard deviation sqrt(4 * (256^2 - 1) / 12)
+const float g_ByteSumMean = 510.0f;
+const float g_ByteSumStdDev = 147.80054f;
+
+// 32-bit integer finalizer with good avalanche behavior. Uses only
+// operations that compilers vectorize.
+inline uint32_t Mix(uint32_t x)
+{
+   x ^= x >> 16;
+   x *= 0x7feb352dU;
+   x ^= x >> 15;
+   x *= 0x846ca68bU;
+   x ^= x >> 16;
+   return x;
+}
+
+// Approximately standard normal deviate from a uniform 32-bit value
+inline float ByteSumDeviate(uint32_t h)
+{
+   uint32_t sum = (h & 0xff) + ((h >> 8) & 0xff) +
+      ((h >> 16) & 0xff) + (h >> 24);
+   return (static_cast<float>(sum) - g_ByteSumMean) * (1.0f / g_ByteSumStdDev);
+}
+
+inline float Clamp(float v, float maxValue)
+{
+   v = v < 0.0f ? 0.0f : v;
+   return v > maxValue ? maxValue : v;
+}
+
+} // anonymous namespace
+
+
+NoiseGenerator::NoiseGenerator() :
+   width_(0),
+   height_(0),
+   bytesPerPixel_(1),
+   maxValue_(255.0f),
+   offsetDN_(0.0f),
+   readNoiseDN_(0.0f),
+   photonsPerPixel_(-1.0),
+   photonConversionFactor_(1.0f),
+   bandPixels_(0),
+   bandFrameNr_(0),
+   rowsPerBand_(0),
+   bandGeneration_(0),
+   bandsPending_(0),
+   quitBandThreads_(false)
+{
+}
+
+
+NoiseGenerator::~NoiseGenerator()
+{
+   StopBandThreads();
+}
+
+
+void NoiseGenerator::Configure(unsigned width, unsigned height,
+      unsigned bytesPerPixel, unsigned bitDepth, double offsetDN,
+      double readNoiseDN, double photonsPerPixel,
+      double photonConversionFactor)
+{
+   width_ = width;
+   height_ = height;
+   bytesPerPixel_ = bytesPerPixel;
+   if (bitDepth > 8 * bytesPerPixel)
+      bitDepth = 8 * bytesPerPixel;
+   maxValue_ = static_cast<float>((1UL << bitDepth) - 1);
+   offsetDN_ = static_cast<float>(offsetDN);
+   readNoiseDN_ = static_cast<float>(readNoiseDN);
+   photonConversionFactor_ = photonConversionFactor > 0.0 ?
+      static_cast<float>(photonConversionFactor) : 1.0f;
+
+   if (photonsPerPixel < 0.0)
+      photonsPerPixel = 0.0;
+   if (photonsPerPixel != photonsPerPixel_)
+   {
+      photonsPerPixel_ = photonsPerPixel;
+      BuildPoissonTable();
+   }
+}
+
+
+void NoiseGenerator::BuildPoissonTable()
+{
+   poissonCDF_.clear();
+   poissonGuide_.clear();
+   if (photonsPerPixel_ > g_MaxTabulatedPoissonMean)
+      return;
+
+   const double lambda = photonsPerPixel_;
+   const double scale = 4294967296.0;
+   double p = exp(-lambda);
+   double cdf = 0.0;
+   for (unsigned k = 0; ; ++k)
+   {
+      cdf += p;
+      if (cdf * scale >= 4294967295.0 || k > lambda + 20.0 * sqrt(lambda) + 20.0)
+      {
+         poissonCDF_.push_back(0xffffffffU);
+         break;
+      }
+      poissonCDF_.push_back(static_cast<uint32_t>(cdf * scale));
+      p *= lambda / (k + 1);
+   }
+
+   const unsigned guideSize = 1U << g_PoissonGuideBits;
+   poissonGuide_.resize(guideSize);
+   unsigned k = 0;
+   for (unsigned b = 0; b < guideSize; ++b)
+   {
+      uint32_t bucketStart = b << (32 - g_PoissonGuideBits);
+      while (poissonCDF_[k] <= bucketStart)
+         ++k;
+      poissonGuide_[b] = k;
+   }
+}
+
+
+template <typename PixelType>
+void NoiseGenerator::FillRowsImpl(PixelType* pixels, uint32_t frameNr,
+      unsigned rowBegin, unsigned rowEnd) const
+{
+   const uint32_t readKey = Mix(frameNr * 0x9e3779b9U + 0x632be5abU);
+   const uint32_t shotKey = Mix(readKey ^ 0x85ebca6bU);
+   const float readScale = readNoiseDN_;
+   const float invPcf = 1.0f / photonConversionFactor_;
+   const float shotMean = static_cast<float>(photonsPerPixel_) * invPcf;
+   const float shotScale = static_cast<float>(sqrt(photonsPerPixel_)) * invPcf;
+   const float offset = offsetDN_ + 0.5f; // Round when truncating
+   const float maxValue = maxValue_;
+   const unsigned width = width_;
+
+   const bool tabulated = !poissonCDF_.empty();
+   const uint32_t* cdf = tabulated ? &poissonCDF_[0] : 0;
+   const unsigned* guide = tabulated ? &poissonGuide_[0] : 0;
+   const unsigned last = static_cast<unsigned>(poissonCDF_.size()) - 1;
+
+   // Work in blocks of fixed length so that the compiler vectorizes the
+   // inner loops even at -O2. The last block of a row may compute a few
+   // pixels that are not stored.
+   const unsigned blockLen = 16;
+   float values[blockLen];
+   uint32_t shotHashes[blockLen];
+   PixelType block[blockLen];
+   for (unsigned y = rowBegin; y < rowEnd; ++y)
+   {
+      PixelType* row = pixels + static_cast<size_t>(y) * width;
+      for (unsigned x = 0; x < width; x += blockLen)
+      {
+         const uint32_t blockBase = y * width + x;
+         for (unsigned i = 0; i < blockLen; ++i)
+         {
+            const uint32_t c = blockBase + i;
+            values[i] = offset + readScale * ByteSumDeviate(Mix(c ^ readKey));
+            shotHashes[i] = Mix(c ^ shotKey);
+         }
+
+         if (tabulated)
+         {
+            for (unsigned i = 0; i < blockLen; ++i)
+            {
+               const uint32_t u = shotHashes[i];
+               unsigned k = guide[u >> (32 - g_PoissonGuideBits)];
+               while (k < last && u >= cdf[k])
+                  ++k;
+               values[i] += static_cast<float>(k) * invPcf;
+            }
+         }
+         else
+         {
+            for (unsigned i = 0; i < blockLen; ++i)
+               values[i] += shotMean + shotScale * ByteSumDeviate(shotHashes[i]);
+         }
+
+         for (unsigned i = 0; i < blockLen; ++i)
+            block[i] = static_cast<PixelType>(Clamp(values[i], maxValue));
+         const unsigned n = width - x < blockLen ? width - x : blockLen;
+         memcpy(row + x, block, n * sizeof(PixelType));
+      }
+   }
+}
+
+
+void NoiseGenerator::FillRows(unsigned char* pixels, uint32_t frameNr,
+      unsigned rowBegin, unsigned rowEnd) const
+{
+   if (rowEnd > height_)
+      rowEnd = height_;
+   if (bytesPerPixel_ == 1)
+      FillRowsImpl(pixels, frameNr, rowBegin, rowEnd);
+   else if (bytesPerPixel_ == 2)
+      FillRowsImpl(reinterpret_cast<uint16_t*>(pixels), frameNr,
+            rowBegin, rowEnd);
+}
+
+
+void NoiseGenerator::Fill(unsigned char* pixels, uint32_t frameNr,
+      unsigned nThreads)
+{
+   if (nThreads < 1)
+      nThreads = 1;
+   if (nThreads != bandThreads_.size() + 1)
+   {
+      StopBandThreads();
+      StartBandThreads(nThreads - 1);
+   }
+
+   const unsigned rowsPerBand = (height_ + nThreads - 1) / nThreads;
+   if (nThreads > 1)
+   {
+      {
+         boost::lock_guard<boost::mutex> lock(bandMutex_);
+         bandPixels_ = pixels;
+         bandFrameNr_ = frameNr;
+         rowsPerBand_ = rowsPerBand;
+         bandsPending_ = nThreads - 1;
+         ++bandGeneration_;
+      }
+      bandWorkCond_.notify_all();
+   }
+
+   FillRows(pixels, frameNr, 0, rowsPerBand);
+
+   boost::unique_lock<boost::mutex> lock(bandMutex_);
+   while (bandsPending_ > 0)
+      bandDoneCond_.wait(lock);
+}
+
+
+void NoiseGenerator::StartBandThreads(unsigned count)
+{
+   quitBandThreads_ = false;
+   for (unsigned i = 1; i <= count; ++i)
+   {
+      bandThreads_.push_back(new boost::thread(
+               boost::bind(&NoiseGenerator::BandThreadLoop, this, i,
+                  bandGeneration_)));
+   }
+}
+
+
+void NoiseGenerator::StopBandThreads()
+{
+   {
+      boost::lock_guard<boost::mutex> lock(bandMutex_);
+      quitBandThreads_ = true;
+   }
+   bandWorkCond_.notify_all();
+   for (std::vector<boost::thread*>::iterator it = bandThreads_.begin(),
+         end = bandThreads_.end(); it != end; ++it)
+   {
+      (*it)->join();
+      delete *it;
+   }
+   bandThreads_.clear();
+}
+
+
+void NoiseGenerator::BandThreadLoop(unsigned band,
+      unsigned long startGeneration)
+{
+   boost::unique_lock<boost::mutex> lock(bandMutex_);
+   unsigned long seen = startGeneration;
+   for (;;)
+   {
+      while (!quitBandThreads_ && bandGeneration_ == seen)
+         bandWorkCond_.wait(lock);
+      if (quitBandThreads_)
+         return;
+      seen = bandGeneration_;
+
+      unsigned char* pixels = bandPixels_;
+      const uint32_t frameNr = bandFrameNr_;
+      const unsigned rowBegin = band * rowsPerBand_;
+      const unsigned rowEnd = rowBegin + rowsPerBand_;
+      lock.unlock();
+      // FillRows() clips the band to the image; bands past the last row
+      // are empty
+      if (rowBegin < height_)
+         FillRows(pixels, frameNr, rowBegin, rowEnd);
+      lock.lock();
+
+      if (--bandsPending_ == 0)
+         bandDoneCond_.notify_all();
+   }
+}
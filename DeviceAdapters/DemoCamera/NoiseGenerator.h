@@ -0,0 +1,118 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          NoiseGenerator.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Fast synthetic noise images for the demo camera, intended
+//                for load testing the acquisition pipeline at high data
+//                rates.
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#ifndef _NOISEGENERATOR_H_
+#define _NOISEGENERATOR_H_
+
+#include <boost/thread.hpp>
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Generates 8- or 16-bit images of offset + Gaussian read noise + Poisson
+ * shot noise.
+ *
+ * Random numbers come from a counter-based generator: each sample is a hash
+ * of (frame key, pixel index), so there is no generator state to carry from
+ * pixel to pixel. This lets the per-row loops be auto-vectorized and lets
+ * any number of threads fill disjoint row bands of the same frame, with
+ * results that do not depend on the number of threads.
+ *
+ * Gaussian deviates are the (scaled) sum of the four bytes of a hash value,
+ * which is accurate to well within what a demo image needs. Poisson
+ * deviates use an inverse-CDF table for small means and the Gaussian
+ * approximation otherwise.
+ */
+class NoiseGenerator
+{
+public:
+   NoiseGenerator();
+   ~NoiseGenerator();
+
+   /**
+    * Set the image format and noise model. Cheap to call for every frame;
+    * the Poisson table is only rebuilt when the mean photon count changes.
+    */
+   void Configure(unsigned width, unsigned height, unsigned bytesPerPixel,
+         unsigned bitDepth, double offsetDN, double readNoiseDN,
+         double photonsPerPixel, double photonConversionFactor);
+
+   bool IsSupportedDepth(unsigned bytesPerPixel) const
+   { return bytesPerPixel == 1 || bytesPerPixel == 2; }
+
+   /**
+    * Fill rows [rowBegin, rowEnd) of frame number frameNr.
+    */
+   void FillRows(unsigned char* pixels, uint32_t frameNr,
+         unsigned rowBegin, unsigned rowEnd) const;
+
+   /**
+    * Fill a whole frame, splitting the rows over nThreads threads (the
+    * calling thread does one of the bands). The other threads are kept
+    * between frames and only restarted when nThreads changes. Not thread
+    * safe.
+    */
+   void Fill(unsigned char* pixels, uint32_t frameNr, unsigned nThreads);
+
+private:
+   NoiseGenerator(const NoiseGenerator&);
+   NoiseGenerator& operator=(const NoiseGenerator&);
+
+   void StartBandThreads(unsigned count);
+   void StopBandThreads();
+   void BandThreadLoop(unsigned band, unsigned long startGeneration);
+
+   template <typename PixelType>
+   void FillRowsImpl(PixelType* pixels, uint32_t frameNr,
+         unsigned rowBegin, unsigned rowEnd) const;
+   void BuildPoissonTable();
+
+   unsigned width_;
+   unsigned height_;
+   unsigned bytesPerPixel_;
+   float maxValue_;
+   float offsetDN_;
+   float readNoiseDN_;
+   double photonsPerPixel_;
+   float photonConversionFactor_;
+
+   // Cumulative Poisson probabilities scaled to 2^32; empty when the
+   // Gaussian approximation is used
+   std::vector<uint32_t> poissonCDF_;
+   std::vector<unsigned> poissonGuide_;
+
+   // Threads that fill bands 1 .. n of each frame; band 0 is filled by the
+   // thread calling Fill()
+   std::vector<boost::thread*> bandThreads_;
+   boost::mutex bandMutex_;
+   boost::condition_variable bandWorkCond_;
+   boost::condition_variable bandDoneCond_;
+   unsigned char* bandPixels_;
+   uint32_t bandFrameNr_;
+   unsigned rowsPerBand_;
+   unsigned long bandGeneration_; // incremented for each frame
+   unsigned bandsPending_;
+   bool quitBandThreads_;
+};
+
+#endif //_NOISEGENERATOR_H_
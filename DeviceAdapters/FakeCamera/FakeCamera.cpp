@@ -23,6 +23,9 @@
 
 #include "FakeCamera.h"
 
+#include <cmath>
+#include <sstream>
+
 const char* cameraName = "FakeCamera";
 
 const char* label_CV_8U = "8bit";
@@ -40,6 +43,9 @@ FakeCamera::FakeCamera() :
 	byteCount_(1),
 	type_(CV_8UC1),
 	emptyImg(1, 1, type_),
+	cache_((size_t)256 << 20),
+	prefetcher_(cache_),
+	prefetch_(true),
 	exposure_(10)
 {
 	resetCurImg();
@@ -49,6 +55,19 @@ FakeCamera::FakeCamera() :
 
 	CreateProperty("FrameCount", "0", MM::Integer, false, new CPropertyAction(this, &FakeCamera::OnFrameCount));
 
+	// Decoded images are kept in memory, and images for the positions next to
+	// the current one are loaded in the background
+	CreateProperty("Cache size (MB)", "256", MM::Integer, false, new CPropertyAction(this, &FakeCamera::OnCacheSize));
+	SetPropertyLimits("Cache size (MB)", 0, 65536);
+
+	CreateProperty("Prefetch", "1", MM::Integer, false, new CPropertyAction(this, &FakeCamera::OnPrefetch));
+	AddAllowedValue("Prefetch", "0");
+	AddAllowedValue("Prefetch", "1");
+
+	// Replay of pre-decoded frames, see RawStack.h
+	CreateProperty("Raw stack", "", MM::String, false, new CPropertyAction(this, &FakeCamera::OnRawStack));
+	CreateProperty("Create raw stack", "", MM::String, false, new CPropertyAction(this, &FakeCamera::OnCreateRawStack));
+
 	CreateProperty(MM::g_Keyword_Name, cameraName, MM::String, true);
 
 	// Description
@@ -86,6 +105,7 @@ FakeCamera::FakeCamera() :
 
 FakeCamera::~FakeCamera()
 {
+	prefetcher_.stop();
 }
 
 int FakeCamera::Initialize()
@@ -95,6 +115,9 @@ int FakeCamera::Initialize()
 
 	initSize_ = false;
 
+	if (prefetch_)
+		prefetcher_.start();
+
 	initialized_ = true;
 
 	return DEVICE_OK;
@@ -102,6 +125,7 @@ int FakeCamera::Initialize()
 
 int FakeCamera::Shutdown()
 {
+	prefetcher_.stop();
 	initialized_ = false;
 
 	return DEVICE_OK;
@@ -274,6 +298,7 @@ int FakeCamera::OnPath(MM::PropertyBase * pProp, MM::ActionType eAct)
 		std::string oldPath = path_;
 		pProp->Get(path_);
 		resetCurImg();
+		prefetcher_.reset();
 
 		if (initialized_)
 		{
@@ -312,11 +337,6 @@ int FakeCamera::ResolvePath(MM::PropertyBase * pProp, MM::ActionType eAct)
 	return DEVICE_OK;
 }
 
-double scaleFac(int bef, int aft)
-{
-	return (double)(1 << (8 * aft)) / (1 << (8 * bef));
-}
-
 int FakeCamera::OnPixelType(MM::PropertyBase * pProp, MM::ActionType eAct)
 {
 	if (eAct == MM::BeforeGet)
@@ -380,6 +400,106 @@ int FakeCamera::OnPixelType(MM::PropertyBase * pProp, MM::ActionType eAct)
 	return DEVICE_OK;
 }
 
+int FakeCamera::OnCacheSize(MM::PropertyBase * pProp, MM::ActionType eAct)
+{
+	if (eAct == MM::BeforeGet)
+	{
+		pProp->Set((long)(cache_.capacity() >> 20));
+	}
+	else if (eAct == MM::AfterSet)
+	{
+		long val;
+		pProp->Get(val);
+		cache_.setCapacity((size_t)val << 20);
+	}
+
+	return DEVICE_OK;
+}
+
+int FakeCamera::OnPrefetch(MM::PropertyBase * pProp, MM::ActionType eAct)
+{
+	if (eAct == MM::BeforeGet)
+	{
+		pProp->Set(prefetch_ ? 1L : 0L);
+	}
+	else if (eAct == MM::AfterSet)
+	{
+		long val;
+		pProp->Get(val);
+		prefetch_ = val != 0;
+
+		if (initialized_)
+		{
+			if (prefetch_)
+				prefetcher_.start();
+			else
+				prefetcher_.stop();
+		}
+	}
+
+	return DEVICE_OK;
+}
+
+int FakeCamera::OnRawStack(MM::PropertyBase * pProp, MM::ActionType eAct)
+{
+	if (eAct == MM::BeforeGet)
+	{
+		pProp->Set(rawStackPath_.c_str());
+	}
+	else if (eAct == MM::AfterSet)
+	{
+		if (capturing_)
+			return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+		std::string val;
+		pProp->Get(val);
+
+		ERRH_START
+			try
+		{
+			if (val.empty())
+				rawStack_.close();
+			else
+				rawStack_.open(val);
+		}
+		catch (error_code ex)
+		{
+			rawStack_.close();
+			rawStackPath_ = "";
+			pProp->Set("");
+			resetCurImg();
+			throw ex;
+		}
+
+		rawStackPath_ = val;
+		resetCurImg();
+		ERRH_END
+	}
+
+	return DEVICE_OK;
+}
+
+int FakeCamera::OnCreateRawStack(MM::PropertyBase * pProp, MM::ActionType eAct)
+{
+	if (eAct == MM::AfterSet)
+	{
+		if (capturing_)
+			return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+		std::string val;
+		pProp->Get(val);
+
+		if (val.empty())
+			return DEVICE_OK;
+
+		ERRH_START
+			createRawStack(val);
+		ERRH_END
+	}
+
+	return DEVICE_OK;
+}
+
 int FakeCamera::OnFrameCount(MM::PropertyBase * pProp, MM::ActionType eAct)
 {
 	if (eAct == MM::BeforeGet)
@@ -397,14 +517,26 @@ int FakeCamera::OnFrameCount(MM::PropertyBase * pProp, MM::ActionType eAct)
 	return DEVICE_OK;
 }
 
-std::string FakeCamera::parseUntil(const char*& it, const char delim) const throw (parse_error)
+std::string FakeCamera::parseUntil(const char*& it, const char delim, std::vector<MaskNumber>* numbers) const throw (parse_error)
 {
 	std::ostringstream ret;
 
 	for (; *it != '\0' && *it != delim; ++it)
 	{
 		if (*it == '?')
-			ret << parsePlaceholder(it);
+		{
+			MaskNumber number;
+			std::string text = parsePlaceholder(it, numbers != 0 ? &number : 0);
+
+			if (numbers != 0 && number.key.size() > 0)
+			{
+				number.pos = (size_t)ret.tellp();
+				number.len = text.size();
+				numbers->push_back(number);
+			}
+
+			ret << text;
+		}
 		else
 			ret << *it;
 	}
@@ -415,7 +547,19 @@ std::string FakeCamera::parseUntil(const char*& it, const char delim) const thro
 	return ret.str();
 }
 
-std::string FakeCamera::parsePlaceholder(const char*& it) const
+//records the value of a placeholder that resolves to a single number
+static void recordNumber(MaskNumber* number, const std::string& key, std::pair<int, int> precSpec, double value, int modulo = 0)
+{
+	if (number == 0)
+		return;
+
+	number->key = key;
+	number->precSpec = precSpec;
+	number->value = value;
+	number->modulo = modulo;
+}
+
+std::string FakeCamera::parsePlaceholder(const char*& it, MaskNumber* number) const
 {
 	const char* start = it;
 	++it;
@@ -462,16 +606,18 @@ std::string FakeCamera::parsePlaceholder(const char*& it) const
 				val = 0;
 
 			printNum(res, precSpec, val);
+			recordNumber(number, name, precSpec, val);
 			return res.str();
 		}
 		
 		if (name == "$frame")
 		{
 			int val = frameCount_;
+			int max = 0;
 
 			if (metadata.size() > 0)
 			{
-				int max = atoi(metadata.c_str());
+				max = atoi(metadata.c_str());
 				if (max == 0)
 					max = 1;
 
@@ -479,6 +625,7 @@ std::string FakeCamera::parsePlaceholder(const char*& it) const
 			}
 
 			printNum(res, precSpec, val);
+			recordNumber(number, name, precSpec, val, max);
 			return res.str();
 		}
 
@@ -527,6 +674,7 @@ std::string FakeCamera::parsePlaceholder(const char*& it) const
 					pos = 0;
 
 				printNum(res, precSpec, pos);
+				recordNumber(number, name, precSpec, pos);
 			}
 		}
 		break;
@@ -539,9 +687,15 @@ std::string FakeCamera::parsePlaceholder(const char*& it) const
 				x = y = 0;
 
 			if (metadata == "$x")
+			{
 				printNum(res, precSpec, x);
+				recordNumber(number, name + "$x", precSpec, x);
+			}
 			else if (metadata == "$y")
+			{
 				printNum(res, precSpec, y);
+				recordNumber(number, name + "$y", precSpec, y);
+			}
 			else
 			{
 				std::string sep = metadata.size() > 0 ? metadata : "-";
@@ -556,6 +710,7 @@ std::string FakeCamera::parsePlaceholder(const char*& it) const
 				pos = 0;
 
 			printNum(res, precSpec, pos);
+			recordNumber(number, name, precSpec, pos);
 		}
 		break;
 		case MM::SignalIODevice:
@@ -577,12 +732,17 @@ std::string FakeCamera::parsePlaceholder(const char*& it) const
 					vol = 0;
 
 				printNum(res, precSpec, vol);
+				recordNumber(number, name, precSpec, vol);
 			}
 		}
 		break;
 		case MM::MagnifierDevice:
-			printNum(res, precSpec, ((MM::Magnifier*)dev)->GetMagnification());
-			break;
+		{
+			double mag = ((MM::Magnifier*)dev)->GetMagnification();
+			printNum(res, precSpec, mag);
+			recordNumber(number, name, precSpec, mag);
+		}
+		break;
 
 		default:
 			throw parse_error();
@@ -642,20 +802,51 @@ std::string FakeCamera::iif(bool test, std::string spec)
 	return test ? spec.substr(sepPos + 1) : spec.substr(0, sepPos + 1);
 }
 
-std::string FakeCamera::parseMask(std::string mask) const throw(error_code)
+std::string FakeCamera::parseMask(std::string mask, std::vector<MaskNumber>* numbers) const throw(error_code)
 {
 	const char* it = mask.data();
-	return parseUntil(it, '\0');
+	return parseUntil(it, '\0', numbers);
 }
 
 void FakeCamera::getImg() const
 {
-	std::string path = parseMask(path_);
+	std::string path;
+	cv::Mat img;
 
-	if (path == curPath_)
-		return;
+	if (rawStack_.isOpen())
+	{
+		if (rawStack_.type() != (int)type_)
+			throw error_code(CONTROLLER_ERROR, "The pixel type does not match that of raw stack '" + rawStackPath_ + "'");
+
+		unsigned index = (unsigned)frameCount_ % rawStack_.frameCount();
+		path = rawStackPath_ + "#" + CDeviceUtils::ConvertToString((long)index);
+
+		if (path == curPath_)
+			return;
+
+		img = rawStack_.frame(index);
+	}
+	else
+	{
+		std::vector<MaskNumber> numbers;
+		path = parseMask(path_, &numbers);
 
-	cv::Mat img = path == lastFailedPath_ ? lastFailedImg_ : cv::imread(path, cv::IMREAD_ANYDEPTH | (color_ ? cv::IMREAD_COLOR : cv::IMREAD_GRAYSCALE));
+		if (path == curPath_)
+			return;
+
+		if (path == lastFailedPath_)
+			img = lastFailedImg_;
+		else if (!cache_.get(path, type_, img))
+		{
+			img = loadImage(path, type_);
+
+			if (img.data != NULL)
+				cache_.put(path, img);
+		}
+
+		if (prefetch_ && cache_.capacity() > 0)
+			prefetchNeighbors(path, numbers);
+	}
 
 	if (img.data == NULL)
 	{
@@ -671,8 +862,6 @@ void FakeCamera::getImg() const
 		}
 	}
 
-	img.convertTo(img, type_, scaleFac((int)img.elemSize() / img.channels(), byteCount_));
-
 	bool dimChanged = (unsigned)img.cols != width_ || (unsigned)img.rows != height_;
 
 	if (dimChanged)
@@ -685,7 +874,8 @@ void FakeCamera::getImg() const
 		}
 	}
 
-	if (color_)
+	// raw stack frames already have an alpha channel
+	if (color_ && img.channels() == 3)
 	{
 		if (alphaChannel_.rows != img.rows || alphaChannel_.cols != img.cols || alphaChannel_.depth() != img.depth())
 		{
@@ -715,6 +905,97 @@ void FakeCamera::getImg() const
 	updateROI();
 }
 
+void FakeCamera::prefetchNeighbors(const std::string& path, const std::vector<MaskNumber>& numbers) const
+{
+	std::vector<std::string> paths;
+
+	for (std::vector<MaskNumber>::const_iterator it = numbers.begin(); it != numbers.end(); ++it)
+	{
+		//the step (including its direction) is that of the last move
+		double& step = steps_[it->key];
+		std::map<std::string, double>::iterator last = lastValues_.find(it->key);
+		if (last != lastValues_.end() && last->second != it->value)
+			step = it->value - last->second;
+		lastValues_[it->key] = it->value;
+
+		if (step == 0)
+			step = it->key == "$frame" ? 1 : pow(10.0, -it->precSpec.second);
+
+		double candidates[] = { it->value + step, it->value + 2 * step, it->value - step };
+
+		for (int i = 0; i < 3; ++i)
+		{
+			double val = candidates[i];
+			if (it->modulo > 0)
+				val = fmod(fmod(val, it->modulo) + it->modulo, it->modulo);
+
+			std::ostringstream res;
+			printNum(res, it->precSpec, val);
+
+			std::string candidate = path.substr(0, it->pos) + res.str() + path.substr(it->pos + it->len);
+			if (candidate != path)
+				paths.push_back(candidate);
+		}
+	}
+
+	prefetcher_.request(paths, type_);
+}
+
+void FakeCamera::createRawStack(const std::string& path)
+{
+	if (path_.find("$frame") == std::string::npos)
+		throw error_code(CONTROLLER_ERROR, "The path mask needs a ?[$frame] placeholder to create a raw stack");
+
+	int oldFrameCount = frameCount_;
+	RawStackWriter writer;
+	std::string firstPath;
+
+	try
+	{
+		for (frameCount_ = 0; ; ++frameCount_)
+		{
+			std::string imgPath = parseMask(path_);
+			if (frameCount_ == 0)
+				firstPath = imgPath;
+			else if (imgPath == firstPath)
+				break; // ?[$frame(max)] wrapped around
+
+			cv::Mat img = loadImage(imgPath, type_);
+			if (img.data == NULL)
+				break;
+
+			if (color_)
+			{
+				cv::Mat alpha(img.rows, img.cols, CV_MAT_DEPTH(type_), cv::Scalar(1 << (8 * byteCount_)));
+				cv::Mat bgra(img.rows, img.cols, type_);
+				int fromTo[] = { 0,0 , 1,1 , 2,2 , 3,3 };
+				cv::Mat from[] = { img, alpha };
+
+				cv::mixChannels(from, 2, &bgra, 1, fromTo, 4);
+				img = bgra;
+			}
+
+			if (frameCount_ == 0)
+				writer.open(path, img.cols, img.rows, type_);
+
+			writer.write(img);
+		}
+	}
+	catch (error_code)
+	{
+		frameCount_ = oldFrameCount;
+		throw;
+	}
+
+	frameCount_ = oldFrameCount;
+
+	if (writer.frameCount() == 0)
+		throw error_code(CONTROLLER_ERROR, "Could not find image '" + firstPath + "'");
+
+	writer.close();
+	LogMessage("Wrote " + std::string(CDeviceUtils::ConvertToString((long)writer.frameCount())) + " images to raw stack '" + path + "'");
+}
+
 void FakeCamera::updateROI() const
 {
 	roi_ = curImg_(cv::Range(roiY_, roiY_ + roiHeight_), cv::Range(roiX_, roiX_ + roiWidth_));
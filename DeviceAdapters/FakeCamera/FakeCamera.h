@@ -23,7 +23,9 @@
 
 #pragma once
 
+#include <map>
 #include <string>
+#include <vector>
 
 #include "DeviceBase.h"
 
@@ -40,6 +42,8 @@
 #define CONTROLLER_ERROR 10002
 
 #include "error_code.h"
+#include "ImageCache.h"
+#include "RawStack.h"
 
 extern const char* cameraName;
 extern const char* label_CV_8U;
@@ -50,6 +54,20 @@ extern const char* label_CV_16UC4;
 
 class parse_error : public std::exception {};
 
+// A placeholder of the path mask that resolved to a single number, and where
+// it ended up in the resolved path
+struct MaskNumber
+{
+	MaskNumber() : precSpec(0, 0), value(0), modulo(0), pos(0), len(0) {}
+
+	std::string key;
+	std::pair<int, int> precSpec;
+	double value;
+	int modulo; // for $frame(max), 0 otherwise
+	size_t pos;
+	size_t len;
+};
+
 class FakeCamera : public CCameraBase<FakeCamera>
 {
 public:
@@ -86,14 +104,20 @@ public:
 	int ResolvePath(MM::PropertyBase* pProp, MM::ActionType eAct);
 	int OnPixelType(MM::PropertyBase* pProp, MM::ActionType eAct);
 	int OnFrameCount(MM::PropertyBase* pProp, MM::ActionType eAct);
+	int OnCacheSize(MM::PropertyBase* pProp, MM::ActionType eAct);
+	int OnPrefetch(MM::PropertyBase* pProp, MM::ActionType eAct);
+	int OnRawStack(MM::PropertyBase* pProp, MM::ActionType eAct);
+	int OnCreateRawStack(MM::PropertyBase* pProp, MM::ActionType eAct);
 
-	std::string parseUntil(const char*& it, const char delim) const throw (parse_error);
-	std::string parsePlaceholder(const char*& it) const;
+	std::string parseUntil(const char*& it, const char delim, std::vector<MaskNumber>* numbers = 0) const throw (parse_error);
+	std::string parsePlaceholder(const char*& it, MaskNumber* number = 0) const;
 	std::pair<int, int> parsePrecision(const char*& it) const throw (parse_error);
 	static std::ostream& printNum(std::ostream& o, std::pair<int, int> precSpec, double num);
 	static std::string iif(bool test, std::string spec);
-	std::string parseMask(std::string mask) const throw(error_code);
+	std::string parseMask(std::string mask, std::vector<MaskNumber>* numbers = 0) const throw(error_code);
 	void getImg() const;
+	void prefetchNeighbors(const std::string& path, const std::vector<MaskNumber>& numbers) const;
+	void createRawStack(const std::string& path);
 	void updateROI() const;
 
 	void initSize(bool loadImg = true) const;
@@ -126,6 +150,17 @@ private:
 	mutable std::string curPath_;
 	mutable std::string lastFailedPath_;
 
+	mutable ImageCache cache_;
+	mutable ImagePrefetcher prefetcher_;
+	bool prefetch_;
+	// last value and last nonzero change of each numeric placeholder, used
+	// to guess which images will be needed next
+	mutable std::map<std::string, double> lastValues_;
+	mutable std::map<std::string, double> steps_;
+
+	RawStack rawStack_;
+	std::string rawStackPath_;
+
 	void resetCurImg();
 
 	double exposure_;
@@ -0,0 +1,248 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ImageCache.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   In-memory cache of decoded FakeCamera images, with
+//                background prefetch of neighboring positions
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+// LICENSE:       Licensed under the Apache License, Version 2.0 (the "License");
+//                you may not use this file except in compliance with the License.
+//                You may obtain a copy of the License at
+//
+//                http://www.apache.org/licenses/LICENSE-2.0
+//
+//                Unless required by applicable law or agreed to in writing, software
+//                distributed under the License is distributed on an "AS IS" BASIS,
+//                WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//                See the License for the specific language governing permissions and
+//                limitations under the License.
+
+#include "ImageCache.h"
+
+#include "DeviceUtils.h"
+
+namespace
+{
+	double scaleFac(int bef, int aft)
+	{
+		return (double)(1 << (8 * aft)) / (1 << (8 * bef));
+	}
+
+	// whether img is what loadImage() returns for the given type
+	bool matchesType(const cv::Mat& img, int type)
+	{
+		int channels = CV_MAT_CN(type) == 4 ? 3 : 1;
+		return img.depth() == CV_MAT_DEPTH(type) && img.channels() == channels;
+	}
+}
+
+cv::Mat loadImage(const std::string& path, int type)
+{
+	bool color = CV_MAT_CN(type) == 4;
+	int byteCount = (int)CV_ELEM_SIZE1(type);
+
+	cv::Mat img = cv::imread(path, cv::IMREAD_ANYDEPTH | (color ? cv::IMREAD_COLOR : cv::IMREAD_GRAYSCALE));
+
+	if (img.data != NULL)
+		img.convertTo(img, type, scaleFac((int)img.elemSize() / img.channels(), byteCount));
+
+	return img;
+}
+
+ImageCache::ImageCache(size_t capacityBytes) :
+	capacity_(capacityBytes),
+	size_(0)
+{
+}
+
+bool ImageCache::get(const std::string& path, int type, cv::Mat& img)
+{
+	MMThreadGuard g(lock_);
+
+	std::map<std::string, EntryList::iterator>::iterator found = index_.find(path);
+	if (found == index_.end() || !matchesType(found->second->second, type))
+		return false;
+
+	// move to front
+	entries_.splice(entries_.begin(), entries_, found->second);
+	img = found->second->second;
+	return true;
+}
+
+bool ImageCache::contains(const std::string& path, int type) const
+{
+	MMThreadGuard g(lock_);
+
+	std::map<std::string, EntryList::iterator>::const_iterator found = index_.find(path);
+	return found != index_.end() && matchesType(found->second->second, type);
+}
+
+void ImageCache::put(const std::string& path, const cv::Mat& img)
+{
+	MMThreadGuard g(lock_);
+
+	if (byteSize(img) > capacity_)
+		return;
+
+	std::map<std::string, EntryList::iterator>::iterator found = index_.find(path);
+	if (found != index_.end())
+	{
+		size_ -= byteSize(found->second->second);
+		entries_.erase(found->second);
+		index_.erase(found);
+	}
+
+	entries_.push_front(std::make_pair(path, img));
+	index_[path] = entries_.begin();
+	size_ += byteSize(img);
+
+	evict();
+}
+
+void ImageCache::clear()
+{
+	MMThreadGuard g(lock_);
+
+	entries_.clear();
+	index_.clear();
+	size_ = 0;
+}
+
+void ImageCache::setCapacity(size_t capacityBytes)
+{
+	MMThreadGuard g(lock_);
+
+	capacity_ = capacityBytes;
+	evict();
+}
+
+size_t ImageCache::capacity() const
+{
+	MMThreadGuard g(lock_);
+
+	return capacity_;
+}
+
+void ImageCache::evict()
+{
+	while (size_ > capacity_ && !entries_.empty())
+	{
+		size_ -= byteSize(entries_.back().second);
+		index_.erase(entries_.back().first);
+		entries_.pop_back();
+	}
+}
+
+size_t ImageCache::byteSize(const cv::Mat& img)
+{
+	return img.total() * img.elemSize();
+}
+
+ImagePrefetcher::ImagePrefetcher(ImageCache& cache) :
+	cache_(cache),
+	type_(CV_8UC1),
+	running_(false),
+	stop_(false)
+{
+}
+
+ImagePrefetcher::~ImagePrefetcher()
+{
+	stop();
+}
+
+void ImagePrefetcher::start()
+{
+	if (running_)
+		return;
+
+	stop_ = false;
+	running_ = true;
+	activate();
+}
+
+void ImagePrefetcher::stop()
+{
+	if (!running_)
+		return;
+
+	{
+		MMThreadGuard g(lock_);
+		stop_ = true;
+		pending_.clear();
+	}
+
+	wait();
+	running_ = false;
+}
+
+void ImagePrefetcher::request(const std::vector<std::string>& paths, int type)
+{
+	MMThreadGuard g(lock_);
+
+	if (type != type_)
+	{
+		type_ = type;
+		missing_.clear();
+	}
+
+	pending_.clear();
+	for (std::vector<std::string>::const_iterator it = paths.begin(); it != paths.end(); ++it)
+	{
+		if (missing_.find(*it) == missing_.end())
+			pending_.push_back(*it);
+	}
+}
+
+void ImagePrefetcher::reset()
+{
+	MMThreadGuard g(lock_);
+
+	pending_.clear();
+	missing_.clear();
+}
+
+int ImagePrefetcher::svc()
+{
+	for (;;)
+	{
+		std::string path;
+		int type;
+		{
+			MMThreadGuard g(lock_);
+
+			if (stop_)
+				break;
+
+			if (!pending_.empty())
+			{
+				path = pending_.front();
+				pending_.pop_front();
+			}
+			type = type_;
+		}
+
+		if (path.empty())
+		{
+			CDeviceUtils::SleepMs(5);
+			continue;
+		}
+
+		if (cache_.contains(path, type))
+			continue;
+
+		cv::Mat img = loadImage(path, type);
+
+		if (img.data == NULL)
+		{
+			MMThreadGuard g(lock_);
+			missing_.insert(path);
+		}
+		else
+			cache_.put(path, img);
+	}
+
+	return 0;
+}
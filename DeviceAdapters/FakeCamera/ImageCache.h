@@ -0,0 +1,97 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ImageCache.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   In-memory cache of decoded FakeCamera images, with
+//                background prefetch of neighboring positions
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+// LICENSE:       Licensed under the Apache License, Version 2.0 (the "License");
+//                you may not use this file except in compliance with the License.
+//                You may obtain a copy of the License at
+//
+//                http://www.apache.org/licenses/LICENSE-2.0
+//
+//                Unless required by applicable law or agreed to in writing, software
+//                distributed under the License is distributed on an "AS IS" BASIS,
+//                WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//                See the License for the specific language governing permissions and
+//                limitations under the License.
+
+#pragma once
+
+#include <deque>
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "DeviceThreads.h"
+
+#ifdef __linux__
+#include <opencv/cv.hpp>
+#else
+#include "opencv/highgui.h"
+#endif
+
+// Reads an image from disk and converts it to the given type (one of CV_8UC1,
+// CV_16UC1, CV_8UC4, CV_16UC4). Color images are returned with 3 channels;
+// the alpha channel is added by the camera. Returns an empty Mat on failure.
+cv::Mat loadImage(const std::string& path, int type);
+
+// Bounded, least recently used cache of decoded images, keyed by path
+class ImageCache
+{
+public:
+	ImageCache(size_t capacityBytes);
+
+	// Returns false if the image is not in the cache or has a different type
+	bool get(const std::string& path, int type, cv::Mat& img);
+	bool contains(const std::string& path, int type) const;
+	void put(const std::string& path, const cv::Mat& img);
+	void clear();
+
+	void setCapacity(size_t capacityBytes);
+	size_t capacity() const;
+
+private:
+	typedef std::list<std::pair<std::string, cv::Mat> > EntryList;
+
+	void evict();
+	static size_t byteSize(const cv::Mat& img);
+
+	EntryList entries_; // most recently used first
+	std::map<std::string, EntryList::iterator> index_;
+	size_t capacity_;
+	size_t size_;
+	mutable MMThreadLock lock_;
+};
+
+// Loads requested images into an ImageCache on a background thread
+class ImagePrefetcher : public MMDeviceThreadBase
+{
+public:
+	ImagePrefetcher(ImageCache& cache);
+	~ImagePrefetcher();
+
+	void start();
+	void stop();
+
+	// Replaces the pending requests, which are served in order
+	void request(const std::vector<std::string>& paths, int type);
+	// Forgets about paths that failed to load
+	void reset();
+
+	int svc();
+
+private:
+	ImageCache& cache_;
+	MMThreadLock lock_;
+	std::deque<std::string> pending_;
+	std::set<std::string> missing_;
+	int type_;
+	bool running_;
+	bool stop_;
+};
@@ -0,0 +1,244 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          RawStack.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Memory-mapped raw image stack replayed by FakeCamera
+//                during sequence acquisition
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+// LICENSE:       Licensed under the Apache License, Version 2.0 (the "License");
+//                you may not use this file except in compliance with the License.
+//                You may obtain a copy of the License at
+//
+//                http://www.apache.org/licenses/LICENSE-2.0
+//
+//                Unless required by applicable law or agreed to in writing, software
+//                distributed under the License is distributed on an "AS IS" BASIS,
+//                WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//                See the License for the specific language governing permissions and
+//                limitations under the License.
+
+#include "RawStack.h"
+
+#include "FakeCamera.h"
+
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	const char rawStackMagic[8] = { 'M', 'M', 'R', 'A', 'W', 'S', 'T', 'K' };
+	const unsigned rawStackVersion = 1;
+
+	struct RawStackHeader
+	{
+		char magic[8];
+		unsigned int version;
+		unsigned int width;
+		unsigned int height;
+		unsigned int type;
+		unsigned int frameCount;
+		unsigned int reserved;
+	};
+
+	bool isSupportedType(int type)
+	{
+		return type == CV_8UC1 || type == CV_16UC1 || type == CV_8UC4 || type == CV_16UC4;
+	}
+
+	size_t frameBytes(unsigned width, unsigned height, int type)
+	{
+		return (size_t)width * height * CV_ELEM_SIZE(type);
+	}
+}
+
+RawStack::RawStack() :
+#ifdef _WIN32
+	file_(INVALID_HANDLE_VALUE),
+	mapping_(NULL),
+#else
+	fd_(-1),
+#endif
+	data_(0),
+	size_(0),
+	width_(0),
+	height_(0),
+	type_(CV_8UC1),
+	frameCount_(0)
+{
+}
+
+RawStack::~RawStack()
+{
+	close();
+}
+
+void RawStack::open(const std::string& path)
+{
+	close();
+
+#ifdef _WIN32
+	file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file_ == INVALID_HANDLE_VALUE)
+		throw error_code(CONTROLLER_ERROR, "Could not open raw stack '" + path + "'");
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file_, &fileSize))
+	{
+		close();
+		throw error_code(CONTROLLER_ERROR, "Could not open raw stack '" + path + "'");
+	}
+	size_ = (size_t)fileSize.QuadPart;
+
+	if (size_ >= sizeof(RawStackHeader))
+	{
+		mapping_ = CreateFileMapping(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping_ != NULL)
+			data_ = (unsigned char*)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+	}
+#else
+	fd_ = ::open(path.c_str(), O_RDONLY);
+	if (fd_ < 0)
+		throw error_code(CONTROLLER_ERROR, "Could not open raw stack '" + path + "'");
+
+	struct stat st;
+	if (fstat(fd_, &st) != 0)
+	{
+		close();
+		throw error_code(CONTROLLER_ERROR, "Could not open raw stack '" + path + "'");
+	}
+	size_ = (size_t)st.st_size;
+
+	if (size_ >= sizeof(RawStackHeader))
+	{
+		void* addr = mmap(0, size_, PROT_READ, MAP_SHARED, fd_, 0);
+		if (addr != MAP_FAILED)
+		{
+			data_ = (unsigned char*)addr;
+			// frames are read sequentially during replay
+			madvise(addr, size_, MADV_SEQUENTIAL);
+		}
+	}
+#endif
+
+	if (data_ == 0)
+	{
+		close();
+		throw error_code(CONTROLLER_ERROR, "Could not map raw stack '" + path + "'");
+	}
+
+	RawStackHeader header;
+	memcpy(&header, data_, sizeof(header));
+
+	if (memcmp(header.magic, rawStackMagic, sizeof(rawStackMagic)) != 0 || header.version != rawStackVersion ||
+		!isSupportedType((int)header.type) || header.frameCount == 0 ||
+		sizeof(header) + frameBytes(header.width, header.height, (int)header.type) * header.frameCount > size_)
+	{
+		close();
+		throw error_code(CONTROLLER_ERROR, "'" + path + "' is not a valid raw stack");
+	}
+
+	width_ = header.width;
+	height_ = header.height;
+	type_ = (int)header.type;
+	frameCount_ = header.frameCount;
+}
+
+void RawStack::close()
+{
+#ifdef _WIN32
+	if (data_ != 0)
+		UnmapViewOfFile(data_);
+	if (mapping_ != NULL)
+		CloseHandle(mapping_);
+	if (file_ != INVALID_HANDLE_VALUE)
+		CloseHandle(file_);
+	mapping_ = NULL;
+	file_ = INVALID_HANDLE_VALUE;
+#else
+	if (data_ != 0)
+		munmap(data_, size_);
+	if (fd_ >= 0)
+		::close(fd_);
+	fd_ = -1;
+#endif
+	data_ = 0;
+	size_ = 0;
+	width_ = height_ = frameCount_ = 0;
+}
+
+cv::Mat RawStack::frame(unsigned index) const
+{
+	unsigned char* start = data_ + sizeof(RawStackHeader) + frameBytes(width_, height_, type_) * (index % frameCount_);
+	return cv::Mat(height_, width_, type_, start);
+}
+
+RawStackWriter::RawStackWriter() :
+	width_(0),
+	height_(0),
+	type_(CV_8UC1),
+	frameCount_(0)
+{
+}
+
+void RawStackWriter::open(const std::string& path, unsigned width, unsigned height, int type)
+{
+	if (!isSupportedType(type))
+		throw error_code(CONTROLLER_ERROR, "Unsupported pixel type for raw stack");
+
+	out_.open(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!out_)
+		throw error_code(CONTROLLER_ERROR, "Could not create raw stack '" + path + "'");
+
+	path_ = path;
+	width_ = width;
+	height_ = height;
+	type_ = type;
+	frameCount_ = 0;
+
+	writeHeader();
+}
+
+void RawStackWriter::write(const cv::Mat& frame)
+{
+	if ((unsigned)frame.cols != width_ || (unsigned)frame.rows != height_ || frame.type() != type_)
+		throw error_code(CONTROLLER_ERROR, "All images of a raw stack must have the same size and type");
+
+	cv::Mat continuous = frame.isContinuous() ? frame : frame.clone();
+	out_.write((const char*)continuous.data, frameBytes(width_, height_, type_));
+	if (!out_)
+		throw error_code(CONTROLLER_ERROR, "Could not write raw stack '" + path_ + "'");
+
+	++frameCount_;
+}
+
+void RawStackWriter::close()
+{
+	out_.seekp(0);
+	writeHeader();
+	out_.close();
+
+	if (!out_)
+		throw error_code(CONTROLLER_ERROR, "Could not write raw stack '" + path_ + "'");
+}
+
+void RawStackWriter::writeHeader()
+{
+	RawStackHeader header;
+	memcpy(header.magic, rawStackMagic, sizeof(rawStackMagic));
+	header.version = rawStackVersion;
+	header.width = width_;
+	header.height = height_;
+	header.type = (unsigned int)type_;
+	header.frameCount = frameCount_;
+	header.reserved = 0;
+
+	out_.write((const char*)&header, sizeof(header));
+}
@@ -0,0 +1,112 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          RawStack.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Memory-mapped raw image stack replayed by FakeCamera
+//                during sequence acquisition
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+// LICENSE:       Licensed under the Apache License, Version 2.0 (the "License");
+//                you may not use this file except in compliance with the License.
+//                You may obtain a copy of the License at
+//
+//                http://www.apache.org/licenses/LICENSE-2.0
+//
+//                Unless required by applicable law or agreed to in writing, software
+//                distributed under the License is distributed on an "AS IS" BASIS,
+//                WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//                See the License for the specific language governing permissions and
+//                limitations under the License.
+
+#pragma once
+
+#include <fstream>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#ifdef __linux__
+#include <opencv/cv.hpp>
+#else
+#include "opencv/highgui.h"
+#endif
+
+#include "error_code.h"
+
+// A raw stack is a file of pre-decoded frames that is memory-mapped for
+// replay, so that no decoding or copying is needed per frame.
+//
+// Layout (native byte order):
+//   char     magic[8]     "MMRAWSTK"
+//   uint32   version      1
+//   uint32   width
+//   uint32   height
+//   uint32   type         OpenCV type of the frames (CV_8UC1, CV_16UC1,
+//                         CV_8UC4 or CV_16UC4)
+//   uint32   frameCount
+//   uint32   reserved     0
+// followed by frameCount frames of width * height pixels each.
+class RawStack
+{
+public:
+	RawStack();
+	~RawStack();
+
+	// throws error_code
+	void open(const std::string& path);
+	void close();
+	bool isOpen() const { return data_ != 0; }
+
+	unsigned width() const { return width_; }
+	unsigned height() const { return height_; }
+	int type() const { return type_; }
+	unsigned frameCount() const { return frameCount_; }
+
+	// Returns a read-only view of the mapped frame; no data is copied
+	cv::Mat frame(unsigned index) const;
+
+private:
+	RawStack(const RawStack&);
+	RawStack& operator=(const RawStack&);
+
+#ifdef _WIN32
+	HANDLE file_;
+	HANDLE mapping_;
+#else
+	int fd_;
+#endif
+	unsigned char* data_;
+	size_t size_;
+
+	unsigned width_;
+	unsigned height_;
+	int type_;
+	unsigned frameCount_;
+};
+
+// Writes a raw stack frame by frame
+class RawStackWriter
+{
+public:
+	RawStackWriter();
+
+	// All methods throw error_code
+	void open(const std::string& path, unsigned width, unsigned height, int type);
+	void write(const cv::Mat& frame);
+	void close();
+
+	unsigned frameCount() const { return frameCount_; }
+
+private:
+	void writeHeader();
+
+	std::ofstream out_;
+	std::string path_;
+	unsigned width_;
+	unsigned height_;
+	int type_;
+	unsigned frameCount_;
+};
@@ -137,6 +137,22 @@ int ImageProcessorChain::OnProcessor(MM::PropertyBase* pProp, MM::ActionType eAc
 
 
 int ImageProcessorChain::Process(unsigned char *pBuffer, unsigned int width, unsigned int height, unsigned int byteDepth)
+{
+   return RunChain(pBuffer, width, height, byteDepth, 0, 0, 0);
+}
+
+
+int ImageProcessorChain::ProcessStreamImage(unsigned char *pBuffer, unsigned int width, unsigned int height, unsigned int byteDepth,
+      unsigned nComponents, const char* cameraLabel, unsigned channel)
+{
+   return RunChain(pBuffer, width, height, byteDepth, nComponents, cameraLabel, channel);
+}
+
+
+// Runs the processors with Process(), or with ProcessStreamImage() if
+// cameraLabel is not null
+int ImageProcessorChain::RunChain(unsigned char *pBuffer, unsigned int width, unsigned int height, unsigned int byteDepth,
+      unsigned nComponents, const char* cameraLabel, unsigned channel)
 {
    int ret = DEVICE_OK;
    busy_ = true;
@@ -152,7 +168,15 @@ int ImageProcessorChain::Process(unsigned char *pBuffer, unsigned int width, uns
          {
             try
             {
-               pP->Process(pBuffer, width, height,byteDepth);
+               // A held image goes no further down the chain
+               int processed = cameraLabel ?
+                  pP->ProcessStreamImage(pBuffer, width, height, byteDepth, nComponents, cameraLabel, channel) :
+                  pP->Process(pBuffer, width, height,byteDepth);
+               if (processed == DEVICE_IMAGE_HELD_BY_PROCESSOR)
+               {
+                  ret = DEVICE_IMAGE_HELD_BY_PROCESSOR;
+                  break;
+               }
             }
             catch(...)
             {
@@ -52,6 +52,8 @@ public:
    bool Busy(void) { return busy_;};
 
    int Process(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth);
+   int ProcessStreamImage(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth,
+         unsigned nComponents, const char* cameraLabel, unsigned channel);
 
    // action interface
    // ----------------
@@ -63,6 +65,9 @@ private:
    std::map< int, std::string> processorNames_;
    std::map< int, MM::ImageProcessor*> processors_;
 
+   int RunChain(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth,
+         unsigned nComponents, const char* cameraLabel, unsigned channel);
+
    ImageProcessorChain& operator=( const ImageProcessorChain& ){ 
       return *this;
    };
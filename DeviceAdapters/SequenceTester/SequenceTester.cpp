@@ -51,6 +51,9 @@ InitializeModuleData()
 {
    RegisterDevice("THub", MM::HubDevice,
          "Fake devices for automated and interactive testing");
+
+   // All device state is guarded by the hub global mutex
+   SetModuleThreadSafety(MM::ThreadSafetyDevice);
 }
 
 
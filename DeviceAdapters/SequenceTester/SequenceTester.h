@@ -93,10 +93,12 @@ class TesterHub : public TesterBase<HubBase, TesterHub>
    // Synchronizes access to the hub and all devices attached to it. Must be
    // locked during every call from the Core (except for the ones that do not
    // access or modify state) _and_ when reading the current state from the
-   // camera's sequence acquisition thread. (There is not much point in having
-   // finer-grained locking because the Core already synchronizes access to the
-   // device adapter. However, we do need this lock to be per-hub so that
-   // access from different Core instances can run concurrently.)
+   // camera's sequence acquisition thread. The module declares per-device
+   // thread safety (see InitializeModuleData()), so the Core locks each
+   // device separately and may call different devices of the hub from
+   // different threads at the same time; this lock is what keeps the shared
+   // hub state consistent. It is per-hub so that access from different Core
+   // instances can run concurrently.
    mutable boost::recursive_mutex hubGlobalMutex_;
 
    SettingLogger logger_;
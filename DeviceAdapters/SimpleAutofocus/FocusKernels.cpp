@@ -0,0 +1,642 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          FocusKernels.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Per-row image kernels for the focus scores, with scalar,
+//                SSE2 and AVX2 implementations
+// COPYRIGHT:     Micro-Manager contributors, 2026
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+
+#include "FocusKernels.h"
+
+#include <algorithm>
+
+// SSE2 is part of x86-64, AVX2 is selected at run time
+#if defined(_M_X64) || defined(__x86_64__)
+#define FOCUSKERNELS_SSE2 1
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#define FOCUSKERNELS_AVX2 1
+#define FOCUSKERNELS_AVX2_TARGET
+#elif defined(__GNUC__)
+#include <immintrin.h>
+#define FOCUSKERNELS_AVX2 1
+#define FOCUSKERNELS_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace {
+
+//////////////////////////////////////////////////////////////////////////////
+// Scalar kernels, also used for the columns left over by the vector kernels
+//
+// The median of 9 sorts each column of 3, then takes the median of the
+// largest of the column minima, the median of the column medians and the
+// smallest of the column maxima.
+
+inline void Sort2(unsigned short& a, unsigned short& b)
+{
+   unsigned short t = std::min(a, b);
+   b = std::max(a, b);
+   a = t;
+}
+
+inline unsigned short Median3(unsigned short a, unsigned short b, unsigned short c)
+{
+   return std::max(std::min(a, b), std::min(std::max(a, b), c));
+}
+
+void MedianOf9RowScalar(const unsigned short* above, const unsigned short* row,
+      const unsigned short* below, unsigned short* out, int width)
+{
+   for (int i = 0; i < width; ++i)
+   {
+      unsigned short lo[3], mid[3], hi[3];
+      for (int k = 0; k < 3; ++k)
+      {
+         unsigned short a = above[i + k], b = row[i + k], c = below[i + k];
+         Sort2(a, b);
+         Sort2(b, c);
+         Sort2(a, b);
+         lo[k] = a;
+         mid[k] = b;
+         hi[k] = c;
+      }
+      out[i] = Median3(std::max(std::max(lo[0], lo[1]), lo[2]),
+            Median3(mid[0], mid[1], mid[2]),
+            std::min(std::min(hi[0], hi[1]), hi[2]));
+   }
+}
+
+// output column i+1 is computed from input columns i .. i+2
+uint64_t EdgeRowScalar(const unsigned short* a, const unsigned short* b,
+      const unsigned short* c, int width)
+{
+   uint64_t sum = 0;
+   for (int i = 0; i + 2 < width; ++i)
+   {
+      int v = (b[i+2] + c[i+1] + 2*c[i+2]) - (2*a[i] + a[i+1] + b[i]);
+      sum += (uint64_t)((int64_t)v * v);
+   }
+   return sum;
+}
+
+uint64_t TenengradRowScalar(const unsigned short* a, const unsigned short* b,
+      const unsigned short* c, int width)
+{
+   uint64_t sum = 0;
+   for (int i = 0; i + 2 < width; ++i)
+   {
+      int gx = (a[i+2] + 2*b[i+2] + c[i+2]) - (a[i] + 2*b[i] + c[i]);
+      int gy = (c[i] + 2*c[i+1] + c[i+2]) - (a[i] + 2*a[i+1] + a[i+2]);
+      sum += (uint64_t)((int64_t)gx * gx + (int64_t)gy * gy);
+   }
+   return sum;
+}
+
+uint64_t BrennerRowScalar(const unsigned short* row, int width)
+{
+   uint64_t sum = 0;
+   for (int i = 0; i + 2 < width; ++i)
+   {
+      int d = row[i+2] - row[i];
+      sum += (uint64_t)((int64_t)d * d);
+   }
+   return sum;
+}
+
+void SumRowScalar(const unsigned short* row, int width, uint64_t& sum, uint64_t& sumOfSquares)
+{
+   for (int i = 0; i < width; ++i)
+   {
+      sum += row[i];
+      sumOfSquares += (uint64_t)row[i] * row[i];
+   }
+}
+
+inline void AddMinimum(unsigned short v, unsigned short extremes[4])
+{
+   if (v < extremes[1])
+   {
+      extremes[1] = std::max(extremes[0], v);
+      extremes[0] = std::min(extremes[0], v);
+   }
+}
+
+inline void AddMaximum(unsigned short v, unsigned short extremes[4])
+{
+   if (extremes[3] < v)
+   {
+      extremes[3] = std::min(extremes[2], v);
+      extremes[2] = std::max(extremes[2], v);
+   }
+}
+
+void ExtremesRowScalar(const unsigned short* row, int width, unsigned short extremes[4])
+{
+   for (int i = 0; i < width; ++i)
+   {
+      AddMinimum(row[i], extremes);
+      AddMaximum(row[i], extremes);
+   }
+}
+
+const FocusKernels scalarKernels =
+{
+   "scalar",
+   MedianOf9RowScalar,
+   EdgeRowScalar,
+   TenengradRowScalar,
+   BrennerRowScalar,
+   SumRowScalar,
+   ExtremesRowScalar
+};
+
+
+#ifdef FOCUSKERNELS_SSE2
+//////////////////////////////////////////////////////////////////////////////
+// SSE2 kernels, 8 pixels at a time
+//
+// SSE2 has no unsigned 16 bit min and max, so the median works on pixels
+// with the top bit flipped, which orders them correctly as signed values.
+
+inline __m128i Load8(const unsigned short* p)
+{
+   return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+inline void Sort2SSE2(__m128i& a, __m128i& b)
+{
+   __m128i t = _mm_min_epi16(a, b);
+   b = _mm_max_epi16(a, b);
+   a = t;
+}
+
+inline __m128i Median3SSE2(__m128i a, __m128i b, __m128i c)
+{
+   return _mm_max_epi16(_mm_min_epi16(a, b), _mm_min_epi16(_mm_max_epi16(a, b), c));
+}
+
+// adds the squares of the four 32 bit lanes of v to the two 64 bit lanes of acc
+inline __m128i AddSquaresSSE2(__m128i acc, __m128i v)
+{
+   __m128i sign = _mm_srai_epi32(v, 31);
+   __m128i a = _mm_sub_epi32(_mm_xor_si128(v, sign), sign);
+   __m128i odd = _mm_srli_epi64(a, 32);
+   return _mm_add_epi64(acc, _mm_add_epi64(_mm_mul_epu32(a, a), _mm_mul_epu32(odd, odd)));
+}
+
+inline uint64_t HorizontalSumSSE2(__m128i acc)
+{
+   uint64_t lanes[2];
+   _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+   return lanes[0] + lanes[1];
+}
+
+void MedianOf9RowSSE2(const unsigned short* above, const unsigned short* row,
+      const unsigned short* below, unsigned short* out, int width)
+{
+   const __m128i bias = _mm_set1_epi16((short)0x8000);
+   int i = 0;
+   for (; i + 8 <= width; i += 8)
+   {
+      __m128i lo[3], mid[3], hi[3];
+      for (int k = 0; k < 3; ++k)
+      {
+         __m128i a = _mm_xor_si128(Load8(above + i + k), bias);
+         __m128i b = _mm_xor_si128(Load8(row + i + k), bias);
+         __m128i c = _mm_xor_si128(Load8(below + i + k), bias);
+         Sort2SSE2(a, b);
+         Sort2SSE2(b, c);
+         Sort2SSE2(a, b);
+         lo[k] = a;
+         mid[k] = b;
+         hi[k] = c;
+      }
+      __m128i m = Median3SSE2(_mm_max_epi16(_mm_max_epi16(lo[0], lo[1]), lo[2]),
+            Median3SSE2(mid[0], mid[1], mid[2]),
+            _mm_min_epi16(_mm_min_epi16(hi[0], hi[1]), hi[2]));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_xor_si128(m, bias));
+   }
+   MedianOf9RowScalar(above + i, row + i, below + i, out + i, width - i);
+}
+
+// the operands are 32 bit pixels, named as in EdgeRowScalar
+inline __m128i EdgeSquaresSSE2(__m128i acc, __m128i a0, __m128i a1,
+      __m128i b0, __m128i b2, __m128i c1, __m128i c2)
+{
+   __m128i pos = _mm_add_epi32(_mm_add_epi32(b2, c1), _mm_slli_epi32(c2, 1));
+   __m128i neg = _mm_add_epi32(_mm_add_epi32(_mm_slli_epi32(a0, 1), a1), b0);
+   return AddSquaresSSE2(acc, _mm_sub_epi32(pos, neg));
+}
+
+uint64_t EdgeRowSSE2(const unsigned short* a, const unsigned short* b,
+      const unsigned short* c, int width)
+{
+   const __m128i zero = _mm_setzero_si128();
+   __m128i acc = zero;
+   int i = 0;
+   for (; i + 10 <= width; i += 8)
+   {
+      __m128i a0 = Load8(a + i), a1 = Load8(a + i + 1);
+      __m128i b0 = Load8(b + i), b2 = Load8(b + i + 2);
+      __m128i c1 = Load8(c + i + 1), c2 = Load8(c + i + 2);
+      acc = EdgeSquaresSSE2(acc,
+            _mm_unpacklo_epi16(a0, zero), _mm_unpacklo_epi16(a1, zero),
+            _mm_unpacklo_epi16(b0, zero), _mm_unpacklo_epi16(b2, zero),
+            _mm_unpacklo_epi16(c1, zero), _mm_unpacklo_epi16(c2, zero));
+      acc = EdgeSquaresSSE2(acc,
+            _mm_unpackhi_epi16(a0, zero), _mm_unpackhi_epi16(a1, zero),
+            _mm_unpackhi_epi16(b0, zero), _mm_unpackhi_epi16(b2, zero),
+            _mm_unpackhi_epi16(c1, zero), _mm_unpackhi_epi16(c2, zero));
+   }
+   return HorizontalSumSSE2(acc) + EdgeRowScalar(a + i, b + i, c + i, width - i);
+}
+
+// the operands are 32 bit pixels, named as in TenengradRowScalar
+inline __m128i TenengradSquaresSSE2(__m128i acc, __m128i a0, __m128i a1, __m128i a2,
+      __m128i b0, __m128i b2, __m128i c0, __m128i c1, __m128i c2)
+{
+   __m128i gx = _mm_sub_epi32(
+         _mm_add_epi32(_mm_add_epi32(a2, c2), _mm_slli_epi32(b2, 1)),
+         _mm_add_epi32(_mm_add_epi32(a0, c0), _mm_slli_epi32(b0, 1)));
+   __m128i gy = _mm_sub_epi32(
+         _mm_add_epi32(_mm_add_epi32(c0, c2), _mm_slli_epi32(c1, 1)),
+         _mm_add_epi32(_mm_add_epi32(a0, a2), _mm_slli_epi32(a1, 1)));
+   return AddSquaresSSE2(AddSquaresSSE2(acc, gx), gy);
+}
+
+uint64_t TenengradRowSSE2(const unsigned short* a, const unsigned short* b,
+      const unsigned short* c, int width)
+{
+   const __m128i zero = _mm_setzero_si128();
+   __m128i acc = zero;
+   int i = 0;
+   for (; i + 10 <= width; i += 8)
+   {
+      __m128i a0 = Load8(a + i), a1 = Load8(a + i + 1), a2 = Load8(a + i + 2);
+      __m128i b0 = Load8(b + i), b2 = Load8(b + i + 2);
+      __m128i c0 = Load8(c + i), c1 = Load8(c + i + 1), c2 = Load8(c + i + 2);
+      acc = TenengradSquaresSSE2(acc,
+            _mm_unpacklo_epi16(a0, zero), _mm_unpacklo_epi16(a1, zero), _mm_unpacklo_epi16(a2, zero),
+            _mm_unpacklo_epi16(b0, zero), _mm_unpacklo_epi16(b2, zero),
+            _mm_unpacklo_epi16(c0, zero), _mm_unpacklo_epi16(c1, zero), _mm_unpacklo_epi16(c2, zero));
+      acc = TenengradSquaresSSE2(acc,
+            _mm_unpackhi_epi16(a0, zero), _mm_unpackhi_epi16(a1, zero), _mm_unpackhi_epi16(a2, zero),
+            _mm_unpackhi_epi16(b0, zero), _mm_unpackhi_epi16(b2, zero),
+            _mm_unpackhi_epi16(c0, zero), _mm_unpackhi_epi16(c1, zero), _mm_unpackhi_epi16(c2, zero));
+   }
+   return HorizontalSumSSE2(acc) + TenengradRowScalar(a + i, b + i, c + i, width - i);
+}
+
+uint64_t BrennerRowSSE2(const unsigned short* row, int width)
+{
+   const __m128i zero = _mm_setzero_si128();
+   __m128i acc = zero;
+   int i = 0;
+   for (; i + 10 <= width; i += 8)
+   {
+      __m128i r0 = Load8(row + i), r2 = Load8(row + i + 2);
+      acc = AddSquaresSSE2(acc, _mm_sub_epi32(_mm_unpacklo_epi16(r2, zero), _mm_unpacklo_epi16(r0, zero)));
+      acc = AddSquaresSSE2(acc, _mm_sub_epi32(_mm_unpackhi_epi16(r2, zero), _mm_unpackhi_epi16(r0, zero)));
+   }
+   return HorizontalSumSSE2(acc) + BrennerRowScalar(row + i, width - i);
+}
+
+void SumRowSSE2(const unsigned short* row, int width, uint64_t& sum, uint64_t& sumOfSquares)
+{
+   const __m128i zero = _mm_setzero_si128();
+   const __m128i lowBytes = _mm_set1_epi16(0x00ff);
+   __m128i sumAcc = zero;
+   __m128i squaresAcc = zero;
+   int i = 0;
+   for (; i + 8 <= width; i += 8)
+   {
+      __m128i v = Load8(row + i);
+      // sum the low and the high bytes separately
+      sumAcc = _mm_add_epi64(sumAcc, _mm_sad_epu8(_mm_and_si128(v, lowBytes), zero));
+      sumAcc = _mm_add_epi64(sumAcc, _mm_slli_epi64(_mm_sad_epu8(_mm_srli_epi16(v, 8), zero), 8));
+      squaresAcc = AddSquaresSSE2(squaresAcc, _mm_unpacklo_epi16(v, zero));
+      squaresAcc = AddSquaresSSE2(squaresAcc, _mm_unpackhi_epi16(v, zero));
+   }
+   sum += HorizontalSumSSE2(sumAcc);
+   sumOfSquares += HorizontalSumSSE2(squaresAcc);
+   SumRowScalar(row + i, width - i, sum, sumOfSquares);
+}
+
+// Keeps the two smallest and two largest values of each lane, then merges
+// the lanes. The lanes start out empty, with the smallest and largest
+// values as placeholders.
+void ExtremesRowSSE2(const unsigned short* row, int width, unsigned short extremes[4])
+{
+   const __m128i bias = _mm_set1_epi16((short)0x8000);
+   __m128i lanes[4];
+   lanes[0] = lanes[1] = _mm_set1_epi16(0x7fff); // 0xffff biased
+   lanes[2] = lanes[3] = bias; // 0 biased
+   int i = 0;
+   for (; i + 8 <= width; i += 8)
+   {
+      __m128i v = _mm_xor_si128(Load8(row + i), bias);
+      lanes[1] = _mm_min_epi16(lanes[1], _mm_max_epi16(lanes[0], v));
+      lanes[0] = _mm_min_epi16(lanes[0], v);
+      lanes[3] = _mm_max_epi16(lanes[3], _mm_min_epi16(lanes[2], v));
+      lanes[2] = _mm_max_epi16(lanes[2], v);
+   }
+   unsigned short values[4][8];
+   for (int k = 0; k < 4; ++k)
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(values[k]), _mm_xor_si128(lanes[k], bias));
+   for (int j = 0; j < 8; ++j)
+   {
+      AddMinimum(values[0][j], extremes);
+      AddMinimum(values[1][j], extremes);
+      AddMaximum(values[2][j], extremes);
+      AddMaximum(values[3][j], extremes);
+   }
+   ExtremesRowScalar(row + i, width - i, extremes);
+}
+
+const FocusKernels sse2Kernels =
+{
+   "SSE2",
+   MedianOf9RowSSE2,
+   EdgeRowSSE2,
+   TenengradRowSSE2,
+   BrennerRowSSE2,
+   SumRowSSE2,
+   ExtremesRowSSE2
+};
+#endif // FOCUSKERNELS_SSE2
+
+
+#ifdef FOCUSKERNELS_AVX2
+//////////////////////////////////////////////////////////////////////////////
+// AVX2 kernels, 16 pixels at a time. The unpacks interleave within 128 bit
+// lanes, which does not matter here because all operands are unpacked alike
+// and only sums are kept.
+
+FOCUSKERNELS_AVX2_TARGET
+inline __m256i Load16(const unsigned short* p)
+{
+   return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+FOCUSKERNELS_AVX2_TARGET
+inline void Sort2AVX2(__m256i& a, __m256i& b)
+{
+   __m256i t = _mm256_min_epu16(a, b);
+   b = _mm256_max_epu16(a, b);
+   a = t;
+}
+
+FOCUSKERNELS_AVX2_TARGET
+inline __m256i Median3AVX2(__m256i a, __m256i b, __m256i c)
+{
+   return _mm256_max_epu16(_mm256_min_epu16(a, b), _mm256_min_epu16(_mm256_max_epu16(a, b), c));
+}
+
+FOCUSKERNELS_AVX2_TARGET
+inline __m256i AddSquaresAVX2(__m256i acc, __m256i v)
+{
+   __m256i a = _mm256_abs_epi32(v);
+   __m256i odd = _mm256_srli_epi64(a, 32);
+   return _mm256_add_epi64(acc, _mm256_add_epi64(_mm256_mul_epu32(a, a), _mm256_mul_epu32(odd, odd)));
+}
+
+FOCUSKERNELS_AVX2_TARGET
+inline uint64_t HorizontalSumAVX2(__m256i acc)
+{
+   uint64_t lanes[4];
+   _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc);
+   return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+FOCUSKERNELS_AVX2_TARGET
+void MedianOf9RowAVX2(const unsigned short* above, const unsigned short* row,
+      const unsigned short* below, unsigned short* out, int width)
+{
+   int i = 0;
+   for (; i + 16 <= width; i += 16)
+   {
+      __m256i lo[3], mid[3], hi[3];
+      for (int k = 0; k < 3; ++k)
+      {
+         __m256i a = Load16(above + i + k);
+         __m256i b = Load16(row + i + k);
+         __m256i c = Load16(below + i + k);
+         Sort2AVX2(a, b);
+         Sort2AVX2(b, c);
+         Sort2AVX2(a, b);
+         lo[k] = a;
+         mid[k] = b;
+         hi[k] = c;
+      }
+      __m256i m = Median3AVX2(_mm256_max_epu16(_mm256_max_epu16(lo[0], lo[1]), lo[2]),
+            Median3AVX2(mid[0], mid[1], mid[2]),
+            _mm256_min_epu16(_mm256_min_epu16(hi[0], hi[1]), hi[2]));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), m);
+   }
+   MedianOf9RowSSE2(above + i, row + i, below + i, out + i, width - i);
+}
+
+FOCUSKERNELS_AVX2_TARGET
+inline __m256i EdgeSquaresAVX2(__m256i acc, __m256i a0, __m256i a1,
+      __m256i b0, __m256i b2, __m256i c1, __m256i c2)
+{
+   __m256i pos = _mm256_add_epi32(_mm256_add_epi32(b2, c1), _mm256_slli_epi32(c2, 1));
+   __m256i neg = _mm256_add_epi32(_mm256_add_epi32(_mm256_slli_epi32(a0, 1), a1), b0);
+   return AddSquaresAVX2(acc, _mm256_sub_epi32(pos, neg));
+}
+
+FOCUSKERNELS_AVX2_TARGET
+uint64_t EdgeRowAVX2(const unsigned short* a, const unsigned short* b,
+      const unsigned short* c, int width)
+{
+   const __m256i zero = _mm256_setzero_si256();
+   __m256i acc = zero;
+   int i = 0;
+   for (; i + 18 <= width; i += 16)
+   {
+      __m256i a0 = Load16(a + i), a1 = Load16(a + i + 1);
+      __m256i b0 = Load16(b + i), b2 = Load16(b + i + 2);
+      __m256i c1 = Load16(c + i + 1), c2 = Load16(c + i + 2);
+      acc = EdgeSquaresAVX2(acc,
+            _mm256_unpacklo_epi16(a0, zero), _mm256_unpacklo_epi16(a1, zero),
+            _mm256_unpacklo_epi16(b0, zero), _mm256_unpacklo_epi16(b2, zero),
+            _mm256_unpacklo_epi16(c1, zero), _mm256_unpacklo_epi16(c2, zero));
+      acc = EdgeSquaresAVX2(acc,
+            _mm256_unpackhi_epi16(a0, zero), _mm256_unpackhi_epi16(a1, zero),
+            _mm256_unpackhi_epi16(b0, zero), _mm256_unpackhi_epi16(b2, zero),
+            _mm256_unpackhi_epi16(c1, zero), _mm256_unpackhi_epi16(c2, zero));
+   }
+   return HorizontalSumAVX2(acc) + EdgeRowSSE2(a + i, b + i, c + i, width - i);
+}
+
+FOCUSKERNELS_AVX2_TARGET
+inline __m256i TenengradSquaresAVX2(__m256i acc, __m256i a0, __m256i a1, __m256i a2,
+      __m256i b0, __m256i b2, __m256i c0, __m256i c1, __m256i c2)
+{
+   __m256i gx = _mm256_sub_epi32(
+         _mm256_add_epi32(_mm256_add_epi32(a2, c2), _mm256_slli_epi32(b2, 1)),
+         _mm256_add_epi32(_mm256_add_epi32(a0, c0), _mm256_slli_epi32(b0, 1)));
+   __m256i gy = _mm256_sub_epi32(
+         _mm256_add_epi32(_mm256_add_epi32(c0, c2), _mm256_slli_epi32(c1, 1)),
+         _mm256_add_epi32(_mm256_add_epi32(a0, a2), _mm256_slli_epi32(a1, 1)));
+   return AddSquaresAVX2(AddSquaresAVX2(acc, gx), gy);
+}
+
+FOCUSKERNELS_AVX2_TARGET
+uint64_t TenengradRowAVX2(const unsigned short* a, const unsigned short* b,
+      const unsigned short* c, int width)
+{
+   const __m256i zero = _mm256_setzero_si256();
+   __m256i acc = zero;
+   int i = 0;
+   for (; i + 18 <= width; i += 16)
+   {
+      __m256i a0 = Load16(a + i), a1 = Load16(a + i + 1), a2 = Load16(a + i + 2);
+      __m256i b0 = Load16(b + i), b2 = Load16(b + i + 2);
+      __m256i c0 = Load16(c + i), c1 = Load16(c + i + 1), c2 = Load16(c + i + 2);
+      acc = TenengradSquaresAVX2(acc,
+            _mm256_unpacklo_epi16(a0, zero), _mm256_unpacklo_epi16(a1, zero), _mm256_unpacklo_epi16(a2, zero),
+            _mm256_unpacklo_epi16(b0, zero), _mm256_unpacklo_epi16(b2, zero),
+            _mm256_unpacklo_epi16(c0, zero), _mm256_unpacklo_epi16(c1, zero), _mm256_unpacklo_epi16(c2, zero));
+      acc = TenengradSquaresAVX2(acc,
+            _mm256_unpackhi_epi16(a0, zero), _mm256_unpackhi_epi16(a1, zero), _mm256_unpackhi_epi16(a2, zero),
+            _mm256_unpackhi_epi16(b0, zero), _mm256_unpackhi_epi16(b2, zero),
+            _mm256_unpackhi_epi16(c0, zero), _mm256_unpackhi_epi16(c1, zero), _mm256_unpackhi_epi16(c2, zero));
+   }
+   return HorizontalSumAVX2(acc) + TenengradRowSSE2(a + i, b + i, c + i, width - i);
+}
+
+FOCUSKERNELS_AVX2_TARGET
+uint64_t BrennerRowAVX2(const unsigned short* row, int width)
+{
+   const __m256i zero = _mm256_setzero_si256();
+   __m256i acc = zero;
+   int i = 0;
+   for (; i + 18 <= width; i += 16)
+   {
+      __m256i r0 = Load16(row + i), r2 = Load16(row + i + 2);
+      acc = AddSquaresAVX2(acc, _mm256_sub_epi32(_mm256_unpacklo_epi16(r2, zero), _mm256_unpacklo_epi16(r0, zero)));
+      acc = AddSquaresAVX2(acc, _mm256_sub_epi32(_mm256_unpackhi_epi16(r2, zero), _mm256_unpackhi_epi16(r0, zero)));
+   }
+   return HorizontalSumAVX2(acc) + BrennerRowSSE2(row + i, width - i);
+}
+
+FOCUSKERNELS_AVX2_TARGET
+void SumRowAVX2(const unsigned short* row, int width, uint64_t& sum, uint64_t& sumOfSquares)
+{
+   const __m256i zero = _mm256_setzero_si256();
+   const __m256i lowBytes = _mm256_set1_epi16(0x00ff);
+   __m256i sumAcc = zero;
+   __m256i squaresAcc = zero;
+   int i = 0;
+   for (; i + 16 <= width; i += 16)
+   {
+      __m256i v = Load16(row + i);
+      sumAcc = _mm256_add_epi64(sumAcc, _mm256_sad_epu8(_mm256_and_si256(v, lowBytes), zero));
+      sumAcc = _mm256_add_epi64(sumAcc, _mm256_slli_epi64(_mm256_sad_epu8(_mm256_srli_epi16(v, 8), zero), 8));
+      squaresAcc = AddSquaresAVX2(squaresAcc, _mm256_unpacklo_epi16(v, zero));
+      squaresAcc = AddSquaresAVX2(squaresAcc, _mm256_unpackhi_epi16(v, zero));
+   }
+   sum += HorizontalSumAVX2(sumAcc);
+   sumOfSquares += HorizontalSumAVX2(squaresAcc);
+   SumRowSSE2(row + i, width - i, sum, sumOfSquares);
+}
+
+FOCUSKERNELS_AVX2_TARGET
+void ExtremesRowAVX2(const unsigned short* row, int width, unsigned short extremes[4])
+{
+   __m256i lanes[4];
+   lanes[0] = lanes[1] = _mm256_set1_epi16((short)0xffff);
+   lanes[2] = lanes[3] = _mm256_setzero_si256();
+   int i = 0;
+   for (; i + 16 <= width; i += 16)
+   {
+      __m256i v = Load16(row + i);
+      lanes[1] = _mm256_min_epu16(lanes[1], _mm256_max_epu16(lanes[0], v));
+      lanes[0] = _mm256_min_epu16(lanes[0], v);
+      lanes[3] = _mm256_max_epu16(lanes[3], _mm256_min_epu16(lanes[2], v));
+      lanes[2] = _mm256_max_epu16(lanes[2], v);
+   }
+   unsigned short values[4][16];
+   for (int k = 0; k < 4; ++k)
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(values[k]), lanes[k]);
+   for (int j = 0; j < 16; ++j)
+   {
+      AddMinimum(values[0][j], extremes);
+      AddMinimum(values[1][j], extremes);
+      AddMaximum(values[2][j], extremes);
+      AddMaximum(values[3][j], extremes);
+   }
+   ExtremesRowSSE2(row + i, width - i, extremes);
+}
+
+const FocusKernels avx2Kernels =
+{
+   "AVX2",
+   MedianOf9RowAVX2,
+   EdgeRowAVX2,
+   TenengradRowAVX2,
+   BrennerRowAVX2,
+   SumRowAVX2,
+   ExtremesRowAVX2
+};
+
+bool CpuSupportsAVX2()
+{
+#if defined(_MSC_VER)
+   int info[4];
+   __cpuid(info, 0);
+   if (info[0] < 7)
+      return false;
+   // the OS must also save the AVX registers on context switches
+   __cpuid(info, 1);
+   const int osxsaveAndAVX = (1 << 27) | (1 << 28);
+   if ((info[2] & osxsaveAndAVX) != osxsaveAndAVX || (_xgetbv(0) & 6) != 6)
+      return false;
+   __cpuidex(info, 7, 0);
+   return (info[1] & (1 << 5)) != 0;
+#else
+   __builtin_cpu_init();
+   return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif // FOCUSKERNELS_AVX2
+
+const FocusKernels* const bestKernels = GetAvailableFocusKernels().back();
+
+} // anonymous namespace
+
+
+const FocusKernels& GetFocusKernels()
+{
+   return *bestKernels;
+}
+
+std::vector<const FocusKernels*> GetAvailableFocusKernels()
+{
+   std::vector<const FocusKernels*> kernels;
+   kernels.push_back(&scalarKernels);
+#ifdef FOCUSKERNELS_SSE2
+   kernels.push_back(&sse2Kernels);
+#endif
+#ifdef FOCUSKERNELS_AVX2
+   if (CpuSupportsAVX2())
+      kernels.push_back(&avx2Kernels);
+#endif
+   return kernels;
+}
@@ -0,0 +1,65 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          FocusKernels.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Per-row image kernels for the focus scores, with scalar,
+//                SSE2 and AVX2 implementations
+// COPYRIGHT:     Micro-Manager contributors, 2026
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+
+#ifndef _FOCUSKERNELS_H_
+#define _FOCUSKERNELS_H_
+
+#include <stdint.h>
+#include <vector>
+
+// All kernels work on 16 bit pixels and accumulate in exact integer
+// arithmetic, so every implementation gives identical results.
+//
+// The three row kernels take the rows above, at and below the output row.
+struct FocusKernels
+{
+   const char* name;
+
+   // 3x3 median filter. The input rows are width + 2 pixels wide; out[i] is
+   // the median of columns i, i+1 and i+2.
+   void (*medianOf9Row)(const unsigned short* above, const unsigned short* row,
+         const unsigned short* below, unsigned short* out, int width);
+
+   // Sum of squares of the [-2 -1 0; -1 0 1; 0 1 2] convolution over columns
+   // 1 .. width-2
+   uint64_t (*edgeRow)(const unsigned short* above, const unsigned short* row,
+         const unsigned short* below, int width);
+
+   // Sum of the squared Sobel gradient magnitude over columns 1 .. width-2
+   uint64_t (*tenengradRow)(const unsigned short* above, const unsigned short* row,
+         const unsigned short* below, int width);
+
+   // Sum of (row[i+2] - row[i])^2
+   uint64_t (*brennerRow)(const unsigned short* row, int width);
+
+   void (*sumRow)(const unsigned short* row, int width, uint64_t& sum, uint64_t& sumOfSquares);
+
+   // Updates the smallest, second smallest, largest and second largest
+   // values seen, in that order
+   void (*extremesRow)(const unsigned short* row, int width, unsigned short extremes[4]);
+};
+
+// The fastest implementation this processor supports
+const FocusKernels& GetFocusKernels();
+
+// All implementations this processor supports, scalar first, fastest last
+std::vector<const FocusKernels*> GetAvailableFocusKernels();
+
+#endif // _FOCUSKERNELS_H_
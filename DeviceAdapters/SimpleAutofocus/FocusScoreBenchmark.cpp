@@ -0,0 +1,157 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          FocusScoreBenchmark.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Checks that the vector focus score kernels agree with the
+//                scalar ones and reports the scoring speed of each sharpness
+//                metric, in megapixels per second
+// COPYRIGHT:     Micro-Manager contributors, 2026
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// Build with "make FocusScoreBenchmark" in this directory, then run
+//
+//   FocusScoreBenchmark [width height [repetitions [max threads]]]
+//
+// The defaults are a 2048 x 2048 image, 10 repetitions and up to 8 threads.
+// The whole image is scored (crop factor 1).
+
+#include "SimpleAutofocus.h"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+namespace {
+
+const char* const metricNames[] = { "MedianEdge", "Brenner", "NormalizedVariance", "Tenengrad" };
+const int metricCount = sizeof(metricNames) / sizeof(metricNames[0]);
+
+// a defocused-looking pattern of blobs with shot-like noise
+std::vector<unsigned short> MakeImage(int width, int height)
+{
+   std::vector<unsigned short> img((size_t)width * height);
+   unsigned int state = 12345;
+   for (int y = 0; y < height; ++y)
+   {
+      for (int x = 0; x < width; ++x)
+      {
+         double signal = 1000. + 800. * sin(x * 0.05) * cos(y * 0.07) + 400. * sin((x + y) * 0.013);
+         state = state * 1664525u + 1013904223u;
+         double noise = ((state >> 16) & 0xff) - 127.5;
+         img[(size_t)y * width + x] = (unsigned short)std::max(0., signal + noise);
+      }
+   }
+   return img;
+}
+
+bool Agree(const FocusScore& a, const FocusScore& b)
+{
+   return a.mean == b.mean && a.standardDeviationOverMean == b.standardDeviationOverMean &&
+      a.sharpness == b.sharpness && a.dynamicRange == b.dynamicRange;
+}
+
+// All kernels and thread counts must give identical scores, including for
+// regions that touch the image border and widths that are not a multiple of
+// the vector length.
+int CheckKernels(const std::vector<const FocusKernels*>& kernels)
+{
+   const int w0 = 301, h0 = 97;
+   std::vector<unsigned short> img = MakeImage(w0, h0);
+   img[5] = 65535;
+   img[w0 * 3 + 7] = 0;
+   const double cropFactors[] = { 1., 0.5, 0.05 };
+
+   int failures = 0;
+   for (int m = 0; m < metricCount; ++m)
+   {
+      for (size_t c = 0; c < sizeof(cropFactors) / sizeof(cropFactors[0]); ++c)
+      {
+         int ow, oh, width, height;
+         GetCropRegion(w0, h0, cropFactors[c], ow, oh, width, height);
+         FocusScore reference;
+         ComputeFocusScore(&img[0], w0, h0, ow, oh, width, height,
+               static_cast<FocusMetric>(m), 0, reference, *kernels[0]);
+         for (size_t k = 0; k < kernels.size(); ++k)
+         {
+            for (unsigned threads = 1; threads <= 3; ++threads)
+            {
+               ScoreBandWorkers workers(threads);
+               FocusScore score;
+               ComputeFocusScore(&img[0], w0, h0, ow, oh, width, height,
+                     static_cast<FocusMetric>(m), &workers, score, *kernels[k]);
+               if (!Agree(score, reference))
+               {
+                  printf("MISMATCH: %s, %s kernels, %u threads, crop factor %g\n",
+                        metricNames[m], kernels[k]->name, threads, cropFactors[c]);
+                  ++failures;
+               }
+            }
+         }
+      }
+   }
+   return failures;
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char** argv)
+{
+   int width = 2048, height = 2048, repetitions = 10;
+   unsigned maxThreads = 8;
+   if (argc > 2)
+   {
+      width = atoi(argv[1]);
+      height = atoi(argv[2]);
+   }
+   if (argc > 3)
+      repetitions = atoi(argv[3]);
+   if (argc > 4)
+      maxThreads = (unsigned)atoi(argv[4]);
+   if (width < 3 || height < 3 || repetitions < 1 || maxThreads < 1)
+   {
+      fprintf(stderr, "usage: %s [width height [repetitions [max threads]]]\n", argv[0]);
+      return 2;
+   }
+
+   std::vector<const FocusKernels*> kernels = GetAvailableFocusKernels();
+   int failures = CheckKernels(kernels);
+   printf("kernel check: %s\n\n", failures == 0 ? "all kernels agree" : "FAILED");
+
+   std::vector<unsigned short> img = MakeImage(width, height);
+   const double megapixels = (double)width * height * 1e-6;
+   printf("%d x %d image, %d repetitions\n", width, height, repetitions);
+   printf("%-20s %-8s %8s %10s %10s\n", "metric", "kernels", "threads", "ms/image", "MP/s");
+   for (int m = 0; m < metricCount; ++m)
+   {
+      for (size_t k = 0; k < kernels.size(); ++k)
+      {
+         for (unsigned threads = 1; threads <= maxThreads; threads *= 2)
+         {
+            ScoreBandWorkers workers(threads);
+            FocusScore score;
+            boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+            for (int r = 0; r < repetitions; ++r)
+            {
+               ComputeFocusScore(&img[0], width, height, 0, 0, width, height,
+                     static_cast<FocusMetric>(m), &workers, score, *kernels[k]);
+            }
+            double ms = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() * 1e-3 / repetitions;
+            printf("%-20s %-8s %8u %10.2f %10.1f\n", metricNames[m], kernels[k]->name, threads, ms, megapixels / (ms * 1e-3));
+         }
+      }
+   }
+   return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ScoringPool.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Scores autofocus images on worker threads, so that the next
+//                image can be acquired while earlier ones are evaluated
+// COPYRIGHT:     Micro-Manager contributors, 2026
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+
+#include "ScoringPool.h"
+
+#include <string.h>
+
+ScoringPool::ScoringPool(unsigned nThreads, int w0, int h0, double cropFactor, FocusMetric metric) :
+   w0_(w0),
+   h0_(h0),
+   metric_(metric),
+   closed_(false)
+{
+   GetCropRegion(w0, h0, cropFactor, ow_, oh_, width_, height_);
+
+   // the median filter reads one pixel beyond the region
+   cutX_ = std::max(0, ow_ - 1);
+   cutY_ = std::max(0, oh_ - 1);
+   cutWidth_ = std::min(w0, ow_ + width_ + 1) - cutX_;
+   cutHeight_ = std::min(h0, oh_ + height_ + 1) - cutY_;
+
+   if (nThreads < 1)
+      nThreads = 1;
+   for (unsigned i = 0; i < nThreads; ++i)
+   {
+      workers_.push_back(new Worker(this));
+      workers_.back()->activate();
+   }
+}
+
+ScoringPool::~ScoringPool()
+{
+   WaitAll();
+   for (std::vector<Job*>::iterator it = jobs_.begin(); it != jobs_.end(); ++it)
+      delete *it;
+}
+
+void ScoringPool::Submit(int seqNo, double z, const unsigned short* img)
+{
+   Job* job = new Job();
+   job->result.seqNo = seqNo;
+   job->result.z = z;
+   job->pixels.resize((size_t)cutWidth_ * cutHeight_);
+   for (int j = 0; j < cutHeight_; ++j)
+   {
+      memcpy(&job->pixels[(size_t)j * cutWidth_], img + (size_t)(cutY_ + j) * w0_ + cutX_,
+            cutWidth_ * sizeof(unsigned short));
+   }
+
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      jobs_.push_back(job);
+      pending_.push_back(job);
+   }
+   workCond_.notify_one();
+}
+
+const std::vector<ScoringPool::Result>& ScoringPool::WaitAll()
+{
+   if (!workers_.empty())
+   {
+      {
+         boost::lock_guard<boost::mutex> lock(mutex_);
+         closed_ = true;
+      }
+      workCond_.notify_all();
+      for (std::vector<Worker*>::iterator it = workers_.begin(); it != workers_.end(); ++it)
+      {
+         (*it)->wait();
+         delete *it;
+      }
+      workers_.clear();
+
+      results_.clear();
+      for (std::vector<Job*>::iterator it = jobs_.begin(); it != jobs_.end(); ++it)
+         results_.push_back((*it)->result);
+   }
+   return results_;
+}
+
+ScoringPool::Job* ScoringPool::NextJob()
+{
+   boost::unique_lock<boost::mutex> lock(mutex_);
+   while (pending_.empty() && !closed_)
+      workCond_.wait(lock);
+   if (pending_.empty())
+      return 0;
+   Job* job = pending_.front();
+   pending_.pop_front();
+   return job;
+}
+
+int ScoringPool::Worker::svc()
+{
+   ScoringPool* p = pool_;
+   // the pool already keeps the processors busy, so each image is scored on
+   // this thread only
+   for (Job* job = p->NextJob(); job != 0; job = p->NextJob())
+   {
+      ComputeFocusScore(&job->pixels[0], p->cutWidth_, p->cutHeight_,
+            p->ow_ - p->cutX_, p->oh_ - p->cutY_, p->width_, p->height_,
+            p->metric_, 0, job->result.score);
+   }
+   return 0;
+}
@@ -0,0 +1,88 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ScoringPool.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Scores autofocus images on worker threads, so that the next
+//                image can be acquired while earlier ones are evaluated
+// COPYRIGHT:     Micro-Manager contributors, 2026
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+
+#ifndef _SCORINGPOOL_H_
+#define _SCORINGPOOL_H_
+
+#include "SimpleAutofocus.h"
+#include "../../MMDevice/DeviceThreads.h"
+
+#include <boost/thread.hpp>
+
+#include <deque>
+#include <vector>
+
+class ScoringPool
+{
+public:
+   struct Result
+   {
+      int seqNo;
+      double z;
+      FocusScore score;
+   };
+
+   // All images submitted must be w0 x h0
+   ScoringPool(unsigned nThreads, int w0, int h0, double cropFactor, FocusMetric metric);
+   ~ScoringPool();
+
+   // Copies the scored region of the image (with a 1 pixel border) and
+   // returns immediately
+   void Submit(int seqNo, double z, const unsigned short* img);
+
+   // Waits until all submitted images are scored and stops the workers.
+   // Results are in order of submission.
+   const std::vector<Result>& WaitAll();
+
+private:
+   struct Job
+   {
+      std::vector<unsigned short> pixels; // the cut-out
+      Result result;
+   };
+
+   class Worker : public MMDeviceThreadBase
+   {
+   public:
+      Worker(ScoringPool* pool) : pool_(pool) {}
+      int svc();
+   private:
+      ScoringPool* pool_;
+   };
+
+   // waits for a job; returns 0 when there is no more work
+   Job* NextJob();
+
+   int w0_, h0_;
+   // region to score, in the full image and in the cut-out
+   int ow_, oh_, width_, height_;
+   int cutX_, cutY_, cutWidth_, cutHeight_;
+   FocusMetric metric_;
+
+   std::vector<Worker*> workers_;
+   std::vector<Job*> jobs_;
+   std::deque<Job*> pending_;
+   bool closed_;
+   boost::mutex mutex_;
+   boost::condition_variable workCond_; // signaled by Submit() and WaitAll()
+   std::vector<Result> results_;
+};
+
+#endif // _SCORINGPOOL_H_
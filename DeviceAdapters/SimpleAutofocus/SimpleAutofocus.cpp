@@ -31,6 +31,7 @@
 
 
 #include "SimpleAutofocus.h"
+#include "ScoringPool.h"
 #include <string>
 #include <math.h>
 #include <sstream>
@@ -61,6 +62,9 @@ const char* g_FocusMonitorDeviceName = "FocusMonitor";
 
 const bool messageDebug = false;
 
+// values of the SharpnessMetric property, in the order of FocusMetric
+const char* const g_FocusMetricNames[] = { "MedianEdge", "Brenner", "NormalizedVariance", "Tenengrad" };
+
 class SAFPoint
 {
 public:
@@ -96,6 +100,7 @@ private:
 class SAFData
 {
    std::set< SAFPoint > points_;
+   std::vector< std::pair<std::string, double> > phaseTimes_;
 
 public:
    void InsertPoint( int seqNo, float z, float meanValue,float stdOverMeanScore,  double hiPassScore, float normalizedDynamicRange)
@@ -109,9 +114,15 @@ public:
 
    // default dtor is ok
 
+   void InsertPhaseTime(const std::string& phase, double milliseconds)
+   {
+      phaseTimes_.push_back(std::make_pair(phase, milliseconds));
+   }
+
    void Clear()
    {
       points_.clear();
+      phaseTimes_.clear();
    }
    const std::string Table()
    {
@@ -123,6 +134,12 @@ public:
          data << "\n";
          data << ii->DataRow();
       }
+      if (!phaseTimes_.empty())
+      {
+         data << "\nPhase\tms";
+         for (size_t i = 0; i < phaseTimes_.size(); ++i)
+            data << "\n" << phaseTimes_[i].first << "\t" << std::setprecision(5) << phaseTimes_[i].second;
+      }
       return data.str();
    }
 };
@@ -185,13 +202,14 @@ SimpleAutofocus::SimpleAutofocus(const char* name) :
    latestSharpness_(0.), 
    enableAutoShuttering_(1),
    sizeOfTempShortBuffer_(0), 
-   pSmoothedIm_(NULL), 
-   sizeOfSmoothedIm_(0), 
    pShort_(NULL),
    recalculate_(0), 
    mean_(0.), 
    standardDeviationOverMean_(0.),
    pPoints_(NULL), 
+   scoringThreads_(4),
+   scoringWorkers_(NULL),
+   metric_(FocusMetricMedianEdge),
    exposureForAutofocusAcquisition_(0.), 
    binningForAutofocusAcquisition_(0)
 {
@@ -206,10 +224,9 @@ int SimpleAutofocus::Shutdown()
 SimpleAutofocus::~SimpleAutofocus()
 {
    delete pPoints_;
+   delete scoringWorkers_;
    if( NULL!=pShort_)
       free(pShort_);
-   if(NULL!=pSmoothedIm_)
-      free(pSmoothedIm_);
    Shutdown();
 }
 
@@ -309,7 +326,17 @@ int SimpleAutofocus::Initialize()
    CreateProperty("SearchAlgorithm","Brent",MM::String, false, pAct);
    AddAllowedValue("SearchAlgorithm","Brent");
    AddAllowedValue("SearchAlgorithm","BruteForce");
+   AddAllowedValue("SearchAlgorithm","PipelinedSweep");
    searchAlgorithm_ = "Brent";
+   // each image is scored on this many threads; the PipelinedSweep scores
+   // this many images at a time instead
+   pAct = new CPropertyAction(this, &SimpleAutofocus::OnScoringThreads);
+   CreateProperty("ScoringThreads","4",MM::Integer, false, pAct);
+   SetPropertyLimits("ScoringThreads", 1, 16);
+   pAct = new CPropertyAction(this, &SimpleAutofocus::OnSharpnessMetric);
+   CreateProperty("SharpnessMetric", g_FocusMetricNames[FocusMetricMedianEdge], MM::String, false, pAct);
+   for (size_t i = 0; i < sizeof(g_FocusMetricNames) / sizeof(g_FocusMetricNames[0]); ++i)
+      AddAllowedValue("SharpnessMetric", g_FocusMetricNames[i]);
    UpdateStatus();
    return DEVICE_OK;
 }
@@ -405,6 +432,10 @@ int SimpleAutofocus::FullFocus()
    {
       retval =  BruteForceSearch();
    }
+   else if( searchAlgorithm_ == "PipelinedSweep")
+   {
+      retval =  PipelinedSweepSearch();
+   }
    int tret = pCore_->SetDeviceProperty(shutterDeviceName, MM::g_Keyword_State, previousShutterState); 
    if( DEVICE_OK != tret)
       LogMessage("Error closing shutter upon exiting FullFocus",false);
@@ -610,6 +641,40 @@ int SimpleAutofocus::OnSearchAlgorithm(MM::PropertyBase* pProp, MM::ActionType e
 }
 
 
+int SimpleAutofocus::OnScoringThreads(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(scoringThreads_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(scoringThreads_);
+   }
+   return DEVICE_OK;
+}
+
+
+int SimpleAutofocus::OnSharpnessMetric(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(g_FocusMetricNames[metric_]);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string name;
+      pProp->Get(name);
+      for (size_t i = 0; i < sizeof(g_FocusMetricNames) / sizeof(g_FocusMetricNames[0]); ++i)
+      {
+         if (name == g_FocusMetricNames[i])
+            metric_ = static_cast<FocusMetric>(i);
+      }
+   }
+   return DEVICE_OK;
+}
+
+
 int SimpleAutofocus::OnChannel(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
    if (eAct == MM::BeforeGet)
@@ -700,216 +765,66 @@ int SimpleAutofocus::OnMean(MM::PropertyBase* pProp, MM::ActionType eAct)
 
 
 
-double SimpleAutofocus::SharpnessAtZ(const double z)
+bool SimpleAutofocus::AcquireImage(int& w0, int& h0)
 {
-   MMThreadGuard g(busyLock_);
-   busy_ = true;
-   Z(z);
-   min1_ = 1.e8;
-   min2_ = 1.e8;
-   max1_ = -1.e8;
-   max2_ = -1.e8;
-   // the crop factor, median filter and 3x3 high-pass process follows the java implementation from Pakpoom Subsoontorn & Hernan Garcia  -- KH
-   int w0 = 0, h0 = 0, d0 = 0;
-   double sharpness = 0;
+   int d0 = 0;
    pCore_->GetImageDimensions(w0, h0, d0);
-   int width =  (int)(cropFactor_*w0);
-   int height = (int)(cropFactor_*h0);
-   int ow = (int)(((1-cropFactor_)/2)*w0);
-   int oh = (int)(((1-cropFactor_)/2)*h0);
-   const unsigned long thisSize = sizeof(*pSmoothedIm_)*width*height;
-   if( thisSize != sizeOfSmoothedIm_)
-   {
-      if(NULL!=pSmoothedIm_)
-         free(pSmoothedIm_);
-      // malloc is faster than new...
-      pSmoothedIm_ = (float*)malloc(thisSize);
-      if(NULL!=pSmoothedIm_)
-      {
-         sizeOfSmoothedIm_ = thisSize;
-      }
-      else // todo throw out of here...
-      {
-         busy_=false;
-         return sharpness;
-      }
-   }
-   // copy from MM image to the working buffer
-   ImgBuffer image(w0,h0,d0);
    //snap an image
    const unsigned char* pI = reinterpret_cast<const unsigned char*>(pCore_->GetImage());
    const unsigned short* pSInput = reinterpret_cast<const unsigned short*>(pI);
-   int iindex;
-   bool legalFormat = false;
+   if( 0 == pI || (1 != d0 && 2 != d0))
+      return false;
    // to keep it simple always copy to a short array
-   if( 0 != pSInput)
+   if( sizeOfTempShortBuffer_ != sizeof(unsigned short)*w0*h0)
    {
-      switch( d0)
-      {
-      case 1:
-         legalFormat = true;
-         if( sizeOfTempShortBuffer_ != sizeof(unsigned short)*w0*h0)
-         {
-            if( NULL != pShort_)
-               free(pShort_);
-            // malloc is faster than new...
-            pShort_ = (unsigned short*)malloc( sizeof(unsigned short)*w0*h0);
-            if( NULL!=pShort_)
-            {
-               sizeOfTempShortBuffer_ = sizeof(unsigned short)*w0*h0;
-            }
-         }
-         for(iindex = 0; iindex < w0*h0; ++iindex)
-         {
-            pShort_[iindex] = pI[iindex];
-         }
-         break;
-      case 2:
-         legalFormat = true;
-         if( sizeOfTempShortBuffer_ != sizeof(unsigned short)*w0*h0)
-         {
-            if( NULL != pShort_)
-               free(pShort_);
-            pShort_ = (unsigned short*)malloc( sizeof(unsigned short)*w0*h0);
-            if( NULL!=pShort_)
-            {
-               sizeOfTempShortBuffer_ = sizeof(unsigned short)*w0*h0;
-            }
-         }
-         for(iindex = 0; iindex < w0*h0; ++iindex)
-         {
-            pShort_[iindex] = pSInput[iindex];
-         }
-         break;
-      default:
-         break;
-      }
+      if( NULL != pShort_)
+         free(pShort_);
+      // malloc is faster than new...
+      pShort_ = (unsigned short*)malloc( sizeof(unsigned short)*w0*h0);
+      sizeOfTempShortBuffer_ = 0;
+      if( NULL == pShort_)
+         return false;
+      sizeOfTempShortBuffer_ = sizeof(unsigned short)*w0*h0;
    }
-   if(legalFormat)
+   if( 1 == d0)
    {
-      // calculate the standard deviation & mean
-      long nPts = 0;
-      mean_ = 0;
-      double M2 = 0;
-      double delta;
-      // one-pass algorithm for mean and std from Welford / Knuth  - KH
-      for (int i=0; i<width; i++)
-      {
-         for (int j=0; j<height; j++)
-         {
-            ++nPts;
-            long value = pShort_[ow+i+ width*(oh+j)];
-            delta = value - mean_;
-            mean_ = mean_ + delta/nPts;
-            M2 = M2 + delta*(value - mean_); // #This expression uses the new value of mean_
-         }
-      }
-      //double variance_n = M2/nPts;
-      double variance = M2/(nPts - 1);
-      standardDeviationOverMean_ = 0.;
-      double meanScaling = 1.;
-      if( 0. != mean_)
+      for(int iindex = 0; iindex < w0*h0; ++iindex)
+         pShort_[iindex] = pI[iindex];
+   }
+   else
+   {
+      memcpy(pShort_, pSInput, sizeof(unsigned short)*w0*h0);
+   }
+   return true;
+}
+
+
+double SimpleAutofocus::SharpnessAtZ(const double z)
+{
+   MMThreadGuard g(busyLock_);
+   busy_ = true;
+   Z(z);
+   int w0 = 0, h0 = 0;
+   FocusScore score;
+   if( AcquireImage(w0, h0))
+   {
+      int ow, oh, width, height;
+      GetCropRegion(w0, h0, cropFactor_, ow, oh, width, height);
+      const unsigned nThreads = scoringThreads_ < 1 ? 1 : (unsigned)scoringThreads_;
+      if (NULL == scoringWorkers_ || scoringWorkers_->GetThreadCount() != nThreads)
       {
-         standardDeviationOverMean_ = pow(variance,0.5)/mean_;
-         meanScaling = 1./mean_;
-      }
-      LogMessage("N " + boost::lexical_cast<std::string,long>(nPts) + " mean " +  boost::lexical_cast<std::string,float>((float)mean_) + " nrmlzd std " +  boost::lexical_cast<std::string,float>((float)standardDeviationOverMean_) );
-      // ToDO -- eliminate copy above.
-      int x[9];
-      int y[9];
-      /*Apply 3x3 median filter to reduce shot noise*/
-      for (int i=0; i<width; i++) {
-         for (int j=0; j<height; j++) {
-            float theValue;
-            x[0]=ow+i-1;
-            y[0]= (oh+j-1);
-            x[1]=ow+i;
-            y[1]= (oh+j-1);
-            x[2]=ow+i+1;
-            y[2]= (oh+j-1);
-            x[3]=ow+i-1;
-            y[3]=(oh+j);
-            x[4]=ow+i;
-            y[4]=(oh+j);
-            x[5]=ow+i+1;
-            y[5]=(oh+j);
-            x[6]=ow+i-1;
-            y[6]=(oh+j+1);
-            x[7]=ow+i;
-            y[7]=(oh+j+1);
-            x[8]=ow+i+1;
-            y[8]=(oh+j+1);
-            // truncate the median filter window  -- duplicate edge points
-            // this could be more efficient, we could fill in the interior image [1,w0-1]x[1,h0-1] then explicitly fill in the edge pixels.
-            for(int ij =0; ij < 9; ++ij)
-            {
-               if( x[ij] < 0)
-                  x[ij] = 0;
-               else if( w0-1 < x[ij])
-                  x[ij] = w0-1;
-               if( y[ij] < 0)
-                  y[ij] = 0;
-               else if( h0-1 < y[ij])
-                  y[ij] = h0-1;
-            }
-            std::vector<unsigned short> windo;
-            for(int ij = 0; ij < 9; ++ij)
-            {
-               windo.push_back(pShort_[ x[ij] + w0*y[ij]]);
-            }
-            // N.B. this window filler as ported from java needs to have a pad guaranteed around the cropped image!!!! KH
-            //windo[0] = pShort_[ow+i-1 + width*(oh+j-1)];
-            //windo[1] = pShort_[ow+i+ width*(oh+j-1)];
-            //windo[2] = pShort_[ow+i+1+ width*(oh+j-1)];
-            //windo[3] = pShort_[ow+i-1+ width*(oh+j)];
-            //windo[4] = pShort_[ow+i+ width*(oh+j)];
-            //windo[5] = pShort_[ow+i+1+ width*(oh+j)];
-            //windo[6] = pShort_[ow+i-1+ width*(oh+j+1)];
-            //windo[7] = pShort_[ow+i+ width*(oh+j+1)];
-            //windo[8] = pShort_[ow+i+1+ width*(oh+j+1)];
-            // to reduce effect of bleaching on the high-pass sharpness measurement, i use the image normalized by the mean - KH.
-            theValue = (float)((double)FindMedian(windo)*meanScaling);
-            pSmoothedIm_[i + j*width] = theValue;
-            // the dynamic range of the normalized image is a very strong function of the image sharpness, also  - KH
-            // here I'm using dynamic range of the median-filter image
-            // a faster measure could skip the median filter, but use the sum of the 5 - 10 highest and 5 - 10 lowest normalized pixels
-            // average over a couple of points to lessen effect of fluctuations & noise
-            // todo - make the active measure of image sharpness user-selectable
-            // save the  max points and the min points
-            if( theValue < min1_ )
-            {
-               min2_ = min1_;
-               min1_ = theValue;
-            }
-            else if (theValue < min2_)
-            {
-               min2_=theValue;
-            }
-            if( max1_ < theValue)
-            {
-               max2_ = max1_;
-               max1_ = theValue;
-            }
-            else if (max2_ < theValue )
-            {
-               max2_=theValue;
-            }
-         }
+         delete scoringWorkers_;
+         scoringWorkers_ = new ScoreBandWorkers(nThreads);
       }
-      /*Edge detection using a 3x3 filter: [-2 -1 0; -1 0 1; 0 1 2]. Then sum all pixel values. Ideally, the sum is large if most edges are sharp*/
-      for (int k=1; k<width-1; k++) {
-         for (int l=1; l<height-1; l++)
-         {
-            double convolvedValue = -2.0*pSmoothedIm_[k-1 + width*(l-1)] - pSmoothedIm_[k+ width*(l-1)]-pSmoothedIm_[k-1 + width*l]+pSmoothedIm_[k+1 + width*l]+pSmoothedIm_[k+ width*(l+1)]+2.0*pSmoothedIm_[k+1+ width*(l+1)];
-            sharpness = sharpness + convolvedValue*convolvedValue;
-         }
-      }
-      //free(pShort);
+      ComputeFocusScore(pShort_, w0, h0, ow, oh, width, height, metric_, scoringWorkers_, score);
+      LogMessage("N " + boost::lexical_cast<std::string,long>((long)width*height) + " mean " +  boost::lexical_cast<std::string,float>((float)score.mean) + " nrmlzd std " +  boost::lexical_cast<std::string,float>((float)score.standardDeviationOverMean) );
    }
+   mean_ = score.mean;
+   standardDeviationOverMean_ = score.standardDeviationOverMean;
    busy_ = false;
-   latestSharpness_ = sharpness;
-   pPoints_->InsertPoint(acquisitionSequenceNumber_++,(float)z,(float)mean_,(float)standardDeviationOverMean_,latestSharpness_,(float)( 0.5*((max1_+max2_)-(min1_+min2_))));
-   return sharpness;
+   latestSharpness_ = score.sharpness;
+   pPoints_->InsertPoint(acquisitionSequenceNumber_++,(float)z,(float)mean_,(float)standardDeviationOverMean_,latestSharpness_,(float)score.dynamicRange);
+   return score.sharpness;
 }
 
 
@@ -1056,3 +971,153 @@ double SimpleAutofocus::DoubleFunctionOfDouble(const double v)
    //todo selection of sharpness measure will set a pointer to member function.....
    return SharpnessAtZ(v);
 }
+
+
+
+// Loads the positions into the focus stage and starts the sequence, if the
+// stage can do it. Each camera exposure then triggers the move to the next
+// position.
+bool SimpleAutofocus::StartFocusStageSequence(const std::vector<double>& positions, MM::Stage*& pStage)
+{
+   pStage = 0;
+   char focusDeviceName[MM::MaxStrLength];
+   if( DEVICE_OK != pCore_->GetDeviceProperty(MM::g_Keyword_CoreDevice, MM::g_Keyword_CoreFocus, focusDeviceName) ||
+      0 == strlen(focusDeviceName))
+      return false;
+   MM::Device* pDevice = pCore_->GetDevice(this, focusDeviceName);
+   if( 0 == pDevice || MM::StageDevice != pDevice->GetType())
+      return false;
+   MM::Stage* pFocus = static_cast<MM::Stage*>(pDevice);
+
+   bool sequenceable = false;
+   long maxLength = 0;
+   if( DEVICE_OK != pFocus->IsStageSequenceable(sequenceable) || !sequenceable ||
+      DEVICE_OK != pFocus->GetStageSequenceMaxLength(maxLength) || maxLength < (long)positions.size())
+      return false;
+
+   int ret = pFocus->ClearStageSequence();
+   for( size_t i = 0; DEVICE_OK == ret && i < positions.size(); ++i)
+      ret = pFocus->AddToStageSequence(positions[i]);
+   if( DEVICE_OK == ret)
+      ret = pFocus->SendStageSequence();
+   if( DEVICE_OK == ret)
+      ret = pFocus->StartStageSequence();
+   if( DEVICE_OK != ret)
+   {
+      LogMessage("AF could not start focus stage sequence, error " + boost::lexical_cast<std::string,int>(ret) + "; stepping instead", false);
+      return false;
+   }
+   pStage = pFocus;
+   return true;
+}
+
+
+// Coarse sweep over the same range as the other searches, scoring images on
+// worker threads while the next ones are acquired, followed by a Brent
+// search within one coarse step of the best sweep position.
+int SimpleAutofocus::PipelinedSweepSearch()
+{
+   MM::MMTime tStart = GetCurrentMMTime();
+   double center = Z();
+   std::vector<double> positions;
+   for( long i = 0; i < 2 * coarseSteps_ + 1; ++i)
+      positions.push_back(center + (i - coarseSteps_) * coarseStepSize_);
+
+   // the sequence starts from the current position
+   Z(positions[0]);
+   MM::Stage* pSequencedStage = 0;
+   bool sequenced = StartFocusStageSequence(positions, pSequencedStage);
+   LogMessage(std::string("AF coarse sweep ") + (sequenced ? "triggered by the camera" : "stepped") +
+      " from " + boost::lexical_cast<std::string,double>(positions.front()) + " to " + boost::lexical_cast<std::string,double>(positions.back()), messageDebug);
+
+   int ret = DEVICE_OK;
+   std::vector<ScoringPool::Result> results;
+   MM::MMTime tSweepStart = GetCurrentMMTime();
+   MM::MMTime tSweepEnd = tSweepStart;
+   {
+      ScoringPool* pPool = 0;
+      int w0 = 0, h0 = 0;
+      for( size_t i = 0; i < positions.size(); ++i)
+      {
+         if( !sequenced && 0 < i)
+            Z(positions[i]);
+         int w = 0, h = 0;
+         if( !AcquireImage(w, h) || (pPool != 0 && (w != w0 || h != h0)))
+         {
+            ret = DEVICE_ERR;
+            break;
+         }
+         if( 0 == pPool)
+         {
+            w0 = w;
+            h0 = h;
+            pPool = new ScoringPool((unsigned)scoringThreads_, w0, h0, cropFactor_, metric_);
+         }
+         pPool->Submit(acquisitionSequenceNumber_++, positions[i], pShort_);
+      }
+      tSweepEnd = GetCurrentMMTime();
+      if( 0 != pSequencedStage)
+         pSequencedStage->StopStageSequence();
+      if( 0 != pPool)
+      {
+         results = pPool->WaitAll();
+         delete pPool;
+      }
+   }
+   MM::MMTime tScored = GetCurrentMMTime();
+   if( DEVICE_OK != ret || results.empty())
+   {
+      Z(center);
+      LogMessage("AF coarse sweep failed, returning to the start position", false);
+      return DEVICE_ERR;
+   }
+
+   size_t best = 0;
+   for( size_t i = 0; i < results.size(); ++i)
+   {
+      const FocusScore& s = results[i].score;
+      pPoints_->InsertPoint(results[i].seqNo, (float)results[i].z, (float)s.mean, (float)s.standardDeviationOverMean, s.sharpness, (float)s.dynamicRange);
+      if( results[best].score.sharpness < s.sharpness)
+         best = i;
+   }
+
+   // fine search
+   double z0 = results[best].z - coarseStepSize_;
+   double z1 = results[best].z + coarseStepSize_;
+   double bestDist = results[best].z;
+   double bestSharpness = results[best].score.sharpness;
+   int status = 0;
+   const int maxFineSteps = acquisitionSequenceNumber_ + 27;
+   double dvalue = -1.*SharpnessAtZ(z1);
+   for ( ; ; )
+   {
+      double z = local_min_rc( &z0, &z1, &status, dvalue, (double)fineStepSize_ );
+      if ( status < 0 )
+         break;
+      dvalue = -1.*SharpnessAtZ( z );
+      if ( bestSharpness < -dvalue )
+      {
+         bestSharpness = -dvalue;
+         bestDist = z;
+      }
+      if ( status == 0 )
+         break;
+      if ( maxFineSteps < acquisitionSequenceNumber_ )
+      {
+         LogMessage("too many steps in Autofocus fine search, please check the parameters!",false);
+         break;
+      }
+   }
+   MM::MMTime tFine = GetCurrentMMTime();
+
+   pPoints_->InsertPhaseTime(sequenced ? "coarse sweep (sequenced)" : "coarse sweep (stepped)", (tSweepEnd - tSweepStart).getMsec());
+   pPoints_->InsertPhaseTime("scoring after sweep", (tScored - tSweepEnd).getMsec());
+   pPoints_->InsertPhaseTime("fine search", (tFine - tScored).getMsec());
+   pPoints_->InsertPhaseTime("total", (tFine - tStart).getMsec());
+
+   LogMessage("AF best position is " + boost::lexical_cast<std::string,double>(bestDist),  messageDebug);
+   LogMessage("AF Performance Table:\n" + pPoints_->Table(), messageDebug);
+   Z(bestDist);
+   latestSharpness_ = bestSharpness;
+   return DEVICE_OK;
+}
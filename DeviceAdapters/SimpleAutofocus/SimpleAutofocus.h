@@ -26,6 +26,10 @@
 #include "../../MMDevice/MMDevice.h"
 #include "../../MMDevice/DeviceBase.h"
 #include "../../MMDevice/ImgBuffer.h"
+#include "FocusKernels.h"
+
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
 
 #include <string>
 //#include <iostream>
@@ -42,7 +46,72 @@ class SAFData;
 
 // computational utility functions
 
-double GetScore(short* img, int w0, int h0, double cropFactor);
+double GetScore(const unsigned short* img, int w0, int h0, double cropFactor);
+
+// sharpness measures
+enum FocusMetric
+{
+   FocusMetricMedianEdge,         // high-pass filter of the median filtered image
+   FocusMetricBrenner,            // squared differences of pixels 2 apart in a row
+   FocusMetricNormalizedVariance, // variance / mean
+   FocusMetricTenengrad           // squared Sobel gradient magnitude
+};
+
+// results of scoring one image
+struct FocusScore
+{
+   FocusScore() : mean(0.), standardDeviationOverMean(0.), sharpness(0.), dynamicRange(0.) {}
+   double mean;
+   double standardDeviationOverMean;
+   double sharpness; // the selected metric, of the mean normalized image
+   double dynamicRange; // of the median filtered, mean normalized image; FocusMetricMedianEdge only
+};
+
+// the centered region that is scored for a given crop factor
+void GetCropRegion(int w0, int h0, double cropFactor, int& ow, int& oh, int& width, int& height);
+
+// Threads that score bands of rows for ComputeFocusScore(). The threads
+// live as long as the object, so that scoring an image does not start and
+// join a thread per band. One image is scored at a time.
+class ScoreBandWorkers
+{
+public:
+   // nThreads includes the thread that calls ComputeFocusScore()
+   explicit ScoreBandWorkers(unsigned nThreads);
+   ~ScoreBandWorkers();
+
+   unsigned GetThreadCount() const { return (unsigned)threads_.size() + 1; }
+
+   // Runs band(0) on the calling thread and band(1) .. band(nBands-1) on the
+   // workers, and returns when all are done. nBands must not exceed
+   // GetThreadCount().
+   void Run(const boost::function<void (unsigned)>& band, unsigned nBands);
+
+private:
+   void WorkerLoop(unsigned slot);
+
+   boost::mutex runMutex_; // one Run() at a time
+   boost::mutex mutex_;
+   boost::condition_variable workCond_;
+   boost::condition_variable doneCond_;
+   std::vector<boost::thread*> threads_;
+   boost::function<void (unsigned)> band_;
+   unsigned nBands_;
+   unsigned long generation_; // incremented by each Run()
+   unsigned pending_;
+   bool quit_;
+};
+
+// Scores the region [ow, ow+width) x [oh, oh+height) of a w0 x h0 image,
+// splitting it into one band of rows per thread of workers (or scoring it on
+// the calling thread only if workers is 0). The median filter uses the
+// pixels around the region, so callers that pass a cut-out must include a
+// 1 pixel border where the full image has one.
+// Thread safe; calls that share workers score one image at a time.
+void ComputeFocusScore(const unsigned short* img, int w0, int h0,
+      int ow, int oh, int width, int height, FocusMetric metric,
+      ScoreBandWorkers* workers, FocusScore& score,
+      const FocusKernels& kernels = GetFocusKernels());
 
 class SimpleAutofocus : public CAutoFocusBase<SimpleAutofocus>
 {
@@ -83,6 +152,7 @@ public:
 
    int BruteForceSearch();
    int BrentSearch();
+   int PipelinedSweepSearch();
 
    // action interface
    // ---------------
@@ -104,6 +174,8 @@ public:
    int OnStandardDeviationOverMean(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnChannel(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnSearchAlgorithm(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnScoringThreads(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnSharpnessMetric(MM::PropertyBase* pProp, MM::ActionType eAct);
 
 
 private:
@@ -133,6 +205,9 @@ private:
 
    double SharpnessAtZ(const double zvalue);
    double DoubleFunctionOfDouble(const double zvalue);
+   // snaps and converts to pShort_; returns false for unsupported pixel types
+   bool AcquireImage(int& w0, int& h0);
+   bool StartFocusStageSequence(const std::vector<double>& positions, MM::Stage*& pStage);
 
    MM::Core* pCore_;
    double cropFactor_;
@@ -144,9 +219,6 @@ private:
    long enableAutoShuttering_;
    unsigned long sizeOfTempShortBuffer_;
 
-   float* pSmoothedIm_;
-   unsigned long sizeOfSmoothedIm_;
-
    unsigned short* pShort_;
    // a flag to trigger recalculation
    long recalculate_;
@@ -158,20 +230,14 @@ private:
    void RefreshChannelsToSelect(void);
    std::string searchAlgorithm_;
    int acquisitionSequenceNumber_;
+   long scoringThreads_;
+   ScoreBandWorkers* scoringWorkers_; // scoringThreads_ threads, made on first use
+   FocusMetric metric_;
 
    double exposureForAutofocusAcquisition_;
    long binningForAutofocusAcquisition_; // over-ride the camera setting if this is non-0
 
 
-   //std::multiset<float> mins_;
-   //std::mulitset<float> maxs_;
-   //const int nExtrema_ = 5;
-
-   float min1_;
-   float min2_;
-   float max1_;
-   float max2_;
-
    // this defines member functions that operate on evaluator DoubleFunctionOfDouble
 #include "../../Util/Brent.h"
 
@@ -1,157 +1,325 @@
 #include "SimpleAutofocus.h"
 
-unsigned short FindMedian(unsigned short* arr, const int lengthMinusOne)
+#include <boost/bind.hpp>
+
+#include <limits.h>
+
+namespace {
+
+// the two smallest and the two largest values seen
+struct ExtremeValues
 {
-   unsigned short tmp;
-   // n.b. this was ported from java, looks like a bubble sort....
-   // todo use qsort
-   for(int i=0; i<lengthMinusOne; ++i)
+   ExtremeValues()
+   {
+      values[0] = values[1] = USHRT_MAX;
+      values[2] = values[3] = 0;
+   }
+
+   void Merge(const ExtremeValues& other)
+   {
+      AddMin(other.values[0]);
+      AddMin(other.values[1]);
+      AddMax(other.values[2]);
+      AddMax(other.values[3]);
+   }
+
+   void AddMin(unsigned short v)
    {
-      for(int j=0; j<lengthMinusOne-i; ++j)
+      if( v < values[0] )
       {
-         if (arr[j+1]<arr[j])
-         {
-            tmp = arr[j];
-            arr[j]=arr[j+1];
-            arr[j+1]=tmp;
-         }
+         values[1] = values[0];
+         values[0] = v;
+      }
+      else if (v < values[1])
+      {
+         values[1] = v;
       }
    }
-   return arr[lengthMinusOne/2 +1];
-}
 
-
-double GetScore(unsigned short* img, int w0, int h0, double cropFactor)
-{
-   unsigned short windo[9];
-   int width =  (int)(cropFactor * w0);
-   int height = (int)(cropFactor * h0);
-   int ow = (int)(((1-cropFactor)/2)*w0);
-   int oh = (int)(((1-cropFactor)/2)*h0);
-   unsigned short* smoothedImage = new unsigned short[width*height];
-   // calculate the standard deviation & mean
-   long nPts = 0;
-   double mean = 0;
-   double M2 = 0;
-   double delta;
-   // one-pass algorithm for mean and std from Welford / Knuth  - KH
-   for (int i=0; i<width; i++)
+   void AddMax(unsigned short v)
    {
-      for (int j=0; j<height; j++)
+      if( values[2] < v)
+      {
+         values[3] = values[2];
+         values[2] = v;
+      }
+      else if (values[3] < v )
       {
-         ++nPts;
-         long value = img[ow+i+ width*(oh+j)];
-         delta = value - mean;
-         mean = mean + delta/nPts;
-         M2 = M2 + delta*(value - mean); // #This expression uses the new value of mean_
+         values[3] = v;
       }
    }
-   //double variance_n = M2/nPts;
-   double variance = M2/(nPts - 1);
-   double stdOverMean = 0.;
-   double meanScaling = 1.;
-   if( 0. != mean)
+
+   // smallest, second smallest, largest, second largest, as in
+   // FocusKernels::extremesRow
+   unsigned short values[4];
+};
+
+struct ScoringRegion
+{
+   const unsigned short* img;
+   int w0, h0;
+   int ow, oh, width, height;
+   FocusMetric metric;
+   const FocusKernels* kernels;
+
+   const unsigned short* Row(int j) const
    {
-      stdOverMean = pow(variance,0.5)/mean;
-      meanScaling = 1./mean;
+      return img + (size_t)(oh + j) * w0 + ow;
    }
-   //LogMessage("N " + boost::lexical_cast<std::string,long>(nPts) + " mean " +  boost::lexical_cast<std::string,float>((float)mean_) + " nrmlzd std " +  boost::lexical_cast<std::string,float>((float)standardDeviationOverMean_) );
-   // ToDO -- eliminate copy above.
-   int x[9];
-   int y[9];
-   /*Apply 3x3 median filter to reduce shot noise*/
-   for (int i=0; i<width; i++)
+};
+
+// sums over a band of rows of the region, in exact integer arithmetic so
+// that the score does not depend on how the region is split
+struct BandScore
+{
+   BandScore() : sum(0), sumOfSquares(0), metricSum(0) {}
+
+   void Merge(const BandScore& other)
+   {
+      sum += other.sum;
+      sumOfSquares += other.sumOfSquares;
+      metricSum += other.metricSum;
+      extremes.Merge(other.extremes);
+   }
+
+   uint64_t sum;
+   uint64_t sumOfSquares;
+   uint64_t metricSum;
+   ExtremeValues extremes; // of the median filtered image
+};
+
+// Median filters rows rowBegin-1 .. rowEnd of the region, keeping only the
+// last three, and sums the edge filter of rows rowBegin .. rowEnd-1.
+void MedianEdgeRows(const ScoringRegion& r, int rowBegin, int rowEnd, BandScore& band)
+{
+   const FocusKernels& kernels = *r.kernels;
+   const int width = r.width;
+   // the median filter reads one pixel around each output pixel, clamped to
+   // the image; rows that need no clamping are used in place
+   const bool clampColumns = r.ow < 1 || r.w0 < r.ow + width + 1;
+   const int padded = width + 2;
+   std::vector<unsigned short> inputRows(clampColumns ? 3 * padded : 0);
+   std::vector<unsigned short> medianRows(3 * (size_t)width);
+
+   const int first = std::max(rowBegin - 1, 0);
+   const int last = std::min(rowEnd + 1, r.height);
+   for (int j = first; j < last; ++j)
    {
-      for (int j=0; j<height; j++)
+      const unsigned short* in[3];
+      for (int k = 0; k < 3; ++k)
       {
-         float theValue;
-         x[0]=ow+i-1;
-         y[0]= (oh+j-1);
-         x[1]=ow+i;
-         y[1]= (oh+j-1);
-         x[2]=ow+i+1;
-         y[2]= (oh+j-1);
-         x[3]=ow+i-1;
-         y[3]=(oh+j);
-         x[4]=ow+i;
-         y[4]=(oh+j);
-         x[5]=ow+i+1;
-         y[5]=(oh+j);
-         x[6]=ow+i-1;
-         y[6]=(oh+j+1);
-         x[7]=ow+i;
-         y[7]=(oh+j+1);
-         x[8]=ow+i+1;
-         y[8]=(oh+j+1);
          // truncate the median filter window  -- duplicate edge points
-         // this could be more efficient, we could fill in the interior image [1,w0-1]x[1,h0-1] then explicitly fill in the edge pixels.
-         for(int ij =0; ij < 9; ++ij)
-         {
-            if( x[ij] < 0)
-               x[ij] = 0;
-            else if( w0-1 < x[ij])
-               x[ij] = w0-1;
-            if( y[ij] < 0)
-               y[ij] = 0;
-            else if( h0-1 < y[ij])
-               y[ij] = h0-1;
-         }
-         for(int ij = 0; ij < 9; ++ij)
-         {
-            windo[ij] = img[x[ij] + w0*y[ij]];
-         }
-         // N.B. this window filler as ported from java needs to have a pad guaranteed around the cropped image!!!! KH
-         //windo[0] = pShort_[ow+i-1 + width*(oh+j-1)];
-         //windo[1] = pShort_[ow+i+ width*(oh+j-1)];
-         //windo[2] = pShort_[ow+i+1+ width*(oh+j-1)];
-         //windo[3] = pShort_[ow+i-1+ width*(oh+j)];
-         //windo[4] = pShort_[ow+i+ width*(oh+j)];
-         //windo[5] = pShort_[ow+i+1+ width*(oh+j)];
-         //windo[6] = pShort_[ow+i-1+ width*(oh+j+1)];
-         //windo[7] = pShort_[ow+i+ width*(oh+j+1)];
-         //windo[8] = pShort_[ow+i+1+ width*(oh+j+1)];
-         // to reduce effect of bleaching on the high-pass sharpness measurement, i use the image normalized by the mean - KH.
-         theValue = (float)((double)FindMedian(windo,8)*meanScaling);
-         smoothedImage[i + j*width] = (unsigned short)theValue;
-         // the dynamic range of the normalized image is a very strong function of the image sharpness, also  - KH
-         // here I'm using dynamic range of the median-filter image
-         // a faster measure could skip the median filter, but use the sum of the 5 - 10 highest and 5 - 10 lowest normalized pixels
-         // average over a couple of points to lessen effect of fluctuations & noise
-         // todo - make the active measure of image sharpness user-selectable
-         // save the  max points and the min points
-         double min1 = 1.e8;
-         double min2 = 1.e8;
-         double max1 = -1.e8;
-         double max2 = -1.e8;
-         if( theValue < min1 )
-         {
-            min2 = min1;
-            min1 = theValue;
-         }
-         else if (theValue < min2)
+         int y = std::min(std::max(r.oh + j + k - 1, 0), r.h0 - 1);
+         const unsigned short* src = r.img + (size_t)y * r.w0;
+         if (clampColumns)
          {
-            min2 = theValue;
+            unsigned short* dst = &inputRows[k * padded];
+            for (int i = 0; i < padded; ++i)
+               dst[i] = src[std::min(std::max(r.ow + i - 1, 0), r.w0 - 1)];
+            in[k] = dst;
          }
-         if( max1 < theValue)
+         else
          {
-            max2 = max1;
-            max1 = theValue;
-         }
-         else if (max2 < theValue )
-         {
-            max2 = theValue;
+            in[k] = src + r.ow - 1;
          }
       }
+      unsigned short* median = &medianRows[(j % 3) * width];
+      kernels.medianOf9Row(in[0], in[1], in[2], median, width);
+
+      if (rowBegin <= j && j < rowEnd)
+         kernels.extremesRow(median, width, band.extremes.values);
+
+      // the edge filter of row j-1 needs the median rows j-2 .. j
+      int l = j - 1;
+      if (std::max(rowBegin, 1) <= l && l < std::min(rowEnd, r.height - 1))
+      {
+         band.metricSum += kernels.edgeRow(&medianRows[((l - 1) % 3) * width],
+               &medianRows[(l % 3) * width], median, width);
+      }
    }
-   /*Edge detection using a 3x3 filter: [-2 -1 0; -1 0 1; 0 1 2]. Then sum all pixel values. Ideally, the sum is large if most edges are sharp*/
-   double sharpness(0.0);
-   for (int k=1; k<width-1; k++) {
-      for (int l=1; l<height-1; l++)
+}
+
+void ScoreRows(const ScoringRegion& r, int rowBegin, int rowEnd, BandScore& band)
+{
+   const FocusKernels& kernels = *r.kernels;
+   for (int j = rowBegin; j < rowEnd; ++j)
+      kernels.sumRow(r.Row(j), r.width, band.sum, band.sumOfSquares);
+
+   switch (r.metric)
+   {
+   case FocusMetricMedianEdge:
+      MedianEdgeRows(r, rowBegin, rowEnd, band);
+      break;
+   case FocusMetricBrenner:
+      for (int j = rowBegin; j < rowEnd; ++j)
+         band.metricSum += kernels.brennerRow(r.Row(j), r.width);
+      break;
+   case FocusMetricTenengrad:
+      for (int j = std::max(rowBegin, 1); j < std::min(rowEnd, r.height - 1); ++j)
+         band.metricSum += kernels.tenengradRow(r.Row(j - 1), r.Row(j), r.Row(j + 1), r.width);
+      break;
+   case FocusMetricNormalizedVariance:
+      // only needs the sums
+      break;
+   }
+}
+
+// scores band i of the region into bands[i]
+void ScoreBand(const ScoringRegion* region, int rowsPerBand, BandScore* bands, unsigned i)
+{
+   const int rowBegin = i * rowsPerBand;
+   ScoreRows(*region, rowBegin, std::min(rowBegin + rowsPerBand, region->height), bands[i]);
+}
+
+} // anonymous namespace
+
+
+ScoreBandWorkers::ScoreBandWorkers(unsigned nThreads) :
+   nBands_(0),
+   generation_(0),
+   pending_(0),
+   quit_(false)
+{
+   for (unsigned i = 1; i < nThreads; ++i)
+      threads_.push_back(new boost::thread(boost::bind(&ScoreBandWorkers::WorkerLoop, this, i - 1)));
+}
+
+ScoreBandWorkers::~ScoreBandWorkers()
+{
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      quit_ = true;
+   }
+   workCond_.notify_all();
+   for (size_t i = 0; i < threads_.size(); ++i)
+   {
+      threads_[i]->join();
+      delete threads_[i];
+   }
+}
+
+void ScoreBandWorkers::Run(const boost::function<void (unsigned)>& band, unsigned nBands)
+{
+   boost::lock_guard<boost::mutex> runLock(runMutex_);
+   if (nBands < 1)
+      return;
+   if (nBands > 1)
+   {
       {
-         double convolvedValue = -2.0*smoothedImage[k-1 + width*(l-1)] - smoothedImage[k+ width*(l-1)]-smoothedImage[k-1 + width*l]+smoothedImage[k+1 + width*l]+smoothedImage[k+ width*(l+1)]+2.0*smoothedImage[k+1+ width*(l+1)];
-         sharpness = sharpness + convolvedValue*convolvedValue;
+         boost::lock_guard<boost::mutex> lock(mutex_);
+         band_ = band;
+         nBands_ = nBands;
+         pending_ = nBands - 1;
+         ++generation_;
       }
+      workCond_.notify_all();
+   }
+
+   band(0);
+
+   boost::unique_lock<boost::mutex> lock(mutex_);
+   while (pending_ > 0)
+      doneCond_.wait(lock);
+   band_.clear();
+}
+
+void ScoreBandWorkers::WorkerLoop(unsigned slot)
+{
+   unsigned long seen = 0;
+   boost::unique_lock<boost::mutex> lock(mutex_);
+   for (;;)
+   {
+      while (!quit_ && generation_ == seen)
+         workCond_.wait(lock);
+      if (quit_)
+         return;
+      seen = generation_;
+
+      // worker slot scores band slot + 1; the calling thread scores band 0
+      if (slot + 1 >= nBands_)
+         continue;
+      boost::function<void (unsigned)> band = band_;
+      lock.unlock();
+      band(slot + 1);
+      lock.lock();
+
+      if (--pending_ == 0)
+         doneCond_.notify_all();
+   }
+}
+
+
+double GetScore(const unsigned short* img, int w0, int h0, double cropFactor)
+{
+   int ow, oh, width, height;
+   GetCropRegion(w0, h0, cropFactor, ow, oh, width, height);
+   FocusScore score;
+   ComputeFocusScore(img, w0, h0, ow, oh, width, height, FocusMetricMedianEdge, 0, score);
+   return score.sharpness;
+}
+
+
+void GetCropRegion(int w0, int h0, double cropFactor, int& ow, int& oh, int& width, int& height)
+{
+   width =  (int)(cropFactor*w0);
+   height = (int)(cropFactor*h0);
+   ow = (int)(((1-cropFactor)/2)*w0);
+   oh = (int)(((1-cropFactor)/2)*h0);
+}
+
+
+// the crop factor, median filter and 3x3 high-pass process follows the java implementation from Pakpoom Subsoontorn & Hernan Garcia  -- KH
+void ComputeFocusScore(const unsigned short* img, int w0, int h0,
+      int ow, int oh, int width, int height, FocusMetric metric,
+      ScoreBandWorkers* workers, FocusScore& score, const FocusKernels& kernels)
+{
+   score = FocusScore();
+   if (width < 1 || height < 1)
+      return;
+
+   ScoringRegion region = { img, w0, h0, ow, oh, width, height, metric, &kernels };
+
+   // split the region into bands of rows, the calling thread does the first
+   unsigned nThreads = workers ? workers->GetThreadCount() : 1;
+   if ((int)nThreads > height)
+      nThreads = height;
+   const int rowsPerBand = (height + nThreads - 1) / nThreads;
+   const unsigned nBands = (height + rowsPerBand - 1) / rowsPerBand;
+   std::vector<BandScore> bands(nBands);
+   if (nBands > 1)
+      workers->Run(boost::bind(&ScoreBand, &region, rowsPerBand, &bands[0], _1), nBands);
+   else
+      ScoreBand(&region, rowsPerBand, &bands[0], 0);
+
+   BandScore total;
+   for (unsigned i = 0; i < nBands; ++i)
+      total.Merge(bands[i]);
+
+   const double nPts = (double)width * height;
+   const double mean = total.sum / nPts;
+   double variance = 0.;
+   if (nPts > 1)
+      variance = std::max(0., ((double)total.sumOfSquares - (double)total.sum * mean) / (nPts - 1));
+   double meanScaling = 1.;
+   score.mean = mean;
+   if( 0. != mean)
+   {
+      score.standardDeviationOverMean = pow(variance,0.5)/mean;
+      meanScaling = 1./mean;
+   }
+
+   // to reduce effect of bleaching on the sharpness measurement, the gradient
+   // metrics are of the image normalized by the mean - KH.
+   if (metric == FocusMetricNormalizedVariance)
+      score.sharpness = variance * meanScaling;
+   else
+      score.sharpness = (double)total.metricSum * meanScaling * meanScaling;
+
+   // the dynamic range of the normalized image is a very strong function of the image sharpness, also  - KH
+   // average over a couple of points to lessen effect of fluctuations & noise
+   if (metric == FocusMetricMedianEdge)
+   {
+      const unsigned short* e = total.extremes.values;
+      score.dynamicRange = 0.5*(((double)e[2] + e[3]) - ((double)e[0] + e[1]))*meanScaling;
    }
-   delete[] smoothedImage;
-   return sharpness;
 }
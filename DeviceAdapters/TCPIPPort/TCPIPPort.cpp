@@ -23,9 +23,9 @@
 
 #include "TCPIPPort.h"
 
+#include "boost/bind.hpp"
 #include "boost/lexical_cast.hpp"
 #include "boost/format.hpp"
-#include "boost/lambda/bind.hpp"
 #include "boost/lambda/lambda.hpp"
 
 #include "Util.h"
@@ -42,7 +42,10 @@ TCPIPPort::TCPIPPort(int index) :
 	port_(0),
 	initialized_(false),
 	sock_(ios_),
-	answerTimeoutMs_(500)
+	answerTimeoutMs_(500),
+	txDone_(false),
+	ioThread_(0),
+	ioWork_(0)
 {
 	SetErrorText(ERR_BUFFER_OVERRUN, "Buffer overrun occured during read");
 	SetErrorText(ERR_TERM_TIMEOUT, "Timeout occured during init or read");
@@ -56,6 +59,7 @@ TCPIPPort::TCPIPPort(int index) :
 
 TCPIPPort::~TCPIPPort()
 {
+	Shutdown();
 }
 
 bool TCPIPPort::Busy()
@@ -68,6 +72,13 @@ void TCPIPPort::close_sock()
 	sock_.close();
 }
 
+void TCPIPPort::OnConnectTimeout(const boost::system::error_code& ec)
+{
+	// the timer is cancelled once connected
+	if (ec != boost::asio::error::operation_aborted)
+		close_sock();
+}
+
 int TCPIPPort::Initialize()
 {
 ERRH_START
@@ -82,15 +93,33 @@ ERRH_START
 
 	boost::asio::deadline_timer deadline(ios_);
 	deadline.expires_from_now(boost::posix_time::millisec(answerTimeoutMs_));
-	deadline.async_wait(boost::lambda::bind(&TCPIPPort::close_sock, this));
+	deadline.async_wait(boost::bind(&TCPIPPort::OnConnectTimeout, this, boost::asio::placeholders::error));
 	
 	boost::asio::async_connect(sock_, it, boost::lambda::var(ec) = boost::lambda::_1);
 
 	do ios_.run_one(); while (ec == boost::asio::error::would_block);
 
+	deadline.cancel();
+	ios_.poll();
+
 	if (ec || !sock_.is_open())
 		return ERR_TERM_TIMEOUT;
 
+	// Commands are short and each one waits for its answer, so do not let
+	// Nagle's algorithm hold them back
+	sock_.set_option(tcp::no_delay(true));
+
+	{
+		boost::lock_guard<boost::mutex> g(rxLock_);
+		rxBuffer_.clear();
+		rxError_ = boost::system::error_code();
+	}
+
+	ios_.reset();
+	StartRead();
+	ioWork_ = new boost::asio::io_service::work(ios_);
+	ioThread_ = new boost::thread(boost::bind(&boost::asio::io_service::run, &ios_));
+
 	initialized_ = true;
 
 	if (index_ == GetCount())
@@ -104,13 +133,91 @@ ERRH_START
 	if (!initialized_)
 		return DEVICE_OK;
 
-	sock_.shutdown(tcp::socket::shutdown_both);
-	sock_.close();
-
 	initialized_ = false;
+
+	// The socket belongs to the io thread while it runs, so close it there.
+	// The pending read then completes with operation_aborted, and run()
+	// returns once it has no more work.
+	ios_.post(boost::bind(&TCPIPPort::CloseSocket, this));
+	delete ioWork_;
+	ioWork_ = 0;
+	if (ioThread_ != 0)
+	{
+		ioThread_->join();
+		delete ioThread_;
+		ioThread_ = 0;
+	}
+
+	// Lets Initialize() run the io_service again
+	ios_.reset();
 ERRH_END
 }
 
+void TCPIPPort::CloseSocket()
+{
+	boost::system::error_code ec;
+	sock_.shutdown(tcp::socket::shutdown_both, ec);
+	sock_.close(ec);
+}
+
+void TCPIPPort::StartRead()
+{
+	sock_.async_read_some(boost::asio::buffer(readChunk_, readChunkSize),
+		boost::bind(&TCPIPPort::OnRead, this,
+			boost::asio::placeholders::error,
+			boost::asio::placeholders::bytes_transferred));
+}
+
+void TCPIPPort::OnRead(const boost::system::error_code& ec, std::size_t bytesRead)
+{
+	{
+		boost::lock_guard<boost::mutex> g(rxLock_);
+		if (ec)
+			rxError_ = ec;
+		else
+			rxBuffer_.append(readChunk_, bytesRead);
+	}
+	rxCond_.notify_all();
+
+	if (!ec)
+		StartRead();
+	else if (ec != boost::asio::error::operation_aborted)
+		LogMessage(("Receive failed: " + ec.message()).c_str());
+}
+
+void TCPIPPort::SendData(const void* data, std::size_t length)
+{
+	boost::lock_guard<boost::mutex> w(writeLock_);
+	{
+		boost::lock_guard<boost::mutex> g(txLock_);
+		txDone_ = false;
+		txError_ = boost::system::error_code();
+	}
+	ios_.post(boost::bind(&TCPIPPort::StartWrite, this, data, length));
+
+	boost::unique_lock<boost::mutex> lock(txLock_);
+	while (!txDone_)
+		txCond_.wait(lock);
+	if (txError_)
+		throw boost::system::system_error(txError_);
+}
+
+void TCPIPPort::StartWrite(const void* data, std::size_t length)
+{
+	boost::asio::async_write(sock_, boost::asio::buffer(data, length),
+		boost::bind(&TCPIPPort::OnWrite, this, boost::asio::placeholders::error));
+}
+
+void TCPIPPort::OnWrite(const boost::system::error_code& ec)
+{
+	{
+		boost::lock_guard<boost::mutex> g(txLock_);
+		txError_ = ec;
+		txDone_ = true;
+	}
+	txCond_.notify_all();
+}
+
 void TCPIPPort::GetName(char* name) const
 {
 	strcpy(name, GetStringName().c_str());
@@ -137,13 +244,15 @@ int TCPIPPort::SetCommand(const char* command, const char* term)
 	if (term != 0)
 		cmd += term;
 
-	boost::asio::write(sock_, boost::asio::buffer(cmd));
+	SendData(cmd.data(), cmd.size());
 
 	LogAsciiCommunication("SetCommand", false, cmd);
 	ERRH_END
 }
 
-//mostly copied from SerialManager.cpp (Serialport::GetAnswer)
+// Waits on the receive buffer, which the io thread fills, instead of
+// polling the socket. Only the data received since the last call is searched
+// for the terminator.
 int TCPIPPort::GetAnswer(char* txt, unsigned maxChars, const char* term)
 {
 ERRH_START
@@ -155,76 +264,94 @@ ERRH_START
 		LogMessage("BUFFER_OVERRUN error occured!");
 		return ERR_BUFFER_OVERRUN;
 	}
-	std::ostringstream logMsg;
-	unsigned long answerOffset = 0;
 	memset(txt, 0, maxChars);
-	char theData = 0;
 
-	MM::MMTime startTime = GetCurrentMMTime();
-	MM::MMTime answerTimeout(answerTimeoutMs_ * 1000.0);
-	MM::MMTime nonTerminatedAnswerTimeout(5.0 * 1000.0); // For bug-compatibility
-	while ((GetCurrentMMTime() - startTime) < answerTimeout)
-	{
-		boost::asio::socket_base::bytes_readable command(true);
-		sock_.io_control(command);
-		size_t bytes_readable = command.get();
+	const std::string terminator(term ? term : "");
 
-		if (bytes_readable > 0)
-		{
-			sock_.read_some(boost::asio::buffer(&theData, 1));
+	boost::system_time startTime = boost::get_system_time();
+	boost::system_time deadline = startTime + boost::posix_time::milliseconds(answerTimeoutMs_);
+	// For bug-compatibility, an answer without terminator is returned after 5 s
+	boost::system_time nonTerminatedDeadline = startTime + boost::posix_time::seconds(5);
 
-			if (maxChars <= answerOffset)
+	std::string answer;
+	int ret = ERR_TERM_TIMEOUT;
+	{
+		boost::unique_lock<boost::mutex> lock(rxLock_);
+		std::size_t searchPos = 0;
+		for (;;)
+		{
+			if (!terminator.empty())
 			{
-				txt[answerOffset] = '\0';
-				LogMessage("BUFFER_OVERRUN error occured!");
-				return ERR_BUFFER_OVERRUN;
+				std::size_t termPos = rxBuffer_.find(terminator, searchPos);
+				if (termPos != std::string::npos && termPos < maxChars)
+				{
+					answer = rxBuffer_.substr(0, termPos + terminator.size());
+					rxBuffer_.erase(0, termPos + terminator.size());
+					ret = DEVICE_OK;
+					break;
+				}
+				if (termPos != std::string::npos || rxBuffer_.size() >= maxChars + terminator.size())
+				{
+					answer = rxBuffer_.substr(0, maxChars);
+					rxBuffer_.erase(0, maxChars);
+					ret = ERR_BUFFER_OVERRUN;
+					break;
+				}
+				// the terminator may start in the data that is already there
+				if (rxBuffer_.size() >= terminator.size())
+					searchPos = rxBuffer_.size() - terminator.size() + 1;
+			}
+			else if (boost::get_system_time() >= nonTerminatedDeadline)
+			{
+				answer = rxBuffer_.substr(0, maxChars);
+				rxBuffer_.erase(0, answer.size());
+				ret = DEVICE_OK;
+				break;
 			}
-			txt[answerOffset++] = theData;
-		}
-		else
-		{
-			//Yield to other threads:
-			CDeviceUtils::SleepMs(1);
-		}
 
-		// look for the terminator, if any
-		if (term && term[0])
-		{
-			// check for terminating sequence
-			char* termPos = strstr(txt, term);
-			if (termPos != 0) // found the terminator
+			if (rxError_)
 			{
-				LogAsciiCommunication("GetAnswer", true, txt);
+				SetErrorText(BOOST_ERROR, rxError_.message().c_str());
+				ret = BOOST_ERROR;
+				break;
+			}
 
-				// erase the terminator from the answer:
-				*termPos = '\0';
+			boost::system_time now = boost::get_system_time();
+			if (now >= deadline)
+				break;
+			rxCond_.timed_wait(lock, terminator.empty() ? std::min(deadline, nonTerminatedDeadline) : deadline);
+		}
+	}
 
-				return DEVICE_OK;
-			}
+	switch (ret)
+	{
+	case DEVICE_OK:
+		LogAsciiCommunication("GetAnswer", true, answer);
+		if (terminator.empty())
+		{
+			long millisecs = static_cast<long>((boost::get_system_time() - startTime).total_milliseconds());
+			LogMessage(("GetAnswer without terminator returning after " +
+				boost::lexical_cast<std::string>(millisecs) +
+				"msec").c_str(), true);
 		}
 		else
 		{
-			// XXX Shouldn't it be an error to not have a terminator?
-			// TODO Make it a precondition check (immediate error) once we've made
-			// sure that no device adapter calls us without a terminator. For now,
-			// keep the behavior for the sake of bug-compatibility.
-
-			MM::MMTime elapsed = GetCurrentMMTime() - startTime;
-			if (elapsed > nonTerminatedAnswerTimeout)
-			{
-				LogAsciiCommunication("GetAnswer", true, txt);
-				long millisecs = static_cast<long>(elapsed.getMsec());
-				LogMessage(("GetAnswer without terminator returning after " +
-					boost::lexical_cast<std::string>(millisecs) +
-					"msec").c_str(), true);
-				return DEVICE_OK;
-			}
+			// erase the terminator from the answer:
+			answer.erase(answer.size() - terminator.size());
 		}
+		memcpy(txt, answer.c_str(), std::min<std::size_t>(answer.size(), maxChars - 1));
+		return DEVICE_OK;
+	case ERR_BUFFER_OVERRUN:
+		memcpy(txt, answer.c_str(), maxChars - 1);
+		LogMessage("BUFFER_OVERRUN error occured!");
+		return ERR_BUFFER_OVERRUN;
+	case ERR_TERM_TIMEOUT:
+		LogMessage("TERM_TIMEOUT error occured!");
+		return ERR_TERM_TIMEOUT;
+	default:
+		return ret;
 	}
-
-	LogMessage("TERM_TIMEOUT error occured!");
-	return ERR_TERM_TIMEOUT;
-	ERRH_END
+ERRH_END
 }
 
 int TCPIPPort::Write(const unsigned char* buf, unsigned long bufLen)
@@ -233,7 +360,7 @@ int TCPIPPort::Write(const unsigned char* buf, unsigned long bufLen)
 		if (!initialized_)
 			return ERR_PORT_NOTINITIALIZED;
 
-	boost::asio::write(sock_, boost::asio::buffer(buf, bufLen));
+	SendData(buf, bufLen);
 
 	LogBinaryCommunication("Write", false, buf, bufLen);
 	ERRH_END
@@ -250,7 +377,13 @@ int TCPIPPort::Read(unsigned char* buf, unsigned long bufLen, unsigned long& cha
 
 	memset(buf, 0, bufLen);
 
-	charsRead = (unsigned long)boost::asio::read(sock_, boost::asio::buffer(buf, bufLen));
+	// like a serial port, return what has been received so far
+	{
+		boost::lock_guard<boost::mutex> g(rxLock_);
+		charsRead = (unsigned long)std::min<std::size_t>(bufLen, rxBuffer_.size());
+		memcpy(buf, rxBuffer_.data(), charsRead);
+		rxBuffer_.erase(0, charsRead);
+	}
 
 	if (charsRead > 0)
 		LogBinaryCommunication("Read", true, buf, charsRead);
@@ -259,6 +392,8 @@ int TCPIPPort::Read(unsigned char* buf, unsigned long bufLen, unsigned long& cha
 
 int TCPIPPort::Purge()
 {
+	boost::lock_guard<boost::mutex> g(rxLock_);
+	rxBuffer_.clear();
 	return DEVICE_OK;
 }
 
@@ -24,7 +24,9 @@
 #pragma once
 
 #include "boost/asio.hpp"
+#include "boost/thread.hpp"
 
+#include <algorithm>
 #include <istream>
 
 #include "../../MMDevice/MMDevice.h"
@@ -69,6 +71,7 @@ public:
 	int OnAnswerTimeout(MM::PropertyBase* pProp, MM::ActionType eAct);
 
 	void close_sock();
+	void OnConnectTimeout(const boost::system::error_code& ec);
 
 	static int GetCount();
 	static void RegisterNewPort();
@@ -85,6 +88,35 @@ private:
 	unsigned short port_;
 	unsigned int answerTimeoutMs_;
 
+	// Receiving: the io_service runs on ioThread_ and keeps an asynchronous
+	// read pending, which appends to rxBuffer_ and wakes up waiting readers.
+	void StartRead();
+	void OnRead(const boost::system::error_code& ec, std::size_t bytesRead);
+	void CloseSocket();
+
+	static const std::size_t readChunkSize = 4096;
+	char readChunk_[readChunkSize];
+
+	// Sending: writes are also started on the io thread, one at a time, and
+	// the caller waits for them to complete. Throws on error.
+	void SendData(const void* data, std::size_t length);
+	void StartWrite(const void* data, std::size_t length);
+	void OnWrite(const boost::system::error_code& ec);
+
+	boost::mutex writeLock_; // held for the duration of a write
+	boost::mutex txLock_;
+	boost::condition_variable txCond_;
+	bool txDone_;
+	boost::system::error_code txError_;
+
+	boost::thread* ioThread_;
+	// keeps run() going after a receive error, so that writes still complete
+	boost::asio::io_service::work* ioWork_;
+	boost::mutex rxLock_;
+	boost::condition_variable rxCond_;
+	std::string rxBuffer_; // received, not yet consumed
+	boost::system::error_code rxError_;
+
 	void LogAsciiCommunication(const char * prefix, bool isInput, const std::string & data);
 	void LogBinaryCommunication(const char* prefix, bool isInput, const unsigned char* content, std::size_t length);
 };
\ No newline at end of file
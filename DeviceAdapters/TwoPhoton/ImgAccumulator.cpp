@@ -29,6 +29,7 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "ImgAccumulator.h"
+#include "../Utilities/FrameAccumulator.h"
 #include <math.h>
 #include <assert.h>
 #include <algorithm>
@@ -59,13 +60,8 @@ void ImgAccumulator::AddPixels(const void* pix, unsigned sourceWidth, unsigned,
 	//pixels coming in will always be 8 bit
 	const unsigned char* pixPtr = static_cast<const unsigned char*>(pix);
 
-	for (unsigned i=0; i<height_; i++) {
-		for (unsigned j=0; j<width_; j++) {
-			int srcIdx = (offsetY+i)*sourceWidth+j;
-			int idx = i*width_+j;
-			accumulator_[idx] += pixPtr[srcIdx];
-		}
-	}
+	for (unsigned i=0; i<height_; i++)
+		AccumulateSamples8(&accumulator_[i*width_], pixPtr + (offsetY+i)*sourceWidth, width_);
 	frameIndex_++;
 }
 
@@ -114,7 +110,7 @@ void ImgAccumulator::Resize(unsigned xSize, unsigned ySize)
    height_ = ySize;
 
    memset(pixels_, 0, width_ * height_ * pixDepth_);
-   accumulator_.resize(width_ * height_, 0.0);
+   accumulator_.resize(width_ * height_, 0);
    frameIndex_ = 0;
 }
 
@@ -132,20 +128,16 @@ void ImgAccumulator::SetupAccumulator()
 void ImgAccumulator::CalculateOutputImage()
 {
 	//Do frame averaging
-	long size = width_ * height_;
+	size_t size = width_ * height_;
+	if (size == 0)
+		return;
 
 	if (pixDepth_ == 1) {
-		for (long i=0; i<size; i++) {
-			//divide by number of frames
-			accumulator_[i] *= (1.0/length_);
-			pixels_[i] = (unsigned char) min(accumulator_[i], (double)UCHAR_MAX);
-		}
+		//divide by number of frames
+		ScaleSamples8(&accumulator_[0], max(length_, 1u), pixels_, size);
 	} else {
 		//reinterperet as two bytes and write to pixels
-		unsigned short* bufPtr = reinterpret_cast<unsigned short*>(pixels_);
-		for (long i=0; i<size; i++)	{
-			bufPtr[i] = (unsigned short) min(accumulator_[i], (double)USHRT_MAX);
-		}
+		ScaleSamples16(&accumulator_[0], 1, reinterpret_cast<unsigned short*>(pixels_), size);
 	}
 
 }
@@ -14,6 +14,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <stdint.h>
 #include "MMDevice.h"
 #include "ImageMetadata.h"
 
@@ -50,7 +51,7 @@ private:
 	void SetupAccumulator();
 
    unsigned char* pixels_;
-   std::vector<double> accumulator_;
+   std::vector<uint32_t> accumulator_;
 
    unsigned int width_;
    unsigned int height_;
@@ -0,0 +1,201 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          CameraStreamMerger.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Merges the sequence acquisitions of the physical cameras of
+//                a MultiCamera into frame-aligned channel inserts
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+
+#include "CameraStreamMerger.h"
+
+#include "../../MMDevice/ImgBuffer.h"
+#include "../../MMDevice/MMDeviceConstants.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+CameraStreamMerger::CameraStreamMerger() :
+   core_(0),
+   mergedFrames_(0)
+{
+}
+
+
+void CameraStreamMerger::Start(MM::Core* core, const std::vector<MM::Camera*>& cameras)
+{
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      core_ = core;
+      cameras_ = cameras;
+      queues_.assign(cameras.size(), std::deque<QueuedImage>());
+      mergedFrames_ = 0;
+   }
+   for (size_t i = 0; i < cameras.size(); ++i)
+      cameras[i]->SetCallback(this);
+}
+
+
+size_t CameraStreamMerger::Stop()
+{
+   std::vector<MM::Camera*> cameras;
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      cameras.swap(cameras_);
+   }
+   for (size_t i = 0; i < cameras.size(); ++i)
+      cameras[i]->SetCallback(core_);
+
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   size_t dropped = 0;
+   for (size_t i = 0; i < queues_.size(); ++i)
+      dropped = std::max(dropped, queues_[i].size());
+   queues_.clear();
+   spareBuffers_.clear();
+   return dropped;
+}
+
+
+long CameraStreamMerger::GetMergedFrameCount() const
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   return mergedFrames_;
+}
+
+
+int CameraStreamMerger::InsertImage(const MM::Device* caller, const ImgBuffer& buf)
+{
+   boost::unique_lock<boost::mutex> lock(mutex_);
+   int channel = ChannelOf(caller);
+   if (channel < 0)
+   {
+      lock.unlock();
+      return core_->InsertImage(caller, buf);
+   }
+   return Merge(channel, buf.GetPixels(), buf.Width(), buf.Height(), buf.Depth(), 1,
+         buf.GetMetadata().Serialize(), true);
+}
+
+
+int CameraStreamMerger::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, const char* serializedMetadata, const bool doProcess)
+{
+   boost::unique_lock<boost::mutex> lock(mutex_);
+   int channel = ChannelOf(caller);
+   if (channel < 0)
+   {
+      lock.unlock();
+      return core_->InsertImage(caller, buf, width, height, byteDepth, nComponents, serializedMetadata, doProcess);
+   }
+   return Merge(channel, buf, width, height, byteDepth, nComponents,
+         serializedMetadata ? serializedMetadata : "", doProcess);
+}
+
+
+int CameraStreamMerger::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, const Metadata* md, const bool doProcess)
+{
+   boost::unique_lock<boost::mutex> lock(mutex_);
+   int channel = ChannelOf(caller);
+   if (channel < 0)
+   {
+      lock.unlock();
+      return core_->InsertImage(caller, buf, width, height, byteDepth, md, doProcess);
+   }
+   return Merge(channel, buf, width, height, byteDepth, 1,
+         md ? md->Serialize() : std::string(), doProcess);
+}
+
+
+int CameraStreamMerger::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, const char* serializedMetadata, const bool doProcess)
+{
+   return InsertImage(caller, buf, width, height, byteDepth, 1, serializedMetadata, doProcess);
+}
+
+
+int CameraStreamMerger::ChannelOf(const MM::Device* caller) const
+{
+   for (size_t i = 0; i < cameras_.size(); ++i)
+   {
+      if (cameras_[i] == caller)
+         return static_cast<int>(i);
+   }
+   return -1;
+}
+
+
+int CameraStreamMerger::Merge(int channel, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, const std::string& serializedMetadata, bool doProcess)
+{
+   // Every merged frame takes one image from each queue, so the first queued
+   // image of each camera always belongs to the same frame
+   bool complete = true;
+   for (size_t i = 0; i < queues_.size(); ++i)
+   {
+      if (static_cast<int>(i) != channel && queues_[i].empty())
+      {
+         complete = false;
+         break;
+      }
+   }
+
+   if (!complete)
+   {
+      if (queues_[channel].size() >= maxQueuedFrames)
+         return DEVICE_BUFFER_OVERFLOW;
+
+      queues_[channel].push_back(QueuedImage());
+      QueuedImage& image = queues_[channel].back();
+      if (!spareBuffers_.empty())
+      {
+         // Reuse the memory of an image that was passed on earlier
+         image.pixels.swap(spareBuffers_.back());
+         spareBuffers_.pop_back();
+      }
+      image.pixels.assign(buf, buf + width * height * byteDepth);
+      image.width = width;
+      image.height = height;
+      image.byteDepth = byteDepth;
+      image.nComponents = nComponents;
+      image.serializedMetadata = serializedMetadata;
+      image.doProcess = doProcess;
+      return DEVICE_OK;
+   }
+
+   // Pass on the frame in channel order. Inserting while holding the lock
+   // keeps frames from different threads from interleaving.
+   int ret = DEVICE_OK;
+   for (size_t i = 0; i < queues_.size(); ++i)
+   {
+      int err;
+      if (static_cast<int>(i) == channel)
+      {
+         err = core_->InsertImage(cameras_[i], buf, width, height, byteDepth,
+               nComponents, serializedMetadata.c_str(), doProcess);
+      }
+      else
+      {
+         const QueuedImage& image = queues_[i].front();
+         err = core_->InsertImage(cameras_[i], &image.pixels[0], image.width,
+               image.height, image.byteDepth, image.nComponents,
+               image.serializedMetadata.c_str(), image.doProcess);
+         spareBuffers_.push_back(std::vector<unsigned char>());
+         spareBuffers_.back().swap(queues_[i].front().pixels);
+         queues_[i].pop_front();
+      }
+      if (ret == DEVICE_OK)
+         ret = err;
+   }
+   ++mergedFrames_;
+   return ret;
+}
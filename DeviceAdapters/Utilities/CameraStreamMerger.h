@@ -0,0 +1,148 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          CameraStreamMerger.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Merges the sequence acquisitions of the physical cameras of
+//                a MultiCamera into frame-aligned channel inserts
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+
+#ifndef _CAMERASTREAMMERGER_H_
+#define _CAMERASTREAMMERGER_H_
+
+#include "../../MMDevice/MMDevice.h"
+#include "../../MMDevice/ImageMetadata.h"
+
+#include <boost/thread.hpp>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+/**
+ * CameraStreamMerger: core callback that stands in for the real one while
+ * the physical cameras of a MultiCamera run a sequence acquisition.
+ *
+ * Images inserted by the cameras are held back until every camera has
+ * delivered the same frame number, and are then passed on to the core one
+ * channel after the other. The core thus sees complete frames, in channel
+ * order, and never a channel of frame n+1 before all channels of frame n.
+ * The image of the camera that completes a frame is passed on directly from
+ * its own buffer; only images that have to wait are copied.
+ *
+ * All other callbacks are forwarded unchanged.
+ */
+class CameraStreamMerger : public MM::Core
+{
+public:
+   // Frames a camera can be ahead of the slowest one before its inserts
+   // fail with DEVICE_BUFFER_OVERFLOW
+   static const size_t maxQueuedFrames = 64;
+
+   CameraStreamMerger();
+
+   // Installs the merger as callback of the cameras. The cameras are the
+   // channels in the given order.
+   void Start(MM::Core* core, const std::vector<MM::Camera*>& cameras);
+   // Restores the core callback of the cameras. Returns the number of
+   // incomplete frames that were dropped.
+   size_t Stop();
+
+   long GetMergedFrameCount() const;
+
+   // Image inserts, merged while started
+   int InsertImage(const MM::Device* caller, const ImgBuffer& buf);
+   int InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, const char* serializedMetadata, const bool doProcess = true);
+   int InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, const Metadata* md = 0, const bool doProcess = true);
+   int InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, const char* serializedMetadata, const bool doProcess = true);
+
+   // Everything else goes to the core unchanged
+   int LogMessage(const MM::Device* caller, const char* msg, bool debugOnly) const { return core_->LogMessage(caller, msg, debugOnly); }
+   MM::Device* GetDevice(const MM::Device* caller, const char* label) { return core_->GetDevice(caller, label); }
+   int GetDeviceProperty(const char* deviceName, const char* propName, char* value) { return core_->GetDeviceProperty(deviceName, propName, value); }
+   int SetDeviceProperty(const char* deviceName, const char* propName, const char* value) { return core_->SetDeviceProperty(deviceName, propName, value); }
+   void GetLoadedDeviceOfType(const MM::Device* caller, MM::DeviceType devType, char* pDeviceName, const unsigned int deviceIterator) { core_->GetLoadedDeviceOfType(caller, devType, pDeviceName, deviceIterator); }
+   int SetSerialProperties(const char* portName, const char* answerTimeout, const char* baudRate, const char* delayBetweenCharsMs, const char* handshaking, const char* parity, const char* stopBits)
+   { return core_->SetSerialProperties(portName, answerTimeout, baudRate, delayBetweenCharsMs, handshaking, parity, stopBits); }
+   int SetSerialCommand(const MM::Device* caller, const char* portName, const char* command, const char* term) { return core_->SetSerialCommand(caller, portName, command, term); }
+   int GetSerialAnswer(const MM::Device* caller, const char* portName, unsigned long ansLength, char* answer, const char* term) { return core_->GetSerialAnswer(caller, portName, ansLength, answer, term); }
+   int WriteToSerial(const MM::Device* caller, const char* port, const unsigned char* buf, unsigned long length) { return core_->WriteToSerial(caller, port, buf, length); }
+   int ReadFromSerial(const MM::Device* caller, const char* port, unsigned char* buf, unsigned long length, unsigned long& read) { return core_->ReadFromSerial(caller, port, buf, length, read); }
+   int PurgeSerial(const MM::Device* caller, const char* portName) { return core_->PurgeSerial(caller, portName); }
+   MM::PortType GetSerialPortType(const char* portName) const { return core_->GetSerialPortType(portName); }
+   int OnPropertiesChanged(const MM::Device* caller) { return core_->OnPropertiesChanged(caller); }
+   int OnPropertyChanged(const MM::Device* caller, const char* propName, const char* propValue) { return core_->OnPropertyChanged(caller, propName, propValue); }
+   int OnStagePositionChanged(const MM::Device* caller, double pos) { return core_->OnStagePositionChanged(caller, pos); }
+   int OnXYStagePositionChanged(const MM::Device* caller, double xPos, double yPos) { return core_->OnXYStagePositionChanged(caller, xPos, yPos); }
+   int OnExposureChanged(const MM::Device* caller, double newExposure) { return core_->OnExposureChanged(caller, newExposure); }
+   int OnSLMExposureChanged(const MM::Device* caller, double newExposure) { return core_->OnSLMExposureChanged(caller, newExposure); }
+   int OnMagnifierChanged(const MM::Device* caller) { return core_->OnMagnifierChanged(caller); }
+   unsigned long GetClockTicksUs(const MM::Device* caller) { return core_->GetClockTicksUs(caller); }
+   MM::MMTime GetCurrentMMTime() { return core_->GetCurrentMMTime(); }
+   int AcqFinished(const MM::Device* caller, int statusCode) { return core_->AcqFinished(caller, statusCode); }
+   int PrepareForAcq(const MM::Device* caller) { return core_->PrepareForAcq(caller); }
+   void ClearImageBuffer(const MM::Device* caller) { core_->ClearImageBuffer(caller); }
+   bool InitializeImageBuffer(unsigned channels, unsigned slices, unsigned int w, unsigned int h, unsigned int pixDepth) { return core_->InitializeImageBuffer(channels, slices, w, h, pixDepth); }
+   int InsertMultiChannel(const MM::Device* caller, const unsigned char* buf, unsigned numChannels, unsigned width, unsigned height, unsigned byteDepth, Metadata* md = 0) { return core_->InsertMultiChannel(caller, buf, numChannels, width, height, byteDepth, md); }
+   const char* GetImage() { return core_->GetImage(); }
+   int GetImageDimensions(int& width, int& height, int& depth) { return core_->GetImageDimensions(width, height, depth); }
+   int GetFocusPosition(double& pos) { return core_->GetFocusPosition(pos); }
+   int SetFocusPosition(double pos) { return core_->SetFocusPosition(pos); }
+   int MoveFocus(double velocity) { return core_->MoveFocus(velocity); }
+   int SetXYPosition(double x, double y) { return core_->SetXYPosition(x, y); }
+   int GetXYPosition(double& x, double& y) { return core_->GetXYPosition(x, y); }
+   int MoveXYStage(double vX, double vY) { return core_->MoveXYStage(vX, vY); }
+   int SetExposure(double expMs) { return core_->SetExposure(expMs); }
+   int GetExposure(double& expMs) { return core_->GetExposure(expMs); }
+   int SetConfig(const char* group, const char* name) { return core_->SetConfig(group, name); }
+   int GetCurrentConfig(const char* group, int bufLen, char* name) { return core_->GetCurrentConfig(group, bufLen, name); }
+   int GetChannelConfig(char* channelConfigName, const unsigned int channelConfigIterator) { return core_->GetChannelConfig(channelConfigName, channelConfigIterator); }
+   MM::ImageProcessor* GetImageProcessor(const MM::Device* caller) { return core_->GetImageProcessor(caller); }
+   MM::AutoFocus* GetAutoFocus(const MM::Device* caller) { return core_->GetAutoFocus(caller); }
+   MM::Hub* GetParentHub(const MM::Device* caller) const { return core_->GetParentHub(caller); }
+   MM::State* GetStateDevice(const MM::Device* caller, const char* deviceName) { return core_->GetStateDevice(caller, deviceName); }
+   MM::SignalIO* GetSignalIODevice(const MM::Device* caller, const char* deviceName) { return core_->GetSignalIODevice(caller, deviceName); }
+   void NextPostedError(int& errorCode, char* pMessage, int maxlen, int& messageLength) { core_->NextPostedError(errorCode, pMessage, maxlen, messageLength); }
+   void PostError(const int errorCode, const char* pMessage) { core_->PostError(errorCode, pMessage); }
+   void ClearPostedErrors() { core_->ClearPostedErrors(); }
+
+private:
+   // An image that waits for the other channels of its frame
+   struct QueuedImage
+   {
+      std::vector<unsigned char> pixels;
+      unsigned width;
+      unsigned height;
+      unsigned byteDepth;
+      unsigned nComponents;
+      std::string serializedMetadata;
+      bool doProcess;
+   };
+
+   // Returns the channel of the camera, or -1 if it is not merged
+   int ChannelOf(const MM::Device* caller) const;
+   // Queues a copy of the image, or passes on the frame if the image
+   // completes it. Called with mutex_ held.
+   int Merge(int channel, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents, const std::string& serializedMetadata, bool doProcess);
+
+   MM::Core* core_;
+   std::vector<MM::Camera*> cameras_;
+   std::vector< std::deque<QueuedImage> > queues_;
+   std::vector< std::vector<unsigned char> > spareBuffers_;
+   long mergedFrames_;
+   mutable boost::mutex mutex_;
+};
+
+#endif // _CAMERASTREAMMERGER_H_
@@ -0,0 +1,246 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          FrameAccumulator.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Combines runs of camera frames into one by averaging,
+//                summing or maximum projection, with scalar and SSE2 kernels
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+
+#include "FrameAccumulator.h"
+
+#include <algorithm>
+
+// SSE2 is part of x86-64
+#if defined(_M_X64) || defined(__x86_64__)
+#define FRAMEACCUMULATOR_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+template <typename SampleType>
+inline void AccumulateScalar(uint32_t* acc, const SampleType* samples, size_t count)
+{
+   for (size_t i = 0; i < count; ++i)
+      acc[i] += samples[i];
+}
+
+template <typename SampleType>
+inline void MaxScalar(uint32_t* acc, const SampleType* samples, size_t count)
+{
+   for (size_t i = 0; i < count; ++i)
+      acc[i] = std::max<uint32_t>(acc[i], samples[i]);
+}
+
+template <typename SampleType>
+inline void ScaleScalar(const uint32_t* acc, uint32_t divisor, SampleType* out, size_t count, uint32_t maxValue)
+{
+   if (divisor == 1)
+   {
+      for (size_t i = 0; i < count; ++i)
+         out[i] = static_cast<SampleType>(std::min(acc[i], maxValue));
+      return;
+   }
+
+   // Sums of a run stay far below 2^32 - divisor / 2
+   const uint32_t half = divisor / 2;
+   for (size_t i = 0; i < count; ++i)
+      out[i] = static_cast<SampleType>(std::min((acc[i] + half) / divisor, maxValue));
+}
+
+#ifdef FRAMEACCUMULATOR_SSE2
+
+// Maxima are sample values, below 2^16, so the signed 32 bit compare of SSE2
+// orders them correctly
+inline __m128i Max32(__m128i a, __m128i b)
+{
+   __m128i aGreater = _mm_cmpgt_epi32(a, b);
+   return _mm_or_si128(_mm_and_si128(aGreater, a), _mm_andnot_si128(aGreater, b));
+}
+
+// Calls op(acc, samples) on 4 accumulators at a time, 16 8-bit samples per
+// iteration
+template <typename Op>
+inline size_t Vector8(uint32_t* acc, const uint8_t* samples, size_t count, Op op)
+{
+   const __m128i zero = _mm_setzero_si128();
+   size_t i = 0;
+   for (; i + 16 <= count; i += 16)
+   {
+      __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+      __m128i lo = _mm_unpacklo_epi8(s, zero);
+      __m128i hi = _mm_unpackhi_epi8(s, zero);
+      __m128i* a = reinterpret_cast<__m128i*>(acc + i);
+      _mm_storeu_si128(a + 0, op(_mm_loadu_si128(a + 0), _mm_unpacklo_epi16(lo, zero)));
+      _mm_storeu_si128(a + 1, op(_mm_loadu_si128(a + 1), _mm_unpackhi_epi16(lo, zero)));
+      _mm_storeu_si128(a + 2, op(_mm_loadu_si128(a + 2), _mm_unpacklo_epi16(hi, zero)));
+      _mm_storeu_si128(a + 3, op(_mm_loadu_si128(a + 3), _mm_unpackhi_epi16(hi, zero)));
+   }
+   return i;
+}
+
+// Same with 8 16-bit samples per iteration
+template <typename Op>
+inline size_t Vector16(uint32_t* acc, const uint16_t* samples, size_t count, Op op)
+{
+   const __m128i zero = _mm_setzero_si128();
+   size_t i = 0;
+   for (; i + 8 <= count; i += 8)
+   {
+      __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+      __m128i* a = reinterpret_cast<__m128i*>(acc + i);
+      _mm_storeu_si128(a + 0, op(_mm_loadu_si128(a + 0), _mm_unpacklo_epi16(s, zero)));
+      _mm_storeu_si128(a + 1, op(_mm_loadu_si128(a + 1), _mm_unpackhi_epi16(s, zero)));
+   }
+   return i;
+}
+
+struct AddOp
+{
+   __m128i operator()(__m128i a, __m128i b) const { return _mm_add_epi32(a, b); }
+};
+
+struct MaxOp
+{
+   __m128i operator()(__m128i a, __m128i b) const { return Max32(a, b); }
+};
+
+#endif // FRAMEACCUMULATOR_SSE2
+
+} // anonymous namespace
+
+
+void AccumulateSamples8(uint32_t* acc, const uint8_t* samples, size_t count)
+{
+   size_t done = 0;
+#ifdef FRAMEACCUMULATOR_SSE2
+   done = Vector8(acc, samples, count, AddOp());
+#endif
+   AccumulateScalar(acc + done, samples + done, count - done);
+}
+
+void AccumulateSamples16(uint32_t* acc, const uint16_t* samples, size_t count)
+{
+   size_t done = 0;
+#ifdef FRAMEACCUMULATOR_SSE2
+   done = Vector16(acc, samples, count, AddOp());
+#endif
+   AccumulateScalar(acc + done, samples + done, count - done);
+}
+
+void MaxSamples8(uint32_t* acc, const uint8_t* samples, size_t count)
+{
+   size_t done = 0;
+#ifdef FRAMEACCUMULATOR_SSE2
+   done = Vector8(acc, samples, count, MaxOp());
+#endif
+   MaxScalar(acc + done, samples + done, count - done);
+}
+
+void MaxSamples16(uint32_t* acc, const uint16_t* samples, size_t count)
+{
+   size_t done = 0;
+#ifdef FRAMEACCUMULATOR_SSE2
+   done = Vector16(acc, samples, count, MaxOp());
+#endif
+   MaxScalar(acc + done, samples + done, count - done);
+}
+
+void ScaleSamples8(const uint32_t* acc, uint32_t divisor, uint8_t* out, size_t count)
+{
+   ScaleScalar(acc, divisor, out, count, 0xff);
+}
+
+void ScaleSamples16(const uint32_t* acc, uint32_t divisor, uint16_t* out, size_t count)
+{
+   ScaleScalar(acc, divisor, out, count, 0xffff);
+}
+
+
+FrameAccumulator::FrameAccumulator() :
+   mode_(Average),
+   frameCount_(1),
+   framesAdded_(0),
+   sampleCount_(0),
+   bytesPerSample_(1)
+{
+}
+
+void FrameAccumulator::SetMode(Mode mode)
+{
+   mode_ = mode;
+   Reset();
+}
+
+void FrameAccumulator::SetFrameCount(unsigned frameCount)
+{
+   frameCount_ = std::max(frameCount, 1u);
+   Reset();
+}
+
+void FrameAccumulator::Reset()
+{
+   framesAdded_ = 0;
+}
+
+bool FrameAccumulator::AddFrame(const unsigned char* samples, size_t sampleCount, unsigned bytesPerSample)
+{
+   if (framesAdded_ >= frameCount_ || sampleCount != sampleCount_ ||
+         bytesPerSample != bytesPerSample_)
+   {
+      framesAdded_ = 0;
+   }
+   if (framesAdded_ == 0)
+   {
+      sampleCount_ = sampleCount;
+      bytesPerSample_ = bytesPerSample;
+      acc_.assign(sampleCount, 0);
+   }
+
+   uint32_t* acc = acc_.empty() ? 0 : &acc_[0];
+   if (bytesPerSample == 2)
+   {
+      const uint16_t* s = reinterpret_cast<const uint16_t*>(samples);
+      if (mode_ == Maximum)
+         MaxSamples16(acc, s, sampleCount);
+      else
+         AccumulateSamples16(acc, s, sampleCount);
+   }
+   else
+   {
+      if (mode_ == Maximum)
+         MaxSamples8(acc, samples, sampleCount);
+      else
+         AccumulateSamples8(acc, samples, sampleCount);
+   }
+
+   return ++framesAdded_ >= frameCount_;
+}
+
+void FrameAccumulator::GetResult(unsigned char* out) const
+{
+   if (acc_.empty())
+      return;
+
+   uint32_t divisor = 1;
+   if (mode_ == Average && framesAdded_ > 0)
+      divisor = framesAdded_;
+
+   if (bytesPerSample_ == 2)
+      ScaleSamples16(&acc_[0], divisor, reinterpret_cast<uint16_t*>(out), sampleCount_);
+   else
+      ScaleSamples8(&acc_[0], divisor, out, sampleCount_);
+}
@@ -0,0 +1,90 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          FrameAccumulator.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Combines runs of camera frames into one by averaging,
+//                summing or maximum projection, with scalar and SSE2 kernels
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+
+#ifndef _FRAMEACCUMULATOR_H_
+#define _FRAMEACCUMULATOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Kernels on arrays of samples. The accumulators are 32 bit, so they hold
+// the sum of at least 65537 frames of 16 bit samples.
+//
+// acc[i] += samples[i]
+void AccumulateSamples8(uint32_t* acc, const uint8_t* samples, size_t count);
+void AccumulateSamples16(uint32_t* acc, const uint16_t* samples, size_t count);
+// acc[i] = max(acc[i], samples[i])
+void MaxSamples8(uint32_t* acc, const uint8_t* samples, size_t count);
+void MaxSamples16(uint32_t* acc, const uint16_t* samples, size_t count);
+// out[i] = acc[i] / divisor, rounded to nearest and clipped to the sample
+// range. The output is produced once per run of frames, so it is scalar.
+void ScaleSamples8(const uint32_t* acc, uint32_t divisor, uint8_t* out, size_t count);
+void ScaleSamples16(const uint32_t* acc, uint32_t divisor, uint16_t* out, size_t count);
+
+
+/**
+ * FrameAccumulator: combines every run of N frames into one.
+ *
+ * Frames are arrays of 8 or 16 bit samples; multi-component pixels are
+ * combined per component. A frame of a different size or sample depth than
+ * the previous one starts a new run.
+ */
+class FrameAccumulator
+{
+public:
+   enum Mode
+   {
+      Average,
+      Sum,
+      Maximum
+   };
+
+   FrameAccumulator();
+
+   Mode GetMode() const { return mode_; }
+   unsigned GetFrameCount() const { return frameCount_; }
+   unsigned GetFramesAdded() const { return framesAdded_; }
+
+   // Both discard the frames of the current run
+   void SetMode(Mode mode);
+   void SetFrameCount(unsigned frameCount);
+
+   void Reset();
+
+   // Returns true if the frame completes the run; the next frame then starts
+   // a new one
+   bool AddFrame(const unsigned char* samples, size_t sampleCount, unsigned bytesPerSample);
+
+   // Writes the combination of the frames added to the current (or just
+   // completed) run, in the sample depth of the frames
+   void GetResult(unsigned char* out) const;
+
+private:
+   Mode mode_;
+   unsigned frameCount_;
+   unsigned framesAdded_;
+   size_t sampleCount_;
+   unsigned bytesPerSample_;
+   std::vector<uint32_t> acc_;
+};
+
+#endif // _FRAMEACCUMULATOR_H_
@@ -54,6 +54,7 @@ const char* g_DeviceNameMultiDAStateDevice = "Multi DA State Device";
 const char* g_DeviceNameAutoFocusStage = "AutoFocus Stage";
 const char* g_DeviceNameStateDeviceShutter = "State Device Shutter";
 const char* g_DeviceNameSerialDTRShutter = "Serial port DTR Shutter";
+const char* g_DeviceNameFrameAccumulator = "Frame Accumulator";
 
 const char* g_PropertyMinUm = "Stage Low Position(um)";
 const char* g_PropertyMaxUm = "Stage High Position(um)";
@@ -62,6 +63,16 @@ const char* g_SyncNow = "Sync positions now";
 const char* g_normalLogicString = "Normal";
 const char* g_invertedLogicString = "Inverted";
 
+const char* g_PropertySequenceMode = "Sequence Mode";
+const char* g_SequenceModeIndependent = "Independent";
+const char* g_SequenceModeMerged = "Merge by frame number";
+
+const char* g_PropertyFrameCount = "Number of Frames";
+const char* g_PropertyAccumulationMode = "Mode";
+const char* g_AccumulationModeAverage = "Average";
+const char* g_AccumulationModeSum = "Sum";
+const char* g_AccumulationModeMaximum = "Maximum";
+
 
 inline long Round(double x)
 {
@@ -93,6 +104,7 @@ MODULE_API void InitializeModuleData()
    RegisterDevice(g_DeviceNameAutoFocusStage, MM::StageDevice, "AutoFocus offset acting as a Z-stage");
    RegisterDevice(g_DeviceNameStateDeviceShutter, MM::ShutterDevice, "State device used as a shutter");
    RegisterDevice(g_DeviceNameSerialDTRShutter, MM::ShutterDevice, "Serial port DTR used as a shutter");
+   RegisterDevice(g_DeviceNameFrameAccumulator, MM::ImageProcessorDevice, "Average, sum or maximum-project every N frames of a sequence");
 }
 
 MODULE_API MM::Device* CreateDevice(const char* deviceName)                  
@@ -128,6 +140,8 @@ MODULE_API MM::Device* CreateDevice(const char* deviceName)
       return new StateDeviceShutter();
    } else if (strcmp(deviceName, g_DeviceNameSerialDTRShutter) == 0) {
       return new SerialDTRShutter();
+   } else if (strcmp(deviceName, g_DeviceNameFrameAccumulator) == 0) {
+      return new FrameAccumulatorProcessor();
    }
 
    return 0;
@@ -326,13 +340,99 @@ int MultiShutter::OnState(MM::PropertyBase* pProp, MM::ActionType eAct)
    return DEVICE_OK;
 }
 
+/*
+ * WorkerPool implementation
+ */
+WorkerPool::WorkerPool() :
+   pending_(0),
+   quit_(false)
+{
+}
+
+WorkerPool::~WorkerPool()
+{
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      quit_ = true;
+   }
+   workCond_.notify_all();
+   for (size_t i = 0; i < threads_.size(); ++i)
+   {
+      threads_[i]->join();
+      delete threads_[i];
+   }
+}
+
+int WorkerPool::Run(const std::vector<Job>& jobs)
+{
+   if (jobs.empty())
+      return DEVICE_OK;
+
+   // The calling thread runs the first job, the pool the others
+   size_t nrWorkers = jobs.size() - 1;
+   if (nrWorkers > 0)
+   {
+      {
+         boost::lock_guard<boost::mutex> lock(mutex_);
+         while (threads_.size() < nrWorkers)
+         {
+            jobs_.push_back(Job());
+            results_.push_back(DEVICE_OK);
+            threads_.push_back(new boost::thread(
+                     boost::bind(&WorkerPool::WorkerLoop, this, threads_.size())));
+         }
+         for (size_t i = 0; i < nrWorkers; ++i)
+         {
+            jobs_[i] = jobs[i + 1];
+            results_[i] = DEVICE_OK;
+         }
+         pending_ = nrWorkers;
+      }
+      workCond_.notify_all();
+   }
+
+   int ret = jobs[0]();
+
+   boost::unique_lock<boost::mutex> lock(mutex_);
+   while (pending_ > 0)
+      doneCond_.wait(lock);
+   for (size_t i = 0; i < nrWorkers && ret == DEVICE_OK; ++i)
+      ret = results_[i];
+   return ret;
+}
+
+void WorkerPool::WorkerLoop(size_t slot)
+{
+   boost::unique_lock<boost::mutex> lock(mutex_);
+   for (;;)
+   {
+      while (!quit_ && jobs_[slot].empty())
+         workCond_.wait(lock);
+      if (quit_)
+         return;
+
+      Job job = jobs_[slot];
+      lock.unlock();
+      int ret = job();
+      lock.lock();
+
+      results_[slot] = ret;
+      jobs_[slot].clear();
+      if (--pending_ == 0)
+         doneCond_.notify_all();
+   }
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
-// Multi Shutter implementation
+// Multi Camera implementation
 ///////////////////////////////////////////////////////////////////////////////
 MultiCamera::MultiCamera() :
    imageBuffer_(0),
    nrCamerasInUse_(0),
-   initialized_(false)
+   initialized_(false),
+   mergeSequences_(false),
+   merging_(false)
 {
    InitializeDefaultErrorMessages();
 
@@ -360,6 +460,8 @@ MultiCamera::~MultiCamera()
 
 int MultiCamera::Shutdown()
 {
+   if (merging_)
+      StopMerging();
    delete imageBuffer_;
    // Rely on the cameras to shut themselves down
    return DEVICE_OK;
@@ -409,6 +511,13 @@ int MultiCamera::Initialize()
    CPropertyAction* pAct = new CPropertyAction(this, &MultiCamera::OnBinning);
    CreateProperty(MM::g_Keyword_Binning, "1", MM::Integer, false, pAct, false);
 
+   // In merged mode the images of the physical cameras are passed on a frame
+   // at a time, all channels of frame n before any channel of frame n+1
+   pAct = new CPropertyAction(this, &MultiCamera::OnSequenceMode);
+   CreateProperty(g_PropertySequenceMode, g_SequenceModeIndependent, MM::String, false, pAct, false);
+   AddAllowedValue(g_PropertySequenceMode, g_SequenceModeIndependent);
+   AddAllowedValue(g_PropertySequenceMode, g_SequenceModeMerged);
+
    initialized_ = true;
 
    return DEVICE_OK;
@@ -427,19 +536,12 @@ int MultiCamera::SnapImage()
    if (!ImageSizesAreEqual())
       return ERR_NO_EQUAL_SIZE;
 
-   CameraSnapThread t[MAX_NUMBER_PHYSICAL_CAMERAS];
-   for (unsigned int i = 0; i < physicalCameras_.size(); i++)
-   {
-      if (physicalCameras_[i] != 0) 
-      {
-         t[i].SetCamera(physicalCameras_[i]);
-         t[i].Start();
-      }
-   }
-   // I think that the CameraSnapThread destructor waits until the SnapImage function is done
-   // So, we are likely to be waiting here until all cameras are done snapping
-
-   return DEVICE_OK;
+   // Returns when all cameras are done snapping
+   std::vector<MM::Camera*> cameras = CamerasInUse();
+   std::vector<WorkerPool::Job> jobs;
+   for (size_t i = 0; i < cameras.size(); ++i)
+      jobs.push_back(boost::bind(&MM::Camera::SnapImage, cameras[i]));
+   return snapPool_.Run(jobs);
 }
 
 /**
@@ -455,44 +557,38 @@ const unsigned char* MultiCamera::GetImageBuffer()
 
 const unsigned char* MultiCamera::GetImageBuffer(unsigned channelNr)
 {
-   // We have a vector of physicalCameras, and a vector of Strings listing the cameras
-   // we actually use.  
-   int j = -1;
+   int i = Logical2Physical(channelNr);
+   if (i < 0 || physicalCameras_[i] == 0)
+      return 0;
+
+   // When all cameras have the same size (which SnapImage() makes sure of)
+   // the physical camera's buffer is returned as is
    unsigned height = GetImageHeight();
    unsigned width = GetImageWidth();
+   unsigned thisHeight = physicalCameras_[i]->GetImageHeight();
+   unsigned thisWidth = physicalCameras_[i]->GetImageWidth();
+   if (height == thisHeight && width == thisWidth)
+      return physicalCameras_[i]->GetImageBuffer();
+
+   // Otherwise pad the image to the size of the largest one
    unsigned pixDepth = GetImageBytesPerPixel();
-   for (unsigned int i = 0; i < physicalCameras_.size(); i++)
+   img_.Resize(width, height, pixDepth);
+   img_.ResetPixels();
+   const unsigned char* pixels = physicalCameras_[i]->GetImageBuffer();
+   if (width == thisWidth)
    {
-      if (usedCameras_[i] != g_Undefined)
-         j++;
-      if (j == (int) channelNr)
+      memcpy(img_.GetPixelsRW(), pixels, thisHeight * thisWidth * pixDepth);
+   }
+   else 
+   {
+      // we need to copy line by line
+      for (unsigned line = 0; line < thisHeight; line++)
       {
-         unsigned thisHeight = physicalCameras_[i]->GetImageHeight();
-         unsigned thisWidth = physicalCameras_[i]->GetImageWidth();
-         if (height == thisHeight && width == thisWidth)
-            return physicalCameras_[i]->GetImageBuffer();
-         else
-         {
-            img_.Resize(width, height, pixDepth);
-            img_.ResetPixels();
-            if (width == thisWidth)
-            {
-               memcpy(img_.GetPixelsRW(), physicalCameras_[i]->GetImageBuffer(), thisHeight * thisWidth * pixDepth);
-            }
-            else 
-            {
-               // we need to copy line by line
-               const unsigned char* pixels = physicalCameras_[i]->GetImageBuffer();
-               for (unsigned i=0; i < thisHeight; i++)
-               {
-                  memcpy(img_.GetPixelsRW() + i * width, pixels + i * thisWidth, thisWidth);
-               }
-            }
-            return img_.GetPixels();
-         }
+         memcpy(img_.GetPixelsRW() + line * width * pixDepth,
+               pixels + line * thisWidth * pixDepth, thisWidth * pixDepth);
       }
    }
-   return 0;
+   return img_.GetPixels();
 }
 
 bool MultiCamera::IsCapturing()
@@ -732,6 +828,9 @@ int MultiCamera::StartSequenceAcquisition(double interval)
    if (!ImageSizesAreEqual())
       return ERR_NO_EQUAL_SIZE;
 
+   if (mergeSequences_)
+      StartMerging();
+
    for (unsigned int i = 0; i < physicalCameras_.size(); i++)
    {
       if (physicalCameras_[i] != 0)
@@ -756,6 +855,9 @@ int MultiCamera::StartSequenceAcquisition(long numImages, double interval_ms, bo
    if (nrCamerasInUse_ < 1)
       return ERR_NO_PHYSICAL_CAMERA;
 
+   if (mergeSequences_)
+      StartMerging();
+
    for (unsigned int i = 0; i < physicalCameras_.size(); i++)
    {
       if (physicalCameras_[i] != 0)
@@ -778,7 +880,11 @@ int MultiCamera::StopSequenceAcquisition()
 
          // 
          if (ret != DEVICE_OK)
+         {
+            if (merging_)
+               StopMerging();
             return ret;
+         }
          std::ostringstream os;
          os << i;
          physicalCameras_[i]->AddTag(MM::g_Keyword_CameraChannelName, usedCameras_[i].c_str(),
@@ -787,6 +893,8 @@ int MultiCamera::StopSequenceAcquisition()
                  os.str().c_str());
       }
    }
+   if (merging_)
+      StopMerging();
    return DEVICE_OK;
 }
 
@@ -848,6 +956,37 @@ int MultiCamera::GetChannelName(unsigned channel, char* name)
    return DEVICE_OK;
 }
 
+std::vector<MM::Camera*> MultiCamera::CamerasInUse() const
+{
+   std::vector<MM::Camera*> cameras;
+   for (unsigned int i = 0; i < physicalCameras_.size(); i++)
+   {
+      if (physicalCameras_[i] != 0)
+         cameras.push_back(physicalCameras_[i]);
+   }
+   return cameras;
+}
+
+void MultiCamera::StartMerging()
+{
+   // The merger takes the place of the core callback of the physical
+   // cameras, so it sees their inserts
+   merger_.Start(GetCoreCallback(), CamerasInUse());
+   merging_ = true;
+}
+
+void MultiCamera::StopMerging()
+{
+   size_t dropped = merger_.Stop();
+   merging_ = false;
+
+   std::ostringstream os;
+   os << "Merged " << merger_.GetMergedFrameCount() << " frames";
+   if (dropped > 0)
+      os << ", dropped " << dropped << " incomplete frames";
+   LogMessage(os.str().c_str(), true);
+}
+
 int MultiCamera::Logical2Physical(int logical)
 {
    int j = -1;
@@ -871,6 +1010,9 @@ int MultiCamera::OnPhysicalCamera(MM::PropertyBase* pProp, MM::ActionType eAct,
 
    else if (eAct == MM::AfterSet)
    {
+      if (merging_)
+         StopMerging();
+
       if (physicalCameras_[i] != 0)
       {
          physicalCameras_[i]->RemoveTag(MM::g_Keyword_CameraChannelName);
@@ -938,6 +1080,146 @@ int MultiCamera::OnBinning(MM::PropertyBase* pProp, MM::ActionType eAct)
    return DEVICE_OK;
 }
 
+int MultiCamera::OnSequenceMode(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(mergeSequences_ ? g_SequenceModeMerged : g_SequenceModeIndependent);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      if (IsCapturing())
+         return DEVICE_CAMERA_BUSY_ACQUIRING;
+      std::string mode;
+      pProp->Get(mode);
+      mergeSequences_ = (mode == g_SequenceModeMerged);
+   }
+   return DEVICE_OK;
+}
+
+
+/*
+ * ParallelStageCommands implementation
+ */
+void ParallelStageCommands::Add(MM::Stage* stage, double value)
+{
+   Target target;
+   target.stage = stage;
+   char module[MM::MaxStrLength];
+   stage->GetModuleName(module);
+   target.module = module;
+   target.value = value;
+   target.result = DEVICE_OK;
+   target.busy = false;
+   targets_.push_back(target);
+}
+
+
+int ParallelStageCommands::Run(Command command, WorkerPool& pool)
+{
+   // Group the stages by module, keeping the order within each module
+   std::vector<std::string> modules;
+   std::vector< std::vector<size_t> > groups;
+   for (size_t i = 0; i < targets_.size(); ++i)
+   {
+      size_t g = std::find(modules.begin(), modules.end(), targets_[i].module) - modules.begin();
+      if (g == modules.size())
+      {
+         modules.push_back(targets_[i].module);
+         groups.push_back(std::vector<size_t>());
+      }
+      groups[g].push_back(i);
+   }
+
+   // The calling thread takes the first group
+   std::vector<WorkerPool::Job> jobs;
+   for (size_t g = 0; g < groups.size(); ++g)
+      jobs.push_back(boost::bind(&ParallelStageCommands::RunGroup, this, command, groups[g]));
+   pool.Run(jobs);
+
+   for (size_t i = 0; i < targets_.size(); ++i)
+   {
+      if (targets_[i].result != DEVICE_OK)
+         return targets_[i].result;
+   }
+   return DEVICE_OK;
+}
+
+
+bool ParallelStageCommands::AnyBusy() const
+{
+   for (size_t i = 0; i < targets_.size(); ++i)
+   {
+      if (targets_[i].busy)
+         return true;
+   }
+   return false;
+}
+
+
+int ParallelStageCommands::RunGroup(Command command, const std::vector<size_t>& targets)
+{
+   for (size_t i = 0; i < targets.size(); ++i)
+      RunOne(command, targets_[targets[i]]);
+   return DEVICE_OK;
+}
+
+
+void ParallelStageCommands::RunOne(Command command, Target& target)
+{
+   MM::Stage* stage = target.stage;
+   switch (command)
+   {
+      case SetPositionUm:
+         target.result = stage->SetPositionUm(target.value);
+         break;
+      case SetRelativePositionUm:
+         target.result = stage->SetRelativePositionUm(target.value);
+         break;
+      case GetPositionUm:
+         target.result = stage->GetPositionUm(target.value);
+         break;
+      case Busy:
+         target.busy = stage->Busy();
+         target.result = DEVICE_OK;
+         break;
+      case Stop:
+         target.result = stage->Stop();
+         break;
+      case SendStageSequence:
+         target.result = stage->SendStageSequence();
+         break;
+      case StartStageSequence:
+         target.result = stage->StartStageSequence();
+         break;
+      case StopStageSequence:
+         target.result = stage->StopStageSequence();
+         break;
+   }
+}
+
+
+// Starts the sequences of all stages at the same time. If any fails, the
+// ones that did start are stopped again.
+static int StartStageSequences(const std::vector<MM::Stage*>& stages, WorkerPool& pool)
+{
+   ParallelStageCommands start;
+   for (size_t i = 0; i < stages.size(); ++i)
+      start.Add(stages[i]);
+   int err = start.Run(ParallelStageCommands::StartStageSequence, pool);
+   if (err != DEVICE_OK)
+   {
+      ParallelStageCommands stop;
+      for (size_t i = 0; i < stages.size(); ++i)
+      {
+         if (start.Result(i) == DEVICE_OK)
+            stop.Add(stages[i]);
+      }
+      stop.Run(ParallelStageCommands::StopStageSequence, pool);
+   }
+   return err;
+}
+
 
 /*
  * MultiStage implementation
@@ -1060,41 +1342,34 @@ int MultiStage::Shutdown()
 
 bool MultiStage::Busy()
 {
+   // Busy if any physical stage is busy; the stages are queried in parallel
+   ParallelStageCommands commands;
    for (std::vector<MM::Stage*>::iterator it = physicalStages_.begin(),
          end = physicalStages_.end();
          it != end;
          ++it)
    {
-      if (!*it)
-         continue;
-
-      if ((*it)->Busy())
-         return true;
+      if (*it)
+         commands.Add(*it);
    }
-   return false;
+   commands.Run(ParallelStageCommands::Busy, commandPool_);
+   return commands.AnyBusy();
 }
 
 
 int MultiStage::Stop()
 {
-   // Return last error encountered, but make sure Stop() is attempted on all
-   // stages.
-   int ret = DEVICE_OK;
-
+   // Stop() is attempted on all stages, even if some fail
+   ParallelStageCommands commands;
    for (std::vector<MM::Stage*>::iterator it = physicalStages_.begin(),
          end = physicalStages_.end();
          it != end;
          ++it)
    {
-      if (!*it)
-         continue;
-
-      int err = (*it)->Stop();
-      if (err != DEVICE_OK)
-         ret = err;
+      if (*it)
+         commands.Add(*it);
    }
-
-   return ret;
+   return commands.Run(ParallelStageCommands::Stop, commandPool_);
 }
 
 
@@ -1118,33 +1393,32 @@ int MultiStage::Home()
 
 int MultiStage::SetPositionUm(double pos)
 {
+   // Stages on different controllers move at the same time
+   ParallelStageCommands commands;
    for (unsigned i = 0; i < nrPhysicalStages_; ++i)
    {
       if (!physicalStages_[i])
          continue;
 
       double physicalPos = stageScalings_[i] * pos + stageTranslations_[i];
-      int err = physicalStages_[i]->SetPositionUm(physicalPos);
-      if (err != DEVICE_OK)
-         return err;
+      commands.Add(physicalStages_[i], physicalPos);
    }
-   return DEVICE_OK;
+   return commands.Run(ParallelStageCommands::SetPositionUm, commandPool_);
 }
 
 
 int MultiStage::SetRelativePositionUm(double d)
 {
+   ParallelStageCommands commands;
    for (unsigned i = 0; i < nrPhysicalStages_; ++i)
    {
       if (!physicalStages_[i])
          continue;
 
       double physicalRelPos = stageScalings_[i] * d;
-      int err = physicalStages_[i]->SetRelativePositionUm(physicalRelPos);
-      if (err != DEVICE_OK)
-         return err;
+      commands.Add(physicalStages_[i], physicalRelPos);
    }
-   return DEVICE_OK;
+   return commands.Run(ParallelStageCommands::SetRelativePositionUm, commandPool_);
 }
 
 
@@ -1304,53 +1578,33 @@ int MultiStage::GetStageSequenceMaxLength(long& nrEvents) const
 
 int MultiStage::StartStageSequence()
 {
-   // Keep track of started stages in order to stop upon error
-   std::vector<MM::Stage*> startedStages;
-
-   int err;
+   // All sequences are started at the same time
+   std::vector<MM::Stage*> stages;
    for (std::vector<MM::Stage*>::iterator it = physicalStages_.begin(),
          end = physicalStages_.end();
          it != end;
          ++it)
    {
-      if (!*it)
-         continue;
-
-      err = (*it)->StartStageSequence();
-      if (err != DEVICE_OK)
-         goto error;
-
-      startedStages.push_back(*it);
-   }
-   return DEVICE_OK;
-
-error:
-   while (!startedStages.empty())
-   {
-      startedStages.back()->StopStageSequence();
-      startedStages.pop_back();
+      if (*it)
+         stages.push_back(*it);
    }
-   return err;
+   return StartStageSequences(stages, commandPool_);
 }
 
 
 int MultiStage::StopStageSequence()
 {
-   int lastErr = DEVICE_OK;
+   // Try to stop all even after error
+   ParallelStageCommands commands;
    for (std::vector<MM::Stage*>::iterator it = physicalStages_.begin(),
          end = physicalStages_.end();
          it != end;
          ++it)
    {
-      if (!*it)
-         continue;
-
-      int err = (*it)->StopStageSequence();
-      if (err != DEVICE_OK)
-         lastErr = err;
-      // Try to stop all even after error
+      if (*it)
+         commands.Add(*it);
    }
-   return lastErr;
+   return commands.Run(ParallelStageCommands::StopStageSequence, commandPool_);
 }
 
 
@@ -1391,19 +1645,17 @@ int MultiStage::AddToStageSequence(double pos)
 
 int MultiStage::SendStageSequence()
 {
+   // Sequences are uploaded to all controllers at the same time
+   ParallelStageCommands commands;
    for (std::vector<MM::Stage*>::iterator it = physicalStages_.begin(),
          end = physicalStages_.end();
          it != end;
          ++it)
    {
-      if (!*it)
-         continue;
-
-      int err = (*it)->SendStageSequence();
-      if (err != DEVICE_OK)
-         return err;
+      if (*it)
+         commands.Add(*it);
    }
-   return DEVICE_OK;
+   return commands.Run(ParallelStageCommands::SendStageSequence, commandPool_);
 }
 
 
@@ -1634,41 +1886,34 @@ int ComboXYStage::Shutdown()
 
 bool ComboXYStage::Busy()
 {
+   // Busy if either axis is busy; the axes are queried in parallel
+   ParallelStageCommands commands;
    for (std::vector<MM::Stage*>::iterator it = physicalStages_.begin(),
          end = physicalStages_.end();
          it != end;
          ++it)
    {
-      if (!*it)
-         continue;
-
-      if ((*it)->Busy())
-         return true;
+      if (*it)
+         commands.Add(*it);
    }
-   return false;
+   commands.Run(ParallelStageCommands::Busy, commandPool_);
+   return commands.AnyBusy();
 }
 
 
 int ComboXYStage::Stop()
 {
-   // Return last error encountered, but make sure Stop() is attempted on both
-   // axes.
-   int ret = DEVICE_OK;
-
+   // Stop() is attempted on both axes, even if one fails
+   ParallelStageCommands commands;
    for (std::vector<MM::Stage*>::iterator it = physicalStages_.begin(),
          end = physicalStages_.end();
          it != end;
          ++it)
    {
-      if (!*it)
-         continue;
-
-      int err = (*it)->Stop();
-      if (err != DEVICE_OK)
-         ret = err;
+      if (*it)
+         commands.Add(*it);
    }
-
-   return ret;
+   return commands.Run(ParallelStageCommands::Stop, commandPool_);
 }
 
 
@@ -1694,6 +1939,8 @@ int ComboXYStage::SetPositionSteps(long x, long y)
 {
    LogMessage(("SetPositionSteps(" + boost::lexical_cast<std::string>(x) + ", " + boost::lexical_cast<std::string>(y) + ")").c_str(), true);
 
+   // X and Y move at the same time if they are on different controllers
+   ParallelStageCommands commands;
    for (int i = 0; i < 2; ++i)
    {
       const long posSteps = (i == 0) ? x : y;
@@ -1705,23 +1952,38 @@ int ComboXYStage::SetPositionSteps(long x, long y)
          simulatedXStepSizeUm_ : simulatedYStepSizeUm_;
       double logicalPosUm = static_cast<double>(posSteps) * simulatedStepSizeUm;
       double physicalPosUm = stageScalings_[i] * logicalPosUm + stageTranslations_[i];
-      int err = physicalStages_[i]->SetPositionUm(physicalPosUm);
-      if (err != DEVICE_OK)
-         return err;
+      commands.Add(physicalStages_[i], physicalPosUm);
    }
-   return DEVICE_OK;
+   return commands.Run(ParallelStageCommands::SetPositionUm, commandPool_);
 }
 
 
 int ComboXYStage::GetPositionSteps(long& x, long& y)
 {
+   // Both axes are read at the same time
+   ParallelStageCommands commands;
+   int commandIndex[2];
+   int nrCommands = 0;
+   for (int i = 0; i < 2; ++i)
+   {
+      commandIndex[i] = -1;
+      if (physicalStages_[i])
+      {
+         commandIndex[i] = nrCommands++;
+         commands.Add(physicalStages_[i]);
+      }
+   }
+   int err = commands.Run(ParallelStageCommands::GetPositionUm, commandPool_);
+   if (err != DEVICE_OK)
+      return err;
+
    for (int i = 0; i < 2; ++i)
    {
       long& posSteps = (i == 0) ? x : y;
       const double& simulatedStepSizeUm = (i == 0) ?
          simulatedXStepSizeUm_ : simulatedYStepSizeUm_;
 
-      if (!physicalStages_[i])
+      if (commandIndex[i] < 0)
       {
          // We can't make this an error because stage position is frequently
          // requested before anybody has a chance to set the physical stages.
@@ -1729,11 +1991,7 @@ int ComboXYStage::GetPositionSteps(long& x, long& y)
          continue;
       }
 
-      double physicalPosUm;
-      int err = physicalStages_[i]->GetPositionUm(physicalPosUm);
-      if (err != DEVICE_OK)
-         return err;
-
+      double physicalPosUm = commands.Position(commandIndex[i]);
       double logicalPosUm = (physicalPosUm - stageTranslations_[i]) / stageScalings_[i];
       posSteps = Round(logicalPosUm / simulatedStepSizeUm);
    }
@@ -1832,46 +2090,26 @@ int ComboXYStage::GetXYStageSequenceMaxLength(long& nrEvents) const
 
 int ComboXYStage::StartXYStageSequence()
 {
-   int startedStages = 0;
-   int err;
    for (int i = 0; i < 2; ++i)
    {
       if (!physicalStages_[i])
-      {
-         err = ERR_NO_PHYSICAL_STAGE;
-         goto error;
-      }
-
-      err = physicalStages_[i]->StartStageSequence();
-      if (err != DEVICE_OK)
-         goto error;
-      ++startedStages;
-   }
-   return DEVICE_OK;
-
-error:
-   while (startedStages > 0)
-   {
-      physicalStages_[--startedStages]->StopStageSequence();
+         return ERR_NO_PHYSICAL_STAGE;
    }
-   return err;
+   // Both sequences are started at the same time
+   return StartStageSequences(physicalStages_, commandPool_);
 }
 
 
 int ComboXYStage::StopXYStageSequence()
 {
-   int lastErr = DEVICE_OK;
+   // Try to stop all even after error or missing stage
+   ParallelStageCommands commands;
    for (int i = 0; i < 2; ++i)
    {
-      if (!physicalStages_[i])
-         continue;
-
-      int err = physicalStages_[i]->StopStageSequence();
-      if (err != DEVICE_OK)
-         lastErr = err;
-      // Try to stop all even after error or missing stage
+      if (physicalStages_[i])
+         commands.Add(physicalStages_[i]);
    }
-   return lastErr;
+   return commands.Run(ParallelStageCommands::StopStageSequence, commandPool_);
 }
 
 
@@ -1912,18 +2150,15 @@ int ComboXYStage::AddToXYStageSequence(double positionX, double positionY)
 
 int ComboXYStage::SendXYStageSequence()
 {
+   ParallelStageCommands commands;
    for (int i = 0; i < 2; ++i)
    {
       if (!physicalStages_[i])
          return ERR_NO_PHYSICAL_STAGE;
+      commands.Add(physicalStages_[i]);
    }
-   for (int i = 0; i < 2; ++i)
-   {
-      int err = physicalStages_[i]->SendStageSequence();
-      if (err != DEVICE_OK)
-         return err;
-   }
-   return DEVICE_OK;
+   // Both sequences are uploaded at the same time
+   return commands.Run(ParallelStageCommands::SendStageSequence, commandPool_);
 }
 
 
@@ -5068,3 +5303,188 @@ int SerialDTRShutter::OnLogic(MM::PropertyBase* pProp, MM::ActionType pAct)
    }
    return DEVICE_OK;
 }
+
+/**********************************************************************
+ * FrameAccumulatorProcessor implementation
+ */
+FrameAccumulatorProcessor::FrameAccumulatorProcessor() :
+   mode_(FrameAccumulator::Average),
+   frameCount_(4),
+   initialized_(false)
+{
+   InitializeDefaultErrorMessages();
+
+   CreateProperty(MM::g_Keyword_Name, g_DeviceNameFrameAccumulator, MM::String, true);
+   CreateProperty(MM::g_Keyword_Description, "Average, sum or maximum-project every N frames of a sequence", MM::String, true);
+}
+
+FrameAccumulatorProcessor::~FrameAccumulatorProcessor()
+{
+   Shutdown();
+}
+
+void FrameAccumulatorProcessor::GetName(char* name) const
+{
+   CDeviceUtils::CopyLimitedString(name, g_DeviceNameFrameAccumulator);
+}
+
+int FrameAccumulatorProcessor::Initialize()
+{
+   // 16 bit sums of this many frames stay well within the accumulators
+   CPropertyAction* pAct = new CPropertyAction(this, &FrameAccumulatorProcessor::OnFrameCount);
+   int ret = CreateProperty(g_PropertyFrameCount, "4", MM::Integer, false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+   SetPropertyLimits(g_PropertyFrameCount, 1, 4096);
+
+   pAct = new CPropertyAction(this, &FrameAccumulatorProcessor::OnMode);
+   ret = CreateProperty(g_PropertyAccumulationMode, g_AccumulationModeAverage, MM::String, false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+   AddAllowedValue(g_PropertyAccumulationMode, g_AccumulationModeAverage);
+   AddAllowedValue(g_PropertyAccumulationMode, g_AccumulationModeSum);
+   AddAllowedValue(g_PropertyAccumulationMode, g_AccumulationModeMaximum);
+
+   initialized_ = true;
+   return DEVICE_OK;
+}
+
+/*
+ * Frames of a sequence acquisition are added to the current run of their
+ * camera and channel; all but the last frame of each run are held back, and
+ * the last one is replaced by the combination of the run. Snapped images
+ * pass unchanged and discard the current runs, so that runs do not span
+ * acquisitions that are separated by a snap.
+ *
+ * Images that do not come with their stream (e.g. from another processor)
+ * belong to channel 0 of the current camera.
+ */
+int FrameAccumulatorProcessor::Process(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth)
+{
+   std::string cameraLabel = GetCurrentCameraLabel();
+   MM::Camera* camera = static_cast<MM::Camera*>(GetDevice(cameraLabel.c_str()));
+   unsigned nComponents = camera ? camera->GetNumberOfComponents() : 1;
+   return Accumulate(buffer, width, height, byteDepth, nComponents, cameraLabel, 0);
+}
+
+int FrameAccumulatorProcessor::ProcessStreamImage(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth,
+      unsigned nComponents, const char* cameraLabel, unsigned channel)
+{
+   return Accumulate(buffer, width, height, byteDepth, nComponents, cameraLabel, channel);
+}
+
+int FrameAccumulatorProcessor::Accumulate(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth,
+      unsigned nComponents, const std::string& cameraLabel, unsigned channel)
+{
+   unsigned bytesPerSample;
+   switch (byteDepth)
+   {
+      case 1:
+         bytesPerSample = 1;
+         break;
+      case 4:
+         // GRAY32 samples are not combined
+         if (nComponents == 1)
+            return DEVICE_OK;
+         bytesPerSample = 1; // RGB32, combined per component
+         break;
+      case 2:
+      case 8: // RGB64
+         bytesPerSample = 2;
+         break;
+      default:
+         return DEVICE_UNSUPPORTED_DATA_FORMAT;
+   }
+
+   MM::Camera* camera = static_cast<MM::Camera*>(GetDevice(cameraLabel.c_str()));
+   bool capturing = camera == 0 || camera->IsCapturing();
+
+   MMThreadGuard g(accumulatorLock_);
+   if (!capturing)
+   {
+      accumulators_.clear();
+      return DEVICE_OK;
+   }
+   if (frameCount_ == 1)
+      return DEVICE_OK;
+
+   std::map<std::pair<std::string, unsigned>, FrameAccumulator>::iterator it =
+      accumulators_.find(std::make_pair(cameraLabel, channel));
+   if (it == accumulators_.end())
+   {
+      it = accumulators_.insert(std::make_pair(std::make_pair(cameraLabel, channel),
+               FrameAccumulator())).first;
+      it->second.SetMode(mode_);
+      it->second.SetFrameCount(frameCount_);
+   }
+   FrameAccumulator& accumulator = it->second;
+
+   size_t sampleCount = (size_t)width * height * (byteDepth / bytesPerSample);
+   if (!accumulator.AddFrame(buffer, sampleCount, bytesPerSample))
+      return DEVICE_IMAGE_HELD_BY_PROCESSOR;
+
+   accumulator.GetResult(buffer);
+   return DEVICE_OK;
+}
+
+std::string FrameAccumulatorProcessor::GetCurrentCameraLabel()
+{
+   char cameraLabel[MM::MaxStrLength];
+   int ret = GetCoreCallback()->GetDeviceProperty(MM::g_Keyword_CoreDevice,
+         MM::g_Keyword_CoreCamera, cameraLabel);
+   if (ret != DEVICE_OK)
+      return "";
+   return cameraLabel;
+}
+
+int FrameAccumulatorProcessor::OnFrameCount(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      MMThreadGuard g(accumulatorLock_);
+      pProp->Set((long)frameCount_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      long frameCount;
+      pProp->Get(frameCount);
+      MMThreadGuard g(accumulatorLock_);
+      frameCount_ = (unsigned)std::max(frameCount, 1L);
+      accumulators_.clear();
+   }
+   return DEVICE_OK;
+}
+
+int FrameAccumulatorProcessor::OnMode(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      MMThreadGuard g(accumulatorLock_);
+      switch (mode_)
+      {
+         case FrameAccumulator::Average:
+            pProp->Set(g_AccumulationModeAverage);
+            break;
+         case FrameAccumulator::Sum:
+            pProp->Set(g_AccumulationModeSum);
+            break;
+         case FrameAccumulator::Maximum:
+            pProp->Set(g_AccumulationModeMaximum);
+            break;
+      }
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string mode;
+      pProp->Get(mode);
+      FrameAccumulator::Mode newMode = FrameAccumulator::Average;
+      if (mode == g_AccumulationModeSum)
+         newMode = FrameAccumulator::Sum;
+      else if (mode == g_AccumulationModeMaximum)
+         newMode = FrameAccumulator::Maximum;
+      MMThreadGuard g(accumulatorLock_);
+      mode_ = newMode;
+      accumulators_.clear();
+   }
+   return DEVICE_OK;
+}
@@ -27,8 +27,15 @@
 #include "../../MMDevice/MMDevice.h"
 #include "../../MMDevice/DeviceBase.h"
 #include "../../MMDevice/ImgBuffer.h"
+#include "CameraStreamMerger.h"
+#include "FrameAccumulator.h"
+
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
 #include <string>
 #include <map>
+#include <vector>
 
 //////////////////////////////////////////////////////////////////////////////
 // Error codes
@@ -99,27 +106,88 @@ private:
 };
 
 /**
- * CameraSnapThread: helper thread for MultiCamera
+ * WorkerPool: threads for MultiCamera, MultiStage and ComboXYStage
+ *
+ * Runs several jobs (snapping a camera, commanding a group of stages) at the
+ * same time. The threads live as long as the pool, so that the jobs do not
+ * have to start and join a thread each time.
  */
-class CameraSnapThread : public MMDeviceThreadBase
+class WorkerPool
 {
-   public:
-      CameraSnapThread() :
-         camera_(0),
-         started_(false)
-      {}
+public:
+   typedef boost::function<int ()> Job;
 
-      ~CameraSnapThread() { if (started_) wait(); }
+   WorkerPool();
+   ~WorkerPool();
 
-      void SetCamera(MM::Camera* camera) { camera_ = camera; }
+   // Runs all jobs and waits until they are done. The calling thread runs
+   // the first job. Returns the first error, in job order.
+   int Run(const std::vector<Job>& jobs);
 
-      int svc() { camera_->SnapImage(); return 0; }
+private:
+   void WorkerLoop(size_t slot);
+
+   boost::mutex mutex_;
+   boost::condition_variable workCond_;
+   boost::condition_variable doneCond_;
+   std::vector<boost::thread*> threads_;
+   // job to run, per thread; empty when the thread is idle
+   std::vector<Job> jobs_;
+   std::vector<int> results_;
+   size_t pending_;
+   bool quit_;
+};
 
-      void Start() { activate(); started_ = true; }
+/**
+ * ParallelStageCommands: helper for MultiStage and ComboXYStage
+ *
+ * Sends one command to several physical stages at the same time, using one
+ * job of a WorkerPool per device adapter module. Stages of the same module
+ * get the command in turn on the same thread, because the core never calls
+ * into a module from two threads at once and adapters may depend on that.
+ * If all stages belong to one module, the calling thread does all the work.
+ */
+class ParallelStageCommands
+{
+public:
+   enum Command
+   {
+      SetPositionUm,
+      SetRelativePositionUm,
+      GetPositionUm,
+      Busy,
+      Stop,
+      SendStageSequence,
+      StartStageSequence,
+      StopStageSequence
+   };
+
+   // value is the (relative) position to go to, and ignored otherwise
+   void Add(MM::Stage* stage, double value = 0.0);
+
+   // Returns the first error, in the order the stages were added. All stages
+   // get the command even if some fail.
+   int Run(Command command, WorkerPool& pool);
+
+   // Results of the last Run(), by the index the stage was added with
+   int Result(size_t i) const { return targets_[i].result; }
+   double Position(size_t i) const { return targets_[i].value; }
+   bool AnyBusy() const;
 
-   private:
-      MM::Camera* camera_;
-      bool started_;
+private:
+   struct Target
+   {
+      MM::Stage* stage;
+      std::string module;
+      double value;
+      int result;
+      bool busy;
+   };
+
+   int RunGroup(Command command, const std::vector<size_t>& targets);
+   void RunOne(Command command, Target& target);
+
+   std::vector<Target> targets_;
 };
 
 /*
@@ -165,10 +233,14 @@ public:
    // ---------------
    int OnPhysicalCamera(MM::PropertyBase* pProp, MM::ActionType eAct, long nr);
    int OnBinning(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnSequenceMode(MM::PropertyBase* pProp, MM::ActionType eAct);
 
 private:
    int Logical2Physical(int logical);
    bool ImageSizesAreEqual();
+   std::vector<MM::Camera*> CamerasInUse() const;
+   void StartMerging();
+   void StopMerging();
    unsigned char* imageBuffer_;
 
    std::vector<std::string> availableCameras_;
@@ -179,6 +251,11 @@ private:
    unsigned int nrCamerasInUse_;
    bool initialized_;
    ImgBuffer img_;
+   WorkerPool snapPool_;
+   // Whether sequence acquisitions are merged by frame number
+   bool mergeSequences_;
+   bool merging_;
+   CameraStreamMerger merger_;
 };
 
 
@@ -238,6 +315,8 @@ private:
    std::vector<MM::Stage*> physicalStages_;
    std::vector<double> stageScalings_;
    std::vector<double> stageTranslations_;
+
+   WorkerPool commandPool_;
 };
 
 
@@ -298,6 +377,8 @@ private:
    std::vector<MM::Stage*> physicalStages_;
    std::vector<double> stageScalings_;
    std::vector<double> stageTranslations_;
+
+   WorkerPool commandPool_;
 };
 
 
@@ -790,4 +871,49 @@ private:
 };
 
 
+/**
+ * FrameAccumulatorProcessor: image processor that combines every N frames of
+ * a sequence acquisition into one, by averaging, summing or maximum
+ * projection. Only the combined frames reach the circular buffer. Each
+ * camera and channel has its own run of frames.
+ */
+class FrameAccumulatorProcessor : public CImageProcessorBase<FrameAccumulatorProcessor>
+{
+public:
+   FrameAccumulatorProcessor();
+   ~FrameAccumulatorProcessor();
+
+   // Device API
+   // ----------
+   int Initialize();
+   int Shutdown() {initialized_ = false; return DEVICE_OK;}
+
+   void GetName(char* pszName) const;
+   bool Busy() {return false;}
+
+   // ImageProcessor API
+   // ------------------
+   int Process(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth);
+   int ProcessStreamImage(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth,
+         unsigned nComponents, const char* cameraLabel, unsigned channel);
+
+   // action interface
+   // ----------------
+   int OnFrameCount(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnMode(MM::PropertyBase* pProp, MM::ActionType eAct);
+
+private:
+   int Accumulate(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth,
+         unsigned nComponents, const std::string& cameraLabel, unsigned channel);
+   std::string GetCurrentCameraLabel();
+
+   FrameAccumulator::Mode mode_;
+   unsigned frameCount_;
+   // The current run of each camera and channel
+   std::map<std::pair<std::string, unsigned>, FrameAccumulator> accumulators_;
+   MMThreadLock accumulatorLock_;
+   bool initialized_;
+};
+
+
 #endif //_UTILITIES_H_
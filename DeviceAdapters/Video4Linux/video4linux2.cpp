@@ -68,13 +68,23 @@ strace -f java -Djava.library.path=/usr/lib/micro-manager -classpath /usr/share/
 #include <fcntl.h>
 #include <unistd.h>
 #include <assert.h>
+#include <climits>
 #include <cstdlib>
 #include <cstring>
 #include <cerrno>
 #include <sys/mman.h>
+#include <sys/select.h>
 
 #include <pthread.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define V4L2_HAVE_AVX2_KERNEL 1
+#endif
+
 using namespace std;
 
 const char
@@ -88,6 +98,11 @@ const char
 const long gWidthDefault = 640,
            gHeightDefault = 480;
 
+// Number of buffers requested from the driver. During sequence acquisition
+// all but the one being converted stay queued, so that short stalls in the
+// core do not make the device drop frames.
+const unsigned int gBufferCount = 8;
+
 struct VidBuffer {
   void *start;
   size_t length;
@@ -97,29 +112,202 @@ struct VidBuffer {
 typedef struct State State;
 struct State {
   int W, H, fd;
+  unsigned int bytesPerLine;
   struct VidBuffer *buffers;
   unsigned int buffers_count;
   struct v4l2_buffer *buf;
 };
 
+/* Conversion kernels. The SIMD versions work on whole groups of pixels
+ * and return how many pixels of the row they converted; the rest of the
+ * row is done by the scalar version. All versions use the same fixed
+ * point arithmetic and give identical results. */
+
+static inline unsigned char clipToByte(int val) {
+  if (val <= 0)
+    return 0;
+  else if (val >= 255)
+    return 255;
+  else
+    return val;
+}
+
+// YUYV (two pixels per 4 bytes) to BGRA, which is what mm displays
+static void convertYUYVRowScalar(const unsigned char* ptrIn, unsigned char* ptrOut, int width) {
+  for (int i = 0; i + 1 < width; i += 2) {
+    int y0 = ptrIn[0];
+    int u0 = ptrIn[1];
+    int y1 = ptrIn[2];
+    int v0 = ptrIn[3];
+    ptrIn += 4;
+    int c = y0 - 16;
+    int d = u0 - 128;
+    int e = v0 - 128;
+
+    ptrOut[0] = clipToByte((298 * c + 516 * d + 128) >> 8); // blue
+    ptrOut[1] = clipToByte((298 * c - 100 * d - 208 * e + 128) >> 8); // green
+    ptrOut[2] = clipToByte((298 * c + 409 * e + 128) >> 8); // red
+    ptrOut[3] = 255; // alpha
+    c = y1 - 16;
+    ptrOut[4] = clipToByte((298 * c + 516 * d + 128) >> 8); // blue
+    ptrOut[5] = clipToByte((298 * c - 100 * d - 208 * e + 128) >> 8); // green
+    ptrOut[6] = clipToByte((298 * c + 409 * e + 128) >> 8); // red
+    ptrOut[7] = 255; // alpha
+    ptrOut += 8;
+  }
+}
+
+// Luminance of YUYV
+static void convertYUYVRowToLumaScalar(const unsigned char* ptrIn, unsigned char* ptrOut, int width) {
+  for (int i = 0; i < width; ++i)
+    ptrOut[i] = ptrIn[2 * i];
+}
+
+// Pairs of 16 bit coefficients, as multiplied by (v)pmaddwd
+static inline int coefficientPair(short first, short second) {
+  return (int)((unsigned)(unsigned short)first | ((unsigned)(unsigned short)second << 16));
+}
+
+#if defined(__SSE2__)
+static int convertYUYVRowSSE2(const unsigned char* ptrIn, unsigned char* ptrOut, int width) {
+  const __m128i lowBytes = _mm_set1_epi16(0x00ff);
+  const __m128i yOffset = _mm_set1_epi16(16);
+  const __m128i uvOffset = _mm_set1_epi16(128);
+  const __m128i ones = _mm_set1_epi16(1);
+  const __m128i rounding = _mm_set1_epi32(128);
+  const __m128i alpha = _mm_set1_epi8((char)0xff);
+  const __m128i blueCoef = _mm_set1_epi32(coefficientPair(298, 516));
+  const __m128i greenCoefYU = _mm_set1_epi32(coefficientPair(298, -100));
+  const __m128i greenCoefV = _mm_set1_epi32(coefficientPair(-208, 128));
+  const __m128i redCoef = _mm_set1_epi32(coefficientPair(298, 409));
+
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    __m128i yuyv = _mm_loadu_si128((const __m128i*)(ptrIn + 2 * x));
+    __m128i c = _mm_sub_epi16(_mm_and_si128(yuyv, lowBytes), yOffset);
+    __m128i uv = _mm_sub_epi16(_mm_srli_epi16(yuyv, 8), uvOffset);
+    // u0 v0 u1 v1 ... -> u0 u0 u1 u1 ... and v0 v0 v1 v1 ...
+    __m128i d = _mm_shufflehi_epi16(_mm_shufflelo_epi16(uv, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 2, 0, 0));
+    __m128i e = _mm_shufflehi_epi16(_mm_shufflelo_epi16(uv, _MM_SHUFFLE(3, 3, 1, 1)), _MM_SHUFFLE(3, 3, 1, 1));
+
+    __m128i cdLo = _mm_unpacklo_epi16(c, d), cdHi = _mm_unpackhi_epi16(c, d);
+    __m128i ceLo = _mm_unpacklo_epi16(c, e), ceHi = _mm_unpackhi_epi16(c, e);
+    __m128i e1Lo = _mm_unpacklo_epi16(e, ones), e1Hi = _mm_unpackhi_epi16(e, ones);
+
+    __m128i b = _mm_packs_epi32(
+        _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cdLo, blueCoef), rounding), 8),
+        _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cdHi, blueCoef), rounding), 8));
+    __m128i g = _mm_packs_epi32(
+        _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cdLo, greenCoefYU), _mm_madd_epi16(e1Lo, greenCoefV)), 8),
+        _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cdHi, greenCoefYU), _mm_madd_epi16(e1Hi, greenCoefV)), 8));
+    __m128i r = _mm_packs_epi32(
+        _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(ceLo, redCoef), rounding), 8),
+        _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(ceHi, redCoef), rounding), 8));
+
+    // saturate to bytes and interleave to b g r a
+    __m128i bg = _mm_unpacklo_epi8(_mm_packus_epi16(b, b), _mm_packus_epi16(g, g));
+    __m128i ra = _mm_unpacklo_epi8(_mm_packus_epi16(r, r), alpha);
+    _mm_storeu_si128((__m128i*)(ptrOut + 4 * x), _mm_unpacklo_epi16(bg, ra));
+    _mm_storeu_si128((__m128i*)(ptrOut + 4 * x + 16), _mm_unpackhi_epi16(bg, ra));
+  }
+  return x;
+}
+
+static int convertYUYVRowToLumaSSE2(const unsigned char* ptrIn, unsigned char* ptrOut, int width) {
+  const __m128i lowBytes = _mm_set1_epi16(0x00ff);
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    __m128i first = _mm_and_si128(_mm_loadu_si128((const __m128i*)(ptrIn + 2 * x)), lowBytes);
+    __m128i second = _mm_and_si128(_mm_loadu_si128((const __m128i*)(ptrIn + 2 * x + 16)), lowBytes);
+    _mm_storeu_si128((__m128i*)(ptrOut + x), _mm_packus_epi16(first, second));
+  }
+  return x;
+}
+#endif
+
+#ifdef V4L2_HAVE_AVX2_KERNEL
+// Same as the SSE2 version, on two 128 bit lanes of 8 pixels each
+__attribute__((target("avx2")))
+static int convertYUYVRowAVX2(const unsigned char* ptrIn, unsigned char* ptrOut, int width) {
+  const __m256i lowBytes = _mm256_set1_epi16(0x00ff);
+  const __m256i yOffset = _mm256_set1_epi16(16);
+  const __m256i uvOffset = _mm256_set1_epi16(128);
+  const __m256i ones = _mm256_set1_epi16(1);
+  const __m256i rounding = _mm256_set1_epi32(128);
+  const __m256i alpha = _mm256_set1_epi8((char)0xff);
+  const __m256i blueCoef = _mm256_set1_epi32(coefficientPair(298, 516));
+  const __m256i greenCoefYU = _mm256_set1_epi32(coefficientPair(298, -100));
+  const __m256i greenCoefV = _mm256_set1_epi32(coefficientPair(-208, 128));
+  const __m256i redCoef = _mm256_set1_epi32(coefficientPair(298, 409));
+
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    __m256i yuyv = _mm256_loadu_si256((const __m256i*)(ptrIn + 2 * x));
+    __m256i c = _mm256_sub_epi16(_mm256_and_si256(yuyv, lowBytes), yOffset);
+    __m256i uv = _mm256_sub_epi16(_mm256_srli_epi16(yuyv, 8), uvOffset);
+    __m256i d = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(uv, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 2, 0, 0));
+    __m256i e = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(uv, _MM_SHUFFLE(3, 3, 1, 1)), _MM_SHUFFLE(3, 3, 1, 1));
+
+    __m256i cdLo = _mm256_unpacklo_epi16(c, d), cdHi = _mm256_unpackhi_epi16(c, d);
+    __m256i ceLo = _mm256_unpacklo_epi16(c, e), ceHi = _mm256_unpackhi_epi16(c, e);
+    __m256i e1Lo = _mm256_unpacklo_epi16(e, ones), e1Hi = _mm256_unpackhi_epi16(e, ones);
+
+    __m256i b = _mm256_packs_epi32(
+        _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(cdLo, blueCoef), rounding), 8),
+        _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(cdHi, blueCoef), rounding), 8));
+    __m256i g = _mm256_packs_epi32(
+        _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(cdLo, greenCoefYU), _mm256_madd_epi16(e1Lo, greenCoefV)), 8),
+        _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(cdHi, greenCoefYU), _mm256_madd_epi16(e1Hi, greenCoefV)), 8));
+    __m256i r = _mm256_packs_epi32(
+        _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(ceLo, redCoef), rounding), 8),
+        _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(ceHi, redCoef), rounding), 8));
+
+    __m256i bg = _mm256_unpacklo_epi8(_mm256_packus_epi16(b, b), _mm256_packus_epi16(g, g));
+    __m256i ra = _mm256_unpacklo_epi8(_mm256_packus_epi16(r, r), alpha);
+    __m256i first = _mm256_unpacklo_epi16(bg, ra); // pixels 0-3 and 8-11
+    __m256i second = _mm256_unpackhi_epi16(bg, ra); // pixels 4-7 and 12-15
+    _mm256_storeu_si256((__m256i*)(ptrOut + 4 * x), _mm256_permute2x128_si256(first, second, 0x20));
+    _mm256_storeu_si256((__m256i*)(ptrOut + 4 * x + 32), _mm256_permute2x128_si256(first, second, 0x31));
+  }
+  return x;
+}
+
+static bool cpuSupportsAVX2() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") != 0;
+}
+#endif
+
 class PixelType {
   public:
-    PixelType(string propertyValue, unsigned bytesPerPixel, unsigned numberOfComponents, unsigned bitDepth) :
+    PixelType(string propertyValue, __u32 v4l2Format, unsigned v4l2BytesPerPixel,
+        unsigned bytesPerPixel, unsigned numberOfComponents, unsigned bitDepth) :
       m_propertyValue(propertyValue),
+      m_v4l2Format(v4l2Format),
+      m_v4l2BytesPerPixel(v4l2BytesPerPixel),
       m_bytesPerPixel(bytesPerPixel),
       m_numberOfComponents(numberOfComponents),
       m_bitDepth(bitDepth) {
       }
 
     string GetPropertyValue() const { return m_propertyValue; }
+    // format requested from the device
+    __u32 GetV4l2Format() const { return m_v4l2Format; }
+    unsigned GetV4l2BytesPerPixel() const { return m_v4l2BytesPerPixel; }
     unsigned GetImageBytesPerPixel() const { return m_bytesPerPixel; }
     unsigned GetNumberOfComponents() const { return m_numberOfComponents; }
     unsigned GetBitDepth() const { return m_bitDepth; }
 
+    // true if the device buffer can be handed to mm as is (when the rows
+    // are not padded)
+    virtual bool IsPassThrough() const { return false; }
+
     virtual void convertV4l2ToOutput(
         State *state, unsigned char* in, unsigned char* output) const = 0;
   private:
     string m_propertyValue;
+    __u32 m_v4l2Format;
+    unsigned m_v4l2BytesPerPixel;
     unsigned m_bytesPerPixel;
     unsigned m_numberOfComponents;
     unsigned m_bitDepth;
@@ -130,17 +318,19 @@ class PixelType8Bit : public PixelType {
     static string PROPERTY_VALUE;
 
     PixelType8Bit() :
-      PixelType(PROPERTY_VALUE, 1, 1, 8) {
+      PixelType(PROPERTY_VALUE, V4L2_PIX_FMT_YUYV, 2, 1, 1, 8) {
       }
 
     virtual void convertV4l2ToOutput(
         State *state, unsigned char* in, unsigned char* output) const {
-      int i,j;
-      for (j = 0; j < state->H; j++) {
-        int wj = state->W * j;
-        for (i = 0; i < state->W; i++) {
-          output[i + wj] = in[2*i + 2*wj];
-        }
+      for (int j = 0; j < state->H; j++) {
+        const unsigned char* rowIn = in + (size_t)state->bytesPerLine * j;
+        unsigned char* rowOut = output + (size_t)state->W * j;
+        int i = 0;
+#if defined(__SSE2__)
+        i = convertYUYVRowToLumaSSE2(rowIn, rowOut, state->W);
+#endif
+        convertYUYVRowToLumaScalar(rowIn + 2*i, rowOut + i, state->W - i);
       }
     }
 };
@@ -152,49 +342,126 @@ class PixelTypeYUYV : public PixelType {
     static string PROPERTY_VALUE;
 
     PixelTypeYUYV() :
-      PixelType(PROPERTY_VALUE, 4, 4, 8) {
+      PixelType(PROPERTY_VALUE, V4L2_PIX_FMT_YUYV, 2, 4, 4, 8) {
       }
 
     virtual void convertV4l2ToOutput(
-        State *state, unsigned char* ptrIn, unsigned char* ptrOut) const {
+        State *state, unsigned char* in, unsigned char* output) const {
       /* Convert YUYV to RGBA32, apparently mm does only display colors
        * in this format */
-      for (int i = 0;  i < state->W * state->H / 2; ++i) {
-        int y0 = ptrIn[0];
-        int u0 = ptrIn[1];
-        int y1 = ptrIn[2];
-        int v0 = ptrIn[3];
-        ptrIn += 4;
-        int c = y0 - 16;
-        int d = u0 - 128;
-        int e = v0 - 128;
-
-        ptrOut[0] = clip((298 * c + 516 * d + 128) >> 8); // blue
-        ptrOut[1] = clip((298 * c - 100 * d - 208 * e + 128) >> 8); // green
-        ptrOut[2] = clip((298 * c + 409 * e + 128) >> 8); // red
-        ptrOut[4] = 255; // alpha
-        c = y1 - 16;
-        ptrOut[4] = clip((298 * c + 516 * d + 128) >> 8); // blue
-        ptrOut[5] = clip((298 * c - 100 * d - 208 * e + 128) >> 8); // green
-        ptrOut[6] = clip((298 * c + 409 * e + 128) >> 8); // red
-        ptrOut[7] = 255; // alpha
-        ptrOut += 8;
+#ifdef V4L2_HAVE_AVX2_KERNEL
+      static const bool useAVX2 = cpuSupportsAVX2();
+#endif
+      for (int j = 0; j < state->H; j++) {
+        const unsigned char* rowIn = in + (size_t)state->bytesPerLine * j;
+        unsigned char* rowOut = output + (size_t)state->W * 4 * j;
+        int i = 0;
+#ifdef V4L2_HAVE_AVX2_KERNEL
+        if (useAVX2)
+          i = convertYUYVRowAVX2(rowIn, rowOut, state->W);
+#endif
+#if defined(__SSE2__)
+        i += convertYUYVRowSSE2(rowIn + 2*i, rowOut + 4*i, state->W - i);
+#endif
+        convertYUYVRowScalar(rowIn + 2*i, rowOut + 4*i, state->W - i);
       }
     }
-
-  private:
-    inline unsigned char clip(int val) const {
-      if (val <= 0)
-        return 0;
-      else if (val >= 255)
-        return 255;
-      else
-        return val;
-    }
 };
 string PixelTypeYUYV::PROPERTY_VALUE = "YUYV";
 PixelTypeYUYV PIXELTYPE_YUYV;
 
+// Monochrome formats that mm can use without conversion
+class PixelTypePassThrough : public PixelType {
+  public:
+    PixelTypePassThrough(string propertyValue, __u32 v4l2Format, unsigned bytesPerPixel) :
+      PixelType(propertyValue, v4l2Format, bytesPerPixel, bytesPerPixel, 1, 8 * bytesPerPixel) {
+      }
+
+    virtual bool IsPassThrough() const { return true; }
+
+    virtual void convertV4l2ToOutput(
+        State *state, unsigned char* in, unsigned char* output) const {
+      size_t rowBytes = (size_t)state->W * GetImageBytesPerPixel();
+      if (state->bytesPerLine == rowBytes) {
+        memcpy(output, in, rowBytes * state->H);
+        return;
+      }
+      for (int j = 0; j < state->H; j++)
+        memcpy(output + rowBytes * j, in + (size_t)state->bytesPerLine * j, rowBytes);
+    }
+};
+PixelTypePassThrough PIXELTYPE_GREY("GREY", V4L2_PIX_FMT_GREY, 1);
+// little endian, like the host
+PixelTypePassThrough PIXELTYPE_Y16("Y16", V4L2_PIX_FMT_Y16, 2);
+
+PixelType* const gPixelTypes[] = { &PIXELTYPE_8BIT, &PIXELTYPE_YUYV, &PIXELTYPE_GREY, &PIXELTYPE_Y16 };
+const size_t gPixelTypeCount = sizeof(gPixelTypes) / sizeof(gPixelTypes[0]);
+
+class V4L2;
+
+// Keeps dequeuing, converting and inserting frames during sequence
+// acquisition; the work is done in V4L2::CaptureFrames
+class V4L2CaptureThread : public MMDeviceThreadBase
+{
+public:
+  V4L2CaptureThread(V4L2* camera) :
+    camera_(camera),
+    numImages_(0),
+    stop_(true),
+    running_(false),
+    joinable_(false)
+  {
+  }
+
+  void Start(long numImages)
+  {
+    Join();
+    MMThreadGuard g(lock_);
+    numImages_ = numImages;
+    stop_ = false;
+    running_ = true;
+    joinable_ = true;
+    activate();
+  }
+
+  void Stop()
+  {
+    MMThreadGuard g(lock_);
+    stop_ = true;
+  }
+
+  // waits for the thread to exit, if it was started
+  void Join()
+  {
+    if (joinable_) {
+      wait();
+      joinable_ = false;
+    }
+  }
+
+  bool IsStopRequested()
+  {
+    MMThreadGuard g(lock_);
+    return stop_;
+  }
+
+  bool IsRunning()
+  {
+    MMThreadGuard g(lock_);
+    return running_;
+  }
+
+  int svc();
+
+private:
+  V4L2* camera_;
+  long numImages_;
+  bool stop_;
+  bool running_;
+  bool joinable_;
+  MMThreadLock lock_;
+};
+
 class V4L2 : public CCameraBase<V4L2>
 {
 public:
@@ -204,7 +471,8 @@ public:
   // little as possible, don't access hardware, do everything else in
   // Initialize()
   V4L2() :
-    pixelType(&PIXELTYPE_8BIT)
+    pixelType(&PIXELTYPE_8BIT),
+    captureThread_(this)
   {
     initialized_ = 0;
   }
@@ -255,8 +523,8 @@ public:
        return nRet;
 
     vector<string> pixTypes;
-    pixTypes.push_back(PixelType8Bit::PROPERTY_VALUE);
-    pixTypes.push_back(PixelTypeYUYV::PROPERTY_VALUE);
+    for (size_t i = 0; i < gPixelTypeCount; ++i)
+      pixTypes.push_back(gPixelTypes[i]->GetPropertyValue());
     nRet = SetAllowedValues(MM::g_Keyword_PixelType, pixTypes);
     if (nRet != DEVICE_OK)
        return nRet;
@@ -287,6 +555,7 @@ public:
   // afterwards, unload device, release all resources
   int Shutdown()
   {
+    StopSequenceAcquisition();
     if (initialized_) {
       VideoClose();
     }
@@ -302,6 +571,9 @@ public:
   // blocks until exposure is finished
   int SnapImage()
   {
+    if (IsCapturing())
+      return DEVICE_CAMERA_BUSY_ACQUIRING;
+
     unsigned char* data = VideoTakeBuffer();
     pixelType->convertV4l2ToOutput(state, data, const_cast<unsigned char*>(imageBuffer.GetPixels()));
     VideoReturnBuffer();
@@ -376,6 +648,42 @@ public:
     //clear_roi();
     return DEVICE_OK;
   }
+
+  // Frames are delivered at the rate set up on the device, so the interval
+  // is ignored
+  int StartSequenceAcquisition(long numImages, double interval_ms, bool stopOnOverflow)
+  {
+    (void) interval_ms;
+    if (IsCapturing())
+      return DEVICE_CAMERA_BUSY_ACQUIRING;
+    if (!initialized_)
+      return DEVICE_NOT_CONNECTED;
+
+    int ret = GetCoreCallback()->PrepareForAcq(this);
+    if (ret != DEVICE_OK)
+      return ret;
+
+    setStopOnOverflow(stopOnOverflow);
+    captureThread_.Start(numImages);
+    return DEVICE_OK;
+  }
+
+  int StartSequenceAcquisition(double interval_ms)
+  {
+    return StartSequenceAcquisition(LONG_MAX, interval_ms, false);
+  }
+
+  int StopSequenceAcquisition()
+  {
+    captureThread_.Stop();
+    captureThread_.Join();
+    return DEVICE_OK;
+  }
+
+  bool IsCapturing()
+  {
+    return captureThread_.IsRunning();
+  }
   
   // action interface
   int OnExposure(MM::PropertyBase* pProp, MM::ActionType eAct)
@@ -432,6 +740,9 @@ public:
     if(eAct == MM::BeforeGet){
       //on_binning(); // FIXME
     }else if(eAct==MM::AfterSet){
+      // binning changes the frame size
+      if (IsCapturing())
+        return DEVICE_CAMERA_BUSY_ACQUIRING;
     }
     return DEVICE_OK;
   }
@@ -445,18 +756,30 @@ public:
 
       string pixType;
       pProp->Get(pixType);
-      if (pixType == PixelType8Bit::PROPERTY_VALUE) {
-        pixelType = &PIXELTYPE_8BIT;
-      }
-      else if (pixType == PixelTypeYUYV::PROPERTY_VALUE) {
-        pixelType = &PIXELTYPE_YUYV;
+      PixelType* newPixelType = 0;
+      for (size_t i = 0; i < gPixelTypeCount; ++i) {
+        if (pixType == gPixelTypes[i]->GetPropertyValue())
+          newPixelType = gPixelTypes[i];
       }
-      else {
+      if (newPixelType == 0) {
         return DEVICE_INVALID_PROPERTY;
       }
-  
+
+      PixelType* oldPixelType = pixelType;
+      pixelType = newPixelType;
       LogMessage("setting pixelType " + pixelType->GetPropertyValue());
-      return this->resizeBuffer();
+      if (pixelType->GetV4l2Format() == oldPixelType->GetV4l2Format())
+        return this->resizeBuffer();
+
+      // the device has to deliver a different format
+      int ret = reinitializeDeviceIfRunning();
+      if (ret != DEVICE_OK) {
+        LogMessage("device does not support pixelType " + pixelType->GetPropertyValue() +
+            ", reverting to " + oldPixelType->GetPropertyValue());
+        pixelType = oldPixelType;
+        reinitializeDeviceIfRunning();
+      }
+      return ret;
     }
     else if (eAct == MM::BeforeGet)
     {
@@ -484,6 +807,93 @@ public:
   }
   
 private:
+  friend class V4L2CaptureThread;
+
+  // Runs on the capture thread. Buffers are handed back to the device
+  // right after their frame is inserted, so the driver always has the
+  // others to fill.
+  int
+  CaptureFrames(long numImages)
+  {
+    char label[MM::MaxStrLength];
+    GetLabel(label);
+    Metadata md;
+    md.put("Camera", label);
+    string serializedMD = md.Serialize();
+
+    const unsigned width = GetImageWidth();
+    const unsigned height = GetImageHeight();
+    const unsigned bytesPerPixel = GetImageBytesPerPixel();
+    const bool passThrough = pixelType->IsPassThrough() &&
+      state->bytesPerLine == width * bytesPerPixel;
+
+    int ret = DEVICE_OK;
+    long count = 0;
+    while (count < numImages && !captureThread_.IsStopRequested()) {
+      // wait with a timeout so that a stop request is noticed
+      fd_set fds;
+      FD_ZERO(&fds);
+      FD_SET(state->fd, &fds);
+      struct timeval tv;
+      tv.tv_sec = 0;
+      tv.tv_usec = 100000;
+      int result = select(state->fd + 1, &fds, NULL, NULL, &tv);
+      if (0 == result || (-1 == result && EINTR == errno))
+        continue;
+      if (-1 == result) {
+        ostringstream msg;
+        msg << "error: waiting for image buffer failed: " << strerror(errno);
+        LogMessage(msg.str().c_str());
+        ret = DEVICE_ERR;
+        break;
+      }
+
+      struct v4l2_buffer buf;
+      memset(&buf, 0, sizeof(buf));
+      buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+      buf.memory = V4L2_MEMORY_MMAP;
+      if (-1 == ioctl(state->fd, VIDIOC_DQBUF, &buf)) {
+        if (EAGAIN == errno || EINTR == errno)
+          continue;
+        ostringstream msg;
+        msg << "error: could not dequeue image buffer: " << strerror(errno);
+        LogMessage(msg.str().c_str());
+        ret = DEVICE_ERR;
+        break;
+      }
+
+      unsigned char* data = (unsigned char*)state->buffers[buf.index].start;
+      const unsigned char* pixels = data;
+      if (!passThrough) {
+        pixelType->convertV4l2ToOutput(state, data, const_cast<unsigned char*>(imageBuffer.GetPixels()));
+        pixels = imageBuffer.GetPixels();
+      }
+
+      ret = GetCoreCallback()->InsertImage(this, pixels, width, height, bytesPerPixel,
+          serializedMD.c_str());
+      if (!isStopOnOverflow() && ret == DEVICE_BUFFER_OVERFLOW) {
+        // do not stop on overflow - just reset the buffer
+        GetCoreCallback()->ClearImageBuffer(this);
+        ret = GetCoreCallback()->InsertImage(this, pixels, width, height, bytesPerPixel,
+            serializedMD.c_str());
+      }
+
+      if (-1 == tryIoctl(state->fd, VIDIOC_QBUF, &buf)) {
+        ostringstream msg;
+        msg << "error: could not requeue image buffer: " << strerror(errno);
+        LogMessage(msg.str().c_str());
+        ret = DEVICE_ERR;
+      }
+
+      if (ret != DEVICE_OK)
+        break;
+      ++count;
+    }
+
+    if (captureThread_.IsStopRequested())
+      LogMessage("SeqAcquisition interrupted by the user");
+    return ret;
+  }
 
   bool
   VideoInit()
@@ -518,7 +928,7 @@ private:
     memset(&reqbuf, 0, sizeof(reqbuf));
     reqbuf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     reqbuf.memory = V4L2_MEMORY_MMAP;
-    reqbuf.count = 4;
+    reqbuf.count = gBufferCount;
 
     if (-1 == tryIoctl(state->fd, VIDIOC_REQBUFS, &reqbuf)) {
       ostringstream msg;
@@ -534,7 +944,7 @@ private:
     }
 
     ostringstream bufMsg;
-    bufMsg << "got " << reqbuf.count << " out of 4 requested buffers";
+    bufMsg << "got " << reqbuf.count << " out of " << gBufferCount << " requested buffers";
     LogMessage(bufMsg.str().c_str());
 
     state->buffers = (struct VidBuffer*)calloc(reqbuf.count, sizeof(*(state->buffers)));
@@ -625,14 +1035,23 @@ private:
     memset(&fmt, 0, sizeof(fmt));
 
     fmt.type                = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+    fmt.fmt.pix.pixelformat = pixelType->GetV4l2Format();
     fmt.fmt.pix.field       = V4L2_FIELD_INTERLACED;
-    fmt.fmt.pix.height      = (unsigned) requestedWidth;
-    fmt.fmt.pix.width       = (unsigned) requestedHeight;
+    fmt.fmt.pix.width       = (unsigned) requestedWidth;
+    fmt.fmt.pix.height      = (unsigned) requestedHeight;
 
     if (-1 == tryIoctl(state->fd, VIDIOC_S_FMT, &fmt)) {
       ostringstream msg;
-      msg << "error: could not set format YUYV: " << strerror(errno);
+      msg << "error: could not set format " << pixelType->GetPropertyValue()
+          << ": " << strerror(errno);
+      LogMessage(msg.str().c_str());
+      return DEVICE_ERR;
+    }
+
+    // drivers substitute a format they support instead of failing
+    if (fmt.fmt.pix.pixelformat != pixelType->GetV4l2Format()) {
+      ostringstream msg;
+      msg << "error: device does not support format " << pixelType->GetPropertyValue();
       LogMessage(msg.str().c_str());
       return DEVICE_ERR;
     }
@@ -655,11 +1074,14 @@ private:
 
     state->W = fmt.fmt.pix.width;
     state->H = fmt.fmt.pix.height;
+    state->bytesPerLine = fmt.fmt.pix.bytesperline;
+    if (state->bytesPerLine < state->W * pixelType->GetV4l2BytesPerPixel())
+      state->bytesPerLine = state->W * pixelType->GetV4l2BytesPerPixel();
 
     ostringstream formatMsg;
     formatMsg << "device is configured for " << state->W << "x" << state->H << " pixel"
-              << " and " << fmt.fmt.pix.bytesperline << " bytes per line ("
-              << (fmt.fmt.pix.bytesperline / state->H) <<" bpp)";
+              << " and " << state->bytesPerLine << " bytes per line ("
+              << (state->bytesPerLine / state->W) <<" bytes per pixel)";
     LogMessage(formatMsg.str().c_str());
     return DEVICE_OK;
   }
@@ -684,6 +1106,7 @@ private:
     state->fd = 0;
     state->W = 0;
     state->H = 0;
+    state->bytesPerLine = 0;
     state->buffers_count = 0;
     state->buffers = 0;
   
@@ -720,7 +1143,11 @@ private:
     }
   }
 
+  // The capture thread dequeues into the device buffers and converts into
+  // imageBuffer, so neither may be replaced while it runs
   int reinitializeDeviceIfRunning() {
+    if (IsCapturing())
+      return DEVICE_CAMERA_BUSY_ACQUIRING;
     if (initialized_) {
       LogMessage("closing current device");
       if (! VideoClose()) {
@@ -763,6 +1190,8 @@ private:
   
   int resizeBuffer()
   {
+    if (IsCapturing())
+      return DEVICE_CAMERA_BUSY_ACQUIRING;
     imageBuffer.Resize(state->W, state->H, pixelType->GetImageBytesPerPixel());
     return DEVICE_OK;
   }
@@ -797,8 +1226,27 @@ private:
   State state[1];
   ImgBuffer imageBuffer;
   PixelType *pixelType;
+  V4L2CaptureThread captureThread_;
 };
 
+int V4L2CaptureThread::svc()
+{
+  int ret = DEVICE_ERR;
+  try {
+    ret = camera_->CaptureFrames(numImages_);
+  }
+  catch (...) {
+    camera_->LogMessage(g_Msg_EXCEPTION_IN_THREAD, false);
+  }
+  {
+    MMThreadGuard g(lock_);
+    stop_ = true;
+    running_ = false;
+  }
+  camera_->OnThreadExiting();
+  return ret;
+}
+
 MODULE_API void InitializeModuleData()
 {
   RegisterDevice(gName, MM::CameraDevice, gDescription);
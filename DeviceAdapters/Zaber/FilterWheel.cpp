@@ -98,8 +98,8 @@ int FilterWheel::Initialize()
       return ret;
    }
 
-   // Disable alert messages.
-   ret = SetSetting(deviceAddress_, 0, "comm.alert", 0);
+   // Enable alert messages, which tell when the device has stopped.
+   ret = EnableAlerts(deviceAddress_);
    if (ret != DEVICE_OK) 
    {
       this->LogMessage("Initial attempt to communicate with device failed.\n", true);
@@ -110,8 +110,8 @@ int Stage::Initialize()
 		return ret;
 	}
 
-	// Disable alert messages.
-	ret = SetSetting(deviceAddress_, 0, "comm.alert", 0);
+	// Enable alert messages, which tell when the device has stopped.
+	ret = EnableAlerts(deviceAddress_);
 	if (ret != DEVICE_OK) 
 	{
 		return ret;
@@ -33,6 +33,12 @@ const char* g_XYStageDescription = "Zaber XY Stage";
 
 using namespace std;
 
+// Stream and stream buffer used for sequences
+const int sequenceStream = 1;
+const int sequenceBuffer = 1;
+// Each point takes three stream actions; keep well within the buffer size
+const long maxSequenceLength = 250;
+
 
 ////////////////////////////////////////////////////////////////////////////////
 // XYStage & Device API methods
@@ -57,7 +63,9 @@ XYStage::XYStage() :
 	motorStepsX_(200),
 	motorStepsY_(200),
 	linearMotionX_(2.0),
-	linearMotionY_(2.0)
+	linearMotionY_(2.0),
+	sequenceable_(false),
+	sequenceTriggerInput_(1)
 {
 	this->LogMessage("XYStage::XYStage\n", true);
 
@@ -146,8 +154,8 @@ int XYStage::Initialize()
 		return ret;
 	}
 
-	// Disable alert messages.
-	ret = SetSetting(deviceAddressX_, 0, "comm.alert", 0);
+	// Enable alert messages, which tell when the axes have stopped.
+	ret = EnableAlerts(deviceAddressX_);
 	if (ret != DEVICE_OK) 
 	{
 		return ret;
@@ -155,7 +163,7 @@ int XYStage::Initialize()
 
 	if (!IsSingleController())
 	{
-		ret = SetSetting(deviceAddressY_, 0, "comm.alert", 0);
+		ret = EnableAlerts(deviceAddressY_);
 		if (ret != DEVICE_OK) 
 		{
 			return ret;
@@ -224,6 +232,18 @@ int XYStage::Initialize()
 		return ret;
 	}
 
+	sequenceable_ = SupportsStreams();
+	if (sequenceable_)
+	{
+		pAct = new CPropertyAction (this, &XYStage::OnSequenceTriggerInput);
+		ret = CreateIntegerProperty("Sequence Trigger Input", sequenceTriggerInput_, false, pAct);
+		if (ret != DEVICE_OK) 
+		{
+			return ret;
+		}
+		SetPropertyLimits("Sequence Trigger Input", 1, 4);
+	}
+
 	ret = UpdateStatus();
 	if (ret != DEVICE_OK) 
 	{
@@ -482,10 +502,184 @@ int XYStage::GetLimitsUm(double& xMin, double& xMax, double& yMin, double& yMax)
 }
 
 
+///////////////////////////////////////////////////////////////////////////////
+// Sequence API
+///////////////////////////////////////////////////////////////////////////////
+
+int XYStage::GetXYStageSequenceMaxLength(long& nrEvents) const
+{
+	nrEvents = maxSequenceLength;
+	return DEVICE_OK;
+}
+
+
+int XYStage::ClearXYStageSequence()
+{
+	this->LogMessage("XYStage::ClearXYStageSequence\n", true);
+
+	sequenceX_.clear();
+	sequenceY_.clear();
+	return DEVICE_OK;
+}
+
+
+int XYStage::AddToXYStageSequence(double positionX, double positionY)
+{
+	this->LogMessage("XYStage::AddToXYStageSequence\n", true);
+
+	if (!sequenceable_)
+	{
+		return DEVICE_UNSUPPORTED_COMMAND;
+	}
+
+	if ((long)sequenceX_.size() >= maxSequenceLength)
+	{
+		return DEVICE_SEQUENCE_TOO_LARGE;
+	}
+
+	sequenceX_.push_back(positionX);
+	sequenceY_.push_back(positionY);
+	return DEVICE_OK;
+}
+
+
+/** Stores the sequence in a stream buffer of the controller. For every
+ * point the stream waits for the trigger input to go high, moves both axes
+ * in a straight line, and waits for the input to go low again.
+ */
+int XYStage::SendXYStageSequence()
+{
+	this->LogMessage("XYStage::SendXYStageSequence\n", true);
+
+	if (!sequenceable_)
+	{
+		return DEVICE_UNSUPPORTED_COMMAND;
+	}
+
+	// The origin set by Micro-Manager is only known through the current
+	// position in microns and in steps.
+	long xSteps, ySteps;
+	int ret = GetPositionSteps(xSteps, ySteps);
+	if (ret != DEVICE_OK) 
+	{
+		return ret;
+	}
+
+	double xUm, yUm;
+	ret = GetPositionUm(xUm, yUm);
+	if (ret != DEVICE_OK) 
+	{
+		return ret;
+	}
+
+	bool mirrorX, mirrorY;
+	GetOrientation(mirrorX, mirrorY);
+	long originX = mirrorX ? xSteps + nint(xUm / stepSizeXUm_) : xSteps - nint(xUm / stepSizeXUm_);
+	long originY = mirrorY ? ySteps + nint(yUm / stepSizeYUm_) : ySteps - nint(yUm / stepSizeYUm_);
+
+	ostringstream cmd;
+	cmd << "stream buffer " << sequenceBuffer << " erase";
+	SendCommand(deviceAddressX_, 0, cmd.str()); // rejected if the buffer is already empty
+
+	cmd.str("");
+	cmd << "stream " << sequenceStream << " setup store " << sequenceBuffer << " 2";
+	ret = SendCommand(deviceAddressX_, 0, cmd.str());
+	if (ret != DEVICE_OK) 
+	{
+		return ret;
+	}
+
+	for (size_t i = 0; i < sequenceX_.size() && ret == DEVICE_OK; ++i)
+	{
+		long x = mirrorX ? originX - nint(sequenceX_[i] / stepSizeXUm_) : originX + nint(sequenceX_[i] / stepSizeXUm_);
+		long y = mirrorY ? originY - nint(sequenceY_[i] / stepSizeYUm_) : originY + nint(sequenceY_[i] / stepSizeYUm_);
+
+		cmd.str("");
+		cmd << "stream " << sequenceStream << " wait io di " << sequenceTriggerInput_ << " == 1";
+		ret = SendCommand(deviceAddressX_, 0, cmd.str());
+		if (ret == DEVICE_OK)
+		{
+			cmd.str("");
+			cmd << "stream " << sequenceStream << " line abs " << x << " " << y;
+			ret = SendCommand(deviceAddressX_, 0, cmd.str());
+		}
+		if (ret == DEVICE_OK)
+		{
+			cmd.str("");
+			cmd << "stream " << sequenceStream << " wait io di " << sequenceTriggerInput_ << " == 0";
+			ret = SendCommand(deviceAddressX_, 0, cmd.str());
+		}
+	}
+
+	// Leave store mode even if storing failed
+	cmd.str("");
+	cmd << "stream " << sequenceStream << " setup disable";
+	int ret2 = SendCommand(deviceAddressX_, 0, cmd.str());
+	return (ret != DEVICE_OK) ? ret : ret2;
+}
+
+
+int XYStage::StartXYStageSequence()
+{
+	this->LogMessage("XYStage::StartXYStageSequence\n", true);
+
+	if (!sequenceable_)
+	{
+		return DEVICE_UNSUPPORTED_COMMAND;
+	}
+
+	ostringstream cmd;
+	cmd << "stream " << sequenceStream << " setup live " << axisX_ << " " << axisY_;
+	int ret = SendCommand(deviceAddressX_, 0, cmd.str());
+	if (ret != DEVICE_OK) 
+	{
+		return ret;
+	}
+
+	cmd.str("");
+	cmd << "stream " << sequenceStream << " call " << sequenceBuffer;
+	NoteMotionStarted(deviceAddressX_);
+	return SendCommand(deviceAddressX_, 0, cmd.str());
+}
+
+
+int XYStage::StopXYStageSequence()
+{
+	this->LogMessage("XYStage::StopXYStageSequence\n", true);
+
+	if (!sequenceable_)
+	{
+		return DEVICE_UNSUPPORTED_COMMAND;
+	}
+
+	// Stopping the axes discards the rest of the stream
+	int ret = ZaberBase::Stop(deviceAddressX_);
+
+	ostringstream cmd;
+	cmd << "stream " << sequenceStream << " setup disable";
+	int ret2 = SendCommand(deviceAddressX_, 0, cmd.str());
+	return (ret != DEVICE_OK) ? ret : ret2;
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // Private helper functions
 ///////////////////////////////////////////////////////////////////////////////
 
+bool XYStage::SupportsStreams() const
+{
+	if (!IsSingleController() || lockstepGroupX_ > 0 || lockstepGroupY_ > 0)
+	{
+		return false;
+	}
+
+	// Older firmware rejects the setting
+	long numStreams;
+	int ret = GetSetting(deviceAddressX_, 0, "stream.numstreams", numStreams);
+	return ret == DEVICE_OK && numStreams >= sequenceStream;
+}
+
+
 int XYStage::SendXYMoveCommand(string type, long x, long y) const
 {
 	this->LogMessage("XYStage::SendXYMoveCommand\n", true);
@@ -629,6 +823,23 @@ int XYStage::OnPort(MM::PropertyBase* pProp, MM::ActionType eAct)
 }
 
 
+int XYStage::OnSequenceTriggerInput(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+	this->LogMessage("XYStage::OnSequenceTriggerInput\n", true);
+
+	if (eAct == MM::BeforeGet)
+	{
+		pProp->Set(sequenceTriggerInput_);
+	}
+	else if (eAct == MM::AfterSet)
+	{
+		pProp->Get(sequenceTriggerInput_);
+	}
+
+	return DEVICE_OK;
+}
+
+
 int XYStage::OnSpeedX(MM::PropertyBase* pProp, MM::ActionType eAct)
 { 
 	this->LogMessage("XYStage::OnSpeedX\n", true);
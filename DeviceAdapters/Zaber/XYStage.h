@@ -56,7 +56,16 @@ public:
 	double GetStepSizeXUm() {return stepSizeXUm_;}
 	double GetStepSizeYUm() {return stepSizeYUm_;}
 
-	int IsXYStageSequenceable(bool& isSequenceable) const {isSequenceable = false; return DEVICE_OK;}
+	// Sequences are run from a stream buffer of the controller, each point
+	// waiting for a pulse on a digital input. Only available for a single
+	// controller without lockstep.
+	int IsXYStageSequenceable(bool& isSequenceable) const {isSequenceable = sequenceable_; return DEVICE_OK;}
+	int GetXYStageSequenceMaxLength(long& nrEvents) const;
+	int StartXYStageSequence();
+	int StopXYStageSequence();
+	int ClearXYStageSequence();
+	int AddToXYStageSequence(double positionX, double positionY);
+	int SendXYStageSequence();
 
 	// action interface
 	// ----------------
@@ -75,12 +84,14 @@ public:
 	int OnAccelY         (MM::PropertyBase* pProp, MM::ActionType eAct);
 	int OnDeviceAddress  (MM::PropertyBase* pProp, MM::ActionType eAct); // Single controller
 	int OnDeviceAddressY (MM::PropertyBase* pProp, MM::ActionType eAct); // Composite XY (two controllers)
+	int OnSequenceTriggerInput (MM::PropertyBase* pProp, MM::ActionType eAct);
 
 private:
 	int SendXYMoveCommand(std::string type, long x, long y) const;
 	int OnSpeed(long address, long axis, MM::PropertyBase* pProp, MM::ActionType eAct) const;
 	int OnAccel(long address, long axis, MM::PropertyBase* pProp, MM::ActionType eAct) const;
 	void GetOrientation(bool& mirrorX, bool& mirrorY);
+	bool SupportsStreams() const;
 
 	inline bool IsSingleController() const
 	{
@@ -105,6 +116,10 @@ private:
 	long motorStepsY_;
 	double linearMotionX_;
 	double linearMotionY_;
+	bool sequenceable_;
+	long sequenceTriggerInput_;
+	std::vector<double> sequenceX_;
+	std::vector<double> sequenceY_;
 };
 
 #endif //_XYSTAGE_H_
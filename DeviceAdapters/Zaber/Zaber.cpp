@@ -35,6 +35,10 @@
 
 using namespace std;
 
+// Busy state of an alert-tracked device is read from the device at least
+// this often, in case an alert was lost
+const double busyCheckIntervalMs = 500.0;
+
 const char* g_Msg_PORT_CHANGE_FORBIDDEN = "The port cannot be changed once the device is initialized.";
 const char* g_Msg_DRIVER_DISABLED = "The driver has disabled itself due to overheating.";
 const char* g_Msg_BUSY_TIMEOUT = "Timed out while waiting for device to finish executing a command.";
@@ -57,6 +61,9 @@ MODULE_API void InitializeModuleData()
 	RegisterDevice(g_FilterWheelName, MM::StateDevice, g_FilterWheelDescription);
 	RegisterDevice(g_FilterTurretName, MM::StateDevice, g_FilterTurretDescription);
 	RegisterDevice(g_IlluminatorName, MM::ShutterDevice, g_IlluminatorDescription);
+
+	// The devices only share their ZaberConnection, which is synchronized
+	SetModuleThreadSafety(MM::ThreadSafetyDevice);
 }                                                            
 
 
@@ -104,36 +111,31 @@ ZaberBase::ZaberBase(MM::Device *device) :
 	port_("Undefined"),
 	device_(device),
 	core_(0),
-	cmdPrefix_("/")
+	cmdPrefix_("/"),
+	connection_(0)
 {
 }
 
 
 ZaberBase::~ZaberBase()
 {
+	if (connection_ != 0)
+	{
+		ZaberConnection::Close(connection_, device_);
+	}
 }
 
 
 // COMMUNICATION "clear buffer" utility function:
-int ZaberBase::ClearPort() const
+int ZaberBase::ClearPort()
 {
 	core_->LogMessage(device_, "ZaberBase::ClearPort\n", true);
 
-	const int bufSize = 255;
-	unsigned char clear[bufSize];
-	unsigned long read = bufSize;
-	int ret;
-
-	while ((int) read == bufSize)
+	if (connection_ == 0)
 	{
-		ret = core_->ReadFromSerial(device_, port_.c_str(), clear, bufSize, read);
-		if (ret != DEVICE_OK) 
-		{
-			return ret;
-		}
+		connection_ = ZaberConnection::Open(core_, device_, port_);
 	}
-
-	return DEVICE_OK;      
+	return connection_->Clear(device_);
 }
 
 
@@ -165,24 +167,37 @@ int ZaberBase::QueryCommand(const string command, vector<string>& reply) const
 {
 	core_->LogMessage(device_, "ZaberBase::QueryCommand\n", true);
 
-	const char* msgFooter = "\r\n"; // required by Zaber ASCII protocol
-
-	const size_t BUFSIZE = 2048;
-	char buf[BUFSIZE] = {'\0'};
-
-	int ret = SendCommand(command);
-	if (ret != DEVICE_OK) 
+	string resp;
+	if (connection_ != 0)
 	{
-		return ret;
+		// The reader thread of the connection receives the reply
+		int ret = connection_->Query(device_, command, resp);
+		if (ret != DEVICE_OK)
+		{
+			return ret;
+		}
 	}
-
-	ret = core_->GetSerialAnswer(device_, port_.c_str(), BUFSIZE, buf, msgFooter);
-	if (ret != DEVICE_OK) 
+	else
 	{
-		return ret;
+		const char* msgFooter = "\r\n"; // required by Zaber ASCII protocol
+
+		const size_t BUFSIZE = 2048;
+		char buf[BUFSIZE] = {'\0'};
+
+		int ret = SendCommand(command);
+		if (ret != DEVICE_OK) 
+		{
+			return ret;
+		}
+
+		ret = core_->GetSerialAnswer(device_, port_.c_str(), BUFSIZE, buf, msgFooter);
+		if (ret != DEVICE_OK) 
+		{
+			return ret;
+		}
+		resp = buf;
 	}
 
-	string resp = buf;
 	if (resp.length() < 1)
 	{
 		return  DEVICE_SERIAL_INVALID_RESPONSE;
@@ -190,7 +205,7 @@ int ZaberBase::QueryCommand(const string command, vector<string>& reply) const
 
 	// remove checksum before parsing
 	int thirdLast = int(resp.length() - 3);
-	if (resp[thirdLast] == ':')
+	if (thirdLast >= 0 && resp[thirdLast] == ':')
 	{
 		resp.erase(thirdLast, string::npos);
 	}
@@ -298,10 +313,44 @@ int ZaberBase::SetSetting(long device, long axis, string setting, double data, i
 }
 
 
+// Turns on alert messages, which the controller sends when its axes stop
+// moving, and lets IsBusy() rely on them.
+int ZaberBase::EnableAlerts(long device) const
+{
+	core_->LogMessage(device_, "ZaberBase::EnableAlerts\n", true);
+
+	int ret = SetSetting(device, 0, "comm.alert", 1);
+	if (ret != DEVICE_OK)
+	{
+		return ret;
+	}
+
+	if (connection_ != 0)
+	{
+		connection_->EnableAlertTracking(device);
+	}
+	return DEVICE_OK;
+}
+
+
 bool ZaberBase::IsBusy(long device) const
 {
 	core_->LogMessage(device_, "ZaberBase::IsBusy\n", true);
 
+	bool tracked = connection_ != 0 && connection_->IsAlertTracked(device);
+	if (tracked)
+	{
+		// Only motion started through this adapter is seen
+		if (!connection_->IsMotionPending(device))
+		{
+			return false;
+		}
+		if (!connection_->IsStatusCheckDue(device, busyCheckIntervalMs))
+		{
+			return true;
+		}
+	}
+
 	ostringstream cmd;
 	cmd << cmdPrefix_ << device;
 	vector<string> resp;
@@ -315,7 +364,12 @@ bool ZaberBase::IsBusy(long device) const
 		return false;
 	}
 
-	return (resp[3] == ("BUSY"));
+	bool busy = (resp[3] == ("BUSY"));
+	if (tracked && !busy)
+	{
+		connection_->NoteIdle(device);
+	}
+	return busy;
 }
 
 
@@ -333,8 +387,15 @@ int ZaberBase::Stop(long device, long lockstepGroup) const
 		cmd << cmdPrefix_ << device << " stop";
 	}
 
+	NoteMotionStarted(device);
 	vector<string> resp;
-	return QueryCommand(cmd.str().c_str(), resp);
+	int ret = QueryCommand(cmd.str().c_str(), resp);
+	if (ret != DEVICE_OK && connection_ != 0)
+	{
+		// Whether anything moves is not known; ask the device next time
+		connection_->RequestStatusCheck(device);
+	}
+	return ret;
 }
 
 
@@ -366,8 +427,15 @@ int ZaberBase::SendMoveCommand(long device, long axis, std::string type, long da
 		cmd << cmdPrefix_ << device << " " << axis << " move " << type << " " << data;
 	}
 
+	NoteMotionStarted(device);
 	vector<string> resp;
-	return QueryCommand(cmd.str().c_str(), resp);
+	int ret = QueryCommand(cmd.str().c_str(), resp);
+	if (ret != DEVICE_OK && connection_ != 0)
+	{
+		// Whether anything moves is not known; ask the device next time
+		connection_->RequestStatusCheck(device);
+	}
+	return ret;
 }
 
 
@@ -379,9 +447,14 @@ int ZaberBase::SendAndPollUntilIdle(long device, long axis, string command, int
 	cmd << cmdPrefix_ << device << " " << axis << " " << command;
 	vector<string> resp;
 
+	NoteMotionStarted(device);
 	int ret = QueryCommand(cmd.str().c_str(), resp);
 	if (ret != DEVICE_OK) 
 	{
+		if (connection_ != 0)
+		{
+			connection_->RequestStatusCheck(device);
+		}
 		return ret;
 	}
 
@@ -405,6 +478,17 @@ int ZaberBase::SendAndPollUntilIdle(long device, long axis, string command, int
 }
 
 
+// Called before a command that may start motion: an alert that arrives
+// after this is taken to be for the new motion.
+void ZaberBase::NoteMotionStarted(long device) const
+{
+	if (connection_ != 0)
+	{
+		connection_->NoteMotionStarted(device);
+	}
+}
+
+
 int ZaberBase::GetRotaryIndexedDeviceInfo(long device, long axis, long& numIndices, long& currentIndex) const
 {
 	core_->LogMessage(device_, "ZaberBase::GetRotaryIndexedDeviceInfo\n", true);
@@ -26,6 +26,7 @@
 #include <MMDevice.h>
 #include <DeviceBase.h>
 #include <ModuleInterface.h>
+#include "ZaberConnection.h"
 #include <sstream>
 #include <string>
 
@@ -64,7 +65,7 @@ public:
 	virtual ~ZaberBase();
 
 protected:
-	int ClearPort() const;
+	int ClearPort();
 	int SendCommand(const std::string command) const;
 	int SendCommand(long device, long axis, const std::string command) const;
 	int QueryCommand(const std::string command, std::vector<std::string>& reply) const;
@@ -72,11 +73,13 @@ protected:
 	int GetSetting(long device, long axis, std::string setting, double& data) const;
 	int SetSetting(long device, long axis, std::string setting, long data) const;
 	int SetSetting(long device, long axis, std::string setting, double data, int decimalPlaces) const;
+	int EnableAlerts(long device) const;
 	bool IsBusy(long device) const;
 	int Stop(long device, long lockstepGroup = 0) const;
 	int GetLimits(long device, long axis, long& min, long& max) const;
 	int SendMoveCommand(long device, long axis, std::string type, long data, bool lockstep = false) const;
 	int SendAndPollUntilIdle(long device, long axis, std::string command, int timeoutMs) const;
+	void NoteMotionStarted(long device) const;
 	int GetRotaryIndexedDeviceInfo(long device, long axis, long& numIndices, long& currentIndex) const;
 
 	bool initialized_;
@@ -84,6 +87,8 @@ protected:
 	MM::Device *device_;
 	MM::Core *core_;
 	std::string cmdPrefix_;
+	// opened by ClearPort()
+	ZaberConnection* connection_;
 };
 
 #endif //_ZABER_H_
@@ -0,0 +1,372 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ZaberConnection.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Shared serial connection to a chain of Zaber controllers,
+//                with a reader thread that separates replies from alerts
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "ZaberConnection.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+using namespace std;
+
+namespace
+{
+	MMThreadLock g_connectionsLock;
+	map<string, ZaberConnection*> g_connections;
+}
+
+
+ZaberConnection* ZaberConnection::Open(MM::Core* core, MM::Device* device, const string& port)
+{
+	MMThreadGuard g(g_connectionsLock);
+
+	ZaberConnection*& connection = g_connections[port];
+	if (connection == 0)
+	{
+		connection = new ZaberConnection(core, port);
+	}
+
+	{
+		boost::lock_guard<boost::mutex> g2(connection->lock_);
+		connection->users_.push_back(device);
+	}
+
+	if (connection->thread_ == 0)
+	{
+		connection->StartReader();
+	}
+	return connection;
+}
+
+
+void ZaberConnection::Close(ZaberConnection* connection, MM::Device* device)
+{
+	MMThreadGuard g(g_connectionsLock);
+
+	// The reader may be reading through the device; it is restarted with
+	// the remaining devices
+	connection->StopReader();
+
+	bool unused;
+	{
+		boost::lock_guard<boost::mutex> g2(connection->lock_);
+		vector<MM::Device*>& users = connection->users_;
+		users.erase(remove(users.begin(), users.end(), device), users.end());
+		unused = users.empty();
+	}
+
+	if (unused)
+	{
+		g_connections.erase(connection->port_);
+		delete connection;
+	}
+	else
+	{
+		connection->StartReader();
+	}
+}
+
+
+ZaberConnection::ZaberConnection(MM::Core* core, const string& port) :
+	core_(core),
+	port_(port),
+	answerTimeoutMs_(2000),
+	thread_(0),
+	stop_(false),
+	reading_(false),
+	queriesInFlight_(0)
+{
+	char timeout[MM::MaxStrLength];
+	if (core_->GetDeviceProperty(port_.c_str(), MM::g_Keyword_AnswerTimeout, timeout) == DEVICE_OK)
+	{
+		int ms = atoi(timeout);
+		if (ms > 0)
+		{
+			answerTimeoutMs_ = ms;
+		}
+	}
+}
+
+
+ZaberConnection::~ZaberConnection()
+{
+	StopReader();
+}
+
+
+void ZaberConnection::StartReader()
+{
+	{
+		boost::lock_guard<boost::mutex> g(lock_);
+		stop_ = false;
+	}
+	thread_ = new ReaderThread(this);
+	thread_->activate();
+}
+
+
+void ZaberConnection::StopReader()
+{
+	if (thread_ == 0)
+	{
+		return;
+	}
+
+	{
+		boost::lock_guard<boost::mutex> g(lock_);
+		stop_ = true;
+	}
+	readerCond_.notify_all();
+	thread_->wait();
+	delete thread_;
+	thread_ = 0;
+}
+
+
+int ZaberConnection::Query(MM::Device* device, const string& command, string& reply)
+{
+	MMThreadGuard q(queryLock_);
+
+	{
+		boost::lock_guard<boost::mutex> g(lock_);
+		// Drop replies that arrived too late for an earlier command. While
+		// the reader is idle such replies are still in the port.
+		replies_.clear();
+		if (!reading_ && !IsReadingNeeded())
+		{
+			core_->PurgeSerial(device, port_.c_str());
+			partialLine_.clear();
+		}
+		++queriesInFlight_;
+	}
+	readerCond_.notify_all();
+
+	int ret = core_->SetSerialCommand(device, port_.c_str(), command.c_str(), "\n");
+
+	boost::unique_lock<boost::mutex> g(lock_);
+	if (ret == DEVICE_OK)
+	{
+		boost::system_time deadline = boost::get_system_time() +
+			boost::posix_time::milliseconds(answerTimeoutMs_);
+		while (replies_.empty() && replyCond_.timed_wait(g, deadline))
+		{
+		}
+		if (replies_.empty())
+		{
+			ret = DEVICE_SERIAL_TIMEOUT;
+		}
+		else
+		{
+			reply = replies_.front();
+			replies_.pop_front();
+		}
+	}
+	--queriesInFlight_;
+	return ret;
+}
+
+
+int ZaberConnection::Clear(MM::Device* device)
+{
+	int ret = core_->PurgeSerial(device, port_.c_str());
+
+	boost::lock_guard<boost::mutex> g(lock_);
+	replies_.clear();
+	partialLine_.clear();
+	return ret;
+}
+
+
+void ZaberConnection::EnableAlertTracking(long address)
+{
+	boost::lock_guard<boost::mutex> g(lock_);
+	states_[address].tracked = true;
+}
+
+
+bool ZaberConnection::IsAlertTracked(long address) const
+{
+	boost::lock_guard<boost::mutex> g(lock_);
+	map<long, DeviceState>::const_iterator it = states_.find(address);
+	return it != states_.end() && it->second.tracked;
+}
+
+
+void ZaberConnection::NoteMotionStarted(long address)
+{
+	MM::MMTime now = core_->GetCurrentMMTime();
+
+	{
+		boost::lock_guard<boost::mutex> g(lock_);
+		DeviceState& state = states_[address];
+		state.motionPending = true;
+		state.alertSeen = false;
+		state.lastCheck = now;
+	}
+	// The reader waits for the IDLE alert
+	readerCond_.notify_all();
+}
+
+
+void ZaberConnection::NoteIdle(long address)
+{
+	boost::lock_guard<boost::mutex> g(lock_);
+	states_[address].motionPending = false;
+}
+
+
+bool ZaberConnection::IsMotionPending(long address) const
+{
+	boost::lock_guard<boost::mutex> g(lock_);
+	map<long, DeviceState>::const_iterator it = states_.find(address);
+	return it != states_.end() && it->second.motionPending;
+}
+
+
+bool ZaberConnection::IsStatusCheckDue(long address, double intervalMs)
+{
+	MM::MMTime now = core_->GetCurrentMMTime();
+
+	{
+		boost::lock_guard<boost::mutex> g(lock_);
+		DeviceState& state = states_[address];
+		if (!state.alertSeen && (now - state.lastCheck).getMsec() < intervalMs)
+		{
+			return false;
+		}
+		state.alertSeen = false;
+		state.lastCheck = now;
+	}
+	readerCond_.notify_all();
+	return true;
+}
+
+
+void ZaberConnection::RequestStatusCheck(long address)
+{
+	boost::lock_guard<boost::mutex> g(lock_);
+	states_[address].alertSeen = true;
+}
+
+
+int ZaberConnection::ReadLoop()
+{
+	for (;;)
+	{
+		// Users are only removed while the reader is stopped, so the
+		// device stays valid until the next time round
+		MM::Device* reader;
+		{
+			boost::unique_lock<boost::mutex> g(lock_);
+			while (!stop_ && (users_.empty() || !IsReadingNeeded()))
+			{
+				readerCond_.wait(g);
+			}
+			if (stop_)
+			{
+				break;
+			}
+			reader = users_.front();
+			reading_ = true;
+		}
+
+		unsigned char buf[256];
+		unsigned long read = 0;
+		int ret = core_->ReadFromSerial(reader, port_.c_str(), buf, sizeof(buf), read);
+
+		vector<string> lines;
+		{
+			boost::unique_lock<boost::mutex> g(lock_);
+			reading_ = false;
+			if (ret != DEVICE_OK || read == 0)
+			{
+				// There is no blocking read on a serial port; wait a little
+				// for data, or until stopped
+				if (!stop_)
+				{
+					readerCond_.timed_wait(g, boost::posix_time::milliseconds(1));
+				}
+				continue;
+			}
+
+			partialLine_.append((const char*)buf, read);
+			string::size_type end;
+			while ((end = partialLine_.find('\n')) != string::npos)
+			{
+				string line = partialLine_.substr(0, end);
+				partialLine_.erase(0, end + 1);
+				if (!line.empty() && line[line.length() - 1] == '\r')
+				{
+					line.erase(line.length() - 1);
+				}
+				lines.push_back(line);
+			}
+		}
+
+		for (size_t i = 0; i < lines.size(); ++i)
+		{
+			HandleLine(lines[i]);
+		}
+	}
+	return 0;
+}
+
+
+bool ZaberConnection::IsReadingNeeded() const
+{
+	if (queriesInFlight_ > 0)
+	{
+		return true;
+	}
+	for (map<long, DeviceState>::const_iterator it = states_.begin(); it != states_.end(); ++it)
+	{
+		const DeviceState& state = it->second;
+		if (state.tracked && state.motionPending && !state.alertSeen)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+
+void ZaberConnection::HandleLine(const string& line)
+{
+	if (line.empty())
+	{
+		return;
+	}
+
+	if (line[0] == '@')
+	{
+		{
+			boost::lock_guard<boost::mutex> g(lock_);
+			replies_.push_back(line);
+		}
+		replyCond_.notify_all();
+	}
+	else if (line[0] == '!' && line.length() >= 3)
+	{
+		long address = atol(line.substr(1, 2).c_str());
+		boost::lock_guard<boost::mutex> g(lock_);
+		states_[address].alertSeen = true;
+	}
+	// Info messages ('#') are not used by the adapter
+}
@@ -0,0 +1,116 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ZaberConnection.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Shared serial connection to a chain of Zaber controllers,
+//                with a reader thread that separates replies from alerts
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#ifndef _ZABERCONNECTION_H_
+#define _ZABERCONNECTION_H_
+
+#include <MMDevice.h>
+#include <DeviceThreads.h>
+#include <boost/thread.hpp>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+// All Zaber devices on a port share one connection. A reader thread takes
+// every line the controllers send: replies ('@') are handed to the command
+// waiting for them, alerts ('!') are recorded per device address. The
+// reader only polls the port while a reply or an alert is expected, and
+// reads through one of the devices using the connection, so it is stopped
+// whenever a device is removed.
+//
+// With alerts enabled (comm.alert = 1) a controller sends an IDLE alert
+// whenever an axis stops moving, so busy state can be tracked without
+// polling the controller.
+class ZaberConnection
+{
+public:
+	// Returns the connection for the port, creating it if needed. Every
+	// Open() must be matched by a Close() with the same device.
+	static ZaberConnection* Open(MM::Core* core, MM::Device* device, const std::string& port);
+	static void Close(ZaberConnection* connection, MM::Device* device);
+
+	// Sends a command and waits for its reply
+	int Query(MM::Device* device, const std::string& command, std::string& reply);
+	// Discards unread data
+	int Clear(MM::Device* device);
+
+	// Busy tracking by alerts, per device address
+	void EnableAlertTracking(long address);
+	bool IsAlertTracked(long address) const;
+	void NoteMotionStarted(long address);
+	void NoteIdle(long address);
+	bool IsMotionPending(long address) const;
+	// Whether the busy state has to be read from the device: after an alert,
+	// and every intervalMs in case an alert was missed
+	bool IsStatusCheckDue(long address, double intervalMs);
+	// Makes the next status check due at once
+	void RequestStatusCheck(long address);
+
+private:
+	class ReaderThread : public MMDeviceThreadBase
+	{
+	public:
+		ReaderThread(ZaberConnection* connection) : connection_(connection) {}
+		int svc() { return connection_->ReadLoop(); }
+	private:
+		ZaberConnection* connection_;
+	};
+
+	struct DeviceState
+	{
+		DeviceState() : tracked(false), motionPending(false), alertSeen(false) {}
+		bool tracked;
+		bool motionPending;
+		bool alertSeen;
+		MM::MMTime lastCheck;
+	};
+
+	ZaberConnection(MM::Core* core, const std::string& port);
+	~ZaberConnection();
+
+	void StartReader();
+	void StopReader();
+	int ReadLoop();
+	// Whether a reply or an alert is expected; call with lock_ held
+	bool IsReadingNeeded() const;
+	void HandleLine(const std::string& line);
+
+	MM::Core* core_;
+	std::string port_;
+	int answerTimeoutMs_;
+	std::vector<MM::Device*> users_;
+
+	ReaderThread* thread_;
+	bool stop_;
+	bool reading_; // the reader is in ReadFromSerial()
+	int queriesInFlight_;
+	std::string partialLine_;
+	std::deque<std::string> replies_;
+	std::map<long, DeviceState> states_;
+	mutable boost::mutex lock_;
+	boost::condition_variable readerCond_; // wakes the reader
+	boost::condition_variable replyCond_; // signaled when a reply arrives
+	// held for the duration of a Query(), so that replies are not mixed up
+	MMThreadLock queryLock_;
+};
+
+#endif //_ZABERCONNECTION_H_
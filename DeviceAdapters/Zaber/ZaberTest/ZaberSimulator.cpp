@@ -0,0 +1,706 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ZaberSimulator.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Simulates a chain of Zaber controllers speaking the ASCII
+//                protocol on a pseudo terminal, for testing the Zaber adapter
+//                without hardware (POSIX only)
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+// USAGE:         zaber_simulator [-n devices] [-a axes] [-t triggerPeriodMs]
+//                                [-l link]
+//
+//                Prints the name of the serial port to use (the pty slave),
+//                and optionally makes a symbolic link to it. Supported are
+//                status queries, get/set of the settings used by the adapter,
+//                move, stop, home, tools findrange, alerts (comm.alert) and
+//                the stream commands used for XY sequences. Digital input 1-4
+//                of every controller is pulsed every triggerPeriodMs, or once
+//                on SIGUSR1.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+	const double speedConvFactor = 1.6384; // maxspeed data per microstep/s
+	const double pulseLengthS = 0.005;
+
+	volatile sig_atomic_t g_pulseRequested = 0;
+
+	void OnSigUsr1(int)
+	{
+		g_pulseRequested = 1;
+	}
+
+	double Now()
+	{
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec + ts.tv_nsec * 1e-9;
+	}
+
+	bool ToLong(const string& s, long& value)
+	{
+		char* end;
+		value = strtol(s.c_str(), &end, 10);
+		return !s.empty() && *end == '\0';
+	}
+}
+
+
+struct Axis
+{
+	Axis() :
+		pos(0), startPos(0), target(0), speed(0), startTime(0), moving(false)
+	{
+		settings["resolution"] = 64;
+		settings["limit.min"] = 0;
+		settings["limit.max"] = 305381;
+		settings["maxspeed"] = 153600;
+		settings["accel"] = 2000;
+		settings["limit.cycle.dist"] = 76800;
+		settings["motion.index.dist"] = 12800;
+	}
+
+	void Start(double to, double stepsPerS, double now)
+	{
+		startPos = pos;
+		target = max((double)settings["limit.min"], min((double)settings["limit.max"], to));
+		speed = stepsPerS > 0 ? stepsPerS : settings["maxspeed"] / speedConvFactor;
+		startTime = now;
+		moving = pos != target;
+	}
+
+	// Returns true when the axis has just stopped
+	bool Update(double now)
+	{
+		if (!moving)
+			return false;
+		double travelled = speed * (now - startTime);
+		if (travelled >= fabs(target - startPos))
+		{
+			pos = target;
+			moving = false;
+			return true;
+		}
+		pos = startPos + (target > startPos ? travelled : -travelled);
+		return false;
+	}
+
+	void Stop()
+	{
+		pos = floor(pos + 0.5);
+		target = pos;
+		moving = false;
+	}
+
+	double pos;
+	double startPos;
+	double target;
+	double speed;
+	double startTime;
+	bool moving;
+	map<string, long> settings;
+};
+
+
+struct Stream
+{
+	enum Mode { Disabled, Store, Live };
+
+	Stream() : mode(Disabled), buffer(0), lineStarted(false) {}
+
+	Mode mode;
+	int buffer;               // store mode
+	vector<int> axes;         // live mode, axis number per stream axis
+	deque<string> pending;    // live mode, actions not yet done
+	bool lineStarted;
+};
+
+
+class Controller
+{
+public:
+	Controller(int address, int numAxes) :
+		address_(address), axes_(numAxes), alert_(0), diHigh_(false)
+	{
+	}
+
+	int Address() const { return address_; }
+
+	void SetInputs(bool high) { diHigh_ = high; }
+
+	// Advances motion and streams; returns alerts to send
+	string Update(double now)
+	{
+		string alerts;
+		for (size_t i = 0; i < axes_.size(); ++i)
+		{
+			if (axes_[i].Update(now) && alert_ != 0 && !IsStreaming())
+			{
+				alerts += Message('!', (int)i + 1, "") + "\r\n";
+			}
+		}
+
+		for (map<int, Stream>::iterator it = streams_.begin(); it != streams_.end(); ++it)
+		{
+			if (RunStream(it->second, now) && alert_ != 0 && !IsBusy(0))
+			{
+				alerts += Message('!', 0, "") + "\r\n";
+			}
+		}
+		return alerts;
+	}
+
+	string Handle(int axis, const vector<string>& words, double now)
+	{
+		if (axis < 0 || axis > (int)axes_.size())
+			return Reject(axis, "BADAXIS");
+		if (words.empty())
+			return Reply(axis, "0");
+
+		const string& cmd = words[0];
+		if (cmd == "get" && words.size() == 2)
+			return Get(axis, words[1]);
+		if (cmd == "set" && words.size() == 3)
+			return Set(axis, words[1], words[2]);
+		if (cmd == "move" && words.size() >= 2)
+			return Move(axis, words, now);
+		if (cmd == "stop")
+		{
+			StopAll(axis);
+			return Reply(axis, "0");
+		}
+		if (cmd == "home" || (cmd == "tools" && words.size() == 2 && words[1] == "findrange"))
+		{
+			for (size_t i = 0; i < axes_.size(); ++i)
+			{
+				if (axis == 0 || axis == (int)i + 1)
+					axes_[i].Start(axes_[i].settings["limit.min"], 0, now);
+			}
+			return Reply(axis, "0");
+		}
+		if (cmd == "tools" && words.size() == 2 && words[1] == "detectholder")
+			return Reply(axis, "0");
+		if (cmd == "stream" && axis == 0)
+			return StreamCommand(words, now);
+		return Reject(axis, "BADCOMMAND");
+	}
+
+private:
+	bool IsStreaming() const
+	{
+		for (map<int, Stream>::const_iterator it = streams_.begin(); it != streams_.end(); ++it)
+		{
+			if (!it->second.pending.empty())
+				return true;
+		}
+		return false;
+	}
+
+	bool IsBusy(int axis) const
+	{
+		if (axis == 0 && IsStreaming())
+			return true;
+		for (size_t i = 0; i < axes_.size(); ++i)
+		{
+			if ((axis == 0 || axis == (int)i + 1) && axes_[i].moving)
+				return true;
+		}
+		return false;
+	}
+
+	string Message(char type, int axis, const string& rest) const
+	{
+		ostringstream os;
+		os << type;
+		os.width(2);
+		os.fill('0');
+		os << address_ << " " << axis << " " << rest << (rest.empty() ? "" : " ")
+			<< (IsBusy(axis) ? "BUSY" : "IDLE") << " --";
+		return os.str();
+	}
+
+	string Reply(int axis, const string& data) const
+	{
+		string msg = Message('@', axis, "OK");
+		return msg + " " + data + "\r\n";
+	}
+
+	string Reject(int axis, const string& reason) const
+	{
+		return Message('@', axis, "RJ") + " " + reason + "\r\n";
+	}
+
+	string Get(int axis, const string& setting)
+	{
+		if (setting == "comm.alert")
+			return Reply(axis, alert_ ? "1" : "0");
+		if (setting == "system.axiscount")
+			return Reply(axis, ToString((long)axes_.size()));
+		if (setting == "stream.numstreams" || setting == "stream.numbufs")
+			return Reply(axis, "2");
+
+		ostringstream data;
+		for (size_t i = 0; i < axes_.size(); ++i)
+		{
+			if (axis != 0 && axis != (int)i + 1)
+				continue;
+			Axis& a = axes_[i];
+			long value;
+			if (setting == "pos")
+				value = (long)floor(a.pos + 0.5);
+			else if (setting == "motion.index.num")
+				value = (long)floor(a.pos / a.settings["motion.index.dist"] + 0.5) + 1;
+			else if (a.settings.count(setting))
+				value = a.settings[setting];
+			else
+				return Reject(axis, "BADDATA");
+			data << (data.str().empty() ? "" : " ") << value;
+		}
+		return Reply(axis, data.str());
+	}
+
+	string Set(int axis, const string& setting, const string& valueText)
+	{
+		long value;
+		if (!ToLong(valueText, value))
+			return Reject(axis, "BADDATA");
+		if (setting == "comm.alert")
+		{
+			alert_ = value;
+			return Reply(axis, "0");
+		}
+
+		for (size_t i = 0; i < axes_.size(); ++i)
+		{
+			if (axis != 0 && axis != (int)i + 1)
+				continue;
+			Axis& a = axes_[i];
+			if (setting == "pos")
+				a.pos = value;
+			else if (a.settings.count(setting))
+				a.settings[setting] = value;
+			else
+				return Reject(axis, "BADDATA");
+		}
+		return Reply(axis, "0");
+	}
+
+	string Move(int axis, const vector<string>& words, double now)
+	{
+		const string& type = words[1];
+		long data = 0;
+		if (type != "min" && type != "max" && (words.size() != 3 || !ToLong(words[2], data)))
+			return Reject(axis, "BADDATA");
+
+		for (size_t i = 0; i < axes_.size(); ++i)
+		{
+			if (axis != 0 && axis != (int)i + 1)
+				continue;
+			Axis& a = axes_[i];
+			if (type == "abs")
+				a.Start(data, 0, now);
+			else if (type == "rel")
+				a.Start(a.pos + data, 0, now);
+			else if (type == "min")
+				a.Start(a.settings["limit.min"], 0, now);
+			else if (type == "max")
+				a.Start(a.settings["limit.max"], 0, now);
+			else if (type == "index")
+				a.Start((double)(data - 1) * a.settings["motion.index.dist"], 0, now);
+			else if (type == "vel")
+			{
+				if (data == 0)
+					a.Stop();
+				else
+					a.Start(data > 0 ? a.settings["limit.max"] : a.settings["limit.min"],
+						fabs(data / speedConvFactor), now);
+			}
+			else
+				return Reject(axis, "BADCOMMAND");
+		}
+		return Reply(axis, "0");
+	}
+
+	void StopAll(int axis)
+	{
+		for (size_t i = 0; i < axes_.size(); ++i)
+		{
+			if (axis == 0 || axis == (int)i + 1)
+				axes_[i].Stop();
+		}
+		// Stopping an axis of a stream ends the stream
+		for (map<int, Stream>::iterator it = streams_.begin(); it != streams_.end(); ++it)
+		{
+			it->second.pending.clear();
+			it->second.lineStarted = false;
+		}
+	}
+
+	string StreamCommand(const vector<string>& words, double now)
+	{
+		long id, buffer;
+		if (words.size() >= 4 && words[1] == "buffer" && ToLong(words[2], buffer) && words[3] == "erase")
+		{
+			buffers_.erase((int)buffer);
+			return Reply(0, "0");
+		}
+		if (words.size() < 3 || !ToLong(words[1], id))
+			return Reject(0, "BADCOMMAND");
+
+		Stream& stream = streams_[(int)id];
+		vector<string> rest(words.begin() + 2, words.end());
+		if (rest[0] == "setup")
+		{
+			if (rest.size() == 2 && rest[1] == "disable")
+			{
+				stream = Stream();
+				return Reply(0, "0");
+			}
+			if (rest.size() == 4 && rest[1] == "store" && ToLong(rest[2], buffer))
+			{
+				stream = Stream();
+				stream.mode = Stream::Store;
+				stream.buffer = (int)buffer;
+				buffers_[(int)buffer].clear();
+				return Reply(0, "0");
+			}
+			if (rest.size() >= 3 && rest[1] == "live")
+			{
+				stream = Stream();
+				stream.mode = Stream::Live;
+				for (size_t i = 2; i < rest.size(); ++i)
+				{
+					long a;
+					if (!ToLong(rest[i], a) || a < 1 || a > (long)axes_.size())
+						return Reject(0, "BADDATA");
+					stream.axes.push_back((int)a);
+				}
+				return Reply(0, "0");
+			}
+			return Reject(0, "BADCOMMAND");
+		}
+
+		if (stream.mode == Stream::Disabled)
+			return Reject(0, "STREAMMODE");
+
+		string action;
+		for (size_t i = 0; i < rest.size(); ++i)
+			action += (i ? " " : "") + rest[i];
+
+		if (rest[0] == "call" && rest.size() == 2 && ToLong(rest[1], buffer))
+		{
+			if (stream.mode != Stream::Live || buffers_.count((int)buffer) == 0)
+				return Reject(0, "BADDATA");
+			const vector<string>& actions = buffers_[(int)buffer];
+			stream.pending.insert(stream.pending.end(), actions.begin(), actions.end());
+			RunStream(stream, now);
+			return Reply(0, "0");
+		}
+
+		if (!IsStreamAction(rest))
+			return Reject(0, "BADCOMMAND");
+
+		if (stream.mode == Stream::Store)
+			buffers_[stream.buffer].push_back(action);
+		else
+		{
+			stream.pending.push_back(action);
+			RunStream(stream, now);
+		}
+		return Reply(0, "0");
+	}
+
+	static bool IsStreamAction(const vector<string>& words)
+	{
+		long n;
+		if (words.size() == 6 && words[0] == "wait" && words[1] == "io" && words[2] == "di")
+			return ToLong(words[3], n) && words[4] == "==" && (words[5] == "0" || words[5] == "1");
+		if (words.size() >= 3 && words[0] == "line" && (words[1] == "abs" || words[1] == "rel"))
+		{
+			for (size_t i = 2; i < words.size(); ++i)
+			{
+				if (!ToLong(words[i], n))
+					return false;
+			}
+			return true;
+		}
+		return false;
+	}
+
+	// Executes stream actions as far as possible; returns true when the
+	// stream has just run out of actions
+	bool RunStream(Stream& stream, double now)
+	{
+		bool wasRunning = !stream.pending.empty();
+		while (!stream.pending.empty())
+		{
+			vector<string> words;
+			istringstream is(stream.pending.front());
+			string w;
+			while (is >> w)
+				words.push_back(w);
+
+			if (words[0] == "wait")
+			{
+				bool wanted = words[5] == "1";
+				if (diHigh_ != wanted)
+					break;
+			}
+			else if (words[0] == "line")
+			{
+				if (!stream.lineStarted)
+				{
+					bool relative = words[1] == "rel";
+					for (size_t i = 2; i < words.size() && i - 2 < stream.axes.size(); ++i)
+					{
+						Axis& a = axes_[stream.axes[i - 2] - 1];
+						double to = atol(words[i].c_str()) + (relative ? a.pos : 0);
+						a.Start(to, 0, now);
+					}
+					stream.lineStarted = true;
+				}
+
+				bool moving = false;
+				for (size_t i = 0; i < stream.axes.size(); ++i)
+					moving = moving || axes_[stream.axes[i] - 1].moving;
+				if (moving)
+					break;
+				stream.lineStarted = false;
+			}
+			stream.pending.pop_front();
+		}
+		return wasRunning && stream.pending.empty();
+	}
+
+	static string ToString(long value)
+	{
+		ostringstream os;
+		os << value;
+		return os.str();
+	}
+
+	int address_;
+	vector<Axis> axes_;
+	long alert_;
+	bool diHigh_;
+	map<int, Stream> streams_;
+	map<int, vector<string> > buffers_;
+};
+
+
+class Simulator
+{
+public:
+	Simulator(int numDevices, int numAxes, double triggerPeriodMs) :
+		triggerPeriodS_(triggerPeriodMs / 1000.0), pulseEnd_(0), nextPulse_(0)
+	{
+		for (int i = 0; i < numDevices; ++i)
+			controllers_.push_back(Controller(i + 1, numAxes));
+	}
+
+	// Handles one line received from the host; returns the replies
+	string HandleLine(const string& line, double now)
+	{
+		string::size_type start = line.find('/');
+		if (start == string::npos)
+			return "";
+
+		vector<string> words;
+		istringstream is(line.substr(start + 1));
+		string w;
+		while (is >> w)
+			words.push_back(w);
+
+		// Remove a checksum, if any
+		if (!words.empty())
+		{
+			string& last = words.back();
+			string::size_type colon = last.find(':');
+			if (colon != string::npos)
+			{
+				last.erase(colon);
+				if (last.empty())
+					words.pop_back();
+			}
+		}
+
+		long address = 0, axis = 0;
+		size_t first = 0;
+		if (first < words.size() && ToLong(words[first], address))
+			++first;
+		if (first < words.size() && ToLong(words[first], axis))
+			++first;
+		vector<string> command(words.begin() + first, words.end());
+
+		string replies;
+		for (size_t i = 0; i < controllers_.size(); ++i)
+		{
+			if (address == 0 || address == controllers_[i].Address())
+				replies += controllers_[i].Handle((int)axis, command, now);
+		}
+		return replies;
+	}
+
+	string Update(double now)
+	{
+		bool high = now < pulseEnd_;
+		if (g_pulseRequested)
+		{
+			g_pulseRequested = 0;
+			pulseEnd_ = now + pulseLengthS;
+			high = true;
+		}
+		if (triggerPeriodS_ > 0 && now >= nextPulse_)
+		{
+			nextPulse_ = now + triggerPeriodS_;
+			pulseEnd_ = now + pulseLengthS;
+			high = true;
+		}
+
+		string alerts;
+		for (size_t i = 0; i < controllers_.size(); ++i)
+		{
+			controllers_[i].SetInputs(high);
+			alerts += controllers_[i].Update(now);
+		}
+		return alerts;
+	}
+
+private:
+	vector<Controller> controllers_;
+	double triggerPeriodS_;
+	double pulseEnd_;
+	double nextPulse_;
+};
+
+
+static void Send(int fd, const string& text)
+{
+	size_t done = 0;
+	while (done < text.size())
+	{
+		ssize_t n = write(fd, text.data() + done, text.size() - done);
+		if (n < 0)
+		{
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			return;
+		}
+		done += n;
+	}
+}
+
+
+int main(int argc, char* argv[])
+{
+	int numDevices = 1, numAxes = 2;
+	double triggerPeriodMs = 0;
+	const char* link = 0;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "n:a:t:l:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n': numDevices = atoi(optarg); break;
+		case 'a': numAxes = atoi(optarg); break;
+		case 't': triggerPeriodMs = atof(optarg); break;
+		case 'l': link = optarg; break;
+		default:
+			fprintf(stderr, "usage: %s [-n devices] [-a axes] [-t triggerPeriodMs] [-l link]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	int master, slave;
+	char name[256];
+	if (openpty(&master, &slave, name, 0, 0) != 0)
+	{
+		perror("openpty");
+		return 1;
+	}
+
+	termios tio;
+	tcgetattr(slave, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(slave, TCSANOW, &tio);
+
+	if (link != 0)
+	{
+		unlink(link);
+		if (symlink(name, link) != 0)
+		{
+			perror("symlink");
+			return 1;
+		}
+	}
+	printf("%s\n", name);
+	fflush(stdout);
+
+	signal(SIGUSR1, OnSigUsr1);
+
+	Simulator simulator(numDevices, numAxes, triggerPeriodMs);
+	string partial;
+	for (;;)
+	{
+		pollfd pfd;
+		pfd.fd = master;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		int ready = poll(&pfd, 1, 1);
+
+		if (ready > 0 && (pfd.revents & POLLIN))
+		{
+			char buf[1024];
+			ssize_t n = read(master, buf, sizeof(buf));
+			if (n > 0)
+			{
+				partial.append(buf, n);
+				string::size_type end;
+				while ((end = partial.find('\n')) != string::npos)
+				{
+					string line = partial.substr(0, end);
+					partial.erase(0, end + 1);
+					Send(master, simulator.HandleLine(line, Now()));
+				}
+			}
+		}
+
+		Send(master, simulator.Update(Now()));
+	}
+}
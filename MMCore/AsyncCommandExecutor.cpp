@@ -0,0 +1,236 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          AsyncCommandExecutor.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Runs core commands in the background, on one worker
+//                thread per named queue
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "AsyncCommandExecutor.h"
+
+#include "CoreUtils.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <deque>
+#include <exception>
+
+namespace mm
+{
+
+struct AsyncCommandExecutor::CommandState
+{
+   Command command;
+   bool done; // Guarded by the executor's mutex_
+   boost::shared_ptr<CMMError> error; // Set before done
+
+   explicit CommandState(Command c) : command(c), done(false) {}
+};
+
+
+class AsyncCommandExecutor::Queue
+{
+   boost::mutex mutex_;
+   boost::condition_variable condition_;
+   std::deque< boost::function<void ()> > pending_;
+   bool stopping_;
+   boost::thread thread_; // Must be last
+
+public:
+   Queue() :
+      stopping_(false),
+      thread_(boost::bind(&Queue::Loop, this))
+   {}
+
+   void Push(boost::function<void ()> f)
+   {
+      {
+         boost::lock_guard<boost::mutex> lock(mutex_);
+         pending_.push_back(f);
+      }
+      condition_.notify_one();
+   }
+
+   // Returns after the pending functions have run
+   void Stop()
+   {
+      {
+         boost::lock_guard<boost::mutex> lock(mutex_);
+         stopping_ = true;
+      }
+      condition_.notify_one();
+      thread_.join();
+   }
+
+private:
+   void Loop()
+   {
+      for (;;)
+      {
+         boost::function<void ()> f;
+         {
+            boost::unique_lock<boost::mutex> lock(mutex_);
+            while (pending_.empty() && !stopping_)
+               condition_.wait(lock);
+            if (pending_.empty())
+               return;
+            f = pending_.front();
+            pending_.pop_front();
+         }
+         f();
+      }
+   }
+};
+
+
+AsyncCommandExecutor::AsyncCommandExecutor() :
+   nextHandle_(1)
+{
+}
+
+
+AsyncCommandExecutor::~AsyncCommandExecutor()
+{
+   Shutdown();
+}
+
+
+long
+AsyncCommandExecutor::Submit(const std::string& queueName, Command command)
+{
+   boost::shared_ptr<CommandState> state(new CommandState(command));
+
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   boost::shared_ptr<Queue>& queue = queues_[queueName];
+   if (!queue)
+      queue.reset(new Queue());
+
+   long handle = nextHandle_++;
+   commands_[handle] = state;
+   queue->Push(boost::bind(&AsyncCommandExecutor::Run, this, state));
+   return handle;
+}
+
+
+bool
+AsyncCommandExecutor::IsDone(long handle) throw (CMMError)
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   return GetCommand(handle)->done;
+}
+
+
+void
+AsyncCommandExecutor::Wait(long handle) throw (CMMError)
+{
+   boost::shared_ptr<CommandState> state;
+   {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      state = GetCommand(handle);
+      while (!state->done)
+         doneCondition_.wait(lock);
+      commands_.erase(handle);
+   }
+   if (state->error)
+      throw CMMError(*state->error);
+}
+
+
+void
+AsyncCommandExecutor::WaitAll(const std::vector<long>& handles) throw (CMMError)
+{
+   boost::shared_ptr<CMMError> firstError;
+   for (std::vector<long>::const_iterator it = handles.begin(),
+         end = handles.end(); it != end; ++it)
+   {
+      try
+      {
+         Wait(*it);
+      }
+      catch (const CMMError& e)
+      {
+         if (!firstError)
+            firstError.reset(new CMMError(e));
+      }
+   }
+   if (firstError)
+      throw CMMError(*firstError);
+}
+
+
+void
+AsyncCommandExecutor::Shutdown()
+{
+   std::map< std::string, boost::shared_ptr<Queue> > queues;
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      queues.swap(queues_);
+   }
+
+   // Commands run with mutex_ unlocked, so the queues can be drained here
+   for (std::map< std::string, boost::shared_ptr<Queue> >::iterator
+         it = queues.begin(), end = queues.end(); it != end; ++it)
+   {
+      it->second->Stop();
+   }
+}
+
+
+void
+AsyncCommandExecutor::Run(boost::shared_ptr<CommandState> state)
+{
+   try
+   {
+      state->command();
+   }
+   catch (const CMMError& e)
+   {
+      state->error.reset(new CMMError(e));
+   }
+   catch (const std::exception& e)
+   {
+      state->error.reset(new CMMError(std::string("Asynchronous command failed: ") +
+               e.what(), MMERR_UnhandledException));
+   }
+   catch (...)
+   {
+      state->error.reset(new CMMError("Asynchronous command failed with an unknown exception",
+               MMERR_UnhandledException));
+   }
+
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      state->done = true;
+      // Release whatever the command holds on to
+      state->command.clear();
+   }
+   doneCondition_.notify_all();
+}
+
+
+boost::shared_ptr<AsyncCommandExecutor::CommandState>
+AsyncCommandExecutor::GetCommand(long handle) throw (CMMError)
+{
+   std::map< long, boost::shared_ptr<CommandState> >::iterator it =
+      commands_.find(handle);
+   if (it == commands_.end())
+      throw CMMError("No pending asynchronous command with handle " +
+            ToString(handle), MMERR_InvalidCommandHandle);
+   return it->second;
+}
+
+} // namespace mm
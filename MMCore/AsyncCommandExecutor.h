@@ -0,0 +1,88 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          AsyncCommandExecutor.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Runs core commands in the background, on one worker
+//                thread per named queue
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "Error.h"
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace mm
+{
+
+/**
+ * Runs commands in the background, on one worker thread per named queue.
+ *
+ * Commands submitted to the same queue run one at a time, in the order they
+ * were submitted; commands on different queues run concurrently. Each
+ * submitted command is identified by a handle, which stays valid until the
+ * command has been waited for.
+ */
+class AsyncCommandExecutor
+{
+public:
+   typedef boost::function<void ()> Command;
+
+private:
+   class Queue;
+   struct CommandState;
+
+   boost::mutex mutex_;
+   boost::condition_variable doneCondition_;
+   std::map< std::string, boost::shared_ptr<Queue> > queues_;
+   std::map< long, boost::shared_ptr<CommandState> > commands_;
+   long nextHandle_;
+
+public:
+   AsyncCommandExecutor();
+   // Waits for all queued commands
+   ~AsyncCommandExecutor();
+
+   long Submit(const std::string& queueName, Command command);
+
+   bool IsDone(long handle) throw (CMMError);
+   // Waits for the command and forgets its handle. If the command threw,
+   // its error is rethrown.
+   void Wait(long handle) throw (CMMError);
+   // Waits for all the commands and forgets their handles. Throws the error
+   // of the first failed command, if any, after all have finished.
+   void WaitAll(const std::vector<long>& handles) throw (CMMError);
+
+   // Waits for all queued commands and stops the worker threads; commands
+   // that are submitted later get their own new threads.
+   void Shutdown();
+
+private:
+   void Run(boost::shared_ptr<CommandState> state);
+   boost::shared_ptr<CommandState> GetCommand(long handle) throw (CMMError);
+
+   AsyncCommandExecutor(const AsyncCommandExecutor&);
+   AsyncCommandExecutor& operator=(const AsyncCommandExecutor&);
+};
+
+} // namespace mm
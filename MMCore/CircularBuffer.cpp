@@ -28,26 +28,41 @@
 
 #include "../MMDevice/DeviceUtils.h"
 
+#include <algorithm>
+
 
 const long long bytesInMB = 1 << 20;
 const long adjustThreshold = LONG_MAX / 2;
 const unsigned long maxCBSize = 100000;    //a reasonable limit to circular buffer size
+const unsigned long decompressedFrameCount = 4;
+const unsigned long maxDecompressionCaches = 8;
 
 CircularBuffer::CircularBuffer(unsigned int memorySizeMB) :
    width_(0), 
    height_(0), 
    pixDepth_(0), 
+   inputWidth_(0), 
+   inputHeight_(0), 
    imageCounter_(0), 
    insertIndex_(0), 
    saveIndex_(0), 
    memorySizeMB_(memorySizeMB), 
-   overflow_(false)
+   overflow_(false),
+   compressedBytes_(0),
+   lastCompressedFrameBytes_(0),
+   compressedReady_(false),
+   decompressionUseCount_(0)
 {
    facet = new boost::posix_time::time_facet("%Y-%m-%d %H:%M:%s");
    tStream.imbue(std::locale(tStream.getloc(), facet));
 }
 
-CircularBuffer::~CircularBuffer() {}
+CircularBuffer::~CircularBuffer()
+{
+   for (std::map<const unsigned char*, mm::ImgBuffer*>::iterator it = detachedImages_.begin();
+         it != detachedImages_.end(); ++it)
+      delete it->second;
+}
 
 bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int h, unsigned int pixDepth)
 {
@@ -62,12 +77,23 @@ bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int
       if (w == 0 || h==0 || pixDepth == 0 || channels == 0)
          return false; // does not make sense
 
-      if (w == width_ && height_ == h && pixDepth_ == pixDepth && channels == numChannels_)
-         if (frameArray_.size() > 0)
+      // images are stored after any software ROI and binning
+      unsigned storedWidth = w;
+      unsigned storedHeight = h;
+      if (roiBinning_ && !roiBinning_->GetOutputSize(w, h, storedWidth, storedHeight))
+         return false; // the ROI is outside the image
+
+      if (w == inputWidth_ && inputHeight_ == h && pixDepth_ == pixDepth && channels == numChannels_)
+         if (frameArray_.size() > 0 || compressedReady_)
             return true; // nothing to change
 
-      width_ = w;
-      height_ = h;
+      if (!pinCounts_.empty())
+         DetachAllPinnedImages();
+
+      inputWidth_ = w;
+      inputHeight_ = h;
+      width_ = storedWidth;
+      height_ = storedHeight;
       pixDepth_ = pixDepth;
       numChannels_ = channels;
 
@@ -84,6 +110,7 @@ bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int
       if (cbSize == 0) 
       {
          frameArray_.resize(0);
+         compressedReady_ = false;
          return false; // memory footprint too small
       }
 
@@ -95,12 +122,27 @@ bool CircularBuffer::Initialize(unsigned channels, unsigned int w, unsigned int
 
       for (unsigned long i=0; i<frameArray_.size(); i++)
          frameArray_[i].Clear();
+      ReleaseDecompressionCaches();
+      compressedReady_ = false;
+      compressedFrames_.clear();
+      compressedBytes_ = 0;
+      lastCompressedFrameBytes_ = 0;
+
+      if (codec_)
+      {
+         // compressed images are allocated as they are inserted; only the
+         // images being read are kept uncompressed, allocated per reading
+         // thread on its first read
+         frameArray_.resize(0);
+         compressedReady_ = true;
+         return true;
+      }
 
       // allocate buffers  - could conceivably throw an out-of-memory exception
       frameArray_.resize(cbSize);
       for (unsigned long i=0; i<frameArray_.size(); i++)
       {
-         frameArray_[i].Resize(w, h, pixDepth);
+         frameArray_[i].Resize(width_, height_, pixDepth);
          frameArray_[i].Preallocate(numChannels_);
       }
    }
@@ -122,18 +164,24 @@ void CircularBuffer::Clear()
    boost::posix_time::ptime t = boost::posix_time::microsec_clock::local_time();
    startTime_ = GetMMTimeNow(t);
    imageNumbers_.clear();
+   compressedFrames_.clear();
+   compressedBytes_ = 0;
+   ForgetDecompressedImages();
 }
 
 unsigned long CircularBuffer::GetSize() const
 {
    MMThreadGuard guard(g_bufferLock);
+   if (codec_)
+      return CompressedCapacity();
    return (unsigned long)frameArray_.size();
 }
 
 unsigned long CircularBuffer::GetFreeSize() const
 {
    MMThreadGuard guard(g_bufferLock);
-   long freeSize = (long)frameArray_.size() - (insertIndex_ - saveIndex_);
+   long capacity = codec_ ? (long)CompressedCapacity() : (long)frameArray_.size();
+   long freeSize = capacity - (insertIndex_ - saveIndex_);
    if (freeSize < 0)
       return 0;
    else
@@ -177,32 +225,72 @@ bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned
 {
     MMThreadGuard guard(g_insertLock);
  
-    mm::ImgBuffer* pImg;
+    mm::ImgBuffer* pImg = 0;
     unsigned long singleChannelSize = (unsigned long)width * height * byteDepth;
+
+    // the image as stored, after any software ROI and binning
+    unsigned storedWidth = width;
+    unsigned storedHeight = height;
+    if (roiBinning_)
+    {
+       if (!roiBinning_->IsSupportedPixelType(byteDepth, nComponents))
+          throw CMMError("Software binning is not supported for the pixel type", MMERR_CircularBufferIncompatibleImage);
+       if (!roiBinning_->GetOutputSize(width, height, storedWidth, storedHeight))
+          throw CMMError("Incompatible image dimensions in the circular buffer", MMERR_CircularBufferIncompatibleImage);
+       reducedPixels_.resize((size_t)storedWidth * storedHeight * byteDepth);
+    }
+    unsigned long storedChannelSize = (unsigned long)storedWidth * storedHeight * byteDepth;
  
     {
        MMThreadGuard guard(g_bufferLock);
  
        // check image dimensions
-       if (width != width_ || height != height_ || byteDepth != pixDepth_)
+       if (width != inputWidth_ || height != inputHeight_ || byteDepth != pixDepth_)
           throw CMMError("Incompatible image dimensions in the circular buffer", MMERR_CircularBufferIncompatibleImage);
  
-       bool overflowed = (insertIndex_ - saveIndex_) >= static_cast<long>(frameArray_.size());
-       if (overflowed) {
-          overflow_ = true;
-          return false;
+       if (codec_)
+       {
+          // the size of the image is only known once it is compressed
+          bool overflowed = compressedFrames_.size() >= maxCBSize ||
+             compressedBytes_ >= (unsigned long long)(memorySizeMB_ * bytesInMB);
+          if (overflowed) {
+             overflow_ = true;
+             return false;
+          }
+       }
+       else
+       {
+          bool overflowed = (insertIndex_ - saveIndex_) >= static_cast<long>(frameArray_.size());
+          if (overflowed) {
+             overflow_ = true;
+             return false;
+          }
+
+          if (!pinCounts_.empty())
+             DetachPinnedImages(frameArray_[insertIndex_ % frameArray_.size()]);
        }
     }
+
+    CompressedFrame compressed;
+    unsigned long long compressedFrameBytes = 0;
+    if (codec_)
+    {
+       compressed.channels.resize(numChannels);
+       compressed.metadata.resize(numChannels);
+    }
  
     for (unsigned i=0; i<numChannels; i++)
     {
        Metadata md;
        {
           MMThreadGuard guard(g_bufferLock);
-          // we assume that all buffers are pre-allocated
-          pImg = frameArray_[insertIndex_ % frameArray_.size()].FindImage(i);
-          if (!pImg)
-             return false;
+          if (!codec_)
+          {
+             // we assume that all buffers are pre-allocated
+             pImg = frameArray_[insertIndex_ % frameArray_.size()].FindImage(i);
+             if (!pImg)
+                return false;
+          }
  
           if (pMd)
           {
@@ -234,8 +322,16 @@ bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned
       tStream.str(std::string());
       tStream.clear();
 
-      md.PutImageTag("Width",width);
-      md.PutImageTag("Height",height);
+      const unsigned char* pixels = pixArray + i*singleChannelSize;
+      if (roiBinning_)
+      {
+         roiBinning_->Apply(pixels, width, height, byteDepth, nComponents, &reducedPixels_[0]);
+         roiBinning_->AddMetadata(width, height, md);
+         pixels = &reducedPixels_[0];
+      }
+
+      md.PutImageTag("Width",storedWidth);
+      md.PutImageTag("Height",storedHeight);
       if (byteDepth == 1)
          md.PutImageTag("PixelType","GRAY8");
       else if (byteDepth == 2)
@@ -252,13 +348,58 @@ bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned
       else
          md.PutImageTag("PixelType","Unknown"); 
 
-      pImg->SetMetadata(md);
-      pImg->SetPixels(pixArray + i*singleChannelSize);
+      // the statistics are computed while the pixels are copied or
+      // compressed, and added to the metadata before it is stored
+      bool statisticsStarted = statistics_ &&
+         statistics_->Start(pixels, storedWidth, storedHeight, byteDepth, nComponents, md);
+      try
+      {
+         if (codec_)
+         {
+            codec_->Compress(pixels, storedChannelSize, byteDepth, compressed.channels[i]);
+            compressedFrameBytes += compressed.channels[i].size();
+         }
+         else
+            pImg->SetPixels(pixels);
+      }
+      catch (...)
+      {
+         if (statisticsStarted)
+            statistics_->Finish(md);
+         throw;
+      }
+      if (statisticsStarted)
+         statistics_->Finish(md);
+
+      if (codec_)
+         compressed.metadata[i] = md;
+      else
+         pImg->SetMetadata(md);
+
+      if (preview_ && i == 0)
+         preview_->Offer(pixels, storedWidth, storedHeight, byteDepth, nComponents, md);
+
+      if (frameExport_)
+         frameExport_->Publish(pixels, storedWidth, storedHeight, byteDepth, nComponents, i, md.Serialize());
    }
 
    {
       MMThreadGuard guard(g_bufferLock);
 
+      if (codec_)
+      {
+         lastCompressedFrameBytes_ = compressedFrameBytes;
+         if (compressedBytes_ + compressedFrameBytes > (unsigned long long)(memorySizeMB_ * bytesInMB))
+         {
+            overflow_ = true;
+            return false;
+         }
+         compressedFrames_.push_back(CompressedFrame());
+         compressedFrames_.back().channels.swap(compressed.channels);
+         compressedFrames_.back().metadata.swap(compressed.metadata);
+         compressedBytes_ += compressedFrameBytes;
+      }
+
       imageCounter_++;
       insertIndex_++;
       if ((insertIndex_ - (long)frameArray_.size()) > adjustThreshold && (saveIndex_- (long)frameArray_.size()) > adjustThreshold)
@@ -266,6 +407,7 @@ bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned
          // adjust buffer indices to avoid overflowing integer size
          insertIndex_ -= adjustThreshold;
          saveIndex_ -= adjustThreshold;
+         ForgetDecompressedImages();
       }
    }
 
@@ -273,6 +415,101 @@ bool CircularBuffer::InsertMultiChannel(const unsigned char* pixArray, unsigned
 }
  
 
+void CircularBuffer::SetFrameExport(boost::shared_ptr<mm::SharedFrameRing> ring)
+{
+   MMThreadGuard guard(g_insertLock);
+   frameExport_ = ring;
+}
+
+boost::shared_ptr<mm::SharedFrameRing> CircularBuffer::GetFrameExport() const
+{
+   MMThreadGuard guard(g_insertLock);
+   return frameExport_;
+}
+
+void CircularBuffer::SetImageStatistics(boost::shared_ptr<mm::ImageStatisticsCalculator> calculator)
+{
+   MMThreadGuard guard(g_insertLock);
+   statistics_ = calculator;
+}
+
+boost::shared_ptr<mm::ImageStatisticsCalculator> CircularBuffer::GetImageStatistics() const
+{
+   MMThreadGuard guard(g_insertLock);
+   return statistics_;
+}
+
+void CircularBuffer::SetPreview(boost::shared_ptr<mm::PreviewGenerator> preview)
+{
+   MMThreadGuard guard(g_insertLock);
+   preview_ = preview;
+}
+
+boost::shared_ptr<mm::PreviewGenerator> CircularBuffer::GetPreview() const
+{
+   MMThreadGuard guard(g_insertLock);
+   return preview_;
+}
+
+void CircularBuffer::SetCompressed(bool compressed)
+{
+   MMThreadGuard insertGuard(g_insertLock);
+   MMThreadGuard guard(g_bufferLock);
+   if (compressed == (codec_.get() != 0))
+      return;
+
+   DetachAllPinnedImages();
+   for (unsigned long i=0; i<frameArray_.size(); i++)
+      frameArray_[i].Clear();
+   frameArray_.resize(0);
+   ReleaseDecompressionCaches();
+   compressedReady_ = false;
+   compressedFrames_.clear();
+   compressedBytes_ = 0;
+   lastCompressedFrameBytes_ = 0;
+
+   // force the next Initialize() to allocate the buffer
+   width_ = 0;
+   height_ = 0;
+   inputWidth_ = 0;
+   inputHeight_ = 0;
+   pixDepth_ = 0;
+   insertIndex_ = 0;
+   saveIndex_ = 0;
+   overflow_ = false;
+
+   codec_.reset(compressed ? new mm::FrameCodec() : 0);
+}
+
+bool CircularBuffer::IsCompressed() const
+{
+   MMThreadGuard guard(g_bufferLock);
+   return codec_.get() != 0;
+}
+
+void CircularBuffer::SetSoftwareROIBinning(boost::shared_ptr<const mm::SoftwareROIBinning> roiBinning)
+{
+   MMThreadGuard insertGuard(g_insertLock);
+   MMThreadGuard guard(g_bufferLock);
+   roiBinning_ = roiBinning;
+
+   // force the next Initialize() to allocate the buffer for the new size
+   inputWidth_ = 0;
+   inputHeight_ = 0;
+   insertIndex_ = 0;
+   saveIndex_ = 0;
+   overflow_ = false;
+   compressedFrames_.clear();
+   compressedBytes_ = 0;
+   ForgetDecompressedImages();
+}
+
+boost::shared_ptr<const mm::SoftwareROIBinning> CircularBuffer::GetSoftwareROIBinning() const
+{
+   MMThreadGuard guard(g_bufferLock);
+   return roiBinning_;
+}
+
 const unsigned char* CircularBuffer::GetTopImage() const
 {
    const mm::ImgBuffer* img = GetNthFromTopImageBuffer(0, 0);
@@ -300,6 +537,12 @@ const mm::ImgBuffer* CircularBuffer::GetNthFromTopImageBuffer(long n,
    if (n + 1 > availableImages)
       return 0;
 
+   if (codec_)
+   {
+      // only the cache of decompressed images changes
+      return const_cast<CircularBuffer*>(this)->DecompressedImage(insertIndex_ - n - 1L, channel);
+   }
+
    long targetIndex = insertIndex_ - n - 1L;
    while (targetIndex < 0)
       targetIndex += (long) frameArray_.size();
@@ -324,7 +567,237 @@ const mm::ImgBuffer* CircularBuffer::GetNextImageBuffer(unsigned channel)
    if (availableImages < 1)
       return 0;
 
+   if (codec_)
+   {
+      const mm::ImgBuffer* img = DecompressedImage(saveIndex_, channel);
+      const CompressedFrame& frame = compressedFrames_.front();
+      for (unsigned i=0; i<frame.channels.size(); i++)
+         compressedBytes_ -= frame.channels[i].size();
+      compressedFrames_.pop_front();
+      ++saveIndex_;
+      return img;
+   }
+
    long targetIndex = saveIndex_ % frameArray_.size();
    ++saveIndex_;
    return frameArray_[targetIndex].FindImage(channel);
 }
+
+const mm::ImgBuffer* CircularBuffer::GetTopImageBufferPinned(unsigned channel)
+{
+   MMThreadGuard guard(g_bufferLock);
+   const mm::ImgBuffer* img = GetNthFromTopImageBuffer(0, channel);
+   if (img)
+      PinImage(img);
+   return img;
+}
+
+const mm::ImgBuffer* CircularBuffer::GetNextImageBufferPinned(unsigned channel)
+{
+   MMThreadGuard guard(g_bufferLock);
+   const mm::ImgBuffer* img = GetNextImageBuffer(channel);
+   if (img)
+      PinImage(img);
+   return img;
+}
+
+/**
+* Returns false if the pixels do not belong to a pinned image.
+*/
+bool CircularBuffer::UnpinImage(const unsigned char* pixels)
+{
+   mm::ImgBuffer* detached = 0;
+   {
+      MMThreadGuard guard(g_bufferLock);
+      std::map<const unsigned char*, long>::iterator it = pinCounts_.find(pixels);
+      if (it == pinCounts_.end())
+         return false;
+      if (--it->second > 0)
+         return true;
+      pinCounts_.erase(it);
+
+      std::map<const unsigned char*, mm::ImgBuffer*>::iterator d = detachedImages_.find(pixels);
+      if (d != detachedImages_.end())
+      {
+         detached = d->second;
+         detachedImages_.erase(d);
+      }
+   }
+   delete detached;
+   return true;
+}
+
+unsigned long CircularBuffer::GetPinnedImageCount() const
+{
+   MMThreadGuard guard(g_bufferLock);
+   return (unsigned long)pinCounts_.size();
+}
+
+void CircularBuffer::TakePinnedImages(CircularBuffer& other)
+{
+   MMThreadGuard otherGuard(other.g_bufferLock);
+   other.DetachAllPinnedImages();
+
+   MMThreadGuard guard(g_bufferLock);
+   pinCounts_.insert(other.pinCounts_.begin(), other.pinCounts_.end());
+   detachedImages_.insert(other.detachedImages_.begin(), other.detachedImages_.end());
+   other.pinCounts_.clear();
+   other.detachedImages_.clear();
+}
+
+void CircularBuffer::PinImage(const mm::ImgBuffer* img)
+{
+   ++pinCounts_[img->GetPixels()];
+}
+
+void CircularBuffer::DetachPinnedImages(mm::FrameBuffer& frame)
+{
+   if (pinCounts_.empty())
+      return;
+
+   bool detached = false;
+   for (unsigned i=0; i<numChannels_; i++)
+   {
+      mm::ImgBuffer* img = frame.FindImage(i);
+      if (img && pinCounts_.find(img->GetPixels()) != pinCounts_.end())
+      {
+         detachedImages_[img->GetPixels()] = frame.ReleaseImage(i);
+         detached = true;
+      }
+   }
+   if (detached)
+      frame.Preallocate(numChannels_);
+}
+
+void CircularBuffer::DetachAllPinnedImages()
+{
+   for (unsigned long i=0; i<frameArray_.size(); i++)
+      DetachPinnedImages(frameArray_[i]);
+   for (std::map<boost::thread::id, DecompressionCache>::iterator it = decompressionCaches_.begin();
+         it != decompressionCaches_.end(); ++it)
+   {
+      for (unsigned long i=0; i<it->second.frames.size(); i++)
+         DetachPinnedImages(it->second.frames[i]);
+   }
+}
+
+/**
+* Number of images that fit in the memory footprint in compressed mode, if
+* the images that are yet to come compress as well as the ones in the buffer
+* (or the last one, or not at all if there was none).
+*/
+unsigned long CircularBuffer::CompressedCapacity() const
+{
+   unsigned long long budget = (unsigned long long)(memorySizeMB_ * bytesInMB);
+   unsigned long long images = (unsigned long long)(insertIndex_ - saveIndex_);
+   unsigned long long frameBytes = (unsigned long long)width_ * height_ * pixDepth_ * numChannels_;
+   if (images > 0)
+      frameBytes = compressedBytes_ / images;
+   else if (lastCompressedFrameBytes_ > 0)
+      frameBytes = lastCompressedFrameBytes_;
+   if (frameBytes == 0)
+      return 0;
+
+   unsigned long long capacity = images;
+   if (budget > compressedBytes_)
+      capacity += (budget - compressedBytes_) / frameBytes;
+   return (unsigned long)std::min<unsigned long long>(capacity, maxCBSize);
+}
+
+/**
+* Returns the given channel of the image at the index, which must be between
+* saveIndex_ and insertIndex_, decompressing the image unless it was among
+* the last ones read by the calling thread.
+*/
+const mm::ImgBuffer* CircularBuffer::DecompressedImage(long index, unsigned channel)
+{
+   if (!compressedReady_)
+      return 0;
+
+   boost::thread::id thread = boost::this_thread::get_id();
+   if (decompressionCaches_.size() >= maxDecompressionCaches &&
+         decompressionCaches_.find(thread) == decompressionCaches_.end())
+   {
+      // the threads that read are usually few and long-lived; drop the cache
+      // of the one that has not read for the longest (it may have ended)
+      std::map<boost::thread::id, DecompressionCache>::iterator oldest = decompressionCaches_.begin();
+      for (std::map<boost::thread::id, DecompressionCache>::iterator it = decompressionCaches_.begin();
+            it != decompressionCaches_.end(); ++it)
+      {
+         if (it->second.lastUse < oldest->second.lastUse)
+            oldest = it;
+      }
+      ReleaseDecompressionCache(oldest);
+   }
+
+   DecompressionCache& cache = decompressionCaches_[thread];
+   cache.lastUse = ++decompressionUseCount_;
+   if (cache.frames.empty())
+   {
+      cache.frames.resize(decompressedFrameCount);
+      for (unsigned long i=0; i<cache.frames.size(); i++)
+      {
+         cache.frames[i].Resize(width_, height_, pixDepth_);
+         cache.frames[i].Preallocate(numChannels_);
+      }
+      cache.indices.assign(decompressedFrameCount, -1);
+      cache.next = 0;
+   }
+
+   for (unsigned long i=0; i<cache.indices.size(); i++)
+   {
+      if (cache.indices[i] == index)
+         return cache.frames[i].FindImage(channel);
+   }
+
+   const CompressedFrame& frame = compressedFrames_[index - saveIndex_];
+   mm::FrameBuffer& decompressed = cache.frames[cache.next];
+   cache.indices[cache.next] = -1;
+   if (!pinCounts_.empty())
+      DetachPinnedImages(decompressed);
+
+   size_t singleChannelSize = (size_t)width_ * height_ * pixDepth_;
+   for (unsigned i=0; i<frame.channels.size(); i++)
+   {
+      mm::ImgBuffer* img = decompressed.FindImage(i);
+      if (!img || !codec_->Decompress(frame.channels[i], img->GetPixelsRW(), singleChannelSize))
+         return 0;
+      img->SetMetadata(frame.metadata[i]);
+   }
+
+   cache.indices[cache.next] = index;
+   cache.next = (cache.next + 1) % cache.frames.size();
+   return decompressed.FindImage(channel);
+}
+
+void CircularBuffer::ForgetDecompressedImages()
+{
+   for (std::map<boost::thread::id, DecompressionCache>::iterator it = decompressionCaches_.begin();
+         it != decompressionCaches_.end(); ++it)
+      std::fill(it->second.indices.begin(), it->second.indices.end(), -1L);
+}
+
+/**
+* Deletes the decompressed images of one reading thread; pinned ones are
+* handed over to the buffer.
+*/
+void CircularBuffer::ReleaseDecompressionCache(std::map<boost::thread::id, DecompressionCache>::iterator it)
+{
+   // the frames are not copyable; clear them in place before erasing
+   for (unsigned long i=0; i<it->second.frames.size(); i++)
+   {
+      DetachPinnedImages(it->second.frames[i]);
+      it->second.frames[i].Clear();
+   }
+   decompressionCaches_.erase(it);
+}
+
+/**
+* Deletes the decompressed images of all reading threads; pinned ones are
+* handed over to the buffer.
+*/
+void CircularBuffer::ReleaseDecompressionCaches()
+{
+   while (!decompressionCaches_.empty())
+      ReleaseDecompressionCache(decompressionCaches_.begin());
+}
@@ -27,12 +27,22 @@
 #include "Error.h"
 #include "ErrorCodes.h"
 #include "FrameBuffer.h"
+#include "FrameCodec.h"
+#include "ImageStatisticsCalculator.h"
+#include "PreviewGenerator.h"
+#include "SharedFrameRing.h"
+#include "SoftwareROIBinning.h"
 
 #include "../MMDevice/DeviceThreads.h"
 #include "../MMDevice/MMDevice.h"
 
+#include <deque>
+#include <map>
 #include <vector>
 #include "boost/date_time/posix_time/posix_time.hpp"
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
 
 #ifdef _MSC_VER
 #pragma warning( disable : 4290 ) // exception declaration warning
@@ -68,6 +78,58 @@ public:
    const mm::ImgBuffer* GetNextImageBuffer(unsigned channel);
    void Clear(); 
 
+   // Pinned images keep their pixels (and metadata) until they are unpinned,
+   // even if their slot is reused or the buffer is reallocated: the slot
+   // then gets a new image and the pinned one is kept aside. Lets the
+   // language wrappers hand out images without copying them.
+   const mm::ImgBuffer* GetTopImageBufferPinned(unsigned channel);
+   const mm::ImgBuffer* GetNextImageBufferPinned(unsigned channel);
+   bool UnpinImage(const unsigned char* pixels);
+   unsigned long GetPinnedImageCount() const;
+   // Takes over the pinned images of another buffer that is about to be
+   // deleted
+   void TakePinnedImages(CircularBuffer& other);
+
+   // Inserted images are also published to the ring, if set
+   void SetFrameExport(boost::shared_ptr<mm::SharedFrameRing> ring);
+   boost::shared_ptr<mm::SharedFrameRing> GetFrameExport() const;
+
+   // Statistics of inserted images are computed and added to their
+   // metadata, if set
+   void SetImageStatistics(boost::shared_ptr<mm::ImageStatisticsCalculator> calculator);
+   boost::shared_ptr<mm::ImageStatisticsCalculator> GetImageStatistics() const;
+
+   // Inserted images (the first channel of multi-channel images) are
+   // offered to the preview generator, if set
+   void SetPreview(boost::shared_ptr<mm::PreviewGenerator> preview);
+   boost::shared_ptr<mm::PreviewGenerator> GetPreview() const;
+
+   // In compressed mode, images are compressed losslessly when inserted and
+   // decompressed when read, so that the memory footprint holds more of
+   // them. The capacity then depends on the actual compressed size of the
+   // images and is estimated from the images in the buffer. Changing the
+   // mode discards all images; the buffer must be initialized again.
+   // Each reading thread gets its own decompressed copies of the images it
+   // reads, which stay valid until that thread has read a few more images
+   // (or the buffer is initialized again); reads from other threads do not
+   // affect them, unless more than a few threads read from the buffer, in
+   // which case the thread that has not read for the longest loses its
+   // copies.
+   // Compression happens with g_insertLock held, which serializes inserts
+   // from several cameras but never blocks readers; decompression happens
+   // with g_bufferLock held, which delays an insert by at most the time it
+   // takes to decompress one image. Images are returned as pointers that
+   // are used after the lock is released, so decompressing outside the
+   // lock would need the caches to be reference counted.
+   void SetCompressed(bool compressed);
+   bool IsCompressed() const;
+
+   // Inserted images are cropped and binned before they are stored, if set;
+   // Width() and Height() are then those of the stored images. Setting it
+   // discards all images; the buffer must be initialized again.
+   void SetSoftwareROIBinning(boost::shared_ptr<const mm::SoftwareROIBinning> roiBinning);
+   boost::shared_ptr<const mm::SoftwareROIBinning> GetSoftwareROIBinning() const;
+
    bool Overflow() {MMThreadGuard guard(g_bufferLock); return overflow_;}
 
    mutable MMThreadLock g_bufferLock;
@@ -77,6 +139,9 @@ private:
    unsigned int width_;
    unsigned int height_;
    unsigned int pixDepth_;
+   // Size of the images to be inserted (before any software ROI and binning)
+   unsigned int inputWidth_;
+   unsigned int inputHeight_;
    long imageCounter_;
    MM::MMTime startTime_;
    std::map<std::string, long> imageNumbers_;
@@ -92,6 +157,56 @@ private:
    bool overflow_;
    std::vector<mm::FrameBuffer> frameArray_;
 
+   // Compressed mode: the images from saveIndex_ to insertIndex_, in place
+   // of frameArray_
+   struct CompressedFrame
+   {
+      std::vector< std::vector<unsigned char> > channels;
+      std::vector<Metadata> metadata;
+   };
+   boost::scoped_ptr<mm::FrameCodec> codec_;
+   std::deque<CompressedFrame> compressedFrames_;
+   unsigned long long compressedBytes_;
+   unsigned long long lastCompressedFrameBytes_;
+   // The last few images that were decompressed for a reading thread, with
+   // the index of each (-1 if none); they stay valid until the thread has
+   // read as many more
+   struct DecompressionCache
+   {
+      std::vector<mm::FrameBuffer> frames;
+      std::vector<long> indices;
+      unsigned long next;
+      unsigned long long lastUse;
+      DecompressionCache() : next(0), lastUse(0) {}
+   };
+   bool compressedReady_;
+   std::map<boost::thread::id, DecompressionCache> decompressionCaches_;
+   unsigned long long decompressionUseCount_;
+
    boost::posix_time::time_facet * facet;
    std::ostringstream tStream;
+
+   // Requires g_insertLock to be held
+   boost::shared_ptr<mm::SharedFrameRing> frameExport_;
+   boost::shared_ptr<mm::ImageStatisticsCalculator> statistics_;
+   boost::shared_ptr<mm::PreviewGenerator> preview_;
+   std::vector<unsigned char> reducedPixels_;
+
+   // Set with both locks held, so either lock suffices to read it
+   boost::shared_ptr<const mm::SoftwareROIBinning> roiBinning_;
+
+   // Pin count by pixel address
+   std::map<const unsigned char*, long> pinCounts_;
+   // Pinned images that are no longer in a slot, owned by the buffer
+   std::map<const unsigned char*, mm::ImgBuffer*> detachedImages_;
+
+   // The following require g_bufferLock to be held
+   void PinImage(const mm::ImgBuffer* img);
+   void DetachPinnedImages(mm::FrameBuffer& frame);
+   void DetachAllPinnedImages();
+   unsigned long CompressedCapacity() const;
+   const mm::ImgBuffer* DecompressedImage(long index, unsigned channel);
+   void ForgetDecompressedImages();
+   void ReleaseDecompressionCache(std::map<boost::thread::id, DecompressionCache>::iterator it);
+   void ReleaseDecompressionCaches();
 };
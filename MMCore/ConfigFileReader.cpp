@@ -0,0 +1,133 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ConfigFileReader.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Single-pass reader for configuration files
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "ConfigFileReader.h"
+
+#include <cstring>
+#include <fstream>
+
+namespace mm
+{
+
+ConfigFileReader::ConfigFileReader() :
+   contents_(1, '\0'),
+   pos_(0),
+   lineStart_(0),
+   lineEnd_(0),
+   lineNumber_(0)
+{
+}
+
+
+bool
+ConfigFileReader::Open(const char* filename)
+{
+   std::ifstream in(filename, std::ios_base::in | std::ios_base::binary);
+   if (!in.is_open())
+      return false;
+
+   in.seekg(0, std::ios_base::end);
+   std::streamoff size = in.tellg();
+   in.seekg(0, std::ios_base::beg);
+   if (size < 0)
+      return false;
+
+   std::vector<char> contents(static_cast<size_t>(size) + 1, '\0');
+   if (size > 0 && !in.read(&contents[0], size))
+      return false;
+
+   contents_.swap(contents);
+   pos_ = lineStart_ = lineEnd_ = 0;
+   lineNumber_ = 0;
+   return true;
+}
+
+
+void
+ConfigFileReader::SetContents(const std::string& contents)
+{
+   contents_.assign(contents.begin(), contents.end());
+   contents_.push_back('\0');
+   pos_ = lineStart_ = lineEnd_ = 0;
+   lineNumber_ = 0;
+}
+
+
+bool
+ConfigFileReader::NextLine(std::vector<const char*>& fields,
+      const char* delimiters)
+{
+   delimiters_ = delimiters;
+   const size_t size = contents_.size() - 1;
+   while (pos_ < size)
+   {
+      const size_t start = pos_;
+      const char* newline = static_cast<const char*>(
+            std::memchr(&contents_[start], '\n', size - start));
+      const size_t lineEnd = newline ? newline - &contents_[0] : size;
+      pos_ = lineEnd + 1;
+      ++lineNumber_;
+
+      size_t end = start;
+      while (end < lineEnd && contents_[end] != '\r')
+         ++end;
+      if (end == start || contents_[start] == '#')
+         continue;
+
+      lineStart_ = start;
+      lineEnd_ = end;
+      contents_[end] = '\0';
+
+      fields.clear();
+      size_t i = start;
+      while (i < end)
+      {
+         if (std::strchr(delimiters, contents_[i]))
+         {
+            contents_[i++] = '\0';
+            continue;
+         }
+         fields.push_back(&contents_[i]);
+         while (i < end && !std::strchr(delimiters, contents_[i]))
+            ++i;
+      }
+      return true;
+   }
+   return false;
+}
+
+
+std::string
+ConfigFileReader::GetLine() const
+{
+   // The delimiters were replaced with null characters; put them back
+   std::string line(contents_.begin() + lineStart_,
+         contents_.begin() + lineEnd_);
+   const char delimiter = delimiters_.empty() ? ',' : delimiters_[0];
+   for (std::string::iterator it = line.begin(), end = line.end();
+         it != end; ++it)
+   {
+      if (*it == '\0')
+         *it = delimiter;
+   }
+   return line;
+}
+
+} // namespace mm
@@ -0,0 +1,65 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ConfigFileReader.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Single-pass reader for configuration files
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace mm
+{
+
+/**
+ * Splits the lines of a configuration file into fields in a single pass.
+ *
+ * The whole file is read into memory at once, and the fields are terminated
+ * in place, so that they can be used without copying them. Empty lines and
+ * comments (lines starting with #) are skipped; a line ends at its first CR
+ * or LF.
+ */
+class ConfigFileReader
+{
+public:
+   ConfigFileReader();
+
+   // Reads the file; returns false if it cannot be read
+   bool Open(const char* filename);
+   void SetContents(const std::string& contents);
+
+   // Advances to the next line and splits it at the delimiter characters,
+   // skipping empty fields. The fields stay valid until the contents are
+   // replaced. Returns false at the end of the file.
+   bool NextLine(std::vector<const char*>& fields, const char* delimiters);
+
+   // Number (from 1) and text of the current line
+   unsigned GetLineNumber() const { return lineNumber_; }
+   std::string GetLine() const;
+
+private:
+   // Followed by a null character
+   std::vector<char> contents_;
+   size_t pos_;
+   size_t lineStart_;
+   size_t lineEnd_;
+   unsigned lineNumber_;
+   std::string delimiters_;
+};
+
+} // namespace mm
@@ -138,11 +138,21 @@ public:
       return configs_.size() == 0;
    }
 
+   /**
+    * Whether applying a preset sets all of its properties, including those
+    * that the state cache shows to be at the preset value already.
+    */
+   bool GetAlwaysApply() const {return alwaysApply_;}
+   void SetAlwaysApply(bool alwaysApply) {alwaysApply_ = alwaysApply;}
+
 protected:
-   ConfigGroupBase() {}
+   ConfigGroupBase() : alwaysApply_(false) {}
    virtual ~ConfigGroupBase() {}
 
    std::map<std::string, T> configs_;
+
+private:
+   bool alwaysApply_;
 };
 
 
@@ -334,6 +344,18 @@ public:
       }
    }
 
+   /**
+    * Finds a group by name. Returns 0 if the group does not exist.
+    */
+   ConfigGroup* FindGroup(const char* groupName)
+   {
+      std::map<std::string, ConfigGroup>::iterator it = groups_.find(groupName);
+      if (it == groups_.end())
+         return 0;
+      else
+         return &(it->second);
+   }
+
    /**
     * Returns a list of groups names.
     */
@@ -222,6 +222,8 @@ CoreCallback::AddCameraMetadata(const MM::Device* caller, const Metadata* pMd)
 
    std::string label = camera->GetLabel();
    newMD.put("Camera", label);
+   if (!newMD.HasTag(MM::g_Keyword_Metadata_BitDepth))
+      newMD.PutImageTag(MM::g_Keyword_Metadata_BitDepth, camera->GetBitDepth());
 
    std::string serializedMD;
    try
@@ -240,6 +242,61 @@ CoreCallback::AddCameraMetadata(const MM::Device* caller, const Metadata* pMd)
    return newMD;
 }
 
+/**
+ * Runs the current image processor, if any, on each channel of an image
+ * inserted by caller. Each channel is processed as part of its own stream,
+ * identified by the camera label and the channel index (the channel within
+ * a multi-channel image, or else the CameraChannelIndex tag of md).
+ * Returns DEVICE_IMAGE_HELD_BY_PROCESSOR if any channel was held back.
+ * nComponents of 0 stands for that of the camera.
+ */
+int
+CoreCallback::ProcessImage(const MM::Device* caller, unsigned char* buf,
+      unsigned numChannels, unsigned width, unsigned height,
+      unsigned byteDepth, unsigned nComponents, const Metadata& md)
+{
+   MM::ImageProcessor* ip = GetImageProcessor(caller);
+   if (!ip)
+      return DEVICE_OK;
+
+   boost::shared_ptr<CameraInstance> camera =
+      boost::static_pointer_cast<CameraInstance>(
+            core_->deviceManager_->GetDevice(caller));
+   std::string label = camera->GetLabel();
+   if (nComponents == 0)
+      nComponents = camera->GetNumberOfComponents();
+
+   unsigned firstChannel = 0;
+   if (numChannels == 1)
+   {
+      // The tag is qualified by the label of the device that added it
+      const std::string key = MM::g_Keyword_CameraChannelIndex;
+      std::vector<std::string> keys = md.GetKeys();
+      for (std::vector<std::string>::const_iterator it = keys.begin(),
+            end = keys.end(); it != end; ++it)
+      {
+         if (*it == key || (it->size() > key.size() &&
+                  it->compare(it->size() - key.size() - 1, std::string::npos,
+                     "-" + key) == 0))
+         {
+            firstChannel = (unsigned)atoi(md.GetSingleTag(it->c_str()).GetValue().c_str());
+            break;
+         }
+      }
+   }
+
+   size_t channelSize = (size_t)width * height * byteDepth;
+   int ret = DEVICE_OK;
+   for (unsigned i = 0; i < numChannels; ++i)
+   {
+      if (ip->ProcessStreamImage(buf + i * channelSize, width, height,
+               byteDepth, nComponents, label.c_str(), firstChannel + i) ==
+            DEVICE_IMAGE_HELD_BY_PROCESSOR)
+         ret = DEVICE_IMAGE_HELD_BY_PROCESSOR;
+   }
+   return ret;
+}
+
 int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height, unsigned byteDepth, const char* serializedMetadata, const bool doProcess)
 {
    Metadata md;
@@ -255,11 +312,8 @@ int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf
 
       if(doProcess)
       {
-         MM::ImageProcessor* ip = GetImageProcessor(caller);
-         if( NULL != ip)
-         {
-            ip->Process(const_cast<unsigned char*>(buf), width, height, byteDepth);
-         }
+         if (ProcessImage(caller, const_cast<unsigned char*>(buf), 1, width, height, byteDepth, 0, md) == DEVICE_IMAGE_HELD_BY_PROCESSOR)
+            return DEVICE_OK;
       }
       if (core_->cbuf_->InsertImage(buf, width, height, byteDepth, &md))
          return DEVICE_OK;
@@ -287,11 +341,8 @@ int CoreCallback::InsertImage(const MM::Device* caller, const unsigned char* buf
 
       if(doProcess)
       {
-         MM::ImageProcessor* ip = GetImageProcessor(caller);
-         if( NULL != ip)
-         {
-            ip->Process(const_cast<unsigned char*>(buf), width, height, byteDepth);
-         }
+         if (ProcessImage(caller, const_cast<unsigned char*>(buf), 1, width, height, byteDepth, nComponents, md) == DEVICE_IMAGE_HELD_BY_PROCESSOR)
+            return DEVICE_OK;
       }
       if (core_->cbuf_->InsertImage(buf, width, height, byteDepth, nComponents, &md))
          return DEVICE_OK;
@@ -308,14 +359,19 @@ int CoreCallback::InsertImage(const MM::Device* caller, const ImgBuffer & imgBuf
 {
    Metadata md = imgBuf.GetMetadata();
    unsigned char* p = const_cast<unsigned char*>(imgBuf.GetPixels());
-   MM::ImageProcessor* ip = GetImageProcessor(caller);
-   if( NULL != ip)
+   try
    {
-      ip->Process(p, imgBuf.Width(), imgBuf.Height(), imgBuf.Depth());
+      if (ProcessImage(caller, p, 1, imgBuf.Width(), imgBuf.Height(), imgBuf.Depth(), 0, AddCameraMetadata(caller, &md)) == DEVICE_IMAGE_HELD_BY_PROCESSOR)
+         return DEVICE_OK;
+   }
+   catch (CMMError& /*e*/)
+   {
+      return DEVICE_INCOMPATIBLE_IMAGE;
    }
 
+   // Already processed
    return InsertImage(caller, imgBuf.GetPixels(), imgBuf.Width(), 
-      imgBuf.Height(), imgBuf.Depth(), &md);
+      imgBuf.Height(), imgBuf.Depth(), &md, false);
 }
 
 void CoreCallback::ClearImageBuffer(const MM::Device* /*caller*/)
@@ -345,11 +401,8 @@ int CoreCallback::InsertMultiChannel(const MM::Device* caller,
    {
       Metadata md = AddCameraMetadata(caller, pMd);
 
-      MM::ImageProcessor* ip = GetImageProcessor(caller);
-      if( NULL != ip)
-      {
-         ip->Process( const_cast<unsigned char*>(buf), width, height, byteDepth);
-      }
+      if (ProcessImage(caller, const_cast<unsigned char*>(buf), numChannels, width, height, byteDepth, 0, md) == DEVICE_IMAGE_HELD_BY_PROCESSOR)
+         return DEVICE_OK;
       if (core_->cbuf_->InsertMultiChannel(buf, numChannels, width, height, byteDepth, &md))
          return DEVICE_OK;
       else
@@ -385,23 +438,24 @@ int CoreCallback::AcqFinished(const MM::Device* caller, int /*statusCode*/)
          core_->currentShutterDevice_.lock();
       if (shutter)
       {
-         // We need to lock the shutter's module for thread safety, but there's
-         // a case where deadlock would result.
-         if (camera->GetAdapterModule() == shutter->GetAdapterModule())
+         // We need to lock the shutter's module (or the shutter, if its
+         // module has per-device locking) for thread safety, but there's a
+         // case where deadlock would result.
+         if (camera->GetLock() == shutter->GetLock())
          {
             // This is a nasty hack to allow the case where the shutter and
-            // camera live in the same module. It is not safe, but this is how
-            // _all_ cases used to be implemented, and I can't immediately
-            // think of a fully safe fix that is reasonably simple.
+            // camera share a lock (live in the same module). It is not safe,
+            // but this is how _all_ cases used to be implemented, and I can't
+            // immediately think of a fully safe fix that is reasonably simple.
             shutter->SetOpen(false);
          }
-         else if (currentCamera && currentCamera->GetAdapterModule() ==
-               shutter->GetAdapterModule())
+         else if (currentCamera && currentCamera->GetLock() ==
+               shutter->GetLock())
          {
             // Likewise, we might be called as a result of a call to
             // StopSequenceAcquisition() on a virtual wrapper camera device
             // (such as Multi Camera), in which case we would get a deadlock if
-            // the shutter is in the same module as the virtual camera.
+            // the shutter shares the lock of the virtual camera.
             // This is an even nastier hack in that it ignores the possibility
             // of StopSequenceAcquisition() being called on a camera other than
             // currentCamera, but such cases are rare.
@@ -409,8 +463,8 @@ int CoreCallback::AcqFinished(const MM::Device* caller, int /*statusCode*/)
          }
          else
          {
-            // If the shutter is in a different device adapter, it is safe to
-            // lock that adapter.
+            // If the shutter has a different lock (is in a different device
+            // adapter), it is safe to take that lock.
             mm::DeviceModuleLockGuard g(shutter);
             shutter->SetOpen(false);
 
@@ -935,7 +989,8 @@ int CoreCallback::SetConfig(const char* group, const char* name)
 {
    try 
    {
-      core_->setConfig(group, name);
+      // The device's lock may be held by this thread
+      core_->applyConfigPreset(group, name, false, false);
       core_->waitForConfig(group, name);
    }
    catch (...)
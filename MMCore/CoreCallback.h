@@ -143,6 +143,9 @@ private:
    MMThreadLock* pValueChangeLock_;
 
    Metadata AddCameraMetadata(const MM::Device* caller, const Metadata* pMd);
+   int ProcessImage(const MM::Device* caller, unsigned char* buf, unsigned numChannels,
+         unsigned width, unsigned height, unsigned byteDepth, unsigned nComponents,
+         const Metadata& md);
 
    int OnConfigGroupChanged(const char* groupName, const char* newConfigName);
    int OnPixelSizeChanged(double newPixelSizeUm);
@@ -0,0 +1,235 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DeviceAdapterMetadataCache.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Cache of the devices offered by device adapter files
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "DeviceAdapterMetadataCache.h"
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace mm
+{
+
+namespace
+{
+
+const char* const FileHeader = "MMDeviceAdapterMetadataCache 1";
+
+// Fields are separated by tabs; tabs, line breaks and backslashes in
+// values are escaped
+std::string Escape(const std::string& value)
+{
+   std::string escaped;
+   escaped.reserve(value.size());
+   for (std::string::const_iterator it = value.begin(), end = value.end();
+         it != end; ++it)
+   {
+      switch (*it)
+      {
+         case '\\': escaped += "\\\\"; break;
+         case '\t': escaped += "\\t"; break;
+         case '\n': escaped += "\\n"; break;
+         case '\r': escaped += "\\r"; break;
+         default: escaped += *it; break;
+      }
+   }
+   return escaped;
+}
+
+std::string Unescape(const std::string& escaped)
+{
+   std::string value;
+   value.reserve(escaped.size());
+   for (size_t i = 0; i < escaped.size(); ++i)
+   {
+      if (escaped[i] != '\\' || i + 1 == escaped.size())
+      {
+         value += escaped[i];
+         continue;
+      }
+      switch (escaped[++i])
+      {
+         case 't': value += '\t'; break;
+         case 'n': value += '\n'; break;
+         case 'r': value += '\r'; break;
+         default: value += escaped[i]; break;
+      }
+   }
+   return value;
+}
+
+void SplitFields(const std::string& line, std::vector<std::string>& fields)
+{
+   fields.clear();
+   size_t start = 0;
+   while (true)
+   {
+      size_t tab = line.find('\t', start);
+      fields.push_back(Unescape(line.substr(start, tab - start)));
+      if (tab == std::string::npos)
+         break;
+      start = tab + 1;
+   }
+}
+
+long long ParseLongLong(const std::string& s)
+{
+   std::istringstream in(s);
+   long long value = 0;
+   in >> value;
+   return value;
+}
+
+} // anonymous namespace
+
+
+bool
+DeviceAdapterMetadataCache::GetFileStamp(const std::string& path,
+      long long& modificationTime, long long& size)
+{
+#ifdef _WIN32
+   struct _stat64 info;
+   if (_stat64(path.c_str(), &info) != 0)
+      return false;
+#else
+   struct stat info;
+   if (stat(path.c_str(), &info) != 0)
+      return false;
+#endif
+   modificationTime = static_cast<long long>(info.st_mtime);
+   size = static_cast<long long>(info.st_size);
+   return true;
+}
+
+
+bool
+DeviceAdapterMetadataCache::Get(const std::string& path,
+      std::vector<AvailableDeviceInfo>& devices) const
+{
+   std::map<std::string, Entry>::const_iterator it = entries_.find(path);
+   if (it == entries_.end())
+      return false;
+
+   long long modificationTime, size;
+   if (!GetFileStamp(path, modificationTime, size) ||
+         modificationTime != it->second.modificationTime ||
+         size != it->second.size)
+      return false;
+
+   devices = it->second.devices;
+   return true;
+}
+
+
+bool
+DeviceAdapterMetadataCache::Put(const std::string& path,
+      const std::vector<AvailableDeviceInfo>& devices)
+{
+   Entry entry;
+   if (!GetFileStamp(path, entry.modificationTime, entry.size))
+      return false;
+
+   std::map<std::string, Entry>::iterator it = entries_.find(path);
+   if (it != entries_.end() &&
+         it->second.modificationTime == entry.modificationTime &&
+         it->second.size == entry.size)
+      return false;
+
+   entry.devices = devices;
+   entries_[path] = entry;
+   return true;
+}
+
+
+bool
+DeviceAdapterMetadataCache::Load(const std::string& filename)
+{
+   entries_.clear();
+
+   std::ifstream in(filename.c_str());
+   std::string line;
+   if (!std::getline(in, line) || line != FileHeader)
+      return false;
+
+   // A = adapter file: path, modification time, size
+   // D = device of the preceding adapter file: name, type, description
+   std::map<std::string, Entry> entries;
+   Entry* current = 0;
+   std::vector<std::string> fields;
+   while (std::getline(in, line))
+   {
+      if (line.empty())
+         continue;
+      SplitFields(line, fields);
+      if (fields[0] == "A" && fields.size() == 4)
+      {
+         current = &entries[fields[1]];
+         current->modificationTime = ParseLongLong(fields[2]);
+         current->size = ParseLongLong(fields[3]);
+         current->devices.clear();
+      }
+      else if (fields[0] == "D" && fields.size() == 4 && current)
+      {
+         AvailableDeviceInfo device;
+         device.name = fields[1];
+         device.type = static_cast<MM::DeviceType>(std::atoi(fields[2].c_str()));
+         device.description = fields[3];
+         current->devices.push_back(device);
+      }
+      else
+      {
+         return false;
+      }
+   }
+
+   entries_.swap(entries);
+   return true;
+}
+
+
+bool
+DeviceAdapterMetadataCache::Save(const std::string& filename) const
+{
+   std::ofstream out(filename.c_str(), std::ios_base::out | std::ios_base::trunc);
+   if (!out)
+      return false;
+
+   out << FileHeader << '\n';
+   for (std::map<std::string, Entry>::const_iterator it = entries_.begin(),
+         end = entries_.end(); it != end; ++it)
+   {
+      out << "A\t" << Escape(it->first) << '\t' <<
+         it->second.modificationTime << '\t' << it->second.size << '\n';
+      const std::vector<AvailableDeviceInfo>& devices = it->second.devices;
+      for (std::vector<AvailableDeviceInfo>::const_iterator dev = devices.begin(),
+            devEnd = devices.end(); dev != devEnd; ++dev)
+      {
+         out << "D\t" << Escape(dev->name) << '\t' <<
+            static_cast<int>(dev->type) << '\t' << Escape(dev->description) << '\n';
+      }
+   }
+   out.close();
+   return !out.fail();
+}
+
+} // namespace mm
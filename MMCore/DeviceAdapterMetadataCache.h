@@ -0,0 +1,82 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DeviceAdapterMetadataCache.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Cache of the devices offered by device adapter files
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "../MMDevice/MMDeviceConstants.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace mm
+{
+
+// A device offered by a device adapter
+struct AvailableDeviceInfo
+{
+   std::string name;
+   MM::DeviceType type;
+   std::string description;
+};
+
+/**
+ * Remembers the devices offered by device adapter files, so that they can be
+ * listed without loading the adapters. Entries are keyed by the path of the
+ * file and are only used while its modification time and size are those it
+ * had when the entry was made.
+ *
+ * The cache can be saved to a text file and loaded again in a later session.
+ * A file that cannot be read, or is not in the expected format, counts as an
+ * empty cache.
+ */
+class DeviceAdapterMetadataCache
+{
+public:
+   // Returns false if there is no entry for the file or the file changed
+   // since it was made
+   bool Get(const std::string& path,
+         std::vector<AvailableDeviceInfo>& devices) const;
+   // Returns true if the entry is new or changed; does nothing if the file
+   // does not exist
+   bool Put(const std::string& path,
+         const std::vector<AvailableDeviceInfo>& devices);
+   void Clear() { entries_.clear(); }
+
+   // Replaces the entries with those in the file. Returns false (and leaves
+   // the cache empty) if the file cannot be read or is not a cache file.
+   bool Load(const std::string& filename);
+   // Returns false if the file cannot be written
+   bool Save(const std::string& filename) const;
+
+private:
+   struct Entry
+   {
+      long long modificationTime;
+      long long size;
+      std::vector<AvailableDeviceInfo> devices;
+   };
+   std::map<std::string, Entry> entries_;
+
+   static bool GetFileStamp(const std::string& path,
+         long long& modificationTime, long long& size);
+};
+
+} // namespace mm
@@ -293,7 +293,7 @@ DeviceManager::GetParentDevice(boost::shared_ptr<DeviceInstance> device) const
 
 
 DeviceModuleLockGuard::DeviceModuleLockGuard(boost::shared_ptr<DeviceInstance> device) :
-   g_(device->GetAdapterModule()->GetLock())
+   g_(device->GetLock())
 {}
 
 
@@ -134,7 +134,8 @@ public:
 };
 
 
-// Scoped acquisition of a device's module's lock
+// Scoped acquisition of a device's module's lock (or of the device's own
+// lock, if its module declares per-device thread safety)
 class DeviceModuleLockGuard
 {
    MMThreadGuard g_;
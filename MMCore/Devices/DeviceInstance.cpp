@@ -74,6 +74,20 @@ DeviceInstance::~DeviceInstance()
    deleteFunction_(pImpl_);
 }
 
+MMThreadLock*
+DeviceInstance::GetLock()
+{
+   switch (adapter_->GetThreadSafety())
+   {
+      case MM::ThreadSafetyDevice:
+         return &deviceLock_;
+      case MM::ThreadSafetyReentrant:
+         return 0;
+      default:
+         return adapter_->GetLock();
+   }
+}
+
 CMMError
 DeviceInstance::MakeException() const
 {
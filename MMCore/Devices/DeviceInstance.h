@@ -19,6 +19,7 @@
 
 #pragma once
 
+#include "../../MMDevice/DeviceThreads.h"
 #include "../../MMDevice/MMDeviceConstants.h"
 #include "../Error.h"
 #include "../Logging/Logger.h"
@@ -71,9 +72,14 @@ private:
    DeleteDeviceFunction deleteFunction_;
    mm::logging::Logger deviceLogger_;
    mm::logging::Logger coreLogger_;
+   MMThreadLock deviceLock_;
 
 public:
    boost::shared_ptr<LoadedDeviceAdapter> GetAdapterModule() const /* final */ { return adapter_; }
+   // The lock that serializes calls into this device: the module lock, a
+   // per-device lock, or none (null), depending on the thread safety
+   // declared by the module
+   MMThreadLock* GetLock() /* final */;
    std::string GetLabel() const /* final */ { return label_; }
    std::string GetDescription() const /* final */ { return description_; }
    void SetDescription(const std::string& description) /* final */ { description_ = description; }
@@ -170,6 +170,14 @@ ImgBuffer* FrameBuffer::FindImage(unsigned channel) const
    return channels_[channel];
 }
 
+ImgBuffer* FrameBuffer::ReleaseImage(unsigned channel)
+{
+   ImgBuffer* img = FindImage(channel);
+   if (img)
+      channels_[channel] = 0;
+   return img;
+}
+
 ImgBuffer* FrameBuffer::InsertNewImage(unsigned channel)
 {
    if (channel >= channels_.size())
@@ -43,6 +43,8 @@ public:
    unsigned int Depth() const {return pixDepth_;}
    void SetPixels(const void* pixArray);
    const unsigned char* GetPixels() const;
+   // For filling in the pixels in place
+   unsigned char* GetPixelsRW() {return pixels_;}
 
    void Resize(unsigned xSize, unsigned ySize, unsigned pixDepth);
    void Resize(unsigned xSize, unsigned ySize);
@@ -73,6 +75,9 @@ public:
    void Preallocate(unsigned channels);
 
    ImgBuffer* FindImage(unsigned channel) const;
+   // Removes the image of the channel without deleting it; the caller takes
+   // ownership. Returns null if the channel is not allocated.
+   ImgBuffer* ReleaseImage(unsigned channel);
    const unsigned char* GetPixels(unsigned channel) const;
    bool SetPixels(unsigned channel, const unsigned char* pixels);
    unsigned Width() const {return width_;}
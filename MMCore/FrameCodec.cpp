@@ -0,0 +1,589 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          FrameCodec.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Lossless image compression for the compressed mode of the
+//                circular buffer
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "FrameCodec.h"
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <stdint.h>
+
+// SSE2 is part of x86-64
+#if defined(_M_X64) || defined(__x86_64__)
+#define FRAMECODEC_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace mm
+{
+
+// Layout of compressed images:
+//    uint32 size, uint32 bytesPerSample, uint32 blockCount,
+//    uint32 encodedSize[blockCount], encoded blocks
+// The top bit of encodedSize is set for blocks stored as is.
+
+struct FrameCodec::Job
+{
+   bool compress;
+   const unsigned char* data; // Uncompressed (Compress) or compressed
+   unsigned char* out; // Decompress only
+   size_t size;
+   unsigned bytesPerSample;
+   size_t blockCount;
+   // Compress: the encoded blocks, empty if stored
+   std::vector< std::vector<unsigned char> > encoded;
+   // Decompress: position and size of the encoded blocks in data
+   std::vector<size_t> offsets;
+   std::vector<uint32_t> encodedSizes;
+   std::vector<char> failed;
+};
+
+
+namespace
+{
+
+// Blocks of this size fit the 16-bit offsets of the coder
+const size_t blockSize = 64 * 1024;
+const uint32_t storedFlag = 0x80000000u;
+const size_t headerWords = 3;
+
+const unsigned hashBits = 13;
+const size_t minMatch = 4;
+// As in LZ4, the last 5 bytes are literals and no match starts in the last 12
+const size_t lastLiterals = 5;
+const size_t matchMargin = 12;
+
+inline uint32_t Read32(const unsigned char* p)
+{
+   uint32_t v;
+   std::memcpy(&v, p, sizeof(v));
+   return v;
+}
+
+inline uint64_t Read64(const unsigned char* p)
+{
+   uint64_t v;
+   std::memcpy(&v, p, sizeof(v));
+   return v;
+}
+
+inline uint32_t Hash(uint32_t v)
+{
+   return (v * 2654435761u) >> (32 - hashBits);
+}
+
+inline unsigned char* WriteLength(unsigned char* op, size_t length)
+{
+   for (; length >= 255; length -= 255)
+      *op++ = 255;
+   *op++ = (unsigned char)length;
+   return op;
+}
+
+// Writes the literals followed by the match, if matchLength > 0. Returns 0
+// if the sequence might not fit before end.
+unsigned char* WriteSequence(unsigned char* op, unsigned char* end,
+      const unsigned char* literals, size_t literalCount,
+      size_t offset, size_t matchLength)
+{
+   size_t worstCase = 1 + literalCount / 255 + 1 + literalCount +
+      2 + matchLength / 255 + 1;
+   if ((size_t)(end - op) < worstCase)
+      return 0;
+
+   unsigned char* token = op++;
+   unsigned t;
+   if (literalCount >= 15)
+   {
+      t = 15 << 4;
+      op = WriteLength(op, literalCount - 15);
+   }
+   else
+      t = (unsigned)literalCount << 4;
+   std::memcpy(op, literals, literalCount);
+   op += literalCount;
+
+   if (matchLength > 0)
+   {
+      *op++ = (unsigned char)(offset & 0xff);
+      *op++ = (unsigned char)(offset >> 8);
+      size_t m = matchLength - minMatch;
+      if (m >= 15)
+      {
+         t |= 15;
+         op = WriteLength(op, m - 15);
+      }
+      else
+         t |= (unsigned)m;
+   }
+   *token = (unsigned char)t;
+   return op;
+}
+
+// Compresses at most blockSize bytes into dst, which has room for size
+// bytes. Returns the compressed size, or 0 if it is not smaller than size.
+size_t LZCompress(const unsigned char* src, size_t size, unsigned char* dst)
+{
+   unsigned char* op = dst;
+   unsigned char* const end = dst + size;
+   size_t anchor = 0;
+
+   if (size > matchMargin)
+   {
+      uint16_t table[1 << hashBits];
+      std::memset(table, 0, sizeof(table));
+      const size_t matchLimit = size - lastLiterals;
+      const size_t searchLimit = size - matchMargin;
+
+      size_t i = 0;
+      while (i < searchLimit)
+      {
+         uint32_t sequence = Read32(src + i);
+         uint32_t h = Hash(sequence);
+         size_t ref = table[h];
+         table[h] = (uint16_t)i;
+         if (ref < i && Read32(src + ref) == sequence)
+         {
+            size_t length = minMatch;
+            while (i + length + 8 <= matchLimit &&
+                  Read64(src + ref + length) == Read64(src + i + length))
+               length += 8;
+            while (i + length < matchLimit && src[ref + length] == src[i + length])
+               ++length;
+
+            op = WriteSequence(op, end, src + anchor, i - anchor, i - ref, length);
+            if (!op)
+               return 0;
+            i += length;
+            anchor = i;
+         }
+         else
+         {
+            // Move faster through data that does not compress
+            i += 1 + ((i - anchor) >> 6);
+         }
+      }
+   }
+
+   op = WriteSequence(op, end, src + anchor, size - anchor, 0, 0);
+   if (!op || op == end)
+      return 0;
+   return op - dst;
+}
+
+inline bool ReadLength(const unsigned char*& ip, const unsigned char* end,
+      size_t& length)
+{
+   unsigned b;
+   do
+   {
+      if (ip == end)
+         return false;
+      b = *ip++;
+      length += b;
+   } while (b == 255);
+   return true;
+}
+
+// Copies a match that may overlap its copy, in which case it repeats the
+// last offset bytes; the copies then double in size
+inline void CopyMatch(unsigned char* op, size_t offset, size_t length)
+{
+   const unsigned char* match = op - offset;
+   if (offset >= length)
+   {
+      std::memcpy(op, match, length);
+      return;
+   }
+   size_t copied = 0;
+   while (copied < length)
+   {
+      size_t chunk = std::min(offset + copied, length - copied);
+      std::memcpy(op + copied, match, chunk);
+      copied += chunk;
+   }
+}
+
+bool LZDecompress(const unsigned char* src, size_t srcSize,
+      unsigned char* dst, size_t size)
+{
+   const unsigned char* ip = src;
+   const unsigned char* const iend = src + srcSize;
+   unsigned char* op = dst;
+   unsigned char* const oend = dst + size;
+
+   for (;;)
+   {
+      if (ip == iend)
+         return false;
+      unsigned token = *ip++;
+
+      size_t literalCount = token >> 4;
+      if (literalCount == 15 && !ReadLength(ip, iend, literalCount))
+         return false;
+      if (literalCount > (size_t)(iend - ip) || literalCount > (size_t)(oend - op))
+         return false;
+      std::memcpy(op, ip, literalCount);
+      ip += literalCount;
+      op += literalCount;
+
+      // The last sequence has literals only
+      if (ip == iend)
+         return op == oend;
+
+      if (iend - ip < 2)
+         return false;
+      size_t offset = ip[0] | ((size_t)ip[1] << 8);
+      ip += 2;
+      if (offset == 0 || offset > (size_t)(op - dst))
+         return false;
+
+      size_t length = token & 15;
+      if (length == 15 && !ReadLength(ip, iend, length))
+         return false;
+      length += minMatch;
+      if (length > (size_t)(oend - op))
+         return false;
+      CopyMatch(op, offset, length);
+      op += length;
+   }
+}
+
+// Groups byte b of every sample into the b-th part of dst
+void Shuffle(const unsigned char* src, size_t size, unsigned bytesPerSample,
+      unsigned char* dst)
+{
+   const size_t count = size / bytesPerSample;
+   size_t i = 0;
+#ifdef FRAMECODEC_SSE2
+   if (bytesPerSample == 2)
+   {
+      const __m128i lowMask = _mm_set1_epi16(0x00ff);
+      for (; i + 16 <= count; i += 16)
+      {
+         __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i));
+         __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i + 16));
+         __m128i lo = _mm_packus_epi16(_mm_and_si128(a, lowMask), _mm_and_si128(b, lowMask));
+         __m128i hi = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), lo);
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + count + i), hi);
+      }
+   }
+#endif
+   for (unsigned b = 0; b < bytesPerSample; ++b)
+   {
+      unsigned char* part = dst + b * count;
+      for (size_t s = i; s < count; ++s)
+         part[s] = src[s * bytesPerSample + b];
+   }
+}
+
+void Unshuffle(const unsigned char* src, size_t size, unsigned bytesPerSample,
+      unsigned char* dst)
+{
+   const size_t count = size / bytesPerSample;
+   size_t i = 0;
+#ifdef FRAMECODEC_SSE2
+   if (bytesPerSample == 2)
+   {
+      for (; i + 16 <= count; i += 16)
+      {
+         __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+         __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + count + i));
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i), _mm_unpacklo_epi8(lo, hi));
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i + 16), _mm_unpackhi_epi8(lo, hi));
+      }
+   }
+#endif
+   for (unsigned b = 0; b < bytesPerSample; ++b)
+   {
+      const unsigned char* part = src + b * count;
+      for (size_t s = i; s < count; ++s)
+         dst[s * bytesPerSample + b] = part[s];
+   }
+}
+
+inline void PutWord(std::vector<unsigned char>& out, size_t index, uint32_t word)
+{
+   std::memcpy(&out[index * sizeof(uint32_t)], &word, sizeof(word));
+}
+
+inline uint32_t GetWord(const std::vector<unsigned char>& in, size_t index)
+{
+   uint32_t word;
+   std::memcpy(&word, &in[index * sizeof(uint32_t)], sizeof(word));
+   return word;
+}
+
+} // anonymous namespace
+
+
+FrameCodec::FrameCodec() :
+   job_(0),
+   jobNumber_(0),
+   nextBlock_(0),
+   pendingBlocks_(0),
+   stopping_(false)
+{
+   // The calling thread also processes blocks
+   unsigned threadCount = boost::thread::hardware_concurrency();
+   unsigned workerCount = std::min(3u, threadCount > 1 ? threadCount - 1 : 0);
+   for (unsigned i = 0; i < workerCount; ++i)
+   {
+      workers_.push_back(boost::shared_ptr<boost::thread>(new boost::thread(
+                  boost::bind(&FrameCodec::WorkerLoop, this))));
+   }
+}
+
+
+FrameCodec::~FrameCodec()
+{
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      stopping_ = true;
+   }
+   jobCondition_.notify_all();
+   for (size_t i = 0; i < workers_.size(); ++i)
+      workers_[i]->join();
+}
+
+
+void
+FrameCodec::Compress(const unsigned char* data, size_t size,
+      unsigned bytesPerSample, std::vector<unsigned char>& out)
+{
+   if (bytesPerSample == 0 || blockSize % bytesPerSample != 0 ||
+         size % bytesPerSample != 0)
+      bytesPerSample = 1;
+
+   boost::lock_guard<boost::mutex> callLock(callMutex_);
+
+   Job job;
+   job.compress = true;
+   job.data = data;
+   job.out = 0;
+   job.size = size;
+   job.bytesPerSample = bytesPerSample;
+   job.blockCount = (size + blockSize - 1) / blockSize;
+   job.encoded.resize(job.blockCount);
+   RunJob(job);
+
+   size_t total = (headerWords + job.blockCount) * sizeof(uint32_t);
+   for (size_t b = 0; b < job.blockCount; ++b)
+   {
+      size_t blockBytes = std::min(blockSize, size - b * blockSize);
+      total += job.encoded[b].empty() ? blockBytes : job.encoded[b].size();
+   }
+
+   // Sized exactly, as the buffer counts the size of compressed images
+   std::vector<unsigned char> result(total);
+   PutWord(result, 0, (uint32_t)size);
+   PutWord(result, 1, bytesPerSample);
+   PutWord(result, 2, (uint32_t)job.blockCount);
+   unsigned char* p = &result[0] + (headerWords + job.blockCount) * sizeof(uint32_t);
+   for (size_t b = 0; b < job.blockCount; ++b)
+   {
+      const std::vector<unsigned char>& encoded = job.encoded[b];
+      if (encoded.empty())
+      {
+         size_t blockBytes = std::min(blockSize, size - b * blockSize);
+         PutWord(result, headerWords + b, (uint32_t)blockBytes | storedFlag);
+         std::memcpy(p, data + b * blockSize, blockBytes);
+         p += blockBytes;
+      }
+      else
+      {
+         PutWord(result, headerWords + b, (uint32_t)encoded.size());
+         std::memcpy(p, &encoded[0], encoded.size());
+         p += encoded.size();
+      }
+   }
+   out.swap(result);
+}
+
+
+bool
+FrameCodec::Decompress(const std::vector<unsigned char>& compressed,
+      unsigned char* out, size_t size)
+{
+   if (compressed.size() < headerWords * sizeof(uint32_t))
+      return false;
+
+   Job job;
+   job.compress = false;
+   job.data = &compressed[0];
+   job.out = out;
+   job.size = GetWord(compressed, 0);
+   job.bytesPerSample = GetWord(compressed, 1);
+   job.blockCount = GetWord(compressed, 2);
+   if (job.size != size || job.bytesPerSample == 0 ||
+         blockSize % job.bytesPerSample != 0 || size % job.bytesPerSample != 0 ||
+         job.blockCount != (size + blockSize - 1) / blockSize ||
+         compressed.size() < (headerWords + job.blockCount) * sizeof(uint32_t))
+      return false;
+
+   size_t offset = (headerWords + job.blockCount) * sizeof(uint32_t);
+   job.offsets.resize(job.blockCount);
+   job.encodedSizes.resize(job.blockCount);
+   for (size_t b = 0; b < job.blockCount; ++b)
+   {
+      job.encodedSizes[b] = GetWord(compressed, headerWords + b);
+      job.offsets[b] = offset;
+      offset += job.encodedSizes[b] & ~storedFlag;
+   }
+   if (offset != compressed.size())
+      return false;
+
+   job.failed.assign(job.blockCount, 0);
+   {
+      boost::lock_guard<boost::mutex> callLock(callMutex_);
+      RunJob(job);
+   }
+   return std::find(job.failed.begin(), job.failed.end(), 1) == job.failed.end();
+}
+
+
+void
+FrameCodec::RunJob(Job& job)
+{
+   if (job.blockCount < 2 || workers_.empty())
+   {
+      for (size_t b = 0; b < job.blockCount; ++b)
+         ProcessBlock(job, b);
+      return;
+   }
+
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      job_ = &job;
+      nextBlock_ = 0;
+      pendingBlocks_ = job.blockCount;
+      ++jobNumber_;
+   }
+   jobCondition_.notify_all();
+
+   ProcessBlocks();
+
+   boost::unique_lock<boost::mutex> lock(mutex_);
+   while (pendingBlocks_ > 0)
+      doneCondition_.wait(lock);
+   job_ = 0;
+}
+
+
+void
+FrameCodec::WorkerLoop()
+{
+   unsigned long lastJobNumber = 0;
+   for (;;)
+   {
+      {
+         boost::unique_lock<boost::mutex> lock(mutex_);
+         while (!stopping_ && jobNumber_ == lastJobNumber)
+            jobCondition_.wait(lock);
+         if (stopping_)
+            return;
+         lastJobNumber = jobNumber_;
+      }
+      ProcessBlocks();
+   }
+}
+
+
+void
+FrameCodec::ProcessBlocks()
+{
+   for (;;)
+   {
+      Job* job;
+      size_t block;
+      {
+         boost::lock_guard<boost::mutex> lock(mutex_);
+         if (!job_ || nextBlock_ >= job_->blockCount)
+            return;
+         job = job_;
+         block = nextBlock_++;
+      }
+
+      ProcessBlock(*job, block);
+
+      bool done;
+      {
+         boost::lock_guard<boost::mutex> lock(mutex_);
+         done = --pendingBlocks_ == 0;
+      }
+      if (done)
+         doneCondition_.notify_one();
+   }
+}
+
+
+void
+FrameCodec::ProcessBlock(Job& job, size_t block)
+{
+   const size_t blockBytes = std::min(blockSize, job.size - block * blockSize);
+   std::vector<unsigned char> shuffled;
+
+   if (job.compress)
+   {
+      const unsigned char* src = job.data + block * blockSize;
+      if (job.bytesPerSample > 1)
+      {
+         shuffled.resize(blockBytes);
+         Shuffle(src, blockBytes, job.bytesPerSample, &shuffled[0]);
+         src = &shuffled[0];
+      }
+
+      std::vector<unsigned char>& encoded = job.encoded[block];
+      encoded.resize(blockBytes);
+      size_t encodedBytes = LZCompress(src, blockBytes, &encoded[0]);
+      encoded.resize(encodedBytes); // Empty if stored
+      return;
+   }
+
+   const unsigned char* src = job.data + job.offsets[block];
+   const size_t encodedBytes = job.encodedSizes[block] & ~storedFlag;
+   unsigned char* dst = job.out + block * blockSize;
+   if (job.encodedSizes[block] & storedFlag)
+   {
+      if (encodedBytes != blockBytes)
+         job.failed[block] = 1;
+      else
+         std::memcpy(dst, src, blockBytes);
+      return;
+   }
+
+   if (job.bytesPerSample == 1)
+   {
+      if (!LZDecompress(src, encodedBytes, dst, blockBytes))
+         job.failed[block] = 1;
+      return;
+   }
+
+   shuffled.resize(blockBytes);
+   if (!LZDecompress(src, encodedBytes, &shuffled[0], blockBytes))
+      job.failed[block] = 1;
+   else
+      Unshuffle(&shuffled[0], blockBytes, job.bytesPerSample, dst);
+}
+
+} // namespace mm
@@ -0,0 +1,89 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          FrameCodec.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Lossless image compression for the compressed mode of the
+//                circular buffer
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <cstddef>
+#include <vector>
+
+namespace mm
+{
+
+/**
+ * Lossless compression of images for the compressed mode of the circular
+ * buffer.
+ *
+ * Images are split into blocks that are compressed independently, so that
+ * the blocks of large images can be shared between the calling thread and a
+ * few worker threads. Within a block, the bytes of the samples are first
+ * grouped by significance (byte shuffling): the high bytes of dim 16-bit
+ * images are mostly equal and become long runs. The shuffled block is then
+ * compressed with a fast LZ77 coder (in the format of LZ4 blocks). Blocks
+ * that do not get smaller are stored as is.
+ */
+class FrameCodec
+{
+public:
+   FrameCodec();
+   // Stops the worker threads
+   ~FrameCodec();
+
+   // Compresses size bytes of samples of bytesPerSample bytes each into out
+   void Compress(const unsigned char* data, size_t size,
+         unsigned bytesPerSample, std::vector<unsigned char>& out);
+
+   // Decompresses the output of Compress() into size bytes at out. Returns
+   // false if the compressed data is corrupt or not of that size.
+   bool Decompress(const std::vector<unsigned char>& compressed,
+         unsigned char* out, size_t size);
+
+private:
+   struct Job;
+
+   // Serializes Compress() and Decompress()
+   boost::mutex callMutex_;
+
+   boost::mutex mutex_;
+   boost::condition_variable jobCondition_;
+   boost::condition_variable doneCondition_;
+   Job* job_; // Set while a job runs
+   unsigned long jobNumber_;
+   size_t nextBlock_;
+   size_t pendingBlocks_;
+   bool stopping_;
+   std::vector< boost::shared_ptr<boost::thread> > workers_;
+
+   void RunJob(Job& job);
+   void WorkerLoop();
+   // Processes blocks of the current job until there are none left
+   void ProcessBlocks();
+   static void ProcessBlock(Job& job, size_t block);
+
+   FrameCodec(const FrameCodec&);
+   FrameCodec& operator=(const FrameCodec&);
+};
+
+} // namespace mm
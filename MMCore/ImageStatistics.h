@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace mm
+{
+   class ImageStatisticsCalculator;
+}
+
+/**
+ * Statistics of one image in the circular buffer: a histogram, the minimum,
+ * maximum and mean pixel value, and the number of saturated pixels. For RGB
+ * images, the statistics cover the red, green and blue components together.
+ *
+ * The histogram spans the range of the camera bit depth, in bins of equal
+ * width; it has fewer bins than were requested if the bit depth has fewer
+ * values.
+ */
+class ImageStatistics
+{
+public:
+   ImageStatistics() :
+      imageNumber_(-1), width_(0), height_(0), bitDepth_(0), binWidth_(1),
+      min_(0), max_(0), mean_(0.0), saturatedCount_(0)
+   {}
+
+   std::string getCameraLabel() const { return cameraLabel_; }
+   long getImageNumber() const { return imageNumber_; }
+   unsigned getWidth() const { return width_; }
+   unsigned getHeight() const { return height_; }
+   unsigned getBitDepth() const { return bitDepth_; }
+
+   unsigned getBinCount() const { return (unsigned) histogram_.size(); }
+   // Number of pixel values in each bin; bin i starts at i * getBinWidth()
+   unsigned getBinWidth() const { return binWidth_; }
+   std::vector<long> getHistogram() const { return histogram_; }
+
+   long getMin() const { return min_; }
+   long getMax() const { return max_; }
+   double getMean() const { return mean_; }
+   // Number of pixel values at 2^bitDepth - 1 or above
+   long getSaturatedCount() const { return saturatedCount_; }
+
+private:
+   friend class mm::ImageStatisticsCalculator;
+
+   std::string cameraLabel_;
+   long imageNumber_;
+   unsigned width_;
+   unsigned height_;
+   unsigned bitDepth_;
+   unsigned binWidth_;
+   std::vector<long> histogram_;
+   long min_;
+   long max_;
+   double mean_;
+   long saturatedCount_;
+};
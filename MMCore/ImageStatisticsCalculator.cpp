@@ -0,0 +1,559 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ImageStatisticsCalculator.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Computes the statistics of images inserted into the
+//                circular buffer
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "ImageStatisticsCalculator.h"
+
+#include "../MMDevice/MMDeviceConstants.h"
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <sstream>
+#include <stdint.h>
+
+// SSE2 is part of x86-64
+#if defined(_M_X64) || defined(__x86_64__)
+#define IMAGESTATISTICS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace mm
+{
+
+struct ImageStatisticsCalculator::Job
+{
+   const unsigned char* pixels;
+   unsigned width;
+   unsigned height;
+   unsigned bytesPerSample; // 1 or 2
+   unsigned samplesPerPixel; // 1, or 4 for RGB (the 4th is not used)
+   unsigned shift; // Value to bin
+   unsigned lastBin;
+   unsigned saturationLevel;
+};
+
+
+struct ImageStatisticsCalculator::Band
+{
+   std::vector<long> histogram;
+   uint64_t sum;
+   uint64_t saturated;
+   uint64_t count;
+   unsigned min;
+   unsigned max;
+};
+
+
+namespace
+{
+
+// Below this many pixels, the inserting thread does all the work in Finish()
+const size_t minPixelsForWorkers = 256 * 1024;
+
+struct Totals
+{
+   uint64_t sum;
+   uint64_t saturated;
+   unsigned min;
+   unsigned max;
+};
+
+template <typename SampleType>
+void TotalsScalar(const SampleType* samples, size_t count, unsigned level, Totals& t)
+{
+   for (size_t i = 0; i < count; ++i)
+   {
+      unsigned v = samples[i];
+      t.sum += v;
+      t.saturated += (v >= level);
+      t.min = std::min(t.min, v);
+      t.max = std::max(t.max, v);
+   }
+}
+
+#ifdef IMAGESTATISTICS_SSE2
+
+// The saturation level is between 1 and the largest sample value
+size_t Totals8(const uint8_t* samples, size_t count, unsigned level, Totals& t)
+{
+   const __m128i zero = _mm_setzero_si128();
+   const __m128i one = _mm_set1_epi8(1);
+   const __m128i levels = _mm_set1_epi8((char)level);
+   __m128i vmin = _mm_set1_epi8((char)0xff);
+   __m128i vmax = zero;
+   __m128i vsum = zero; // 2 x 64 bit
+   __m128i vsat = zero; // 2 x 64 bit
+
+   size_t i = 0;
+   for (; i + 16 <= count; i += 16)
+   {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+      vmin = _mm_min_epu8(vmin, v);
+      vmax = _mm_max_epu8(vmax, v);
+      vsum = _mm_add_epi64(vsum, _mm_sad_epu8(v, zero));
+      __m128i saturated = _mm_cmpeq_epi8(_mm_max_epu8(v, levels), v);
+      vsat = _mm_add_epi64(vsat, _mm_sad_epu8(_mm_and_si128(saturated, one), zero));
+   }
+
+   uint8_t mins[16], maxs[16];
+   uint64_t sums[2], sats[2];
+   _mm_storeu_si128(reinterpret_cast<__m128i*>(mins), vmin);
+   _mm_storeu_si128(reinterpret_cast<__m128i*>(maxs), vmax);
+   _mm_storeu_si128(reinterpret_cast<__m128i*>(sums), vsum);
+   _mm_storeu_si128(reinterpret_cast<__m128i*>(sats), vsat);
+   if (i > 0)
+   {
+      for (int k = 0; k < 16; ++k)
+      {
+         t.min = std::min<unsigned>(t.min, mins[k]);
+         t.max = std::max<unsigned>(t.max, maxs[k]);
+      }
+   }
+   t.sum += sums[0] + sums[1];
+   t.saturated += sats[0] + sats[1];
+   return i;
+}
+
+// 16 bit samples are compared as signed values after flipping the top bit.
+// The 32 bit sums are moved to 64 bits before they can overflow.
+size_t Totals16(const uint16_t* samples, size_t count, unsigned level, Totals& t)
+{
+   const __m128i zero = _mm_setzero_si128();
+   const __m128i bias = _mm_set1_epi16((short)0x8000);
+   const __m128i one = _mm_set1_epi16(1);
+   const __m128i levelsBelow = _mm_set1_epi16((short)((level - 1) ^ 0x8000));
+   __m128i vmin = _mm_set1_epi16(0x7fff);
+   __m128i vmax = _mm_set1_epi16((short)0x8000);
+   __m128i vsum64 = zero;
+   __m128i vsat64 = zero;
+
+   size_t i = 0;
+   while (i + 8 <= count)
+   {
+      __m128i vsum32 = zero;
+      __m128i vsat32 = zero;
+      size_t end = std::min(count - 7, i + 8 * 32768);
+      for (; i < end; i += 8)
+      {
+         __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+         __m128i b = _mm_xor_si128(v, bias);
+         vmin = _mm_min_epi16(vmin, b);
+         vmax = _mm_max_epi16(vmax, b);
+         vsum32 = _mm_add_epi32(vsum32, _mm_unpacklo_epi16(v, zero));
+         vsum32 = _mm_add_epi32(vsum32, _mm_unpackhi_epi16(v, zero));
+         __m128i saturated = _mm_and_si128(_mm_cmpgt_epi16(b, levelsBelow), one);
+         vsat32 = _mm_add_epi32(vsat32, _mm_madd_epi16(saturated, one));
+      }
+      vsum64 = _mm_add_epi64(vsum64, _mm_unpacklo_epi32(vsum32, zero));
+      vsum64 = _mm_add_epi64(vsum64, _mm_unpackhi_epi32(vsum32, zero));
+      vsat64 = _mm_add_epi64(vsat64, _mm_unpacklo_epi32(vsat32, zero));
+      vsat64 = _mm_add_epi64(vsat64, _mm_unpackhi_epi32(vsat32, zero));
+   }
+
+   int16_t mins[8], maxs[8];
+   uint64_t sums[2], sats[2];
+   _mm_storeu_si128(reinterpret_cast<__m128i*>(mins), vmin);
+   _mm_storeu_si128(reinterpret_cast<__m128i*>(maxs), vmax);
+   _mm_storeu_si128(reinterpret_cast<__m128i*>(sums), vsum64);
+   _mm_storeu_si128(reinterpret_cast<__m128i*>(sats), vsat64);
+   if (i > 0)
+   {
+      for (int k = 0; k < 8; ++k)
+      {
+         t.min = std::min<unsigned>(t.min, (uint16_t)(mins[k] ^ 0x8000));
+         t.max = std::max<unsigned>(t.max, (uint16_t)(maxs[k] ^ 0x8000));
+      }
+   }
+   t.sum += sums[0] + sums[1];
+   t.saturated += sats[0] + sats[1];
+   return i;
+}
+
+#endif // IMAGESTATISTICS_SSE2
+
+// Four interleaved histograms for the smaller bin counts, so that runs of
+// equal values do not serialize on one counter
+template <typename SampleType>
+void HistogramGray(const SampleType* samples, size_t count, unsigned shift,
+      unsigned lastBin, long* histogram)
+{
+   const unsigned binCount = lastBin + 1;
+   if (binCount > 1024)
+   {
+      for (size_t i = 0; i < count; ++i)
+         ++histogram[std::min<unsigned>(samples[i] >> shift, lastBin)];
+      return;
+   }
+
+   std::vector<long> sub(4 * binCount, 0);
+   long* h0 = &sub[0];
+   long* h1 = h0 + binCount;
+   long* h2 = h1 + binCount;
+   long* h3 = h2 + binCount;
+   size_t i = 0;
+   for (; i + 4 <= count; i += 4)
+   {
+      ++h0[std::min<unsigned>(samples[i] >> shift, lastBin)];
+      ++h1[std::min<unsigned>(samples[i + 1] >> shift, lastBin)];
+      ++h2[std::min<unsigned>(samples[i + 2] >> shift, lastBin)];
+      ++h3[std::min<unsigned>(samples[i + 3] >> shift, lastBin)];
+   }
+   for (; i < count; ++i)
+      ++h0[std::min<unsigned>(samples[i] >> shift, lastBin)];
+   for (unsigned b = 0; b < binCount; ++b)
+      histogram[b] += h0[b] + h1[b] + h2[b] + h3[b];
+}
+
+template <typename SampleType>
+void BandGray(const SampleType* samples, size_t count, unsigned shift,
+      unsigned lastBin, unsigned level, Totals& t, long* histogram)
+{
+   size_t done = 0;
+#ifdef IMAGESTATISTICS_SSE2
+   if (sizeof(SampleType) == 1)
+      done = Totals8(reinterpret_cast<const uint8_t*>(samples), count, level, t);
+   else
+      done = Totals16(reinterpret_cast<const uint16_t*>(samples), count, level, t);
+#endif
+   TotalsScalar(samples + done, count - done, level, t);
+   HistogramGray(samples, count, shift, lastBin, histogram);
+}
+
+// RGB pixels are stored as B, G, R and an unused 4th component
+template <typename SampleType>
+void BandRGB(const SampleType* samples, size_t pixelCount, unsigned shift,
+      unsigned lastBin, unsigned level, Totals& t, long* histogram)
+{
+   for (size_t i = 0; i < pixelCount; ++i)
+   {
+      const SampleType* p = samples + 4 * i;
+      TotalsScalar(p, 3, level, t);
+      for (int c = 0; c < 3; ++c)
+         ++histogram[std::min<unsigned>(p[c] >> shift, lastBin)];
+   }
+}
+
+unsigned BitDepthOf(Metadata& md, unsigned bitsPerSample)
+{
+   if (md.HasTag(MM::g_Keyword_Metadata_BitDepth))
+   {
+      try
+      {
+         unsigned bitDepth = boost::lexical_cast<unsigned>(
+               md.GetSingleTag(MM::g_Keyword_Metadata_BitDepth).GetValue());
+         if (bitDepth > 0 && bitDepth <= bitsPerSample)
+            return bitDepth;
+      }
+      catch (const boost::bad_lexical_cast&)
+      {
+      }
+   }
+   return bitsPerSample;
+}
+
+} // anonymous namespace
+
+
+ImageStatisticsCalculator::ImageStatisticsCalculator(unsigned binCount) :
+   binCount_(binCount),
+   job_(new Job()),
+   bands_(new std::vector<Band>()),
+   onWorkers_(false),
+   jobNumber_(0),
+   pendingBands_(0),
+   stopping_(false),
+   haveLast_(false)
+{
+   // The inserting thread keeps a core to copy the image
+   unsigned threadCount = boost::thread::hardware_concurrency();
+   unsigned workerCount = std::min(4u, threadCount > 1 ? threadCount - 1 : 0);
+   for (unsigned i = 0; i < workerCount; ++i)
+   {
+      workers_.push_back(boost::shared_ptr<boost::thread>(new boost::thread(
+                  boost::bind(&ImageStatisticsCalculator::WorkerLoop, this, i))));
+   }
+}
+
+
+ImageStatisticsCalculator::~ImageStatisticsCalculator()
+{
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      stopping_ = true;
+   }
+   jobCondition_.notify_all();
+   for (size_t i = 0; i < workers_.size(); ++i)
+      workers_[i]->join();
+}
+
+
+bool
+ImageStatisticsCalculator::IsSupportedBinCount(unsigned binCount)
+{
+   return binCount == 256 || binCount == 1024 || binCount == 65536;
+}
+
+
+bool
+ImageStatisticsCalculator::Compute(const unsigned char* pixels,
+      unsigned width, unsigned height, unsigned byteDepth,
+      unsigned nComponents, Metadata& md)
+{
+   if (!Start(pixels, width, height, byteDepth, nComponents, md))
+      return false;
+   Finish(md);
+   return true;
+}
+
+
+bool
+ImageStatisticsCalculator::Start(const unsigned char* pixels,
+      unsigned width, unsigned height, unsigned byteDepth,
+      unsigned nComponents, Metadata& md)
+{
+   Job job;
+   job.pixels = pixels;
+   job.width = width;
+   job.height = height;
+   switch (byteDepth)
+   {
+      case 1:
+      case 2:
+         job.bytesPerSample = byteDepth;
+         job.samplesPerPixel = 1;
+         break;
+      case 4:
+         if (nComponents == 1)
+            return false;
+         job.bytesPerSample = 1;
+         job.samplesPerPixel = 4;
+         break;
+      case 8:
+         job.bytesPerSample = 2;
+         job.samplesPerPixel = 4;
+         break;
+      default:
+         return false;
+   }
+
+   ImageStatistics stats;
+   stats.width_ = width;
+   stats.height_ = height;
+   stats.bitDepth_ = BitDepthOf(md, 8 * job.bytesPerSample);
+   if (md.HasTag("Camera"))
+      stats.cameraLabel_ = md.GetSingleTag("Camera").GetValue();
+   if (md.HasTag(MM::g_Keyword_Metadata_ImageNumber))
+   {
+      try
+      {
+         stats.imageNumber_ = boost::lexical_cast<long>(
+               md.GetSingleTag(MM::g_Keyword_Metadata_ImageNumber).GetValue());
+      }
+      catch (const boost::bad_lexical_cast&)
+      {
+      }
+   }
+
+   unsigned binBits = 0;
+   while ((1u << binBits) < binCount_)
+      ++binBits;
+   job.shift = stats.bitDepth_ > binBits ? stats.bitDepth_ - binBits : 0;
+   job.lastBin = ((1u << stats.bitDepth_) - 1) >> job.shift;
+   job.saturationLevel = (1u << stats.bitDepth_) - 1;
+   stats.binWidth_ = 1u << job.shift;
+
+   // Unlocked by Finish(); the workers are idle until then
+   computeMutex_.lock();
+   *job_ = job;
+   stats_ = stats;
+
+   onWorkers_ = !workers_.empty() && (size_t)width * height >= minPixelsForWorkers;
+   unsigned bandCount = 1;
+   if (onWorkers_)
+      bandCount = (unsigned)std::min<size_t>(workers_.size(), height);
+   bands_->resize(bandCount);
+   if (onWorkers_)
+   {
+      {
+         boost::lock_guard<boost::mutex> lock(mutex_);
+         pendingBands_ = bandCount;
+         ++jobNumber_;
+      }
+      jobCondition_.notify_all();
+   }
+   return true;
+}
+
+
+void
+ImageStatisticsCalculator::Finish(Metadata& md)
+{
+   // Locked by Start()
+   boost::unique_lock<boost::mutex> computeLock(computeMutex_, boost::adopt_lock);
+
+   std::vector<Band>& bands = *bands_;
+   if (onWorkers_)
+   {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      while (pendingBands_ > 0)
+         doneCondition_.wait(lock);
+   }
+   else
+   {
+      ComputeBand(*job_, 0, 1, bands[0]);
+   }
+
+   ImageStatistics& stats = stats_;
+   uint64_t sum = 0, saturated = 0, count = 0;
+   unsigned minValue = 0xffffffff, maxValue = 0;
+   stats.histogram_.assign(job_->lastBin + 1, 0);
+   for (size_t b = 0; b < bands.size(); ++b)
+   {
+      const Band& band = bands[b];
+      sum += band.sum;
+      saturated += band.saturated;
+      count += band.count;
+      minValue = std::min(minValue, band.min);
+      maxValue = std::max(maxValue, band.max);
+      for (size_t k = 0; k < stats.histogram_.size(); ++k)
+         stats.histogram_[k] += band.histogram[k];
+   }
+   if (count == 0)
+      minValue = 0;
+   stats.min_ = minValue;
+   stats.max_ = maxValue;
+   stats.mean_ = count > 0 ? (double)sum / count : 0.0;
+   stats.saturatedCount_ = (long)saturated;
+
+   md.PutImageTag("Statistics-Min", stats.min_);
+   md.PutImageTag("Statistics-Max", stats.max_);
+   md.PutImageTag("Statistics-Mean", stats.mean_);
+   md.PutImageTag("Statistics-SaturatedPixels", stats.saturatedCount_);
+   // 65536 bins would dwarf the rest of the metadata
+   if (stats.histogram_.size() <= 1024)
+   {
+      std::ostringstream histogram;
+      for (size_t k = 0; k < stats.histogram_.size(); ++k)
+      {
+         if (k > 0)
+            histogram << ',';
+         histogram << stats.histogram_[k];
+      }
+      md.PutImageTag("Statistics-BinWidth", stats.binWidth_);
+      md.PutImageTag("Statistics-Histogram", histogram.str());
+   }
+
+   {
+      boost::lock_guard<boost::mutex> lastLock(lastMutex_);
+      last_ = stats;
+      haveLast_ = true;
+   }
+}
+
+
+bool
+ImageStatisticsCalculator::GetLastStatistics(ImageStatistics& stats) const
+{
+   boost::lock_guard<boost::mutex> lock(lastMutex_);
+   if (!haveLast_)
+      return false;
+   stats = last_;
+   return true;
+}
+
+
+void
+ImageStatisticsCalculator::WorkerLoop(unsigned bandIndex)
+{
+   unsigned long lastJobNumber = 0;
+   for (;;)
+   {
+      const Job* job;
+      Band* band;
+      unsigned bandCount;
+      {
+         boost::unique_lock<boost::mutex> lock(mutex_);
+         while (!stopping_ && jobNumber_ == lastJobNumber)
+            jobCondition_.wait(lock);
+         if (stopping_)
+            return;
+         lastJobNumber = jobNumber_;
+         bandCount = (unsigned)bands_->size();
+         if (bandIndex >= bandCount)
+            continue;
+         job = job_.get();
+         band = &(*bands_)[bandIndex];
+      }
+
+      ComputeBand(*job, bandIndex, bandCount, *band);
+
+      {
+         boost::lock_guard<boost::mutex> lock(mutex_);
+         --pendingBands_;
+      }
+      doneCondition_.notify_one();
+   }
+}
+
+
+void
+ImageStatisticsCalculator::ComputeBand(const Job& job, unsigned bandIndex,
+      unsigned bandCount, Band& band)
+{
+   size_t firstRow = (size_t)job.height * bandIndex / bandCount;
+   size_t endRow = (size_t)job.height * (bandIndex + 1) / bandCount;
+   size_t pixelCount = (endRow - firstRow) * job.width;
+   size_t firstSample = firstRow * job.width * job.samplesPerPixel;
+
+   Totals t;
+   t.sum = 0;
+   t.saturated = 0;
+   t.min = 0xffffffff;
+   t.max = 0;
+   band.histogram.assign(job.lastBin + 1, 0);
+   long* histogram = &band.histogram[0];
+
+   if (job.bytesPerSample == 1)
+   {
+      const uint8_t* samples = job.pixels + firstSample;
+      if (job.samplesPerPixel == 1)
+         BandGray(samples, pixelCount, job.shift, job.lastBin, job.saturationLevel, t, histogram);
+      else
+         BandRGB(samples, pixelCount, job.shift, job.lastBin, job.saturationLevel, t, histogram);
+   }
+   else
+   {
+      const uint16_t* samples = reinterpret_cast<const uint16_t*>(job.pixels) + firstSample;
+      if (job.samplesPerPixel == 1)
+         BandGray(samples, pixelCount, job.shift, job.lastBin, job.saturationLevel, t, histogram);
+      else
+         BandRGB(samples, pixelCount, job.shift, job.lastBin, job.saturationLevel, t, histogram);
+   }
+
+   band.sum = t.sum;
+   band.saturated = t.saturated;
+   band.count = pixelCount * (job.samplesPerPixel == 1 ? 1 : 3);
+   band.min = t.min;
+   band.max = t.max;
+}
+
+} // namespace mm
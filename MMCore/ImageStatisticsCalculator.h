@@ -0,0 +1,111 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ImageStatisticsCalculator.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Computes the statistics of images inserted into the
+//                circular buffer
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "ImageStatistics.h"
+
+#include "../MMDevice/ImageMetadata.h"
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <vector>
+
+namespace mm
+{
+
+/**
+ * Computes the statistics of images as they are inserted into the circular
+ * buffer, and attaches them to the image metadata.
+ *
+ * The rows of large images are split between a few worker threads, which
+ * work while the inserting thread copies the image into the buffer; the
+ * inserting thread then waits for the result, so that the metadata is
+ * complete when the image becomes visible to readers. Small images (and all
+ * images on a single core) are computed by the inserting thread.
+ */
+class ImageStatisticsCalculator
+{
+public:
+   // Supported bin counts are 256, 1024 and 65536
+   explicit ImageStatisticsCalculator(unsigned binCount);
+   // Stops the worker threads
+   ~ImageStatisticsCalculator();
+
+   static bool IsSupportedBinCount(unsigned binCount);
+
+   unsigned GetBinCount() const { return binCount_; }
+
+   // Starts computing the statistics of the pixels, which must stay
+   // unchanged until Finish(); md supplies the camera label, image number
+   // and bit depth. Returns false for pixel types without statistics (32-bit
+   // grayscale). If it returns true, the same thread must call Finish().
+   bool Start(const unsigned char* pixels, unsigned width, unsigned height,
+         unsigned byteDepth, unsigned nComponents, Metadata& md);
+   // Waits for the statistics started by Start() and puts them into md
+   void Finish(Metadata& md);
+
+   // Start() followed by Finish()
+   bool Compute(const unsigned char* pixels, unsigned width, unsigned height,
+         unsigned byteDepth, unsigned nComponents, Metadata& md);
+
+   // Returns false if no image has been computed yet
+   bool GetLastStatistics(ImageStatistics& stats) const;
+
+private:
+   struct Band;
+   struct Job;
+
+   const unsigned binCount_;
+
+   // Held from Start() to Finish()
+   boost::mutex computeMutex_;
+   // The image between Start() and Finish()
+   boost::scoped_ptr<Job> job_;
+   boost::scoped_ptr< std::vector<Band> > bands_;
+   ImageStatistics stats_;
+   bool onWorkers_;
+
+   boost::mutex mutex_;
+   boost::condition_variable jobCondition_;
+   boost::condition_variable doneCondition_;
+   unsigned long jobNumber_;
+   unsigned pendingBands_;
+   bool stopping_;
+   std::vector< boost::shared_ptr<boost::thread> > workers_;
+
+   mutable boost::mutex lastMutex_;
+   ImageStatistics last_;
+   bool haveLast_;
+
+   void WorkerLoop(unsigned bandIndex);
+   static void ComputeBand(const Job& job, unsigned bandIndex,
+         unsigned bandCount, Band& band);
+
+   ImageStatisticsCalculator(const ImageStatisticsCalculator&);
+   ImageStatisticsCalculator& operator=(const ImageStatisticsCalculator&);
+};
+
+} // namespace mm
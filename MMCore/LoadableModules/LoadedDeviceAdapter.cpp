@@ -31,6 +31,7 @@
 
 LoadedDeviceAdapter::LoadedDeviceAdapter(const std::string& name, const std::string& filename) :
    name_(name),
+   threadSafety_(MM::ThreadSafetyModule),
    InitializeModuleData_(0),
    CreateDevice_(0),
    DeleteDevice_(0),
@@ -63,6 +64,7 @@ LoadedDeviceAdapter::LoadedDeviceAdapter(const std::string& name, const std::str
    }
 
    InitializeModuleData();
+   threadSafety_ = GetModuleThreadSafety();
 }
 
 
@@ -240,6 +242,34 @@ LoadedDeviceAdapter::InitializeModuleData()
 }
 
 
+MM::ModuleThreadSafety
+LoadedDeviceAdapter::GetModuleThreadSafety() const
+{
+   // Optional: modules built before this function existed get the module
+   // lock
+   fnGetModuleThreadSafety getThreadSafety;
+   try
+   {
+      getThreadSafety = reinterpret_cast<fnGetModuleThreadSafety>
+         (module_->GetFunction("GetModuleThreadSafety"));
+   }
+   catch (const CMMError&)
+   {
+      return MM::ThreadSafetyModule;
+   }
+
+   switch (getThreadSafety())
+   {
+      case MM::ThreadSafetyDevice:
+         return MM::ThreadSafetyDevice;
+      case MM::ThreadSafetyReentrant:
+         return MM::ThreadSafetyReentrant;
+      default:
+         return MM::ThreadSafetyModule;
+   }
+}
+
+
 MM::Device*
 LoadedDeviceAdapter::CreateDevice(const char* deviceName)
 {
@@ -51,9 +51,12 @@ public:
    std::string GetName() const { return name_; }
 
    // The "module lock", used to synchronize _most_ access to the device
-   // adapter.
+   // adapter, unless the adapter declares a finer thread safety (see
+   // DeviceInstance::GetLock()).
    MMThreadLock* GetLock();
 
+   MM::ModuleThreadSafety GetThreadSafety() const { return threadSafety_; }
+
    std::vector<std::string> GetAvailableDeviceNames() const;
    std::string GetDeviceDescription(const std::string& deviceName) const;
    MM::DeviceType GetAdvertisedDeviceType(const std::string& deviceName) const;
@@ -94,6 +97,7 @@ private:
 
    // Wrappers around raw module interface functions
    void InitializeModuleData();
+   MM::ModuleThreadSafety GetModuleThreadSafety() const;
    long GetModuleVersion() const;
    long GetDeviceInterfaceVersion() const;
    unsigned GetNumberOfDevices() const;
@@ -108,6 +112,7 @@ private:
    boost::shared_ptr<LoadedModule> module_;
 
    MMThreadLock lock_;
+   MM::ModuleThreadSafety threadSafety_;
 
    // Cached function pointers
    mutable fnInitializeModuleData InitializeModuleData_;
@@ -42,8 +42,10 @@
 #include "../MMDevice/DeviceUtils.h"
 #include "../MMDevice/ImageMetadata.h"
 #include "../MMDevice/ModuleInterface.h"
+#include "AsyncCommandExecutor.h"
 #include "CircularBuffer.h"
 #include "ConfigGroup.h"
+#include "ConfigFileReader.h"
 #include "Configuration.h"
 #include "CoreCallback.h"
 #include "CoreProperty.h"
@@ -51,15 +53,22 @@
 #include "DeviceManager.h"
 #include "Devices/DeviceInstances.h"
 #include "Host.h"
+#include "ImageStatisticsCalculator.h"
+#include "LoadableModules/LoadedDeviceAdapter.h"
 #include "LogManager.h"
 #include "MMCore.h"
 #include "MMEventCallback.h"
 #include "PluginManager.h"
+#include "PreviewGenerator.h"
+#include "SharedFrameRing.h"
+#include "SoftwareROIBinning.h"
 
+#include <boost/bind.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <algorithm>
 #include <assert.h>
+#include <cstring>
 #include <fstream>
 #include <set>
 #include <sstream>
@@ -141,6 +150,7 @@ CMMCore::CMMCore() :
    cbuf_(0),
    pluginManager_(new CPluginManager()),
    deviceManager_(new mm::DeviceManager()),
+   asyncCommands_(new mm::AsyncCommandExecutor()),
    pPostedErrorsLock_(NULL)
 {
    configGroups_ = new ConfigGroupCollection();
@@ -168,6 +178,8 @@ CMMCore::CMMCore() :
  */
 CMMCore::~CMMCore()
 {
+   asyncCommands_->Shutdown();
+
    try
    {
       // TODO We should attempt to continue cleanup beyond the first device
@@ -359,13 +371,23 @@ string CMMCore::getVersionInfo() const
 
 /**
  * Get available devices from the specified device library.
+ *
+ * The library is not loaded if the device adapter metadata cache has an
+ * up-to-date entry for it (see setDeviceAdapterMetadataCacheFile()).
  */
 std::vector<std::string>
 CMMCore::getAvailableDevices(const char* moduleName) throw (CMMError)
 {
-   boost::shared_ptr<LoadedDeviceAdapter> module =
-      pluginManager_->GetDeviceAdapter(moduleName);
-   return module->GetAvailableDeviceNames();
+   std::vector<mm::AvailableDeviceInfo> devices =
+      pluginManager_->GetAvailableDevices(moduleName);
+   std::vector<std::string> names;
+   names.reserve(devices.size());
+   for (std::vector<mm::AvailableDeviceInfo>::const_iterator
+         it = devices.begin(), end = devices.end(); it != end; ++it)
+   {
+      names.push_back(it->name);
+   }
+   return names;
 }
 
 /**
@@ -376,15 +398,14 @@ CMMCore::getAvailableDeviceDescriptions(const char* moduleName) throw (CMMError)
 {
    // XXX It is a little silly that we return the list of descriptions, rather
    // than provide access to the description of each device.
-   boost::shared_ptr<LoadedDeviceAdapter> module =
-      pluginManager_->GetDeviceAdapter(moduleName);
-   std::vector<std::string> names = module->GetAvailableDeviceNames();
+   std::vector<mm::AvailableDeviceInfo> devices =
+      pluginManager_->GetAvailableDevices(moduleName);
    std::vector<std::string> descriptions;
-   descriptions.reserve(names.size());
-   for (std::vector<std::string>::const_iterator
-         it = names.begin(), end = names.end(); it != end; ++it)
+   descriptions.reserve(devices.size());
+   for (std::vector<mm::AvailableDeviceInfo>::const_iterator
+         it = devices.begin(), end = devices.end(); it != end; ++it)
    {
-      descriptions.push_back(module->GetDeviceDescription(*it));
+      descriptions.push_back(it->description);
    }
    return descriptions;
 }
@@ -397,20 +418,71 @@ CMMCore::getAvailableDeviceTypes(const char* moduleName) throw (CMMError)
 {
    // XXX It is a little silly that we return the list of types, rather than
    // provide access to the type of each device.
-   boost::shared_ptr<LoadedDeviceAdapter> module =
-      pluginManager_->GetDeviceAdapter(moduleName);
-   std::vector<std::string> names = module->GetAvailableDeviceNames();
+   std::vector<mm::AvailableDeviceInfo> devices =
+      pluginManager_->GetAvailableDevices(moduleName);
    std::vector<long> types;
-   types.reserve(names.size());
-   for (std::vector<std::string>::const_iterator
-         it = names.begin(), end = names.end(); it != end; ++it)
+   types.reserve(devices.size());
+   for (std::vector<mm::AvailableDeviceInfo>::const_iterator
+         it = devices.begin(), end = devices.end(); it != end; ++it)
    {
-      MM::DeviceType devType = module->GetAdvertisedDeviceType(*it);
-      types.push_back(static_cast<long>(devType));
+      types.push_back(static_cast<long>(it->type));
    }
    return types;
 }
 
+/**
+ * Set the file in which the device adapter metadata cache is kept.
+ *
+ * Listing the devices in a device adapter (getAvailableDevices(),
+ * getAvailableDeviceDescriptions(), getAvailableDeviceTypes()) requires
+ * loading the adapter's library, which can be slow. The results are cached,
+ * keyed by the library file's path, modification time, and size, so that an
+ * adapter is only loaded again after its file changes. Setting a cache file
+ * makes the cache persist across sessions: the cache is read from the file
+ * now, and new entries are written to it by
+ * saveDeviceAdapterMetadataCache(), when another file is set, or when the
+ * Core is destroyed.
+ *
+ * No cache file is set by default; the application chooses where to keep it.
+ * A missing or invalid file is treated as an empty cache.
+ *
+ * @param filename the cache file; an empty string keeps the cache in memory
+ *                 only
+ */
+void
+CMMCore::setDeviceAdapterMetadataCacheFile(const char* filename) throw (CMMError)
+{
+   if (!filename)
+      throw CMMError("Null filename");
+
+   pluginManager_->SetMetadataCacheFile(filename);
+   LOG_INFO(coreLogger_) << "Device adapter metadata cache file set to \"" <<
+      filename << "\"";
+}
+
+/**
+ * Return the file in which the device adapter metadata cache is kept, or an
+ * empty string if none is set.
+ */
+std::string
+CMMCore::getDeviceAdapterMetadataCacheFile() const
+{
+   return pluginManager_->GetMetadataCacheFile();
+}
+
+/**
+ * Write new entries of the device adapter metadata cache to the cache file.
+ *
+ * Call this after listing the devices of a number of adapters, so that the
+ * file is written once rather than for every adapter. Does nothing if no
+ * cache file is set.
+ */
+void
+CMMCore::saveDeviceAdapterMetadataCache()
+{
+   pluginManager_->SaveMetadataCache();
+}
+
 /**
  * Returns the module and device interface versions.
  */
@@ -783,6 +855,9 @@ void CMMCore::unloadDevice(const char* label///< the name of the device to unloa
 {
    boost::shared_ptr<DeviceInstance> pDevice = deviceManager_->GetDevice(label);
 
+   // Asynchronous commands may still refer to the device
+   asyncCommands_->Shutdown();
+
    try {
       mm::DeviceModuleLockGuard guard(pDevice);
       LOG_DEBUG(coreLogger_) << "Will unload device " << label;
@@ -801,8 +876,14 @@ void CMMCore::unloadDevice(const char* label///< the name of the device to unloa
  */
 void CMMCore::unloadAllDevices() throw (CMMError)
 {
+   asyncCommands_->Shutdown();
+
    try {
       configGroups_->Clear();
+      {
+         MMThreadGuard g(learnedPresetOrderLock_);
+         learnedPresetOrders_.clear();
+      }
 
       //selected channel group is no longer valid
       //channelGroup_ = "":
@@ -1326,6 +1407,233 @@ void CMMCore::waitForImageSynchro() throw (CMMError)
    }
 }
 
+
+// Commands run by the asynchronous device control functions
+namespace
+{
+   void SetPropertyAndWait(CMMCore* core, const std::string& label,
+         const std::string& propName, const std::string& propValue)
+   {
+      core->setProperty(label.c_str(), propName.c_str(), propValue.c_str());
+      core->waitForDevice(label.c_str());
+   }
+
+   void SetStateAndWait(CMMCore* core, const std::string& label, long state)
+   {
+      core->setState(label.c_str(), state);
+      core->waitForDevice(label.c_str());
+   }
+
+   void SetPositionAndWait(CMMCore* core, const std::string& label,
+         double position)
+   {
+      core->setPosition(label.c_str(), position);
+      core->waitForDevice(label.c_str());
+   }
+
+   void SetXYPositionAndWait(CMMCore* core, const std::string& label,
+         double x, double y)
+   {
+      core->setXYPosition(label.c_str(), x, y);
+      core->waitForDevice(label.c_str());
+   }
+
+   void SetConfigAndWait(CMMCore* core, const std::string& group,
+         const std::string& config)
+   {
+      core->setConfig(group.c_str(), config.c_str());
+      core->waitForConfig(group.c_str(), config.c_str());
+   }
+
+   void SnapImage(CMMCore* core)
+   {
+      core->snapImage();
+   }
+} // anonymous namespace
+
+/**
+ * Starts setting a device property and returns without waiting.
+ * @param label      the device label
+ * @param propName   the property name
+ * @param propValue  the new property value
+ * @return the handle of the command
+ * \see waitForCommand()
+ */
+long CMMCore::setPropertyAsync(const char* label, const char* propName,
+      const char* propValue) throw (CMMError)
+{
+   CheckDeviceLabel(label);
+   CheckPropertyName(propName);
+   CheckPropertyValue(propValue);
+
+   std::string queueName("core");
+   if (!IsCoreDeviceLabel(label))
+      queueName = getAsyncQueueName(deviceManager_->GetDevice(label));
+
+   return asyncCommands_->Submit(queueName, boost::bind(&SetPropertyAndWait,
+            this, std::string(label), std::string(propName),
+            std::string(propValue)));
+}
+
+/**
+ * Starts setting the state of a state device and returns without waiting.
+ * @param stateDeviceLabel  the device label
+ * @param state             the new state
+ * @return the handle of the command
+ * \see waitForCommand()
+ */
+long CMMCore::setStateAsync(const char* stateDeviceLabel, long state)
+   throw (CMMError)
+{
+   boost::shared_ptr<StateInstance> pStateDev =
+      deviceManager_->GetDeviceOfType<StateInstance>(stateDeviceLabel);
+
+   return asyncCommands_->Submit(getAsyncQueueName(pStateDev),
+         boost::bind(&SetStateAndWait, this, std::string(stateDeviceLabel),
+            state));
+}
+
+/**
+ * Starts moving a stage and returns without waiting. The command completes
+ * when the stage has stopped moving.
+ * @param stageLabel  the stage device label
+ * @param position    the desired stage position, in microns
+ * @return the handle of the command
+ * \see waitForCommand()
+ */
+long CMMCore::setPositionAsync(const char* stageLabel, double position)
+   throw (CMMError)
+{
+   boost::shared_ptr<StageInstance> pStage =
+      deviceManager_->GetDeviceOfType<StageInstance>(stageLabel);
+
+   return asyncCommands_->Submit(getAsyncQueueName(pStage),
+         boost::bind(&SetPositionAndWait, this, std::string(stageLabel),
+            position));
+}
+
+/**
+ * Starts moving the current focus stage and returns without waiting.
+ * @param position  the desired stage position, in microns
+ * @return the handle of the command
+ */
+long CMMCore::setPositionAsync(double position) throw (CMMError)
+{
+   return setPositionAsync(getFocusDevice().c_str(), position);
+}
+
+/**
+ * Starts moving an XY stage and returns without waiting. The command
+ * completes when the stage has stopped moving.
+ * @param xyStageLabel  the XY stage device label
+ * @param x             the X axis position in microns
+ * @param y             the Y axis position in microns
+ * @return the handle of the command
+ * \see waitForCommand()
+ */
+long CMMCore::setXYPositionAsync(const char* xyStageLabel, double x, double y)
+   throw (CMMError)
+{
+   boost::shared_ptr<XYStageInstance> pXYStage =
+      deviceManager_->GetDeviceOfType<XYStageInstance>(xyStageLabel);
+
+   return asyncCommands_->Submit(getAsyncQueueName(pXYStage),
+         boost::bind(&SetXYPositionAndWait, this, std::string(xyStageLabel),
+            x, y));
+}
+
+/**
+ * Starts moving the current XY stage and returns without waiting.
+ * @param x  the X axis position in microns
+ * @param y  the Y axis position in microns
+ * @return the handle of the command
+ */
+long CMMCore::setXYPositionAsync(double x, double y) throw (CMMError)
+{
+   return setXYPositionAsync(getXYStageDevice().c_str(), x, y);
+}
+
+/**
+ * Starts applying a configuration preset and returns without waiting. The
+ * command completes when all devices in the preset are ready. Presets of
+ * the same group are applied in the order they were requested.
+ * @param groupName   the configuration group name
+ * @param configName  the configuration preset name
+ * @return the handle of the command
+ * \see waitForCommand()
+ */
+long CMMCore::setConfigAsync(const char* groupName, const char* configName)
+   throw (CMMError)
+{
+   // Fail early if the preset does not exist
+   getConfigData(groupName, configName);
+
+   return asyncCommands_->Submit("config:" + std::string(groupName),
+         boost::bind(&SetConfigAndWait, this, std::string(groupName),
+            std::string(configName)));
+}
+
+/**
+ * Starts snapping an image with the current camera and returns without
+ * waiting. Once the command has completed, the image can be retrieved with
+ * getImage().
+ * @return the handle of the command
+ * \see snapImage()
+ */
+long CMMCore::snapImageAsync() throw (CMMError)
+{
+   boost::shared_ptr<CameraInstance> camera = currentCameraDevice_.lock();
+   if (!camera)
+      throw CMMError(getCoreErrorText(MMERR_CameraNotAvailable).c_str(),
+            MMERR_CameraNotAvailable);
+
+   return asyncCommands_->Submit(getAsyncQueueName(camera),
+         boost::bind(&SnapImage, this));
+}
+
+/**
+ * Returns whether an asynchronous command has completed, without waiting.
+ * @param handle  the handle returned when the command was started
+ */
+bool CMMCore::isCommandDone(long handle) throw (CMMError)
+{
+   return asyncCommands_->IsDone(handle);
+}
+
+/**
+ * Waits (blocks the calling thread) until an asynchronous command has
+ * completed, and releases its handle. If the command failed, its error is
+ * thrown.
+ * @param handle  the handle returned when the command was started
+ */
+void CMMCore::waitForCommand(long handle) throw (CMMError)
+{
+   asyncCommands_->Wait(handle);
+}
+
+/**
+ * Waits (blocks the calling thread) until all the given asynchronous
+ * commands have completed, and releases their handles. If any command
+ * failed, the error of the first failed one is thrown.
+ * @param handles  the handles returned when the commands were started
+ */
+void CMMCore::waitForAll(const std::vector<long>& handles) throw (CMMError)
+{
+   asyncCommands_->WaitAll(handles);
+}
+
+/**
+ * Returns the name of the asynchronous command queue for a device. Devices
+ * that cannot be called concurrently share a queue.
+ */
+std::string CMMCore::getAsyncQueueName(boost::shared_ptr<DeviceInstance> pDev)
+{
+   boost::shared_ptr<LoadedDeviceAdapter> module = pDev->GetAdapterModule();
+   if (module->GetThreadSafety() == MM::ThreadSafetyModule)
+      return "module:" + module->GetName();
+   return "device:" + pDev->GetLabel();
+}
+
 /**
  * Sets the position of the stage in microns.
  * @param label     the stage device label
@@ -2430,6 +2738,241 @@ void CMMCore::snapImage() throw (CMMError)
    }
 }
 
+/**
+ * Acquires a burst of images with the current settings into the circular
+ * buffer, which is cleared first, and returns when all of them are there.
+ * The images are then read with popNextImage() and related functions, with
+ * the same metadata as in sequence acquisition.
+ *
+ * This is faster than calling snapImage() and getImage() repeatedly: with
+ * auto-shutter, the shutter stays open for the whole burst instead of being
+ * opened and closed for each image. Cameras that support sequence
+ * acquisition acquire the burst as a sequence, reading out each image while
+ * exposing the next one; other cameras snap the images one after another.
+ *
+ * @param numImages  number of images; must fit in the circular buffer
+ * @param intervalMs  minimum time between the starts of successive
+ *                    exposures, 0 for as fast as possible. As in
+ *                    startSequenceAcquisition(), not all cameras support it
+ *                    in sequence mode.
+ */
+void CMMCore::snapImages(long numImages, double intervalMs) throw (CMMError)
+{
+   boost::shared_ptr<CameraInstance> camera = currentCameraDevice_.lock();
+   if (!camera)
+      throw CMMError(getCoreErrorText(MMERR_CameraNotAvailable).c_str(), MMERR_CameraNotAvailable);
+   if (numImages < 1)
+      throw CMMError("Invalid number of images for a burst: " +
+            ToString(numImages), MMERR_InvalidContents);
+   if (camera->IsCapturing())
+      throw CMMError(getCoreErrorText(MMERR_NotAllowedDuringSequenceAcquisition).c_str(),
+            MMERR_NotAllowedDuringSequenceAcquisition);
+
+   {
+      MMThreadGuard g(*pPostedErrorsLock_);
+      postedErrors_.clear();
+   }
+
+   double exposureMs;
+   {
+      mm::DeviceModuleLockGuard guard(camera);
+      if (!cbuf_->Initialize(camera->GetNumberOfChannels(), camera->GetImageWidth(), camera->GetImageHeight(), camera->GetImageBytesPerPixel()))
+      {
+         logError(getDeviceName(camera).c_str(), getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str());
+         throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(), MMERR_CircularBufferFailedToInitialize);
+      }
+      exposureMs = camera->GetExposure();
+   }
+   if ((unsigned long)numImages > cbuf_->GetSize())
+      throw CMMError("Burst of " + ToString(numImages) + " images does not "
+            "fit in the circular buffer (" + ToString(cbuf_->GetSize()) +
+            " images)", MMERR_InvalidContents);
+   cbuf_->Clear();
+
+   // wait for all synchronized devices to stop before taking the images
+   waitForImageSynchro();
+
+   boost::shared_ptr<ShutterInstance> shutter;
+   if (autoShutter_)
+      shutter = currentShutterDevice_.lock();
+   if (shutter)
+      setAutoShutterOpen(shutter, true);
+
+   try
+   {
+      int ret;
+      {
+         mm::DeviceModuleLockGuard guard(camera);
+         LOG_DEBUG(coreLogger_) << "Will snap burst of " << numImages <<
+            " images from current camera";
+         ret = camera->StartSequenceAcquisition(numImages, intervalMs, true);
+      }
+
+      if (ret == DEVICE_OK)
+      {
+         waitForBurstSequence(camera, numImages, std::max(exposureMs, intervalMs));
+      }
+      else if (ret == DEVICE_UNSUPPORTED_COMMAND || ret == DEVICE_NOT_SUPPORTED)
+      {
+         LOG_DEBUG(coreLogger_) << "Current camera does not support "
+            "sequence acquisition; snapping images one by one";
+         snapBurstImages(camera, numImages, intervalMs);
+      }
+      else
+      {
+         logError("CMMCore::snapImages", getDeviceErrorText(ret, camera).c_str());
+         throw CMMError(getDeviceErrorText(ret, camera).c_str(), MMERR_DEVICE_GENERIC);
+      }
+   }
+   catch (...)
+   {
+      // Also close the shutter on errors other than CMMError, such as
+      // std::bad_alloc
+      if (shutter)
+      {
+         try
+         {
+            setAutoShutterOpen(shutter, false);
+         }
+         catch (...)
+         {
+            // Report the original error
+         }
+      }
+      throw;
+   }
+
+   if (shutter)
+      setAutoShutterOpen(shutter, false);
+
+   long count = cbuf_->GetRemainingImageCount();
+   if (count < numImages)
+   {
+      std::string msg = "Burst ended after " + ToString(count) + " of " +
+         ToString(numImages) + " images";
+      if (cbuf_->Overflow())
+         msg += " (circular buffer overflowed)";
+      logError("CMMCore::snapImages", msg.c_str());
+      throw CMMError(msg);
+   }
+   LOG_DEBUG(coreLogger_) << "Did snap burst of " << numImages <<
+      " images from current camera";
+}
+
+void CMMCore::setAutoShutterOpen(boost::shared_ptr<ShutterInstance> shutter,
+      bool open) throw (CMMError)
+{
+   int ret;
+   {
+      mm::DeviceModuleLockGuard guard(shutter);
+      ret = shutter->SetOpen(open);
+   }
+   if (ret != DEVICE_OK)
+   {
+      logError("CMMCore::snapImages", getDeviceErrorText(ret, shutter).c_str());
+      throw CMMError(getDeviceErrorText(ret, shutter).c_str(), MMERR_DEVICE_GENERIC);
+   }
+   waitForDevice(shutter);
+}
+
+// Waits for a burst acquired as a sequence to end. Gives up if no image
+// arrives for the time of a frame plus the device timeout.
+void CMMCore::waitForBurstSequence(boost::shared_ptr<CameraInstance> camera,
+      long numImages, double frameTimeMs) throw (CMMError)
+{
+   long count = 0;
+   MM::MMTime lastProgress = GetMMTimeNow();
+   const MM::MMTime patience(1000.0 * (frameTimeMs + timeoutMs_));
+   while (true)
+   {
+      {
+         mm::DeviceModuleLockGuard guard(camera);
+         if (!camera->IsCapturing())
+            break;
+      }
+
+      long newCount = cbuf_->GetRemainingImageCount();
+      if (newCount != count)
+      {
+         count = newCount;
+         lastProgress = GetMMTimeNow();
+      }
+      else if (lastProgress + patience < GetMMTimeNow())
+      {
+         {
+            mm::DeviceModuleLockGuard guard(camera);
+            camera->StopSequenceAcquisition();
+         }
+         std::string msg = "Burst timed out after " + ToString(count) +
+            " of " + ToString(numImages) + " images";
+         logError("CMMCore::snapImages", msg.c_str());
+         throw CMMError(msg, MMERR_DevicePollingTimeout);
+      }
+
+      sleep(1.0);
+   }
+}
+
+// Acquires a burst with SnapImage(), for cameras without sequence
+// acquisition, inserting the images as the camera would
+void CMMCore::snapBurstImages(boost::shared_ptr<CameraInstance> camera,
+      long numImages, double intervalMs) throw (CMMError)
+{
+   std::vector<unsigned char> channels;
+   const MM::MMTime start = GetMMTimeNow();
+   for (long i = 0; i < numImages; ++i)
+   {
+      if (intervalMs > 0.0 && i > 0)
+      {
+         double elapsedMs = (GetMMTimeNow() - start).getMsec();
+         if (elapsedMs < i * intervalMs)
+            sleep(i * intervalMs - elapsedMs);
+      }
+
+      mm::DeviceModuleLockGuard guard(camera);
+      int ret = camera->SnapImage();
+      if (ret != DEVICE_OK)
+      {
+         logError("CMMCore::snapImages", getDeviceErrorText(ret, camera).c_str());
+         throw CMMError(getDeviceErrorText(ret, camera).c_str(), MMERR_DEVICE_GENERIC);
+      }
+      everSnapped_ = true;
+
+      unsigned width = camera->GetImageWidth();
+      unsigned height = camera->GetImageHeight();
+      unsigned byteDepth = camera->GetImageBytesPerPixel();
+      unsigned numChannels = camera->GetNumberOfChannels();
+      Metadata md;
+      if (numChannels == 1)
+      {
+         const unsigned char* pixels = camera->GetImageBuffer();
+         if (!pixels)
+            throw CMMError(getCoreErrorText(MMERR_CameraBufferReadFailed).c_str(), MMERR_CameraBufferReadFailed);
+         ret = callback_->InsertImage(camera->GetRawPtr(), pixels, width,
+               height, byteDepth, camera->GetNumberOfComponents(),
+               md.Serialize().c_str());
+      }
+      else
+      {
+         const size_t channelBytes = (size_t)width * height * byteDepth;
+         channels.resize(channelBytes * numChannels);
+         for (unsigned c = 0; c < numChannels; ++c)
+         {
+            const unsigned char* pixels = camera->GetImageBuffer(c);
+            if (!pixels)
+               throw CMMError(getCoreErrorText(MMERR_CameraBufferReadFailed).c_str(), MMERR_CameraBufferReadFailed);
+            std::memcpy(&channels[c * channelBytes], pixels, channelBytes);
+         }
+         ret = callback_->InsertMultiChannel(camera->GetRawPtr(),
+               &channels[0], numChannels, width, height, byteDepth, &md);
+      }
+      if (ret == DEVICE_BUFFER_OVERFLOW)
+         break; // Reported by snapImages()
+      if (ret != DEVICE_OK)
+         throw CMMError("Incompatible image dimensions in the circular buffer", MMERR_CircularBufferIncompatibleImage);
+   }
+}
+
 
 // Predicate used by assignImageSynchro() and removeImageSynchro()
 namespace
@@ -3075,14 +3618,127 @@ void* CMMCore::popNextImageMD(Metadata& md) throw (CMMError)
 }
 
 /**
- * Removes all images from the circular buffer.
+ * Gets the last image from the circular buffer and pins it: its pixels stay
+ * valid, and are not overwritten, until unpinImage() is called with them.
+ * This lets the language wrappers hand out images without copying them.
+ * Every pinned image must be unpinned exactly once.
  *
- * It is rarely necessary to call this directly since starting a sequence
- * acquisition or changing the ROI will always clear the buffer.
+ * The size and pixel depth are those of the returned image, which may
+ * differ from the current camera settings.
  */
-void CMMCore::clearCircularBuffer() throw (CMMError)
+void* CMMCore::getLastImagePinned(unsigned& width, unsigned& height,
+      unsigned& bytesPerPixel) throw (CMMError)
 {
-   cbuf_->Clear();
+   const mm::ImgBuffer* pBuf = cbuf_->GetTopImageBufferPinned(0);
+   if (pBuf != 0)
+   {
+      width = pBuf->Width();
+      height = pBuf->Height();
+      bytesPerPixel = pBuf->Depth();
+      return const_cast<unsigned char*>(pBuf->GetPixels());
+   }
+   else
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+}
+
+/**
+ * Gets and removes the next image from the circular buffer, and pins it.
+ * See getLastImagePinned().
+ */
+void* CMMCore::popNextImagePinned(unsigned& width, unsigned& height,
+      unsigned& bytesPerPixel) throw (CMMError)
+{
+   const mm::ImgBuffer* pBuf = cbuf_->GetNextImageBufferPinned(0);
+   if (pBuf != 0)
+   {
+      width = pBuf->Width();
+      height = pBuf->Height();
+      bytesPerPixel = pBuf->Depth();
+      return const_cast<unsigned char*>(pBuf->GetPixels());
+   }
+   else
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+}
+
+/**
+ * Gets the last image (and metadata) of the given camera channel from the
+ * circular buffer, and pins it. See getLastImagePinned().
+ */
+void* CMMCore::getLastImagePinnedMD(unsigned channel, Metadata& md,
+      unsigned& width, unsigned& height, unsigned& bytesPerPixel)
+   throw (CMMError)
+{
+   const mm::ImgBuffer* pBuf = cbuf_->GetTopImageBufferPinned(channel);
+   if (pBuf != 0)
+   {
+      md = pBuf->GetMetadata();
+      width = pBuf->Width();
+      height = pBuf->Height();
+      bytesPerPixel = pBuf->Depth();
+      return const_cast<unsigned char*>(pBuf->GetPixels());
+   }
+   else
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+}
+
+/**
+ * Gets and removes the next image (and metadata) of the given camera channel
+ * from the circular buffer, and pins it. See getLastImagePinned().
+ */
+void* CMMCore::popNextImagePinnedMD(unsigned channel, Metadata& md,
+      unsigned& width, unsigned& height, unsigned& bytesPerPixel)
+   throw (CMMError)
+{
+   const mm::ImgBuffer* pBuf = cbuf_->GetNextImageBufferPinned(channel);
+   if (pBuf != 0)
+   {
+      md = pBuf->GetMetadata();
+      width = pBuf->Width();
+      height = pBuf->Height();
+      bytesPerPixel = pBuf->Depth();
+      return const_cast<unsigned char*>(pBuf->GetPixels());
+   }
+   else
+      throw CMMError(getCoreErrorText(MMERR_CircularBufferEmpty).c_str(), MMERR_CircularBufferEmpty);
+}
+
+/**
+ * Gets and removes the next image (and metadata) from the circular buffer,
+ * and pins it. See getLastImagePinned().
+ */
+void* CMMCore::popNextImagePinnedMD(Metadata& md, unsigned& width,
+      unsigned& height, unsigned& bytesPerPixel) throw (CMMError)
+{
+   return popNextImagePinnedMD(0, md, width, height, bytesPerPixel);
+}
+
+/**
+ * Releases an image pinned by getLastImagePinned(), popNextImagePinned() or
+ * popNextImagePinnedMD(). The pixels must not be accessed afterwards.
+ */
+void CMMCore::unpinImage(const void* pixels) throw (CMMError)
+{
+   if (!cbuf_->UnpinImage(static_cast<const unsigned char*>(pixels)))
+      throw CMMError("Image is not pinned");
+}
+
+/**
+ * Returns the number of images that are pinned in the circular buffer.
+ */
+long CMMCore::getPinnedImageCount()
+{
+   return cbuf_->GetPinnedImageCount();
+}
+
+/**
+ * Removes all images from the circular buffer.
+ *
+ * It is rarely necessary to call this directly since starting a sequence
+ * acquisition or changing the ROI will always clear the buffer.
+ */
+void CMMCore::clearCircularBuffer() throw (CMMError)
+{
+   cbuf_->Clear();
 }
 
 /**
@@ -3091,7 +3747,7 @@ void CMMCore::clearCircularBuffer() throw (CMMError)
 void CMMCore::setCircularBufferMemoryFootprint(unsigned sizeMB ///< n megabytes
                                                ) throw (CMMError)
 {
-   delete cbuf_; // discard old buffer
+   CircularBuffer* oldBuffer = cbuf_;
    LOG_DEBUG(coreLogger_) << "Will set circular buffer size to " <<
       sizeMB << " MB";
 	try
@@ -3107,30 +3763,571 @@ void CMMCore::setCircularBufferMemoryFootprint(unsigned sizeMB ///< n megabytes
 	}
 	if (NULL == cbuf_) throw CMMError(getCoreErrorText(MMERR_OutOfMemory).c_str(), MMERR_OutOfMemory);
 
+   // discard old buffer; images pinned in it stay valid
+   cbuf_->TakePinnedImages(*oldBuffer);
+   cbuf_->SetFrameExport(oldBuffer->GetFrameExport());
+   cbuf_->SetImageStatistics(oldBuffer->GetImageStatistics());
+   cbuf_->SetPreview(oldBuffer->GetPreview());
+   cbuf_->SetCompressed(oldBuffer->IsCompressed());
+   cbuf_->SetSoftwareROIBinning(oldBuffer->GetSoftwareROIBinning());
+   delete oldBuffer;
+
 
 	try
 	{
 
-		// attempt to initialize based on the current camera settings
+		// attempt to initialize based on the current camera settings
+      boost::shared_ptr<CameraInstance> camera = currentCameraDevice_.lock();
+      if (camera)
+		{
+         mm::DeviceModuleLockGuard guard(camera);
+         if (!cbuf_->Initialize(camera->GetNumberOfChannels(), camera->GetImageWidth(), camera->GetImageHeight(), camera->GetImageBytesPerPixel()))
+				throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(), MMERR_CircularBufferFailedToInitialize);
+		}
+
+      LOG_DEBUG(coreLogger_) << "Did set circular buffer size to " <<
+         sizeMB << " MB";
+	}
+	catch(bad_alloc& ex)
+	{
+		ostringstream messs;
+		messs << getCoreErrorText(MMERR_OutOfMemory).c_str() << " " << ex.what() << endl;
+		throw CMMError(messs.str().c_str() , MMERR_OutOfMemory);
+	}
+	if (NULL == cbuf_)
+      throw CMMError(getCoreErrorText(MMERR_OutOfMemory).c_str(), MMERR_OutOfMemory);
+}
+
+/**
+ * Starts exporting the images inserted into the circular buffer to a named
+ * shared-memory segment, so that other processes on the same computer can
+ * read them (see SharedFrameRingReader.h). The segment holds the last
+ * slotCount images with their metadata. Images larger than the current
+ * camera image (e.g. after changing the ROI) are not exported.
+ *
+ * Only supported on POSIX systems (Linux and OS X).
+ *
+ * @param name  name of the shared-memory segment
+ * @param slotCount  number of images kept in the segment
+ */
+void CMMCore::startSharedFrameExport(const char* name, unsigned slotCount) throw (CMMError)
+{
+   if (!name)
+      throw CMMError("Null shared memory name", MMERR_NullPointerException);
+
+   size_t pixelCapacity = (size_t) cbuf_->Width() * cbuf_->Height() * cbuf_->Depth();
+   boost::shared_ptr<CameraInstance> camera = currentCameraDevice_.lock();
+   if (camera)
+   {
+      mm::DeviceModuleLockGuard guard(camera);
+      pixelCapacity = std::max(pixelCapacity, (size_t) camera->GetImageWidth() *
+            camera->GetImageHeight() * camera->GetImageBytesPerPixel());
+   }
+   if (pixelCapacity == 0)
+      throw CMMError(getCoreErrorText(MMERR_CameraNotAvailable).c_str(), MMERR_CameraNotAvailable);
+
+   // Stop the current export first, in case it has the same name
+   cbuf_->SetFrameExport(boost::shared_ptr<mm::SharedFrameRing>());
+
+   const size_t metadataCapacity = 64 * 1024;
+   boost::shared_ptr<mm::SharedFrameRing> ring(
+         new mm::SharedFrameRing(name, slotCount, pixelCapacity, metadataCapacity));
+   cbuf_->SetFrameExport(ring);
+
+   LOG_INFO(coreLogger_) << "Exporting images to shared memory " <<
+      ring->GetName() << " (" << slotCount << " slots of " << pixelCapacity <<
+      " bytes)";
+}
+
+/**
+ * Stops exporting images to shared memory and removes the segment. Readers
+ * that have the segment open can still read the images in it.
+ */
+void CMMCore::stopSharedFrameExport()
+{
+   if (cbuf_->GetFrameExport())
+   {
+      cbuf_->SetFrameExport(boost::shared_ptr<mm::SharedFrameRing>());
+      LOG_INFO(coreLogger_) << "Stopped exporting images to shared memory";
+   }
+}
+
+/**
+ * Returns the name of the shared-memory segment that images are exported
+ * to, or an empty string if they are not exported.
+ */
+std::string CMMCore::getSharedFrameExportName()
+{
+   boost::shared_ptr<mm::SharedFrameRing> ring = cbuf_->GetFrameExport();
+   return ring ? ring->GetName() : std::string();
+}
+
+/**
+ * Enables or disables the computation of image statistics. While enabled,
+ * each image inserted into the circular buffer gets a histogram, the
+ * minimum, maximum and mean pixel value and the number of saturated pixels
+ * (at the camera bit depth), before it becomes available to readers.
+ *
+ * The statistics are added to the image metadata as Statistics-Min,
+ * Statistics-Max, Statistics-Mean and Statistics-SaturatedPixels, and, for
+ * up to 1024 bins, Statistics-BinWidth and Statistics-Histogram (the bin
+ * counts, separated by commas). The statistics of the last image are also
+ * available from getLastImageStatistics().
+ *
+ * Large images are computed by worker threads while the inserting thread
+ * copies them into the buffer.
+ * Snapped images are not inserted and get no statistics.
+ *
+ * @param enable  whether to compute statistics
+ * @param binCount  number of histogram bins: 256, 1024 or 65536
+ */
+void CMMCore::enableImageStatistics(bool enable, unsigned binCount) throw (CMMError)
+{
+   if (!enable)
+   {
+      if (cbuf_->GetImageStatistics())
+      {
+         cbuf_->SetImageStatistics(boost::shared_ptr<mm::ImageStatisticsCalculator>());
+         LOG_INFO(coreLogger_) << "Disabled image statistics";
+      }
+      return;
+   }
+
+   if (!mm::ImageStatisticsCalculator::IsSupportedBinCount(binCount))
+      throw CMMError("Unsupported number of histogram bins: " +
+            ToString(binCount) + " (must be 256, 1024 or 65536)",
+            MMERR_InvalidContents);
+
+   boost::shared_ptr<mm::ImageStatisticsCalculator> calculator =
+      cbuf_->GetImageStatistics();
+   if (calculator && calculator->GetBinCount() == binCount)
+      return;
+
+   cbuf_->SetImageStatistics(boost::shared_ptr<mm::ImageStatisticsCalculator>(
+            new mm::ImageStatisticsCalculator(binCount)));
+   LOG_INFO(coreLogger_) << "Enabled image statistics with " << binCount <<
+      " histogram bins";
+}
+
+/**
+ * Returns true if image statistics are computed for inserted images.
+ */
+bool CMMCore::isImageStatisticsEnabled()
+{
+   return cbuf_->GetImageStatistics().get() != 0;
+}
+
+/**
+ * Returns the statistics of the image that was last inserted into the
+ * circular buffer. See enableImageStatistics().
+ *
+ * @throws CMMError if statistics are disabled or no image has been
+ * inserted since they were enabled
+ */
+ImageStatistics CMMCore::getLastImageStatistics() throw (CMMError)
+{
+   boost::shared_ptr<mm::ImageStatisticsCalculator> calculator =
+      cbuf_->GetImageStatistics();
+   ImageStatistics stats;
+   if (!calculator || !calculator->GetLastStatistics(stats))
+      throw CMMError("No image statistics available", MMERR_CircularBufferEmpty);
+   return stats;
+}
+
+/**
+ * Enables or disables lossless compression of the images in the circular
+ * buffer. While enabled, images are compressed as they are inserted and
+ * decompressed when they are read, so that the memory footprint holds more
+ * of them: sparse or dim images typically take a half to a quarter of their
+ * size. Large images are compressed in blocks, shared with worker threads.
+ *
+ * The capacity of the buffer then depends on the actual size of the
+ * compressed images; getBufferTotalCapacity() and getBufferFreeCapacity()
+ * estimate it from the images in the buffer.
+ *
+ * Changing the setting discards the images in the buffer, so it is not
+ * allowed during sequence acquisition.
+ *
+ * @param enable  whether to compress images
+ */
+void CMMCore::enableCircularBufferCompression(bool enable) throw (CMMError)
+{
+   if (enable == cbuf_->IsCompressed())
+      return;
+
+   checkCircularBufferReconfigurable();
+   cbuf_->SetCompressed(enable);
+   LOG_INFO(coreLogger_) << (enable ? "Enabled" : "Disabled") <<
+      " circular buffer compression";
+   reinitializeCircularBuffer();
+}
+
+/**
+ * Returns true if the images in the circular buffer are compressed. See
+ * enableCircularBufferCompression().
+ */
+bool CMMCore::isCircularBufferCompressionEnabled()
+{
+   return cbuf_->IsCompressed();
+}
+
+/**
+ * Sets a region of interest that is cropped from the images of sequence
+ * acquisitions in software, before they are stored in the circular buffer.
+ * Meant for cameras that cannot crop in hardware (or only in coarse steps);
+ * it is applied after the camera ROI, in the pixels of the camera image,
+ * and is clipped to the image.
+ *
+ * The images in the buffer then have the size of the ROI (divided by the
+ * software binning), which may differ from getImageWidth() and
+ * getImageHeight(); getBufferedImageWidth(), getBufferedImageHeight() and
+ * the Width and Height metadata tags of the images give the actual size.
+ * The region used is recorded in the SoftwareROI-X-start,
+ * SoftwareROI-Y-start, SoftwareROI-Width and SoftwareROI-Height tags.
+ * Snapped images are not cropped.
+ *
+ * Changing the software ROI discards the images in the buffer, so it is not
+ * allowed during sequence acquisition.
+ */
+void CMMCore::setSoftwareROI(int x, int y, int xSize, int ySize) throw (CMMError)
+{
+   if (x < 0 || y < 0 || xSize <= 0 || ySize <= 0)
+      throw CMMError("Invalid software ROI: " + ToString(x) + ", " +
+            ToString(y) + ", " + ToString(xSize) + ", " + ToString(ySize),
+            MMERR_InvalidContents);
+
+   setSoftwareROIBinning(x, y, xSize, ySize, getSoftwareBinning(),
+         isSoftwareBinningAveraging());
+}
+
+/**
+ * Returns the software ROI (see setSoftwareROI()); the sizes are 0 if none
+ * is set.
+ */
+void CMMCore::getSoftwareROI(int& x, int& y, int& xSize, int& ySize)
+{
+   boost::shared_ptr<const mm::SoftwareROIBinning> roiBinning =
+      cbuf_->GetSoftwareROIBinning();
+   x = y = xSize = ySize = 0;
+   if (roiBinning)
+   {
+      x = roiBinning->GetX();
+      y = roiBinning->GetY();
+      xSize = roiBinning->GetWidth();
+      ySize = roiBinning->GetHeight();
+   }
+}
+
+/**
+ * Removes the software ROI, so that the whole camera image is stored (but
+ * still binned if software binning is set).
+ */
+void CMMCore::clearSoftwareROI() throw (CMMError)
+{
+   setSoftwareROIBinning(0, 0, 0, 0, getSoftwareBinning(),
+         isSoftwareBinningAveraging());
+}
+
+/**
+ * Sets a binning that is applied to the images of sequence acquisitions in
+ * software, after the software ROI and before they are stored in the
+ * circular buffer. Blocks of 2x2, 4x4 or 8x8 pixels are summed (and clipped
+ * to the range of the pixel type) or averaged, per component for RGB images;
+ * 32-bit grayscale images cannot be binned. A binning of 1 turns software
+ * binning off.
+ *
+ * The binning is recorded in the SoftwareBinning and SoftwareBinning-Mode
+ * (Sum or Mean) metadata tags. See setSoftwareROI() for the image size and
+ * for when the setting can be changed.
+ *
+ * @param binning  1, 2, 4 or 8
+ * @param average  whether to average instead of summing the pixels
+ */
+void CMMCore::setSoftwareBinning(unsigned binning, bool average) throw (CMMError)
+{
+   if (!mm::SoftwareROIBinning::IsSupportedBinning(binning))
+      throw CMMError("Unsupported software binning: " + ToString(binning) +
+            " (must be 1, 2, 4 or 8)", MMERR_InvalidContents);
+
+   int x, y, xSize, ySize;
+   getSoftwareROI(x, y, xSize, ySize);
+   setSoftwareROIBinning(x, y, xSize, ySize, binning, average);
+}
+
+/**
+ * Returns the software binning (see setSoftwareBinning()), 1 if none.
+ */
+unsigned CMMCore::getSoftwareBinning()
+{
+   boost::shared_ptr<const mm::SoftwareROIBinning> roiBinning =
+      cbuf_->GetSoftwareROIBinning();
+   return roiBinning ? roiBinning->GetBinning() : 1;
+}
+
+/**
+ * Returns true if software binning averages the binned pixels instead of
+ * summing them.
+ */
+bool CMMCore::isSoftwareBinningAveraging()
+{
+   boost::shared_ptr<const mm::SoftwareROIBinning> roiBinning =
+      cbuf_->GetSoftwareROIBinning();
+   return roiBinning && roiBinning->IsAveraging();
+}
+
+/**
+ * Horizontal dimension in pixels of the images in the circular buffer, as
+ * returned by getLastImage(), popNextImage() and their variants. Differs
+ * from getImageWidth() when a software ROI or binning is set.
+ */
+unsigned CMMCore::getBufferedImageWidth()
+{
+   return cbuf_->Width();
+}
+
+/**
+ * Vertical dimension in pixels of the images in the circular buffer. See
+ * getBufferedImageWidth().
+ */
+unsigned CMMCore::getBufferedImageHeight()
+{
+   return cbuf_->Height();
+}
+
+/**
+ * Size in bytes of each image (each channel) in the circular buffer. See
+ * getBufferedImageWidth().
+ */
+long CMMCore::getBufferedImageBufferSize()
+{
+   return (long)cbuf_->Width() * cbuf_->Height() * cbuf_->Depth();
+}
+
+/**
+ * Enables or disables preview images: reduced copies of the images
+ * inserted into the circular buffer, made at a limited rate, for display
+ * while a fast sequence acquisition runs. Images that arrive sooner than
+ * 1 / maxRate after the last preview are skipped. Each preview is
+ * downsampled by averaging blocks of pixels (per component for RGB images)
+ * and, if a range is set with setPreviewImage8BitRange(), converted to
+ * 8 bits. For multi-channel cameras, the first channel is used.
+ *
+ * The last preview is returned by getLastPreviewImage(). Previews do not
+ * take images from the circular buffer, and are made after any software
+ * ROI and binning.
+ *
+ * @param enable  whether to make preview images
+ * @param maxRate  maximum number of previews per second; 0 for all images
+ * @param downsampling  1, 2, 4 or 8
+ */
+void CMMCore::enablePreviewImages(bool enable, double maxRate,
+      unsigned downsampling) throw (CMMError)
+{
+   if (!enable)
+   {
+      if (cbuf_->GetPreview())
+      {
+         cbuf_->SetPreview(boost::shared_ptr<mm::PreviewGenerator>());
+         LOG_INFO(coreLogger_) << "Disabled preview images";
+      }
+      return;
+   }
+
+   if (!mm::PreviewGenerator::IsSupportedDownsampling(downsampling))
+      throw CMMError("Unsupported preview downsampling: " +
+            ToString(downsampling) + " (must be 1, 2, 4 or 8)",
+            MMERR_InvalidContents);
+
+   boost::shared_ptr<mm::PreviewGenerator> preview = cbuf_->GetPreview();
+   if (preview)
+   {
+      preview->SetMaxRate(maxRate);
+      preview->SetDownsampling(downsampling);
+   }
+   else
+   {
+      cbuf_->SetPreview(boost::shared_ptr<mm::PreviewGenerator>(
+               new mm::PreviewGenerator(maxRate, downsampling)));
+   }
+   LOG_INFO(coreLogger_) << "Enabled preview images at up to " << maxRate <<
+      " per second, downsampled by " << downsampling;
+}
+
+/**
+ * Returns true if preview images are made. See enablePreviewImages().
+ */
+bool CMMCore::isPreviewImagesEnabled()
+{
+   return cbuf_->GetPreview().get() != 0;
+}
+
+/**
+ * Converts preview images with 16-bit samples (GRAY16 and RGB64) to 8 bits,
+ * mapping min (and below) to 0 and max (and above) to 255. Other images
+ * are not converted. The range can be changed while images are acquired,
+ * for example to follow the display contrast.
+ *
+ * @throws CMMError if preview images are not enabled or min is not less
+ * than max
+ */
+void CMMCore::setPreviewImage8BitRange(unsigned min, unsigned max) throw (CMMError)
+{
+   boost::shared_ptr<mm::PreviewGenerator> preview = cbuf_->GetPreview();
+   if (!preview)
+      throw CMMError("Preview images are not enabled", MMERR_InvalidContents);
+   if (min >= max || max > 65535)
+      throw CMMError("Invalid preview 8-bit range: " + ToString(min) +
+            " to " + ToString(max), MMERR_InvalidContents);
+   preview->Set8BitRange(min, max);
+}
+
+/**
+ * Stops the conversion of preview images to 8 bits. See
+ * setPreviewImage8BitRange().
+ */
+void CMMCore::clearPreviewImage8BitRange()
+{
+   boost::shared_ptr<mm::PreviewGenerator> preview = cbuf_->GetPreview();
+   if (preview)
+      preview->Clear8BitRange();
+}
+
+/**
+ * Returns the pixels of the last preview image (see enablePreviewImages()).
+ * Its size and pixel type differ from those of the camera images; they are
+ * returned by getPreviewImageWidth(), getPreviewImageHeight(),
+ * getPreviewImageBytesPerPixel() and getPreviewImageNumberOfComponents()
+ * until the next call. The pixels stay valid until then too.
+ *
+ * @throws CMMError if no preview image has been made since preview images
+ * were enabled
+ */
+void* CMMCore::getLastPreviewImage() throw (CMMError)
+{
+   Metadata md;
+   return getLastPreviewImageMD(md);
+}
+
+/**
+ * Returns the pixels and the metadata of the last preview image. The
+ * metadata is that of the image in the circular buffer, with the Width,
+ * Height, PixelType (and, if converted, BitDepth) of the preview and a
+ * PreviewDownsampling tag. See getLastPreviewImage().
+ */
+void* CMMCore::getLastPreviewImageMD(Metadata& md) throw (CMMError)
+{
+   boost::shared_ptr<mm::PreviewGenerator> preview = cbuf_->GetPreview();
+   boost::shared_ptr<const mm::PreviewImage> image;
+   if (preview)
+      image = preview->GetLastPreview();
+   if (!image)
+      throw CMMError("No preview image available", MMERR_CircularBufferEmpty);
+
+   lastPreview_ = image;
+   md = image->metadata;
+   return const_cast<unsigned char*>(&image->pixels[0]);
+}
+
+/**
+ * Width of the preview image last returned by getLastPreviewImage(), 0 if
+ * none.
+ */
+unsigned CMMCore::getPreviewImageWidth()
+{
+   return lastPreview_ ? lastPreview_->width : 0;
+}
+
+/**
+ * Height of the preview image last returned by getLastPreviewImage(), 0 if
+ * none.
+ */
+unsigned CMMCore::getPreviewImageHeight()
+{
+   return lastPreview_ ? lastPreview_->height : 0;
+}
+
+/**
+ * Bytes per pixel of the preview image last returned by
+ * getLastPreviewImage(), 0 if none.
+ */
+unsigned CMMCore::getPreviewImageBytesPerPixel()
+{
+   return lastPreview_ ? lastPreview_->byteDepth : 0;
+}
+
+/**
+ * Number of components of the preview image last returned by
+ * getLastPreviewImage() (4 for RGB images, 1 otherwise), 0 if none.
+ */
+unsigned CMMCore::getPreviewImageNumberOfComponents()
+{
+   return lastPreview_ ? lastPreview_->nComponents : 0;
+}
+
+void CMMCore::setSoftwareROIBinning(unsigned x, unsigned y, unsigned xSize,
+      unsigned ySize, unsigned binning, bool average) throw (CMMError)
+{
+   checkCircularBufferReconfigurable();
+
+   boost::shared_ptr<const mm::SoftwareROIBinning> roiBinning;
+   if ((xSize > 0 && ySize > 0) || binning > 1)
+      roiBinning.reset(new mm::SoftwareROIBinning(x, y, xSize, ySize, binning, average));
+
+   boost::shared_ptr<CameraInstance> camera = currentCameraDevice_.lock();
+   if (roiBinning && camera)
+   {
+      mm::DeviceModuleLockGuard guard(camera);
+      unsigned outWidth, outHeight;
+      if (!roiBinning->GetOutputSize(camera->GetImageWidth(), camera->GetImageHeight(), outWidth, outHeight))
+         throw CMMError("Software ROI is outside the camera image", MMERR_InvalidContents);
+   }
+
+   cbuf_->SetSoftwareROIBinning(roiBinning);
+
+   if (roiBinning)
+      LOG_INFO(coreLogger_) << "Set software ROI to " << x << ", " << y <<
+         ", " << xSize << ", " << ySize << " and software binning to " <<
+         binning << (average ? " (mean)" : " (sum)");
+   else
+      LOG_INFO(coreLogger_) << "Cleared software ROI and binning";
+
+   reinitializeCircularBuffer();
+}
+
+// Changes that discard the images in the circular buffer are not allowed
+// during sequence acquisition
+void CMMCore::checkCircularBufferReconfigurable() throw (CMMError)
+{
+   boost::shared_ptr<CameraInstance> camera = currentCameraDevice_.lock();
+   if (camera)
+   {
+      mm::DeviceModuleLockGuard guard(camera);
+      if (camera->IsCapturing())
+         throw CMMError(getCoreErrorText(MMERR_NotAllowedDuringSequenceAcquisition).c_str(),
+               MMERR_NotAllowedDuringSequenceAcquisition);
+   }
+}
+
+// Initializes the circular buffer for the current camera, if any, after its
+// settings have changed
+void CMMCore::reinitializeCircularBuffer() throw (CMMError)
+{
+   try
+   {
       boost::shared_ptr<CameraInstance> camera = currentCameraDevice_.lock();
       if (camera)
-		{
+      {
          mm::DeviceModuleLockGuard guard(camera);
          if (!cbuf_->Initialize(camera->GetNumberOfChannels(), camera->GetImageWidth(), camera->GetImageHeight(), camera->GetImageBytesPerPixel()))
-				throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(), MMERR_CircularBufferFailedToInitialize);
-		}
-
-      LOG_DEBUG(coreLogger_) << "Did set circular buffer size to " <<
-         sizeMB << " MB";
-	}
-	catch(bad_alloc& ex)
-	{
-		ostringstream messs;
-		messs << getCoreErrorText(MMERR_OutOfMemory).c_str() << " " << ex.what() << endl;
-		throw CMMError(messs.str().c_str() , MMERR_OutOfMemory);
-	}
-	if (NULL == cbuf_)
-      throw CMMError(getCoreErrorText(MMERR_OutOfMemory).c_str(), MMERR_OutOfMemory);
+            throw CMMError(getCoreErrorText(MMERR_CircularBufferFailedToInitialize).c_str(), MMERR_CircularBufferFailedToInitialize);
+      }
+   }
+   catch (std::bad_alloc& ex)
+   {
+      std::ostringstream messs;
+      messs << getCoreErrorText(MMERR_OutOfMemory).c_str() << " " << ex.what() << std::endl;
+      throw CMMError(messs.str().c_str(), MMERR_OutOfMemory);
+   }
 }
 
 /**
@@ -3159,6 +4356,7 @@ long CMMCore::getRemainingImageCount()
 
 /**
  * Returns the total number of images that can be stored in the buffer
+ * (an estimate if the buffer is compressed)
  */
 long CMMCore::getBufferTotalCapacity()
 {
@@ -4987,7 +6185,9 @@ void CMMCore::setPixelSizeConfig(const char* resolutionID) throw (CMMError)
    }
 
    try {
-      applyConfiguration(*psc);
+      applyConfiguration(
+            std::string(MM::g_CFGCommand_ConfigPixelSize) + "," + resolutionID,
+            *psc, !pixelSizeGroup_->GetAlwaysApply(), true);
    } catch (CMMError& err) {
       logError("setPixelSizeConfig", getCoreErrorText(err.getCode()).c_str());
       throw;
@@ -4997,6 +6197,27 @@ void CMMCore::setPixelSizeConfig(const char* resolutionID) throw (CMMError)
       resolutionID;
 }
 
+/**
+ * Sets whether setPixelSizeConfig() writes all properties of a preset,
+ * including those that the system state cache shows to be at the preset
+ * value already.
+ * @see setConfigGroupAlwaysApply()
+ * @param alwaysApply  true to write all properties of a preset
+ */
+void CMMCore::setPixelSizeConfigAlwaysApply(bool alwaysApply)
+{
+   pixelSizeGroup_->SetAlwaysApply(alwaysApply);
+}
+
+/**
+ * Returns whether setPixelSizeConfig() writes all properties of a preset.
+ * @see setPixelSizeConfigAlwaysApply()
+ */
+bool CMMCore::getPixelSizeConfigAlwaysApply()
+{
+   return pixelSizeGroup_->GetAlwaysApply();
+}
+
 /**
  * Applies a configuration to a group. The command will fail if the
  * configuration was not previously defined.
@@ -5005,6 +6226,18 @@ void CMMCore::setPixelSizeConfig(const char* resolutionID) throw (CMMError)
  * @param configName  the configuration preset name
  */
 void CMMCore::setConfig(const char* groupName, const char* configName) throw (CMMError)
+{
+   applyConfigPreset(groupName, configName, true, false);
+}
+
+/*
+ * Implements setConfig(). Devices of different modules are set concurrently
+ * only if the calling thread holds no module or device lock; this is not the
+ * case when a device sets a preset through its core callback. If alwaysApply
+ * is set, all properties are written regardless of the group's setting.
+ */
+void CMMCore::applyConfigPreset(const char* groupName, const char* configName,
+      bool concurrent, bool alwaysApply) throw (CMMError)
 {
    CheckConfigGroupName(groupName);
    CheckConfigPresetName(configName);
@@ -5023,8 +6256,11 @@ void CMMCore::setConfig(const char* groupName, const char* configName) throw (CM
    LOG_DEBUG(coreLogger_) << "Config group " << groupName <<
       ": will apply preset " << configName;
 
+   bool skipUnchanged = !alwaysApply &&
+      !configGroups_->FindGroup(groupName)->GetAlwaysApply();
    try {
-      applyConfiguration(*pCfg);
+      applyConfiguration(std::string(MM::g_CFGCommand_ConfigGroup) + "," +
+            groupName + "," + configName, *pCfg, skipUnchanged, concurrent);
    } catch (CMMError&) {
       throw;
    }
@@ -5546,6 +6782,54 @@ bool CMMCore::isGroupDefined(const char* groupName)
    return  configGroups_->isDefined(groupName);
 }
 
+/**
+ * Sets whether setConfig() writes all properties of the group's presets.
+ *
+ * By default, properties that the system state cache shows to be at the
+ * preset value already are not written again. Groups containing devices
+ * that do not report changes made outside of the Core (so that the cache
+ * can be out of date), or whose properties need to be re-asserted even when
+ * unchanged, should set this flag.
+ *
+ * @param groupName    the configuration group name
+ * @param alwaysApply  true to write all properties of a preset
+ */
+void CMMCore::setConfigGroupAlwaysApply(const char* groupName,
+      bool alwaysApply) throw (CMMError)
+{
+   CheckConfigGroupName(groupName);
+
+   ConfigGroup* group = configGroups_->FindGroup(groupName);
+   if (!group)
+   {
+      logError(groupName, getCoreErrorText(MMERR_NoConfigGroup).c_str());
+      throw CMMError("Configuration group " + ToQuotedString(groupName) +
+            " does not exist",
+            MMERR_NoConfigGroup);
+   }
+   group->SetAlwaysApply(alwaysApply);
+}
+
+/**
+ * Returns whether setConfig() writes all properties of the group's presets.
+ * @see setConfigGroupAlwaysApply()
+ * @param groupName    the configuration group name
+ */
+bool CMMCore::getConfigGroupAlwaysApply(const char* groupName) throw (CMMError)
+{
+   CheckConfigGroupName(groupName);
+
+   ConfigGroup* group = configGroups_->FindGroup(groupName);
+   if (!group)
+   {
+      logError(groupName, getCoreErrorText(MMERR_NoConfigGroup).c_str());
+      throw CMMError("Configuration group " + ToQuotedString(groupName) +
+            " does not exist",
+            MMERR_NoConfigGroup);
+   }
+   return group->GetAlwaysApply();
+}
+
 /**
  * Defines a reference for the collection of property-value pairs.
  * This construct is useful for defining
@@ -6570,7 +7854,10 @@ void CMMCore::saveSystemConfiguration(const char* fileName) throw (CMMError)
       // normal group records
       for (size_t j=0; j<configs.size(); j++)
       {
-         Configuration c = getConfigData(groups[i].c_str(), configs[j].c_str());
+         Configuration c = getPresetInLearnedOrder(
+               std::string(MM::g_CFGCommand_ConfigGroup) + "," + groups[i] +
+                  "," + configs[j],
+               getConfigData(groups[i].c_str(), configs[j].c_str()));
          for (size_t k=0; k<c.size(); k++)
          {
             PropertySetting s = c.getSetting(k);
@@ -6578,6 +7865,9 @@ void CMMCore::saveSystemConfiguration(const char* fileName) throw (CMMError)
                << configs[j] << ',' << s.getDeviceLabel() << ',' << s.getPropertyName() << ',' << s.getPropertyValue() << endl;
          }
       }
+
+      if (getConfigGroupAlwaysApply(groups[i].c_str()))
+         os << MM::g_CFGCommand_ConfigGroupAlwaysApply << ',' << groups[i] << endl;
    }
 
    // save device roles
@@ -6658,9 +7948,10 @@ void CMMCore::loadSystemConfigurationImpl(const char* fileName) throw (CMMError)
    if (!fileName)
       throw CMMError("Null filename");
 
-   ifstream is;
-   is.open(fileName, ios_base::in);
-   if (!is.is_open())
+   // The whole file is read at once, and the fields of each line are used in
+   // place, without copying
+   mm::ConfigFileReader reader;
+   if (!reader.Open(fileName))
    {
       logError(fileName, getCoreErrorText(MMERR_FileOpenFailed).c_str());
       throw CMMError(ToQuotedString(fileName) + ": " + getCoreErrorText(MMERR_FileOpenFailed),
@@ -6668,207 +7959,196 @@ void CMMCore::loadSystemConfigurationImpl(const char* fileName) throw (CMMError)
    }
 
    // Process commands
-   const int maxLineLength = 4 * MM::MaxStrLength + 4; // accommodate up to 4 strings and delimiters
-   char line[maxLineLength+1];
-   vector<string> tokens;
+   vector<const char*> tokens;
 
-   int lineCount = 0;
-
-   while(is.getline(line, maxLineLength, '\n'))
+   while (reader.NextLine(tokens, MM::g_FieldDelimiters))
    {
-      // strip a potential Windows/dos CR
-      istringstream il(line);
-      il.getline(line, maxLineLength, '\r');
-
-      lineCount++;
-      if (strlen(line) > 0)
+      try
       {
-         if (line[0] == '#')
-         {
-            // comment, so skip processing
-            continue;
-         }
 
-         // parse tokens
-         tokens.clear();
-         CDeviceUtils::Tokenize(line, tokens, MM::g_FieldDelimiters);
+         // non-empty and non-comment lines mush have at least one token
+         if (tokens.size() < 1)
+            throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+                  ToQuotedString(reader.GetLine()) + ")",
+                  MMERR_InvalidCFGEntry);
 
-         try
+         if(strcmp(tokens[0], MM::g_CFGCommand_Device) == 0)
          {
-
-            // non-empty and non-comment lines mush have at least one token
-            if (tokens.size() < 1)
+            // load device command
+            // -------------------
+            if (tokens.size() != 4)
                throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                     ToQuotedString(line) + ")",
+                     ToQuotedString(reader.GetLine()) + ")",
                      MMERR_InvalidCFGEntry);
-
-            if(tokens[0].compare(MM::g_CFGCommand_Device) == 0)
-            {
-               // load device command
-               // -------------------
-               if (tokens.size() != 4)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               loadDevice(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str());
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_Property) == 0)
-            {
-               // set property command
-               // --------------------
-               if (tokens.size() == 4)
-                  setProperty(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str());
-               else if (tokens.size() == 3)
-                  // ...assuming here that the last missing toke represents an empty string
-                  setProperty(tokens[1].c_str(), tokens[2].c_str(), "");
-               else
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_Delay) == 0)
-            {
-               // set delay command
-               // -----------------
-               if (tokens.size() != 3)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               setDeviceDelayMs(tokens[1].c_str(), atof(tokens[2].c_str()));
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_FocusDirection) == 0)
-            {
-               // set focus direction command
-               // ---------------------------
-               if (tokens.size() != 3)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               setFocusDirection(tokens[1].c_str(), atol(tokens[2].c_str()));
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_Label) == 0)
-            {
-               // define label command
-               // --------------------
-               if (tokens.size() != 4)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               defineStateLabel(tokens[1].c_str(), atol(tokens[2].c_str()), tokens[3].c_str());
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_Configuration) == 0)
-            {
-               // define configuration command
-               // ----------------------------
-               if (tokens.size() != 5)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               LOG_WARNING(coreLogger_) << "Obsolete command " << tokens[0] <<
-                  " ignored in configuration file";
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_ConfigGroup) == 0)
-            {
-               // define grouped configuration command
-               // ------------------------------------
-               if (tokens.size() == 6)
-                  defineConfig(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str(), tokens[4].c_str(), tokens[5].c_str());
-               else if (tokens.size() == 5)
-               {
-                  // we will assume here that the last (missing) token is representing an empty string
-                  defineConfig(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str(), tokens[4].c_str(), "");
-               }
-               else if (tokens.size() == 2)
-                  defineConfigGroup(tokens[1].c_str());
-               else
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_ConfigPixelSize) == 0)
-            {
-               // define pixel size configuration command
-               // ---------------------------------------
-               if (tokens.size() == 5)
-                  definePixelSizeConfig(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str(), tokens[4].c_str());
-               else
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_PixelSize_um) == 0)
+            loadDevice(tokens[1], tokens[2], tokens[3]);
+         }
+         else if(strcmp(tokens[0], MM::g_CFGCommand_Property) == 0)
+         {
+            // set property command
+            // --------------------
+            if (tokens.size() == 4)
+               setProperty(tokens[1], tokens[2], tokens[3]);
+            else if (tokens.size() == 3)
+               // ...assuming here that the last missing toke represents an empty string
+               setProperty(tokens[1], tokens[2], "");
+            else
+               throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+                     ToQuotedString(reader.GetLine()) + ")",
+                     MMERR_InvalidCFGEntry);
+         }
+         else if(strcmp(tokens[0], MM::g_CFGCommand_Delay) == 0)
+         {
+            // set delay command
+            // -----------------
+            if (tokens.size() != 3)
+               throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+                     ToQuotedString(reader.GetLine()) + ")",
+                     MMERR_InvalidCFGEntry);
+            setDeviceDelayMs(tokens[1], atof(tokens[2]));
+         }
+         else if(strcmp(tokens[0], MM::g_CFGCommand_FocusDirection) == 0)
+         {
+            // set focus direction command
+            // ---------------------------
+            if (tokens.size() != 3)
+               throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+                     ToQuotedString(reader.GetLine()) + ")",
+                     MMERR_InvalidCFGEntry);
+            setFocusDirection(tokens[1], atol(tokens[2]));
+         }
+         else if(strcmp(tokens[0], MM::g_CFGCommand_Label) == 0)
+         {
+            // define label command
+            // --------------------
+            if (tokens.size() != 4)
+               throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+                     ToQuotedString(reader.GetLine()) + ")",
+                     MMERR_InvalidCFGEntry);
+            defineStateLabel(tokens[1], atol(tokens[2]), tokens[3]);
+         }
+         else if(strcmp(tokens[0], MM::g_CFGCommand_Configuration) == 0)
+         {
+            // define configuration command
+            // ----------------------------
+            if (tokens.size() != 5)
+               throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+                     ToQuotedString(reader.GetLine()) + ")",
+                     MMERR_InvalidCFGEntry);
+            LOG_WARNING(coreLogger_) << "Obsolete command " << tokens[0] <<
+               " ignored in configuration file";
+         }
+         else if(strcmp(tokens[0], MM::g_CFGCommand_ConfigGroup) == 0)
+         {
+            // define grouped configuration command
+            // ------------------------------------
+            if (tokens.size() == 6)
+               defineConfig(tokens[1], tokens[2], tokens[3], tokens[4], tokens[5]);
+            else if (tokens.size() == 5)
             {
-               // set pixel size
-               // --------------
-               if (tokens.size() == 3)
-                  setPixelSizeUm(tokens[1].c_str(), atof(tokens[2].c_str()));
-               else
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
+               // we will assume here that the last (missing) token is representing an empty string
+               defineConfig(tokens[1], tokens[2], tokens[3], tokens[4], "");
             }
-            else if(tokens[0].compare(MM::g_CFGCommand_PixelSizeAffine) == 0)
+            else if (tokens.size() == 2)
+               defineConfigGroup(tokens[1]);
+            else
+               throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+                     ToQuotedString(reader.GetLine()) + ")",
+                     MMERR_InvalidCFGEntry);
+         }
+         else if(strcmp(tokens[0], MM::g_CFGCommand_ConfigGroupAlwaysApply) == 0)
+         {
+            // write all properties of the group's presets
+            // -------------------------------------------
+            if (tokens.size() == 2)
+               setConfigGroupAlwaysApply(tokens[1], true);
+            else
+               throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+                     ToQuotedString(reader.GetLine()) + ")",
+                     MMERR_InvalidCFGEntry);
+         }
+         else if(strcmp(tokens[0], MM::g_CFGCommand_ConfigPixelSize) == 0)
+         {
+            // define pixel size configuration command
+            // ---------------------------------------
+            if (tokens.size() == 5)
+               definePixelSizeConfig(tokens[1], tokens[2], tokens[3], tokens[4]);
+            else
+               throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+                     ToQuotedString(reader.GetLine()) + ")",
+                     MMERR_InvalidCFGEntry);
+         }
+         else if(strcmp(tokens[0], MM::g_CFGCommand_PixelSize_um) == 0)
+         {
+            // set pixel size
+            // --------------
+            if (tokens.size() == 3)
+               setPixelSizeUm(tokens[1], atof(tokens[2]));
+            else
+               throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+                     ToQuotedString(reader.GetLine()) + ")",
+                     MMERR_InvalidCFGEntry);
+         }
+         else if(strcmp(tokens[0], MM::g_CFGCommand_PixelSizeAffine) == 0)
+         {
+            // set affine transform
+            // --------------
+            //
+            if (tokens.size() == 8)
             {
-               // set affine transform
-               // --------------
-               //
-               if (tokens.size() == 8)
+               std::vector<double> *affineT = new std::vector<double>(6);
+               for (int i = 0; i < 6; i++)
                {
-                  std::vector<double> *affineT = new std::vector<double>(6);
-                  for (int i = 0; i < 6; i++)
-                  {
-                     affineT->at(i) = atof(tokens[i + 2].c_str());
-                  }
-                  setPixelSizeAffine(tokens[1].c_str(), *affineT);
-                  delete affineT;
+                  affineT->at(i) = atof(tokens[i + 2]);
                }
-               else
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_Equipment) == 0)
-            {
-               // define configuration command
-               // ----------------------------
-               if (tokens.size() != 4)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               definePropertyBlock(tokens[1].c_str(), tokens[2].c_str(), tokens[3].c_str());
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_ImageSynchro) == 0)
-            {
-               // define image synchro
-               // --------------------
-               if (tokens.size() != 2)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-               assignImageSynchro(tokens[1].c_str());
-            }
-            else if(tokens[0].compare(MM::g_CFGCommand_ParentID) == 0)
-            {
-               // set parent ID
-               // -------------
-               if (tokens.size() != 3)
-                  throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
-                        ToQuotedString(line) + ")",
-                        MMERR_InvalidCFGEntry);
-
-               setParentLabel(tokens[1].c_str(), tokens[2].c_str());
+               setPixelSizeAffine(tokens[1], *affineT);
+               delete affineT;
             }
-
+            else
+               throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+                     ToQuotedString(reader.GetLine()) + ")",
+                     MMERR_InvalidCFGEntry);
+         }
+         else if(strcmp(tokens[0], MM::g_CFGCommand_Equipment) == 0)
+         {
+            // define configuration command
+            // ----------------------------
+            if (tokens.size() != 4)
+               throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+                     ToQuotedString(reader.GetLine()) + ")",
+                     MMERR_InvalidCFGEntry);
+            definePropertyBlock(tokens[1], tokens[2], tokens[3]);
+         }
+         else if(strcmp(tokens[0], MM::g_CFGCommand_ImageSynchro) == 0)
+         {
+            // define image synchro
+            // --------------------
+            if (tokens.size() != 2)
+               throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+                     ToQuotedString(reader.GetLine()) + ")",
+                     MMERR_InvalidCFGEntry);
+            assignImageSynchro(tokens[1]);
          }
-         catch (CMMError& err)
+         else if(strcmp(tokens[0], MM::g_CFGCommand_ParentID) == 0)
          {
-            if (externalCallback_)
-               externalCallback_->onSystemConfigurationLoaded();
-            std::ostringstream errorText;
-            errorText << "Line " << lineCount << ": " << line << endl;
-            errorText << err.getFullMsg() << endl << endl;
-            throw CMMError(errorText.str().c_str(), MMERR_InvalidConfigurationFile);
+            // set parent ID
+            // -------------
+            if (tokens.size() != 3)
+               throw CMMError(getCoreErrorText(MMERR_InvalidCFGEntry) + " (" +
+                     ToQuotedString(reader.GetLine()) + ")",
+                     MMERR_InvalidCFGEntry);
+
+            setParentLabel(tokens[1], tokens[2]);
          }
+
+      }
+      catch (CMMError& err)
+      {
+         if (externalCallback_)
+            externalCallback_->onSystemConfigurationLoaded();
+         std::ostringstream errorText;
+         errorText << "Line " << reader.GetLineNumber() << ": " << reader.GetLine() << endl;
+         errorText << err.getFullMsg() << endl << endl;
+         throw CMMError(errorText.str().c_str(), MMERR_InvalidConfigurationFile);
       }
    }
 
@@ -6882,7 +8162,9 @@ void CMMCore::loadSystemConfigurationImpl(const char* fileName) throw (CMMError)
       waitForSystem();
       updateSystemStateCache();
 
-      this->setConfig(MM::g_CFGGroup_System, MM::g_CFGGroup_System_Startup);
+      // Write all properties, as the devices have just been initialized
+      applyConfigPreset(MM::g_CFGGroup_System,
+            MM::g_CFGGroup_System_Startup, true, true);
    }
 
    waitForSystem();
@@ -7195,6 +8477,7 @@ void CMMCore::InitializeErrorMessages()
    errorText_[MMERR_NullPointerException] = "Null Pointer Exception.";
    errorText_[MMERR_CreatePeripheralFailed] = "Hub failed to create specified peripheral device.";
    errorText_[MMERR_BadAffineTransform] = "Bad affine transform.  Affine transforms need to have 6 numbers; 2 rows of 3 column.";
+   errorText_[MMERR_InvalidCommandHandle] = "No pending asynchronous command with the given handle.";
 }
 
 void CMMCore::CreateCoreProperties()
@@ -7337,103 +8620,232 @@ bool CMMCore::IsCoreDeviceLabel(const char* label) const throw (CMMError)
    return (strcmp(label, MM::g_Keyword_CoreDevice) == 0);
 }
 
-/**
- * Set all properties in a configuration
- * Upon error, don't stop, but try to set all failed properties again
- * until all success or no more change takes place
- * If errors remain, throw an error
- */
-void CMMCore::applyConfiguration(const Configuration& config) throw (CMMError)
-{
-   std::ostringstream sall;
-   bool error = false;
-   vector<PropertySetting> failedProps;
+/*
+ * Applies a preset. Properties that the state cache shows to be at the
+ * preset value already are skipped if skipUnchanged is set.
+ *
+ * Core properties are set first. The device properties are then set in one
+ * batch per asynchronous command queue (see getAsyncQueueName()), and, if
+ * concurrent is set, the batches run concurrently on those queues. Within a
+ * batch, the properties are set in the order of the preset.
+ *
+ * Setting a property may fail until other properties have been set; the
+ * failed properties of all batches are retried until none are left or none
+ * succeed. If retrying was needed, the order in which the properties
+ * succeeded is remembered under presetKey, so that the preset can be applied
+ * in a single pass next time (see getPresetInLearnedOrder()). The stored
+ * preset itself is not modified.
+ */
+void CMMCore::applyConfiguration(const std::string& presetKey,
+      const Configuration& preset, bool skipUnchanged,
+      bool concurrent) throw (CMMError)
+{
+   Configuration config = getPresetInLearnedOrder(presetKey, preset);
+
+   std::vector<PropertySetting> coreSettings;
+   std::vector<std::string> queueNames;
+   std::vector< std::vector<PropertySetting> > batches;
    for (size_t i=0; i<config.size(); i++)
    {
       PropertySetting setting = config.getSetting(i);
-
-      // perform special processing for core commands
       if (setting.getDeviceLabel().compare(MM::g_Keyword_CoreDevice) == 0)
       {
-         properties_->Execute(setting.getPropertyName().c_str(), setting.getPropertyValue().c_str());
+         coreSettings.push_back(setting);
+         continue;
+      }
+
+      std::string queueName =
+         getAsyncQueueName(deviceManager_->GetDevice(setting.getDeviceLabel()));
+      size_t q = std::find(queueNames.begin(), queueNames.end(), queueName) -
+         queueNames.begin();
+      if (q == queueNames.size())
+      {
+         queueNames.push_back(queueName);
+         batches.resize(q + 1);
+      }
+      batches[q].push_back(setting);
+   }
+
+   // perform special processing for core commands
+   for (size_t i=0; i<coreSettings.size(); i++)
+   {
+      const PropertySetting& setting = coreSettings[i];
+      properties_->Execute(setting.getPropertyName().c_str(), setting.getPropertyValue().c_str());
+      {
+         MMThreadGuard scg(stateCacheLock_);
+         stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, setting.getPropertyName().c_str(), setting.getPropertyValue().c_str()));
+      }
+   }
+
+   // passes[q][j] is the pass in which batches[q][j] was set (unchanged
+   // properties that are skipped count as set in the first pass)
+   std::vector< std::vector<int> > passes(batches.size());
+   std::vector< std::vector<size_t> > pending(batches.size());
+   size_t numPending = 0;
+   for (size_t q=0; q<batches.size(); q++)
+   {
+      passes[q].assign(batches[q].size(), 1);
+      for (size_t j=0; j<batches[q].size(); j++)
+      {
+         if (skipUnchanged)
          {
             MMThreadGuard scg(stateCacheLock_);
-            stateCache_.addSetting(PropertySetting(MM::g_Keyword_CoreDevice, setting.getPropertyName().c_str(), setting.getPropertyValue().c_str()));
+            const std::string label = batches[q][j].getDeviceLabel();
+            const std::string propName = batches[q][j].getPropertyName();
+            if (stateCache_.isPropertyIncluded(label.c_str(), propName.c_str()) &&
+                  stateCache_.getSetting(label.c_str(), propName.c_str()).
+                     getPropertyValue() == batches[q][j].getPropertyValue())
+               continue;
+         }
+         pending[q].push_back(j);
+      }
+      numPending += pending[q].size();
+   }
+
+   int lastPass = 0;
+   for (int pass=1; numPending > 0; pass++)
+   {
+      std::vector<size_t> active;
+      for (size_t q=0; q<batches.size(); q++)
+      {
+         if (!pending[q].empty())
+            active.push_back(q);
+      }
+
+      std::vector<std::string> errors(batches.size());
+      if (!concurrent || active.size() == 1)
+      {
+         for (size_t i=0; i<active.size(); i++)
+         {
+            size_t q = active[i];
+            applyPropertiesPass(batches[q], pending[q], passes[q], pass,
+                  errors[q]);
          }
       }
       else
       {
-         // normal processing
-         boost::shared_ptr<DeviceInstance> pDevice =
-            deviceManager_->GetDevice(setting.getDeviceLabel());
-         mm::DeviceModuleLockGuard guard(pDevice);
-         try
+         std::vector<long> handles;
+         for (size_t i=0; i<active.size(); i++)
          {
-            pDevice->SetProperty(setting.getPropertyName(),
-                  setting.getPropertyValue());
+            size_t q = active[i];
+            handles.push_back(asyncCommands_->Submit(queueNames[q],
+                     boost::bind(&CMMCore::applyPropertiesPass, this,
+                        boost::ref(batches[q]), boost::ref(pending[q]),
+                        boost::ref(passes[q]), pass, boost::ref(errors[q]))));
+         }
+         asyncCommands_->WaitAll(handles);
+      }
+
+      size_t numFailed = 0;
+      std::string lastError;
+      for (size_t q=0; q<batches.size(); q++)
+      {
+         numFailed += pending[q].size();
+         if (!errors[q].empty())
+            lastError = errors[q];
+      }
 
+      if (numFailed == numPending)
+      {
+         for (size_t q=0; q<batches.size(); q++)
+         {
+            for (size_t i=0; i<pending[q].size(); i++)
             {
-               MMThreadGuard scg(stateCacheLock_);
-               stateCache_.addSetting(setting);
+               const PropertySetting& setting = batches[q][pending[q][i]];
+               logError(setting.getDeviceLabel().c_str(),
+                     ("Cannot set property " +
+                      ToQuotedString(setting.getPropertyName()) + " to " +
+                      ToQuotedString(setting.getPropertyValue())).c_str());
             }
          }
-         catch (const CMMError&)
-         {
-            failedProps.push_back(setting);
-            error = true;
-         }
+         throw CMMError(lastError.c_str(), MMERR_DEVICE_GENERIC);
       }
+      numPending = numFailed;
+      lastPass = pass;
    }
-   if (error)
+
+   if (lastPass <= 1)
+      return;
+
+   // Keep the order in which the properties succeeded
+   Configuration learned;
+   for (size_t i=0; i<coreSettings.size(); i++)
+      learned.addSetting(coreSettings[i]);
+   for (int pass=1; pass<=lastPass; pass++)
    {
-      string errorString;
-      while (failedProps.size() > (unsigned) applyProperties(failedProps, errorString) )
+      for (size_t q=0; q<batches.size(); q++)
       {
-         if (failedProps.size() == 0)
-            return;
+         for (size_t j=0; j<batches[q].size(); j++)
+         {
+            if (passes[q][j] == pass)
+               learned.addSetting(batches[q][j]);
+         }
       }
-
-      throw CMMError(errorString.c_str(), MMERR_DEVICE_GENERIC);
    }
+   LOG_DEBUG(coreLogger_) << "Learned property order of preset " <<
+      presetKey << ": " << learned.getVerbose();
+
+   MMThreadGuard g(learnedPresetOrderLock_);
+   learnedPresetOrders_[presetKey] = learned;
 }
 
 /*
  * Helper function for applyConfiguration
- * It is possible that setting certain properties failed because they are dependent
- * on other properties to be set first. As a workaround, continue to apply these failed
- * properties until there are none left or none succeed
- * returns number of properties successfully set
+ * Sets the pending properties of a batch once, in order. On return, pending
+ * holds the properties that failed, and lastError the message of the last
+ * failure; passes is updated for the properties that were set.
  */
-int CMMCore::applyProperties(vector<PropertySetting>& props, string& lastError)
+void CMMCore::applyPropertiesPass(std::vector<PropertySetting>& settings,
+      std::vector<size_t>& pending, std::vector<int>& passes, int pass,
+      std::string& lastError) throw (CMMError)
 {
-  // int succeeded = 0;
-   vector<PropertySetting> failedProps;
-   for (size_t i=0; i<props.size(); i++)
+   std::vector<size_t> failed;
+   for (size_t i=0; i<pending.size(); i++)
    {
-      // normal processing
+      const PropertySetting& setting = settings[pending[i]];
       boost::shared_ptr<DeviceInstance> pDevice =
-         deviceManager_->GetDevice(props[i].getDeviceLabel());
+         deviceManager_->GetDevice(setting.getDeviceLabel());
       mm::DeviceModuleLockGuard guard(pDevice);
       try
       {
-         pDevice->SetProperty(props[i].getPropertyName(),
-               props[i].getPropertyValue());
+         pDevice->SetProperty(setting.getPropertyName(),
+               setting.getPropertyValue());
 
          {
             MMThreadGuard scg(stateCacheLock_);
-            stateCache_.addSetting(props[i]);
+            stateCache_.addSetting(setting);
          }
+         passes[pending[i]] = pass;
       }
       catch (const CMMError& e)
       {
-         failedProps.push_back(props[i]);
-         std::string message = e.getFullMsg();
-         logError(props[i].getDeviceLabel().c_str(), message.c_str());
-         lastError = message;
+         failed.push_back(pending[i]);
+         lastError = e.getFullMsg();
       }
    }
-   props = failedProps;
-   return (int) failedProps.size();
+   pending.swap(failed);
+}
+
+/*
+ * Returns the preset in the order learned by applyConfiguration(), or the
+ * preset itself if no order was learned or the preset has been edited since.
+ */
+Configuration CMMCore::getPresetInLearnedOrder(const std::string& presetKey,
+      const Configuration& preset)
+{
+   MMThreadGuard g(learnedPresetOrderLock_);
+   std::map<std::string, Configuration>::iterator it =
+      learnedPresetOrders_.find(presetKey);
+   if (it == learnedPresetOrders_.end())
+      return preset;
+
+   Configuration& learned = it->second;
+   if (learned.size() == preset.size() &&
+         learned.isConfigurationIncluded(preset))
+      return learned;
+
+   learnedPresetOrders_.erase(it);
+   return preset;
 }
 
 
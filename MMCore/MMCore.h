@@ -60,6 +60,7 @@
 #include "CoreUtils.h"
 #include "Error.h"
 #include "ErrorCodes.h"
+#include "ImageStatistics.h"
 #include "Logging/Logger.h"
 
 #include <boost/shared_ptr.hpp>
@@ -108,8 +109,11 @@ class XYStageInstance;
 class CMMCore;
 
 namespace mm {
+   class AsyncCommandExecutor;
    class DeviceManager;
    class LogManager;
+   class SoftwareROIBinning;
+   struct PreviewImage;
 } // namespace mm
 
 typedef unsigned int* imgRGB32;
@@ -200,6 +204,10 @@ public:
    std::vector<std::string> getAvailableDevices(const char* library) throw (CMMError);
    std::vector<std::string> getAvailableDeviceDescriptions(const char* library) throw (CMMError);
    std::vector<long> getAvailableDeviceTypes(const char* library) throw (CMMError);
+
+   void setDeviceAdapterMetadataCacheFile(const char* filename) throw (CMMError);
+   std::string getDeviceAdapterMetadataCacheFile() const;
+   void saveDeviceAdapterMetadataCache();
    ///@}
 
    /** \name Generic device control.
@@ -256,6 +264,36 @@ public:
    void sleep(double intervalMs) const;
    ///@}
 
+   /** \name Asynchronous device control.
+    *
+    * Commands that run in the background and return a handle right away.
+    * Commands on devices of the same device adapter run one at a time, in
+    * the order they were issued; commands on devices of different adapters
+    * (or of adapters declaring per-device thread safety) run concurrently.
+    * A command is complete when the device is no longer busy. Each handle
+    * must eventually be passed to waitForCommand() or waitForAll(), which
+    * rethrow the command's error, if any.
+    */
+   ///@{
+   long setPropertyAsync(const char* label, const char* propName,
+         const char* propValue) throw (CMMError);
+   long setStateAsync(const char* stateDeviceLabel, long state)
+      throw (CMMError);
+   long setPositionAsync(const char* stageLabel, double position)
+      throw (CMMError);
+   long setPositionAsync(double position) throw (CMMError);
+   long setXYPositionAsync(const char* xyStageLabel, double x, double y)
+      throw (CMMError);
+   long setXYPositionAsync(double x, double y) throw (CMMError);
+   long setConfigAsync(const char* groupName, const char* configName)
+      throw (CMMError);
+   long snapImageAsync() throw (CMMError);
+
+   bool isCommandDone(long handle) throw (CMMError);
+   void waitForCommand(long handle) throw (CMMError);
+   void waitForAll(const std::vector<long>& handles) throw (CMMError);
+   ///@}
+
    /** \name Management of 'current' device for specific roles. */
    ///@{
    std::string getCameraDevice();
@@ -303,6 +341,9 @@ public:
    void renameConfigGroup(const char* oldGroupName,
          const char* newGroupName) throw (CMMError);
    bool isGroupDefined(const char* groupName);
+   void setConfigGroupAlwaysApply(const char* groupName,
+         bool alwaysApply) throw (CMMError);
+   bool getConfigGroupAlwaysApply(const char* groupName) throw (CMMError);
    bool isConfigDefined(const char* groupName, const char* configName);
    void setConfig(const char* groupName, const char* configName) throw (CMMError);
    void deleteConfig(const char* groupName, const char* configName) throw (CMMError);
@@ -337,6 +378,8 @@ public:
    std::vector<std::string> getAvailablePixelSizeConfigs() const;
    bool isPixelSizeConfigDefined(const char* resolutionID) const throw (CMMError);
    void setPixelSizeConfig(const char* resolutionID) throw (CMMError);
+   void setPixelSizeConfigAlwaysApply(bool alwaysApply);
+   bool getPixelSizeConfigAlwaysApply();
    void renamePixelSizeConfig(const char* oldConfigName,
          const char* newConfigName) throw (CMMError);
    void deletePixelSizeConfig(const char* configName) throw (CMMError);
@@ -374,6 +417,7 @@ public:
    double getExposure(const char* label) throw (CMMError);
 
    void snapImage() throw (CMMError);
+   void snapImages(long numImages, double intervalMs = 0.0) throw (CMMError);
    void* getImage() throw (CMMError);
    void* getImage(unsigned numChannel) throw (CMMError);
 
@@ -418,6 +462,20 @@ public:
    void* getNBeforeLastImageMD(unsigned long n, Metadata& md)
       const throw (CMMError);
    void* popNextImageMD(Metadata& md) throw (CMMError);
+   void* getLastImagePinned(unsigned& width, unsigned& height,
+         unsigned& bytesPerPixel) throw (CMMError);
+   void* popNextImagePinned(unsigned& width, unsigned& height,
+         unsigned& bytesPerPixel) throw (CMMError);
+   void* getLastImagePinnedMD(unsigned channel, Metadata& md,
+         unsigned& width, unsigned& height, unsigned& bytesPerPixel)
+      throw (CMMError);
+   void* popNextImagePinnedMD(unsigned channel, Metadata& md,
+         unsigned& width, unsigned& height, unsigned& bytesPerPixel)
+      throw (CMMError);
+   void* popNextImagePinnedMD(Metadata& md, unsigned& width,
+         unsigned& height, unsigned& bytesPerPixel) throw (CMMError);
+   void unpinImage(const void* pixels) throw (CMMError);
+   long getPinnedImageCount();
 
    long getRemainingImageCount();
    long getBufferTotalCapacity();
@@ -427,6 +485,36 @@ public:
    unsigned getCircularBufferMemoryFootprint();
    void initializeCircularBuffer() throw (CMMError);
    void clearCircularBuffer() throw (CMMError);
+   void startSharedFrameExport(const char* name, unsigned slotCount)
+      throw (CMMError);
+   void stopSharedFrameExport();
+   std::string getSharedFrameExportName();
+   void enableImageStatistics(bool enable, unsigned binCount = 256)
+      throw (CMMError);
+   bool isImageStatisticsEnabled();
+   ImageStatistics getLastImageStatistics() throw (CMMError);
+   void enableCircularBufferCompression(bool enable) throw (CMMError);
+   bool isCircularBufferCompressionEnabled();
+   void setSoftwareROI(int x, int y, int xSize, int ySize) throw (CMMError);
+   void getSoftwareROI(int& x, int& y, int& xSize, int& ySize);
+   void clearSoftwareROI() throw (CMMError);
+   void setSoftwareBinning(unsigned binning, bool average) throw (CMMError);
+   unsigned getSoftwareBinning();
+   bool isSoftwareBinningAveraging();
+   unsigned getBufferedImageWidth();
+   unsigned getBufferedImageHeight();
+   long getBufferedImageBufferSize();
+   void enablePreviewImages(bool enable, double maxRate = 30.0,
+         unsigned downsampling = 1) throw (CMMError);
+   bool isPreviewImagesEnabled();
+   void setPreviewImage8BitRange(unsigned min, unsigned max) throw (CMMError);
+   void clearPreviewImage8BitRange();
+   void* getLastPreviewImage() throw (CMMError);
+   void* getLastPreviewImageMD(Metadata& md) throw (CMMError);
+   unsigned getPreviewImageWidth();
+   unsigned getPreviewImageHeight();
+   unsigned getPreviewImageBytesPerPixel();
+   unsigned getPreviewImageNumberOfComponents();
 
    bool isExposureSequenceable(const char* cameraLabel) throw (CMMError);
    void startExposureSequence(const char* cameraLabel) throw (CMMError);
@@ -676,6 +764,9 @@ private:
    std::vector< boost::weak_ptr<DeviceInstance> > imageSynchroDevices_;
    boost::shared_ptr<CPluginManager> pluginManager_;
    boost::shared_ptr<mm::DeviceManager> deviceManager_;
+   boost::shared_ptr<mm::AsyncCommandExecutor> asyncCommands_;
+   // The preview image last returned by getLastPreviewImage()
+   boost::shared_ptr<const mm::PreviewImage> lastPreview_;
    std::map<int, std::string> errorText_;
    CPropBlockMap propBlocks_;
 
@@ -683,6 +774,9 @@ private:
    // or acquiring a module lock
    mutable MMThreadLock stateCacheLock_;
    mutable Configuration stateCache_; // Synchronized by stateCacheLock_
+   MMThreadLock learnedPresetOrderLock_;
+   // Synchronized by learnedPresetOrderLock_
+   std::map<std::string, Configuration> learnedPresetOrders_;
 
    MMThreadLock* pPostedErrorsLock_;
    mutable std::deque<std::pair< int, std::string> > postedErrors_;
@@ -701,9 +795,18 @@ private:
    static void CheckPropertyBlockName(const char* blockName) throw (CMMError);
    bool IsCoreDeviceLabel(const char* label) const throw (CMMError);
 
-   void applyConfiguration(const Configuration& config) throw (CMMError);
-   int applyProperties(std::vector<PropertySetting>& props, std::string& lastError);
+   void applyConfigPreset(const char* groupName, const char* configName,
+         bool concurrent, bool alwaysApply) throw (CMMError);
+   void applyConfiguration(const std::string& presetKey,
+         const Configuration& preset, bool skipUnchanged,
+         bool concurrent) throw (CMMError);
+   void applyPropertiesPass(std::vector<PropertySetting>& settings,
+         std::vector<size_t>& pending, std::vector<int>& passes, int pass,
+         std::string& lastError) throw (CMMError);
+   Configuration getPresetInLearnedOrder(const std::string& presetKey,
+         const Configuration& preset);
    void waitForDevice(boost::shared_ptr<DeviceInstance> pDev) throw (CMMError);
+   std::string getAsyncQueueName(boost::shared_ptr<DeviceInstance> pDev);
    Configuration getConfigGroupState(const char* group, bool fromCache) throw (CMMError);
    std::string getDeviceErrorText(int deviceCode, boost::shared_ptr<DeviceInstance> pDevice);
    std::string getDeviceName(boost::shared_ptr<DeviceInstance> pDev);
@@ -712,6 +815,16 @@ private:
    void assignDefaultRole(boost::shared_ptr<DeviceInstance> pDev);
    void updateCoreProperty(const char* propName, MM::DeviceType devType) throw (CMMError);
    void loadSystemConfigurationImpl(const char* fileName) throw (CMMError);
+   void setAutoShutterOpen(boost::shared_ptr<ShutterInstance> shutter,
+         bool open) throw (CMMError);
+   void waitForBurstSequence(boost::shared_ptr<CameraInstance> camera,
+         long numImages, double frameTimeMs) throw (CMMError);
+   void snapBurstImages(boost::shared_ptr<CameraInstance> camera,
+         long numImages, double intervalMs) throw (CMMError);
+   void checkCircularBufferReconfigurable() throw (CMMError);
+   void reinitializeCircularBuffer() throw (CMMError);
+   void setSoftwareROIBinning(unsigned x, unsigned y, unsigned xSize,
+         unsigned ySize, unsigned binning, bool average) throw (CMMError);
 };
 
 #endif //_MMCORE_H_
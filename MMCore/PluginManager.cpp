@@ -65,7 +65,8 @@ const char* const LIB_NAME_SUFFIX = "";
 
 std::vector<std::string> CPluginManager::fallbackSearchPaths_;
 
-CPluginManager::CPluginManager()
+CPluginManager::CPluginManager() :
+   metadataCacheModified_(false)
 {
    const std::vector<std::string> paths = GetDefaultSearchPaths();
    SetSearchPaths(paths.begin(), paths.end());
@@ -73,6 +74,7 @@ CPluginManager::CPluginManager()
 
 CPluginManager::~CPluginManager()
 {
+   SaveMetadataCache();
 }
 
 
@@ -114,6 +116,19 @@ CPluginManager::FindInSearchPath(std::string filename)
    return filename;
 }
 
+/**
+ * Return the path of the library file for a module (or the bare filename, if
+ * it is not found in the search paths).
+ */
+std::string
+CPluginManager::FindModuleFile(const std::string& moduleName)
+{
+   std::string filename(LIB_NAME_PREFIX);
+   filename += moduleName;
+   filename += LIB_NAME_SUFFIX;
+   return FindInSearchPath(filename);
+}
+
 /** 
  * Load a plugin library.
  *
@@ -145,10 +160,7 @@ CPluginManager::GetDeviceAdapter(const std::string& moduleName)
       return it->second;
    }
 
-   std::string filename(LIB_NAME_PREFIX);
-   filename += moduleName;
-   filename += LIB_NAME_SUFFIX;
-   filename = FindInSearchPath(filename);
+   std::string filename = FindModuleFile(moduleName);
 
    boost::shared_ptr<LoadedDeviceAdapter> module =
       boost::make_shared<LoadedDeviceAdapter>(moduleName, filename);
@@ -166,6 +178,102 @@ CPluginManager::GetDeviceAdapter(const char* moduleName)
    return GetDeviceAdapter(std::string(moduleName));
 }
 
+/**
+ * Return the names, types, and descriptions of the devices in a module.
+ *
+ * Listing the devices requires loading the library, which for some adapters
+ * (those linked to large vendor SDKs) takes a long time. The result is
+ * therefore kept in the metadata cache, keyed by the library file's path,
+ * modification time, and size; as long as the file is unchanged, later calls
+ * (including in later sessions, if a cache file is set) do not load it.
+ *
+ * @param moduleName Simple module name without path, prefix, or suffix.
+ */
+std::vector<mm::AvailableDeviceInfo>
+CPluginManager::GetAvailableDevices(const std::string& moduleName)
+{
+   if (moduleName.empty())
+   {
+      throw CMMError("Empty device adapter module name");
+   }
+
+   std::vector<mm::AvailableDeviceInfo> devices;
+
+   std::map< std::string, boost::shared_ptr<LoadedDeviceAdapter> >::iterator it =
+      moduleMap_.find(moduleName);
+   const bool loaded = (it != moduleMap_.end());
+   const std::string filename = FindModuleFile(moduleName);
+   if (!loaded && metadataCache_.Get(filename, devices))
+   {
+      return devices;
+   }
+
+   boost::shared_ptr<LoadedDeviceAdapter> module =
+      loaded ? it->second : GetDeviceAdapter(moduleName);
+   std::vector<std::string> names = module->GetAvailableDeviceNames();
+   devices.reserve(names.size());
+   for (std::vector<std::string>::const_iterator
+         nameIt = names.begin(), end = names.end(); nameIt != end; ++nameIt)
+   {
+      mm::AvailableDeviceInfo device;
+      device.name = *nameIt;
+      device.type = module->GetAdvertisedDeviceType(*nameIt);
+      device.description = module->GetDeviceDescription(*nameIt);
+      devices.push_back(device);
+   }
+
+   // Adapters are usually listed one after the other, so the file is only
+   // written once they have been (see SaveMetadataCache())
+   if (metadataCache_.Put(filename, devices))
+      metadataCacheModified_ = true;
+   return devices;
+}
+
+std::vector<mm::AvailableDeviceInfo>
+CPluginManager::GetAvailableDevices(const char* moduleName)
+{
+   if (!moduleName)
+   {
+      throw CMMError("Null device adapter module name");
+   }
+   return GetAvailableDevices(std::string(moduleName));
+}
+
+/**
+ * Set the file in which the device adapter metadata cache is kept.
+ *
+ * Changes to the cache are first saved to the previous file, if any. The
+ * cache is then replaced with the contents of the new file (if it exists and
+ * is valid). An empty filename keeps the cache in memory only.
+ */
+void
+CPluginManager::SetMetadataCacheFile(const std::string& filename)
+{
+   SaveMetadataCache();
+   metadataCacheFile_ = filename;
+   if (filename.empty())
+      return;
+   metadataCache_.Load(filename);
+}
+
+/**
+ * Write the device adapter metadata cache to the cache file, if one is set
+ * and entries have been added since it was last written.
+ *
+ * This is done when the cache file is changed and when the plugin manager is
+ * destroyed, rather than every time an adapter is listed.
+ */
+void
+CPluginManager::SaveMetadataCache()
+{
+   if (!metadataCacheModified_ || metadataCacheFile_.empty())
+      return;
+
+   // Failing to save the cache only costs time in the next session
+   metadataCache_.Save(metadataCacheFile_);
+   metadataCacheModified_ = false;
+}
+
 /** 
  * Unload a module.
  */
@@ -24,6 +24,8 @@
 #define _PLUGIN_MANAGER_H_
 
 
+#include "DeviceAdapterMetadataCache.h"
+
 #include "../MMDevice/DeviceThreads.h"
 
 #include <boost/shared_ptr.hpp>
@@ -64,16 +66,35 @@ public:
    boost::shared_ptr<LoadedDeviceAdapter>
    GetDeviceAdapter(const char* moduleName);
 
+   /**
+    * Return the devices offered by a device adapter module, without loading
+    * it if the metadata cache has an up-to-date entry for its file
+    */
+   std::vector<mm::AvailableDeviceInfo>
+   GetAvailableDevices(const std::string& moduleName);
+   std::vector<mm::AvailableDeviceInfo>
+   GetAvailableDevices(const char* moduleName);
+
+   // File in which the device adapter metadata cache is kept (empty for none)
+   void SetMetadataCacheFile(const std::string& filename);
+   std::string GetMetadataCacheFile() const { return metadataCacheFile_; }
+   void SaveMetadataCache();
+
 private:
    static std::vector<std::string> GetDefaultSearchPaths();
    std::vector<std::string> GetActualSearchPaths() const;
    static void GetModules(std::vector<std::string> &modules, const char *path);
    std::string FindInSearchPath(std::string filename);
+   std::string FindModuleFile(const std::string& moduleName);
 
    std::vector<std::string> preferredSearchPaths_;
    static std::vector<std::string> fallbackSearchPaths_;
 
    std::map< std::string, boost::shared_ptr<LoadedDeviceAdapter> > moduleMap_;
+
+   mm::DeviceAdapterMetadataCache metadataCache_;
+   std::string metadataCacheFile_;
+   bool metadataCacheModified_;
 };
 
 #endif //_PLUGIN_MANAGER_H_
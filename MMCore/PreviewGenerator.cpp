@@ -0,0 +1,219 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          PreviewGenerator.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Reduced, rate-limited previews of images inserted into
+//                the circular buffer
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "PreviewGenerator.h"
+
+#include "SoftwareROIBinning.h"
+
+#include "../MMDevice/MMDeviceConstants.h"
+
+#include <boost/thread/locks.hpp>
+
+#include <stdint.h>
+
+namespace mm
+{
+
+namespace
+{
+
+const char* PixelTypeName(unsigned byteDepth, unsigned nComponents)
+{
+   switch (byteDepth)
+   {
+      case 1: return "GRAY8";
+      case 2: return "GRAY16";
+      case 4: return nComponents == 1 ? "GRAY32" : "RGB32";
+      case 8: return "RGB64";
+      default: return "Unknown";
+   }
+}
+
+} // anonymous namespace
+
+
+PreviewGenerator::PreviewGenerator(double maxRate, unsigned downsampling) :
+   maxRate_(maxRate),
+   downsampling_(downsampling),
+   lutMin_(0),
+   lutMax_(0),
+   haveLastTime_(false)
+{
+}
+
+
+bool
+PreviewGenerator::IsSupportedDownsampling(unsigned downsampling)
+{
+   return SoftwareROIBinning::IsSupportedBinning(downsampling);
+}
+
+
+void
+PreviewGenerator::SetMaxRate(double maxRate)
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   maxRate_ = maxRate;
+}
+
+
+double
+PreviewGenerator::GetMaxRate() const
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   return maxRate_;
+}
+
+
+void
+PreviewGenerator::SetDownsampling(unsigned downsampling)
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   downsampling_ = downsampling;
+}
+
+
+unsigned
+PreviewGenerator::GetDownsampling() const
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   return downsampling_;
+}
+
+
+void
+PreviewGenerator::Set8BitRange(unsigned min, unsigned max)
+{
+   boost::shared_ptr<std::vector<unsigned char> > lut(
+         new std::vector<unsigned char>(65536));
+   const double scale = 255.0 / (max - min);
+   for (unsigned i = 0; i < 65536; ++i)
+   {
+      if (i <= min)
+         (*lut)[i] = 0;
+      else if (i >= max)
+         (*lut)[i] = 255;
+      else
+         (*lut)[i] = static_cast<unsigned char>((i - min) * scale + 0.5);
+   }
+
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   lut_ = lut;
+   lutMin_ = min;
+   lutMax_ = max;
+}
+
+
+void
+PreviewGenerator::Clear8BitRange()
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   lut_.reset();
+}
+
+
+bool
+PreviewGenerator::Get8BitRange(unsigned& min, unsigned& max) const
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   if (!lut_)
+      return false;
+   min = lutMin_;
+   max = lutMax_;
+   return true;
+}
+
+
+bool
+PreviewGenerator::Offer(const unsigned char* pixels, unsigned width,
+      unsigned height, unsigned byteDepth, unsigned nComponents,
+      const Metadata& md)
+{
+   unsigned downsampling;
+   boost::shared_ptr<const std::vector<unsigned char> > lut;
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      boost::posix_time::ptime now =
+         boost::posix_time::microsec_clock::universal_time();
+      if (maxRate_ > 0.0 && haveLastTime_ &&
+            (now - lastTime_).total_microseconds() < 1e6 / maxRate_)
+         return false;
+
+      downsampling = downsampling_;
+      lut = lut_;
+      lastTime_ = now;
+      haveLastTime_ = true;
+   }
+
+   SoftwareROIBinning box(0, 0, 0, 0, downsampling, true);
+   unsigned outWidth, outHeight;
+   if (!box.IsSupportedPixelType(byteDepth, nComponents) ||
+         !box.GetOutputSize(width, height, outWidth, outHeight))
+      return false;
+
+   const unsigned samplesPerPixel = nComponents > 1 ? nComponents : 1;
+   const size_t outSamples = (size_t)outWidth * outHeight * samplesPerPixel;
+   const bool to8Bit = lut && byteDepth == 2 * samplesPerPixel;
+
+   boost::shared_ptr<PreviewImage> preview(new PreviewImage());
+   preview->width = outWidth;
+   preview->height = outHeight;
+   preview->byteDepth = to8Bit ? byteDepth / 2 : byteDepth;
+   preview->nComponents = nComponents;
+   if (to8Bit)
+   {
+      downsampled_.resize(outSamples * 2);
+      box.Apply(pixels, width, height, byteDepth, nComponents, &downsampled_[0]);
+      const uint16_t* samples = reinterpret_cast<const uint16_t*>(&downsampled_[0]);
+      const unsigned char* table = &(*lut)[0];
+      preview->pixels.resize(outSamples);
+      for (size_t i = 0; i < outSamples; ++i)
+         preview->pixels[i] = table[samples[i]];
+   }
+   else
+   {
+      preview->pixels.resize((size_t)outWidth * outHeight * byteDepth);
+      box.Apply(pixels, width, height, byteDepth, nComponents, &preview->pixels[0]);
+   }
+
+   preview->metadata = md;
+   preview->metadata.PutImageTag("Width", outWidth);
+   preview->metadata.PutImageTag("Height", outHeight);
+   preview->metadata.PutImageTag(MM::g_Keyword_PixelType,
+         PixelTypeName(preview->byteDepth, nComponents));
+   if (to8Bit)
+      preview->metadata.PutImageTag(MM::g_Keyword_Metadata_BitDepth, 8);
+   preview->metadata.PutImageTag("PreviewDownsampling", downsampling);
+
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   last_ = preview;
+   return true;
+}
+
+
+boost::shared_ptr<const PreviewImage>
+PreviewGenerator::GetLastPreview() const
+{
+   boost::lock_guard<boost::mutex> lock(mutex_);
+   return last_;
+}
+
+} // namespace mm
@@ -0,0 +1,107 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          PreviewGenerator.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Reduced, rate-limited previews of images inserted into
+//                the circular buffer
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "../MMDevice/ImageMetadata.h"
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <vector>
+
+namespace mm
+{
+
+// A preview image, which does not change once made
+struct PreviewImage
+{
+   std::vector<unsigned char> pixels;
+   unsigned width;
+   unsigned height;
+   unsigned byteDepth;
+   unsigned nComponents;
+   Metadata metadata;
+};
+
+/**
+ * Makes reduced copies of images as they are inserted into the circular
+ * buffer, for display while a fast sequence acquisition runs.
+ *
+ * At most maxRate images per second are used; the others are skipped at
+ * the cost of a clock reading. Each image used is downsampled by averaging
+ * (rounded) blocks of 2x2, 4x4 or 8x8 pixels and, if a range is set, its
+ * 16-bit samples are mapped to 8 bits through a lookup table. Only the last
+ * preview is kept.
+ *
+ * The settings can be changed while images are inserted.
+ */
+class PreviewGenerator
+{
+public:
+   // A maxRate of 0 or less uses every image
+   PreviewGenerator(double maxRate, unsigned downsampling);
+
+   // Supported downsampling factors are 1, 2, 4 and 8
+   static bool IsSupportedDownsampling(unsigned downsampling);
+
+   void SetMaxRate(double maxRate);
+   double GetMaxRate() const;
+   void SetDownsampling(unsigned downsampling);
+   unsigned GetDownsampling() const;
+
+   // Maps 16-bit samples from min (and below) to 0 and from max (and
+   // above) to 255, linearly in between. Requires min < max.
+   void Set8BitRange(unsigned min, unsigned max);
+   void Clear8BitRange();
+   // Returns false if 16-bit samples are kept
+   bool Get8BitRange(unsigned& min, unsigned& max) const;
+
+   // Makes the preview of an image, unless the previous one was made less
+   // than 1 / maxRate ago or the pixel type is not supported (32-bit
+   // grayscale with downsampling). Returns true if a preview was made.
+   bool Offer(const unsigned char* pixels, unsigned width, unsigned height,
+         unsigned byteDepth, unsigned nComponents, const Metadata& md);
+
+   // Returns null if no preview has been made yet
+   boost::shared_ptr<const PreviewImage> GetLastPreview() const;
+
+private:
+   mutable boost::mutex mutex_;
+   double maxRate_;
+   unsigned downsampling_;
+   // 8-bit value of each 16-bit sample; null if no range is set
+   boost::shared_ptr<const std::vector<unsigned char> > lut_;
+   unsigned lutMin_;
+   unsigned lutMax_;
+   bool haveLastTime_;
+   boost::posix_time::ptime lastTime_;
+   boost::shared_ptr<const PreviewImage> last_;
+
+   // Used by Offer() only, which is called by one thread at a time
+   std::vector<unsigned char> downsampled_;
+
+   PreviewGenerator(const PreviewGenerator&);
+   PreviewGenerator& operator=(const PreviewGenerator&);
+};
+
+} // namespace mm
@@ -0,0 +1,206 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          SharedFrameRing.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Exports images to a shared-memory frame ring that other
+//                processes can read
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "SharedFrameRing.h"
+
+#include <cstring>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace mm
+{
+
+using namespace sharedring;
+
+namespace
+{
+
+std::string SegmentName(const std::string& name)
+{
+   if (!name.empty() && name[0] == '/')
+      return name;
+   return "/" + name;
+}
+
+SlotHeader* GetSlot(RingHeader* header, uint64_t frameNumber)
+{
+   unsigned char* base = reinterpret_cast<unsigned char*>(header);
+   return reinterpret_cast<SlotHeader*>(base + header->firstSlotOffset +
+         (frameNumber % header->slotCount) * header->slotStride);
+}
+
+} // anonymous namespace
+
+
+#ifndef _WIN32
+
+SharedFrameRing::SharedFrameRing(const std::string& name, unsigned slotCount,
+      size_t pixelCapacity, size_t metadataCapacity) throw (CMMError) :
+   name_(SegmentName(name)),
+   header_(0),
+   segmentSize_(0)
+{
+   if (name_.length() < 2 || name_.find('/', 1) != std::string::npos)
+      throw CMMError("Invalid shared memory name: " + name);
+   if (slotCount == 0)
+      throw CMMError("The shared frame ring needs at least one slot");
+
+   uint64_t firstSlotOffset = AlignUp(sizeof(RingHeader));
+   uint64_t slotStride = AlignUp(AlignUp(sizeof(SlotHeader)) +
+         AlignUp(pixelCapacity) + metadataCapacity);
+   segmentSize_ = static_cast<size_t>(firstSlotOffset + slotCount * slotStride);
+
+   // A segment left behind by a crashed process is replaced
+   shm_unlink(name_.c_str());
+   int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+   if (fd < 0)
+      throw CMMError("Cannot create shared memory " + name_ + ": " +
+            std::strerror(errno));
+   if (ftruncate(fd, segmentSize_) != 0)
+   {
+      int err = errno;
+      close(fd);
+      shm_unlink(name_.c_str());
+      throw CMMError("Cannot allocate shared memory " + name_ + ": " +
+            std::strerror(err));
+   }
+   void* addr = mmap(0, segmentSize_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   int err = errno;
+   close(fd);
+   if (addr == MAP_FAILED)
+   {
+      shm_unlink(name_.c_str());
+      throw CMMError("Cannot map shared memory " + name_ + ": " +
+            std::strerror(err));
+   }
+
+   // The segment is zero-filled, so all slots start out empty (sequence 0)
+   header_ = static_cast<RingHeader*>(addr);
+   header_->version = Version;
+   header_->slotCount = slotCount;
+   header_->firstSlotOffset = static_cast<uint32_t>(firstSlotOffset);
+   header_->slotStride = slotStride;
+   header_->pixelCapacity = pixelCapacity;
+   header_->metadataCapacity = metadataCapacity;
+   header_->publishedCount = 0;
+   header_->skippedCount = 0;
+   header_->writerActive = 1;
+   // Readers check the magic number last
+   FullBarrier();
+   header_->magic = Magic;
+}
+
+
+SharedFrameRing::~SharedFrameRing()
+{
+   header_->writerActive = 0;
+   FullBarrier();
+   munmap(header_, segmentSize_);
+   shm_unlink(name_.c_str());
+}
+
+
+size_t
+SharedFrameRing::GetPixelCapacity() const
+{
+   return static_cast<size_t>(header_->pixelCapacity);
+}
+
+
+bool
+SharedFrameRing::Publish(const unsigned char* pixels, unsigned width,
+      unsigned height, unsigned bytesPerPixel, unsigned numComponents,
+      unsigned channel, const std::string& serializedMetadata)
+{
+   uint64_t pixelBytes = static_cast<uint64_t>(width) * height * bytesPerPixel;
+   if (pixelBytes > header_->pixelCapacity ||
+         serializedMetadata.size() > header_->metadataCapacity)
+   {
+      header_->skippedCount = header_->skippedCount + 1;
+      return false;
+   }
+
+   uint64_t frameNumber = header_->publishedCount;
+   SlotHeader* slot = GetSlot(header_, frameNumber);
+   unsigned char* slotPixels =
+      reinterpret_cast<unsigned char*>(slot) + AlignUp(sizeof(SlotHeader));
+   unsigned char* slotMetadata = slotPixels + AlignUp(header_->pixelCapacity);
+
+   slot->sequence = CompleteSequence(frameNumber) - 1;
+   FullBarrier();
+
+   slot->frameNumber = frameNumber;
+   slot->pixelBytes = pixelBytes;
+   slot->metadataBytes = static_cast<uint32_t>(serializedMetadata.size());
+   slot->width = width;
+   slot->height = height;
+   slot->bytesPerPixel = bytesPerPixel;
+   slot->numComponents = numComponents;
+   slot->channel = channel;
+   std::memcpy(slotPixels, pixels, static_cast<size_t>(pixelBytes));
+   std::memcpy(slotMetadata, serializedMetadata.data(), serializedMetadata.size());
+
+   FullBarrier();
+   slot->sequence = CompleteSequence(frameNumber);
+   FullBarrier();
+   header_->publishedCount = frameNumber + 1;
+   return true;
+}
+
+#else // _WIN32
+
+SharedFrameRing::SharedFrameRing(const std::string& name, unsigned,
+      size_t, size_t) throw (CMMError) :
+   name_(SegmentName(name)),
+   header_(0),
+   segmentSize_(0)
+{
+   throw CMMError("Shared memory frame export is not supported on this platform");
+}
+
+
+SharedFrameRing::~SharedFrameRing()
+{
+}
+
+
+size_t
+SharedFrameRing::GetPixelCapacity() const
+{
+   return 0;
+}
+
+
+bool
+SharedFrameRing::Publish(const unsigned char*, unsigned, unsigned, unsigned,
+      unsigned, unsigned, const std::string&)
+{
+   return false;
+}
+
+#endif // _WIN32
+
+} // namespace mm
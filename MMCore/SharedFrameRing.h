@@ -0,0 +1,67 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          SharedFrameRing.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Exports images to a shared-memory frame ring that other
+//                processes can read
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "Error.h"
+#include "SharedFrameRingLayout.h"
+
+#include <string>
+
+namespace mm
+{
+
+/**
+ * Writer side of the shared-memory frame ring: exports images to a named
+ * POSIX shared-memory segment, where other processes can read them with
+ * SharedFrameRingReader. The layout is described in SharedFrameRingLayout.h.
+ *
+ * Publish() must not be called concurrently.
+ */
+class SharedFrameRing
+{
+   std::string name_;
+   sharedring::RingHeader* header_;
+   size_t segmentSize_;
+
+public:
+   // Creates the segment, replacing any existing segment with the same name
+   SharedFrameRing(const std::string& name, unsigned slotCount,
+         size_t pixelCapacity, size_t metadataCapacity) throw (CMMError);
+   // Marks the ring inactive and removes the name; readers that still have
+   // the segment open can keep reading it
+   ~SharedFrameRing();
+
+   const std::string& GetName() const { return name_; }
+   size_t GetPixelCapacity() const;
+
+   // Returns false (and counts the frame as skipped) if the image or its
+   // metadata do not fit into a slot
+   bool Publish(const unsigned char* pixels, unsigned width, unsigned height,
+         unsigned bytesPerPixel, unsigned numComponents, unsigned channel,
+         const std::string& serializedMetadata);
+
+private:
+   SharedFrameRing(const SharedFrameRing&);
+   SharedFrameRing& operator=(const SharedFrameRing&);
+};
+
+} // namespace mm
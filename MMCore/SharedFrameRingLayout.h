@@ -0,0 +1,103 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          SharedFrameRingLayout.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Memory layout of the shared-memory frame ring
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+// Memory layout of the shared-memory frame ring exported by the core (see
+// SharedFrameRing.h) and read by other processes (see
+// SharedFrameRingReader.h). This header, SharedFrameRingReader.h and
+// SharedFrameRingReader.cpp do not depend on the rest of MMCore, so that
+// they can be compiled into consumer programs as they are.
+//
+// The segment starts with a RingHeader, followed by slotCount slots of
+// slotStride bytes each. Every slot is a SlotHeader followed by the pixels
+// (up to pixelCapacity bytes) and the serialized Metadata (up to
+// metadataCapacity bytes). Frame n is written to slot n % slotCount.
+//
+// There is a single writer and no locks. Each slot carries a sequence
+// number that is odd while the slot is being written and 2 * (n + 1) once
+// it holds the complete frame n. A reader checks the sequence number before
+// and after using a slot to detect that the frame was overwritten.
+//
+// Shared memory is only supported on POSIX systems.
+
+#include <stdint.h>
+
+namespace mm
+{
+namespace sharedring
+{
+
+const uint32_t Magic = 0x474e524d; // "MRNG"
+const uint32_t Version = 1;
+const uint32_t Alignment = 64;
+
+struct RingHeader
+{
+   uint32_t magic;
+   uint32_t version;
+   uint32_t slotCount;
+   uint32_t firstSlotOffset;
+   uint64_t slotStride;
+   uint64_t pixelCapacity;
+   uint64_t metadataCapacity;
+
+   // Number of frames published so far; frame n is complete once this
+   // exceeds n
+   volatile uint64_t publishedCount;
+   // Frames that did not fit into a slot and were not published
+   volatile uint64_t skippedCount;
+   // Cleared when the writer stops exporting
+   volatile uint32_t writerActive;
+};
+
+struct SlotHeader
+{
+   volatile uint64_t sequence;
+   uint64_t frameNumber;
+   uint64_t pixelBytes;
+   uint32_t metadataBytes;
+   uint32_t width;
+   uint32_t height;
+   uint32_t bytesPerPixel;
+   uint32_t numComponents;
+   uint32_t channel;
+};
+
+inline uint64_t CompleteSequence(uint64_t frameNumber)
+{
+   return 2 * (frameNumber + 1);
+}
+
+inline uint64_t AlignUp(uint64_t size)
+{
+   return (size + Alignment - 1) / Alignment * Alignment;
+}
+
+#ifndef _WIN32
+// Full fence, ordering the accesses to a slot against its sequence number
+inline void FullBarrier()
+{
+   __sync_synchronize();
+}
+#endif
+
+} // namespace sharedring
+} // namespace mm
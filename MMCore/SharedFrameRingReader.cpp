@@ -0,0 +1,226 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          SharedFrameRingReader.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Reads frames from the shared-memory frame ring exported
+//                by the core
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "SharedFrameRingReader.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace mm
+{
+
+using namespace sharedring;
+
+SharedFrameRingReader::SharedFrameRingReader() :
+   header_(0),
+   segmentSize_(0),
+   nextFrame_(0),
+   droppedCount_(0)
+{
+}
+
+
+SharedFrameRingReader::~SharedFrameRingReader()
+{
+   Close();
+}
+
+
+#ifndef _WIN32
+
+bool
+SharedFrameRingReader::Open(const std::string& name)
+{
+   Close();
+
+   std::string segmentName = (!name.empty() && name[0] == '/') ? name : "/" + name;
+   int fd = shm_open(segmentName.c_str(), O_RDONLY, 0);
+   if (fd < 0)
+      return false;
+
+   struct stat st;
+   void* addr = MAP_FAILED;
+   if (fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(RingHeader)))
+      addr = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+   if (addr == MAP_FAILED)
+      return false;
+
+   const RingHeader* header = static_cast<const RingHeader*>(addr);
+   FullBarrier();
+   bool compatible = header->magic == Magic && header->version == Version &&
+      header->slotCount > 0 &&
+      header->firstSlotOffset + header->slotCount * header->slotStride <=
+         static_cast<uint64_t>(st.st_size);
+   if (!compatible)
+   {
+      munmap(addr, st.st_size);
+      return false;
+   }
+
+   header_ = header;
+   segmentSize_ = st.st_size;
+   nextFrame_ = header_->publishedCount;
+   droppedCount_ = 0;
+   return true;
+}
+
+
+void
+SharedFrameRingReader::Close()
+{
+   if (header_ != 0)
+   {
+      munmap(const_cast<RingHeader*>(header_), segmentSize_);
+      header_ = 0;
+      segmentSize_ = 0;
+   }
+}
+
+
+bool
+SharedFrameRingReader::IsWriterActive() const
+{
+   return header_ != 0 && header_->writerActive != 0;
+}
+
+
+uint64_t
+SharedFrameRingReader::GetSkippedCount() const
+{
+   return header_ != 0 ? header_->skippedCount : 0;
+}
+
+
+bool
+SharedFrameRingReader::NextFrame(Frame& frame)
+{
+   if (header_ == 0)
+      return false;
+
+   for (;;)
+   {
+      uint64_t published = header_->publishedCount;
+      FullBarrier();
+      if (nextFrame_ >= published)
+         return false;
+
+      // The oldest frames may already have been overwritten (or be in the
+      // process of being overwritten by the next frame)
+      uint64_t keep = header_->slotCount > 1 ? header_->slotCount - 1 : 1;
+      uint64_t oldest = published > keep ? published - keep : 0;
+      if (nextFrame_ < oldest)
+      {
+         droppedCount_ += oldest - nextFrame_;
+         nextFrame_ = oldest;
+      }
+
+      uint64_t frameNumber = nextFrame_++;
+      if (ReadFrame(frameNumber, frame))
+         return true;
+      ++droppedCount_;
+   }
+}
+
+
+bool
+SharedFrameRingReader::LatestFrame(Frame& frame)
+{
+   if (header_ == 0)
+      return false;
+
+   for (;;)
+   {
+      uint64_t published = header_->publishedCount;
+      FullBarrier();
+      if (nextFrame_ >= published)
+         return false;
+
+      nextFrame_ = published;
+      if (ReadFrame(published - 1, frame))
+         return true;
+   }
+}
+
+
+bool
+SharedFrameRingReader::IsValid(const Frame& frame) const
+{
+   if (header_ == 0)
+      return false;
+
+   const unsigned char* base = reinterpret_cast<const unsigned char*>(header_);
+   const SlotHeader* slot = reinterpret_cast<const SlotHeader*>(base +
+         header_->firstSlotOffset +
+         (frame.frameNumber % header_->slotCount) * header_->slotStride);
+   FullBarrier();
+   return slot->sequence == CompleteSequence(frame.frameNumber);
+}
+
+
+bool
+SharedFrameRingReader::ReadFrame(uint64_t frameNumber, Frame& frame) const
+{
+   const unsigned char* base = reinterpret_cast<const unsigned char*>(header_);
+   const SlotHeader* slot = reinterpret_cast<const SlotHeader*>(base +
+         header_->firstSlotOffset +
+         (frameNumber % header_->slotCount) * header_->slotStride);
+
+   if (slot->sequence != CompleteSequence(frameNumber))
+      return false;
+   FullBarrier();
+
+   const unsigned char* pixels =
+      reinterpret_cast<const unsigned char*>(slot) + AlignUp(sizeof(SlotHeader));
+   frame.frameNumber = frameNumber;
+   frame.pixels = pixels;
+   frame.pixelBytes = static_cast<size_t>(slot->pixelBytes);
+   frame.width = slot->width;
+   frame.height = slot->height;
+   frame.bytesPerPixel = slot->bytesPerPixel;
+   frame.numComponents = slot->numComponents;
+   frame.channel = slot->channel;
+   frame.metadata = reinterpret_cast<const char*>(pixels + AlignUp(header_->pixelCapacity));
+   frame.metadataBytes = slot->metadataBytes;
+
+   // The header fields are only consistent if the slot was not touched
+   // while they were read
+   return IsValid(frame);
+}
+
+#else // _WIN32
+
+bool SharedFrameRingReader::Open(const std::string&) { return false; }
+void SharedFrameRingReader::Close() {}
+bool SharedFrameRingReader::IsWriterActive() const { return false; }
+uint64_t SharedFrameRingReader::GetSkippedCount() const { return 0; }
+bool SharedFrameRingReader::NextFrame(Frame&) { return false; }
+bool SharedFrameRingReader::LatestFrame(Frame&) { return false; }
+bool SharedFrameRingReader::IsValid(const Frame&) const { return false; }
+bool SharedFrameRingReader::ReadFrame(uint64_t, Frame&) const { return false; }
+
+#endif // _WIN32
+
+} // namespace mm
@@ -0,0 +1,104 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          SharedFrameRingReader.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Reads frames from the shared-memory frame ring exported
+//                by the core
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "SharedFrameRingLayout.h"
+
+#include <cstddef>
+#include <string>
+
+namespace mm
+{
+
+/**
+ * Reader side of the shared-memory frame ring exported by the core
+ * (CMMCore::startSharedFrameExport()). Frames are read in place, without
+ * copying or locking. Any number of readers can read the same ring.
+ *
+ * The pixels and metadata of a frame stay in the ring and are overwritten
+ * once the writer has gone around it. Call IsValid() after using a frame:
+ * if it returns false, the frame was (possibly partially) overwritten in
+ * the meantime and the data must be discarded.
+ *
+ * This class does not depend on the rest of MMCore; see
+ * SharedFrameRingLayout.h.
+ */
+class SharedFrameRingReader
+{
+public:
+   struct Frame
+   {
+      uint64_t frameNumber;
+      const unsigned char* pixels;
+      size_t pixelBytes;
+      unsigned width;
+      unsigned height;
+      unsigned bytesPerPixel;
+      unsigned numComponents;
+      unsigned channel;
+      // Metadata in the format of Metadata::Serialize() (not null-terminated)
+      const char* metadata;
+      size_t metadataBytes;
+   };
+
+private:
+   const sharedring::RingHeader* header_;
+   size_t segmentSize_;
+   uint64_t nextFrame_;
+   uint64_t droppedCount_;
+
+public:
+   SharedFrameRingReader();
+   ~SharedFrameRingReader();
+
+   // Returns false if the ring does not exist or is not compatible.
+   // Reading starts with the next frame to be published.
+   bool Open(const std::string& name);
+   void Close();
+   bool IsOpen() const { return header_ != 0; }
+
+   // False once the writer has stopped exporting; frames that were already
+   // published can still be read
+   bool IsWriterActive() const;
+
+   // Gets the oldest frame that has not been read yet and is still in the
+   // ring. Returns false if there is no new frame.
+   bool NextFrame(Frame& frame);
+   // Gets the most recent frame, skipping any unread older frames. Returns
+   // false if there is no new frame.
+   bool LatestFrame(Frame& frame);
+   // Whether the frame is still intact
+   bool IsValid(const Frame& frame) const;
+
+   // Frames that were overwritten before they could be read
+   uint64_t GetDroppedCount() const { return droppedCount_; }
+   // Frames that the writer could not publish because they were too large
+   uint64_t GetSkippedCount() const;
+
+private:
+   bool ReadFrame(uint64_t frameNumber, Frame& frame) const;
+
+   SharedFrameRingReader(const SharedFrameRingReader&);
+   SharedFrameRingReader& operator=(const SharedFrameRingReader&);
+};
+
+} // namespace mm
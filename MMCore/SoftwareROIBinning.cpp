@@ -0,0 +1,390 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          SoftwareROIBinning.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Crops and bins camera images in software
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "SoftwareROIBinning.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdint.h>
+#include <vector>
+
+// SSE2 is part of x86-64
+#if defined(_M_X64) || defined(__x86_64__)
+#define SOFTWAREBINNING_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace mm
+{
+
+namespace
+{
+
+// acc[i] += samples[i]
+template <typename SampleType>
+inline void AddRowScalar(uint32_t* acc, const SampleType* samples, size_t count)
+{
+   for (size_t i = 0; i < count; ++i)
+      acc[i] += samples[i];
+}
+
+void AddRow(uint32_t* acc, const uint8_t* samples, size_t count)
+{
+   size_t i = 0;
+#ifdef SOFTWAREBINNING_SSE2
+   const __m128i zero = _mm_setzero_si128();
+   for (; i + 16 <= count; i += 16)
+   {
+      __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+      __m128i lo = _mm_unpacklo_epi8(s, zero);
+      __m128i hi = _mm_unpackhi_epi8(s, zero);
+      __m128i* a = reinterpret_cast<__m128i*>(acc + i);
+      _mm_storeu_si128(a + 0, _mm_add_epi32(_mm_loadu_si128(a + 0), _mm_unpacklo_epi16(lo, zero)));
+      _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), _mm_unpackhi_epi16(lo, zero)));
+      _mm_storeu_si128(a + 2, _mm_add_epi32(_mm_loadu_si128(a + 2), _mm_unpacklo_epi16(hi, zero)));
+      _mm_storeu_si128(a + 3, _mm_add_epi32(_mm_loadu_si128(a + 3), _mm_unpackhi_epi16(hi, zero)));
+   }
+#endif
+   AddRowScalar(acc + i, samples + i, count - i);
+}
+
+void AddRow(uint32_t* acc, const uint16_t* samples, size_t count)
+{
+   size_t i = 0;
+#ifdef SOFTWAREBINNING_SSE2
+   const __m128i zero = _mm_setzero_si128();
+   for (; i + 8 <= count; i += 8)
+   {
+      __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+      __m128i* a = reinterpret_cast<__m128i*>(acc + i);
+      _mm_storeu_si128(a + 0, _mm_add_epi32(_mm_loadu_si128(a + 0), _mm_unpacklo_epi16(s, zero)));
+      _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), _mm_unpackhi_epi16(s, zero)));
+   }
+#endif
+   AddRowScalar(acc + i, samples + i, count - i);
+}
+
+#ifdef SOFTWAREBINNING_SSE2
+// Sums of adjacent lanes: a0+a1, a2+a3, b0+b1, b2+b3
+inline __m128i PairSums(__m128i a, __m128i b)
+{
+   __m128 fa = _mm_castsi128_ps(a);
+   __m128 fb = _mm_castsi128_ps(b);
+   __m128i even = _mm_castps_si128(_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(2, 0, 2, 0)));
+   __m128i odd = _mm_castps_si128(_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(3, 1, 3, 1)));
+   return _mm_add_epi32(even, odd);
+}
+#endif
+
+// Sums each run of binning pixels of a row of column sums, per component
+void SumPixels(const uint32_t* acc, size_t outPixels,
+      unsigned samplesPerPixel, unsigned binning, uint32_t* sums)
+{
+   size_t j = 0;
+#ifdef SOFTWAREBINNING_SSE2
+   if (samplesPerPixel == 4)
+   {
+      for (; j < outPixels; ++j)
+      {
+         const uint32_t* a = acc + j * binning * 4;
+         __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+         for (unsigned k = 1; k < binning; ++k)
+            v = _mm_add_epi32(v, _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + 4 * k)));
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + 4 * j), v);
+      }
+   }
+   else if (samplesPerPixel == 1 && binning == 2)
+   {
+      for (; j + 4 <= outPixels; j += 4)
+      {
+         const __m128i* a = reinterpret_cast<const __m128i*>(acc + 2 * j);
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + j),
+               PairSums(_mm_loadu_si128(a), _mm_loadu_si128(a + 1)));
+      }
+   }
+   else if (samplesPerPixel == 1 && binning == 4)
+   {
+      for (; j + 4 <= outPixels; j += 4)
+      {
+         const __m128i* a = reinterpret_cast<const __m128i*>(acc + 4 * j);
+         __m128i lo = PairSums(_mm_loadu_si128(a), _mm_loadu_si128(a + 1));
+         __m128i hi = PairSums(_mm_loadu_si128(a + 2), _mm_loadu_si128(a + 3));
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + j), PairSums(lo, hi));
+      }
+   }
+   else if (samplesPerPixel == 1 && binning == 8)
+   {
+      for (; j + 4 <= outPixels; j += 4)
+      {
+         const __m128i* a = reinterpret_cast<const __m128i*>(acc + 8 * j);
+         __m128i q0 = PairSums(_mm_loadu_si128(a), _mm_loadu_si128(a + 1));
+         __m128i q1 = PairSums(_mm_loadu_si128(a + 2), _mm_loadu_si128(a + 3));
+         __m128i q2 = PairSums(_mm_loadu_si128(a + 4), _mm_loadu_si128(a + 5));
+         __m128i q3 = PairSums(_mm_loadu_si128(a + 6), _mm_loadu_si128(a + 7));
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + j),
+               PairSums(PairSums(q0, q1), PairSums(q2, q3)));
+      }
+   }
+#endif
+   for (; j < outPixels; ++j)
+   {
+      for (unsigned c = 0; c < samplesPerPixel; ++c)
+      {
+         uint32_t sum = 0;
+         for (unsigned k = 0; k < binning; ++k)
+            sum += acc[(j * binning + k) * samplesPerPixel + c];
+         sums[j * samplesPerPixel + c] = sum;
+      }
+   }
+}
+
+// out[i] = sums[i] >> shift, rounded, if shift > 0 (averaging); otherwise
+// sums[i] clipped to maxValue
+template <typename SampleType>
+inline void StoreScalar(const uint32_t* sums, size_t count, unsigned shift,
+      uint32_t maxValue, SampleType* out)
+{
+   if (shift > 0)
+   {
+      const uint32_t half = 1u << (shift - 1);
+      for (size_t i = 0; i < count; ++i)
+         out[i] = static_cast<SampleType>((sums[i] + half) >> shift);
+   }
+   else
+   {
+      for (size_t i = 0; i < count; ++i)
+         out[i] = static_cast<SampleType>(std::min(sums[i], maxValue));
+   }
+}
+
+#ifdef SOFTWAREBINNING_SSE2
+// Sums stay far below 2^31, so the signed compare of SSE2 orders them
+inline __m128i Reduce(__m128i v, unsigned shift, __m128i half, __m128i maxValue)
+{
+   if (shift > 0)
+      return _mm_srli_epi32(_mm_add_epi32(v, half), shift);
+   __m128i greater = _mm_cmpgt_epi32(v, maxValue);
+   return _mm_or_si128(_mm_and_si128(greater, maxValue), _mm_andnot_si128(greater, v));
+}
+#endif
+
+void Store(const uint32_t* sums, size_t count, unsigned shift, uint8_t* out)
+{
+   size_t i = 0;
+#ifdef SOFTWAREBINNING_SSE2
+   const __m128i half = _mm_set1_epi32(shift > 0 ? 1 << (shift - 1) : 0);
+   const __m128i maxValue = _mm_set1_epi32(0xff);
+   for (; i + 16 <= count; i += 16)
+   {
+      const __m128i* s = reinterpret_cast<const __m128i*>(sums + i);
+      __m128i v0 = Reduce(_mm_loadu_si128(s + 0), shift, half, maxValue);
+      __m128i v1 = Reduce(_mm_loadu_si128(s + 1), shift, half, maxValue);
+      __m128i v2 = Reduce(_mm_loadu_si128(s + 2), shift, half, maxValue);
+      __m128i v3 = Reduce(_mm_loadu_si128(s + 3), shift, half, maxValue);
+      __m128i packed = _mm_packus_epi16(_mm_packs_epi32(v0, v1), _mm_packs_epi32(v2, v3));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+   }
+#endif
+   StoreScalar(sums + i, count - i, shift, 0xff, out + i);
+}
+
+void Store(const uint32_t* sums, size_t count, unsigned shift, uint16_t* out)
+{
+   size_t i = 0;
+#ifdef SOFTWAREBINNING_SSE2
+   const __m128i half = _mm_set1_epi32(shift > 0 ? 1 << (shift - 1) : 0);
+   const __m128i maxValue = _mm_set1_epi32(0xffff);
+   // The signed pack of SSE2 needs values offset by 2^15
+   const __m128i offset32 = _mm_set1_epi32(0x8000);
+   const __m128i offset16 = _mm_set1_epi16((short)0x8000);
+   for (; i + 8 <= count; i += 8)
+   {
+      const __m128i* s = reinterpret_cast<const __m128i*>(sums + i);
+      __m128i v0 = _mm_sub_epi32(Reduce(_mm_loadu_si128(s + 0), shift, half, maxValue), offset32);
+      __m128i v1 = _mm_sub_epi32(Reduce(_mm_loadu_si128(s + 1), shift, half, maxValue), offset32);
+      __m128i packed = _mm_xor_si128(_mm_packs_epi32(v0, v1), offset16);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+   }
+#endif
+   StoreScalar(sums + i, count - i, shift, 0xffff, out + i);
+}
+
+template <typename SampleType>
+void Bin(const SampleType* samples, size_t rowSamples, unsigned x, unsigned y,
+      unsigned outWidth, unsigned outHeight, unsigned samplesPerPixel,
+      unsigned binning, bool average, SampleType* out)
+{
+   const size_t regionRowSamples = (size_t)outWidth * binning * samplesPerPixel;
+   const size_t outRowSamples = (size_t)outWidth * samplesPerPixel;
+   // Averages divide by binning * binning, a power of 2
+   unsigned shift = 0;
+   if (average)
+   {
+      for (unsigned b = binning; b > 1; b /= 2)
+         shift += 2;
+   }
+
+   std::vector<uint32_t> acc(regionRowSamples);
+   std::vector<uint32_t> sums(outRowSamples);
+   for (unsigned row = 0; row < outHeight; ++row)
+   {
+      std::fill(acc.begin(), acc.end(), 0);
+      for (unsigned k = 0; k < binning; ++k)
+      {
+         const SampleType* line = samples +
+            ((size_t)y + (size_t)row * binning + k) * rowSamples +
+            (size_t)x * samplesPerPixel;
+         AddRow(&acc[0], line, regionRowSamples);
+      }
+      SumPixels(&acc[0], outWidth, samplesPerPixel, binning, &sums[0]);
+      Store(&sums[0], outRowSamples, shift, out + row * outRowSamples);
+   }
+}
+
+} // anonymous namespace
+
+
+SoftwareROIBinning::SoftwareROIBinning(unsigned x, unsigned y,
+      unsigned width, unsigned height, unsigned binning, bool average) :
+   x_(x),
+   y_(y),
+   width_(width),
+   height_(height),
+   binning_(binning),
+   average_(average)
+{
+   if (width_ == 0 || height_ == 0)
+   {
+      x_ = y_ = 0;
+      width_ = height_ = 0;
+   }
+}
+
+
+bool
+SoftwareROIBinning::IsSupportedBinning(unsigned binning)
+{
+   return binning == 1 || binning == 2 || binning == 4 || binning == 8;
+}
+
+
+bool
+SoftwareROIBinning::GetRegion(unsigned imageWidth, unsigned imageHeight,
+      unsigned& x, unsigned& y, unsigned& width, unsigned& height) const
+{
+   x = 0;
+   y = 0;
+   width = imageWidth;
+   height = imageHeight;
+   if (HasROI())
+   {
+      if (x_ >= imageWidth || y_ >= imageHeight)
+         return false;
+      x = x_;
+      y = y_;
+      width = std::min(width_, imageWidth - x_);
+      height = std::min(height_, imageHeight - y_);
+   }
+   width -= width % binning_;
+   height -= height % binning_;
+   return width > 0 && height > 0;
+}
+
+
+bool
+SoftwareROIBinning::GetOutputSize(unsigned imageWidth, unsigned imageHeight,
+      unsigned& outWidth, unsigned& outHeight) const
+{
+   unsigned x, y, width, height;
+   if (!GetRegion(imageWidth, imageHeight, x, y, width, height))
+      return false;
+   outWidth = width / binning_;
+   outHeight = height / binning_;
+   return true;
+}
+
+
+bool
+SoftwareROIBinning::IsSupportedPixelType(unsigned byteDepth,
+      unsigned nComponents) const
+{
+   if (binning_ == 1)
+      return true;
+   // 8 or 16 bit samples; 32-bit grayscale cannot be summed
+   unsigned samplesPerPixel = nComponents > 1 ? nComponents : 1;
+   unsigned bytesPerSample = byteDepth / samplesPerPixel;
+   return byteDepth % samplesPerPixel == 0 &&
+      (bytesPerSample == 1 || bytesPerSample == 2);
+}
+
+
+void
+SoftwareROIBinning::Apply(const unsigned char* pixels, unsigned imageWidth,
+      unsigned imageHeight, unsigned byteDepth, unsigned nComponents,
+      unsigned char* out) const
+{
+   unsigned x, y, width, height;
+   if (!GetRegion(imageWidth, imageHeight, x, y, width, height))
+      return;
+
+   if (binning_ == 1)
+   {
+      const size_t rowBytes = (size_t)width * byteDepth;
+      for (unsigned row = 0; row < height; ++row)
+      {
+         std::memcpy(out + row * rowBytes,
+               pixels + (((size_t)y + row) * imageWidth + x) * byteDepth,
+               rowBytes);
+      }
+      return;
+   }
+
+   unsigned samplesPerPixel = nComponents > 1 ? nComponents : 1;
+   const size_t rowSamples = (size_t)imageWidth * samplesPerPixel;
+   if (byteDepth / samplesPerPixel == 2)
+   {
+      Bin(reinterpret_cast<const uint16_t*>(pixels), rowSamples, x, y,
+            width / binning_, height / binning_, samplesPerPixel, binning_,
+            average_, reinterpret_cast<uint16_t*>(out));
+   }
+   else
+   {
+      Bin(pixels, rowSamples, x, y, width / binning_, height / binning_,
+            samplesPerPixel, binning_, average_, out);
+   }
+}
+
+
+void
+SoftwareROIBinning::AddMetadata(unsigned imageWidth, unsigned imageHeight,
+      Metadata& md) const
+{
+   unsigned x, y, width, height;
+   if (!GetRegion(imageWidth, imageHeight, x, y, width, height))
+      return;
+   md.PutImageTag("SoftwareROI-X-start", x);
+   md.PutImageTag("SoftwareROI-Y-start", y);
+   md.PutImageTag("SoftwareROI-Width", width);
+   md.PutImageTag("SoftwareROI-Height", height);
+   md.PutImageTag("SoftwareBinning", binning_);
+   md.PutImageTag("SoftwareBinning-Mode", average_ ? "Mean" : "Sum");
+}
+
+} // namespace mm
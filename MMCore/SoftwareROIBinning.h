@@ -0,0 +1,88 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          SoftwareROIBinning.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     MMCore
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Crops and bins camera images in software
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include "../MMDevice/ImageMetadata.h"
+
+namespace mm
+{
+
+/**
+ * Crops and bins images as they are inserted into the circular buffer, for
+ * cameras that cannot (or not in every readout mode) crop or bin in
+ * hardware, or only in coarse steps.
+ *
+ * The region of interest is in the pixels of the camera image; it is
+ * clipped to the image and shortened to a multiple of the binning. Binning
+ * sums or averages (rounded) blocks of 2x2, 4x4 or 8x8 pixels, per component for
+ * RGB pixels; sums are clipped to the range of the pixel type. 32-bit
+ * grayscale images can be cropped but not binned.
+ *
+ * Instances do not change, so that the inserting thread can use one while
+ * the settings are replaced.
+ */
+class SoftwareROIBinning
+{
+public:
+   // A width or height of 0 stands for the whole image
+   SoftwareROIBinning(unsigned x, unsigned y, unsigned width, unsigned height,
+         unsigned binning, bool average);
+
+   // Supported binnings are 1, 2, 4 and 8
+   static bool IsSupportedBinning(unsigned binning);
+
+   unsigned GetX() const { return x_; }
+   unsigned GetY() const { return y_; }
+   unsigned GetWidth() const { return width_; }
+   unsigned GetHeight() const { return height_; }
+   bool HasROI() const { return width_ > 0 && height_ > 0; }
+   unsigned GetBinning() const { return binning_; }
+   bool IsAveraging() const { return average_; }
+
+   // Computes the part of an image of the given size that is used. Returns
+   // false if no pixels are left.
+   bool GetRegion(unsigned imageWidth, unsigned imageHeight,
+         unsigned& x, unsigned& y, unsigned& width, unsigned& height) const;
+   bool GetOutputSize(unsigned imageWidth, unsigned imageHeight,
+         unsigned& outWidth, unsigned& outHeight) const;
+
+   bool IsSupportedPixelType(unsigned byteDepth, unsigned nComponents) const;
+
+   // Writes the cropped and binned image to out, which has room for the
+   // output size. The pixel type must be supported.
+   void Apply(const unsigned char* pixels, unsigned imageWidth,
+         unsigned imageHeight, unsigned byteDepth, unsigned nComponents,
+         unsigned char* out) const;
+
+   // Puts the region used (in camera image pixels) and the binning into md
+   void AddMetadata(unsigned imageWidth, unsigned imageHeight,
+         Metadata& md) const;
+
+private:
+   unsigned x_;
+   unsigned y_;
+   unsigned width_;
+   unsigned height_;
+   unsigned binning_;
+   bool average_;
+};
+
+} // namespace mm
@@ -0,0 +1,186 @@
+#include <gtest/gtest.h>
+
+#include "AsyncCommandExecutor.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <vector>
+
+using mm::AsyncCommandExecutor;
+
+namespace
+{
+   class Recorder
+   {
+      boost::mutex mutex_;
+      boost::condition_variable condition_;
+      std::vector<int> ids_;
+
+   public:
+      void Record(int id)
+      {
+         {
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            ids_.push_back(id);
+         }
+         condition_.notify_all();
+      }
+
+      // Records the id, then waits until the other id has been recorded
+      void RecordAndMeet(int id, int otherId, bool* met)
+      {
+         Record(id);
+         boost::unique_lock<boost::mutex> lock(mutex_);
+         boost::system_time deadline = boost::get_system_time() +
+            boost::posix_time::seconds(5);
+         while (std::find(ids_.begin(), ids_.end(), otherId) == ids_.end())
+         {
+            if (!condition_.timed_wait(lock, deadline))
+               return;
+         }
+         *met = true;
+      }
+
+      void SleepAndRecord(int id)
+      {
+         boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+         Record(id);
+      }
+
+      std::vector<int> Ids()
+      {
+         boost::lock_guard<boost::mutex> lock(mutex_);
+         return ids_;
+      }
+   };
+
+   void Fail(int code)
+   {
+      throw CMMError("failed", code);
+   }
+
+   void ThrowNonStandard()
+   {
+      throw 42;
+   }
+}
+
+TEST(AsyncCommandExecutorTests, CommandsOnOneQueueRunInOrder)
+{
+   AsyncCommandExecutor executor;
+   Recorder recorder;
+   std::vector<long> handles;
+   handles.push_back(executor.Submit("q",
+            boost::bind(&Recorder::SleepAndRecord, &recorder, 1)));
+   handles.push_back(executor.Submit("q",
+            boost::bind(&Recorder::Record, &recorder, 2)));
+   handles.push_back(executor.Submit("q",
+            boost::bind(&Recorder::Record, &recorder, 3)));
+   executor.WaitAll(handles);
+
+   std::vector<int> ids = recorder.Ids();
+   ASSERT_EQ(3u, ids.size());
+   EXPECT_EQ(1, ids[0]);
+   EXPECT_EQ(2, ids[1]);
+   EXPECT_EQ(3, ids[2]);
+}
+
+TEST(AsyncCommandExecutorTests, CommandsOnDifferentQueuesOverlap)
+{
+   AsyncCommandExecutor executor;
+   Recorder recorder;
+   bool met1 = false, met2 = false;
+   long h1 = executor.Submit("a",
+         boost::bind(&Recorder::RecordAndMeet, &recorder, 1, 2, &met1));
+   long h2 = executor.Submit("b",
+         boost::bind(&Recorder::RecordAndMeet, &recorder, 2, 1, &met2));
+   executor.Wait(h1);
+   executor.Wait(h2);
+   EXPECT_TRUE(met1);
+   EXPECT_TRUE(met2);
+}
+
+TEST(AsyncCommandExecutorTests, ErrorIsRethrownOnWait)
+{
+   AsyncCommandExecutor executor;
+   long handle = executor.Submit("q", boost::bind(&Fail, 7));
+   try
+   {
+      executor.Wait(handle);
+      FAIL() << "Wait() did not throw";
+   }
+   catch (const CMMError& e)
+   {
+      EXPECT_EQ(7, e.getCode());
+   }
+
+   // The handle is released by the wait
+   EXPECT_THROW(executor.IsDone(handle), CMMError);
+   EXPECT_THROW(executor.Wait(handle), CMMError);
+}
+
+TEST(AsyncCommandExecutorTests, NonStandardExceptionIsRethrownOnWait)
+{
+   AsyncCommandExecutor executor;
+   long handle = executor.Submit("q", &ThrowNonStandard);
+   try
+   {
+      executor.Wait(handle);
+      FAIL() << "Wait() did not throw";
+   }
+   catch (const CMMError& e)
+   {
+      EXPECT_EQ(MMERR_UnhandledException, e.getCode());
+   }
+}
+
+TEST(AsyncCommandExecutorTests, WaitAllWaitsForEveryCommand)
+{
+   AsyncCommandExecutor executor;
+   Recorder recorder;
+   std::vector<long> handles;
+   handles.push_back(executor.Submit("a", boost::bind(&Fail, 7)));
+   handles.push_back(executor.Submit("b",
+            boost::bind(&Recorder::SleepAndRecord, &recorder, 1)));
+   handles.push_back(executor.Submit("b", boost::bind(&Fail, 8)));
+   try
+   {
+      executor.WaitAll(handles);
+      FAIL() << "WaitAll() did not throw";
+   }
+   catch (const CMMError& e)
+   {
+      EXPECT_EQ(7, e.getCode());
+   }
+   EXPECT_EQ(1u, recorder.Ids().size());
+   for (size_t i = 0; i < handles.size(); ++i)
+      EXPECT_THROW(executor.IsDone(handles[i]), CMMError);
+}
+
+TEST(AsyncCommandExecutorTests, ShutdownRunsQueuedCommands)
+{
+   AsyncCommandExecutor executor;
+   Recorder recorder;
+   long h1 = executor.Submit("q",
+         boost::bind(&Recorder::SleepAndRecord, &recorder, 1));
+   long h2 = executor.Submit("q",
+         boost::bind(&Recorder::Record, &recorder, 2));
+   executor.Shutdown();
+   EXPECT_EQ(2u, recorder.Ids().size());
+   EXPECT_TRUE(executor.IsDone(h1));
+   EXPECT_TRUE(executor.IsDone(h2));
+
+   // The executor can still be used
+   long h3 = executor.Submit("q",
+         boost::bind(&Recorder::Record, &recorder, 3));
+   executor.Wait(h3);
+   EXPECT_EQ(3u, recorder.Ids().size());
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,256 @@
+#include <gtest/gtest.h>
+
+#include "CircularBuffer.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread/barrier.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <vector>
+
+namespace
+{
+   const unsigned width = 512;
+   const unsigned height = 512;
+   // 1 MB holds 4 frames of 512 x 512 x 1
+
+   void Insert(CircularBuffer& buffer, unsigned char value)
+   {
+      std::vector<unsigned char> pixels(width * height, value);
+      Metadata md;
+      md.PutImageTag("Camera", "Camera");
+      ASSERT_TRUE(buffer.InsertImage(&pixels[0], width, height, 1, &md));
+   }
+
+   void ReadFromTop(CircularBuffer* buffer, long count)
+   {
+      for (long n = 0; n < count; ++n)
+         buffer->GetNthFromTopImageBuffer(n);
+   }
+
+   // Keeps the thread alive until all readers have read
+   void ReadFromTopAndWait(CircularBuffer* buffer, long count, boost::barrier* done)
+   {
+      ReadFromTop(buffer, count);
+      done->wait();
+   }
+}
+
+TEST(CircularBufferTests, UnpinnedSlotIsReused)
+{
+   CircularBuffer buffer(1);
+   ASSERT_TRUE(buffer.Initialize(1, width, height, 1));
+   ASSERT_EQ(4u, buffer.GetSize());
+
+   Insert(buffer, 1);
+   const unsigned char* first = buffer.GetNextImage();
+   for (int i = 0; i < 4; ++i)
+      Insert(buffer, 2);
+   EXPECT_EQ(first, buffer.GetTopImage());
+   EXPECT_EQ(2, first[0]);
+}
+
+TEST(CircularBufferTests, PinnedImageSurvivesSlotReuse)
+{
+   CircularBuffer buffer(1);
+   ASSERT_TRUE(buffer.Initialize(1, width, height, 1));
+
+   Insert(buffer, 1);
+   const mm::ImgBuffer* pinned = buffer.GetNextImageBufferPinned(0);
+   ASSERT_TRUE(pinned != 0);
+   const unsigned char* pixels = pinned->GetPixels();
+   EXPECT_EQ(1u, buffer.GetPinnedImageCount());
+
+   for (int i = 0; i < 8; ++i)
+   {
+      Insert(buffer, 2);
+      buffer.GetNextImage();
+   }
+   EXPECT_EQ(1, pixels[0]);
+   EXPECT_EQ(1, pixels[width * height - 1]);
+
+   EXPECT_TRUE(buffer.UnpinImage(pixels));
+   EXPECT_FALSE(buffer.UnpinImage(pixels));
+   EXPECT_EQ(0u, buffer.GetPinnedImageCount());
+}
+
+TEST(CircularBufferTests, PinIsCounted)
+{
+   CircularBuffer buffer(1);
+   ASSERT_TRUE(buffer.Initialize(1, width, height, 1));
+
+   Insert(buffer, 3);
+   const unsigned char* pixels = buffer.GetTopImageBufferPinned(0)->GetPixels();
+   EXPECT_EQ(pixels, buffer.GetTopImageBufferPinned(0)->GetPixels());
+   EXPECT_EQ(1u, buffer.GetPinnedImageCount());
+
+   EXPECT_TRUE(buffer.UnpinImage(pixels));
+   EXPECT_EQ(1u, buffer.GetPinnedImageCount());
+   EXPECT_TRUE(buffer.UnpinImage(pixels));
+   EXPECT_EQ(0u, buffer.GetPinnedImageCount());
+}
+
+TEST(CircularBufferTests, PinnedImageSurvivesReinitialize)
+{
+   CircularBuffer buffer(1);
+   ASSERT_TRUE(buffer.Initialize(1, width, height, 1));
+
+   Insert(buffer, 4);
+   const unsigned char* pixels = buffer.GetTopImageBufferPinned(0)->GetPixels();
+   ASSERT_TRUE(buffer.Initialize(1, width / 2, height / 2, 2));
+   EXPECT_EQ(4, pixels[0]);
+   EXPECT_TRUE(buffer.UnpinImage(pixels));
+}
+
+TEST(CircularBufferTests, PinnedImagesCanBeTakenOver)
+{
+   CircularBuffer* oldBuffer = new CircularBuffer(1);
+   ASSERT_TRUE(oldBuffer->Initialize(1, width, height, 1));
+   Insert(*oldBuffer, 5);
+   const unsigned char* pixels = oldBuffer->GetNextImageBufferPinned(0)->GetPixels();
+
+   CircularBuffer newBuffer(2);
+   newBuffer.TakePinnedImages(*oldBuffer);
+   EXPECT_EQ(0u, oldBuffer->GetPinnedImageCount());
+   delete oldBuffer;
+
+   EXPECT_EQ(1u, newBuffer.GetPinnedImageCount());
+   EXPECT_EQ(5, pixels[0]);
+   EXPECT_TRUE(newBuffer.UnpinImage(pixels));
+}
+
+TEST(CircularBufferTests, CompressedImagesAreReadBack)
+{
+   CircularBuffer buffer(1);
+   buffer.SetCompressed(true);
+   ASSERT_TRUE(buffer.IsCompressed());
+   ASSERT_TRUE(buffer.Initialize(1, width, height, 1));
+   // Nothing is known about the compression yet
+   EXPECT_EQ(4u, buffer.GetSize());
+
+   for (unsigned char v = 1; v <= 20; ++v)
+      Insert(buffer, v);
+   EXPECT_EQ(20u, buffer.GetRemainingImageCount());
+   EXPECT_LT(20u, buffer.GetSize());
+   EXPECT_FALSE(buffer.Overflow());
+
+   const mm::ImgBuffer* top = buffer.GetTopImageBuffer(0);
+   ASSERT_TRUE(top != 0);
+   EXPECT_EQ(20, top->GetPixels()[width * height - 1]);
+   EXPECT_EQ("Camera", top->GetMetadata().GetSingleTag("Camera").GetValue());
+   EXPECT_EQ(19, buffer.GetNthFromTopImageBuffer(1)->GetPixels()[0]);
+
+   for (unsigned char v = 1; v <= 20; ++v)
+   {
+      const unsigned char* pixels = buffer.GetNextImage();
+      ASSERT_TRUE(pixels != 0);
+      EXPECT_EQ(v, pixels[0]);
+      EXPECT_EQ(v, pixels[width * height - 1]);
+   }
+   EXPECT_TRUE(buffer.GetNextImage() == 0);
+}
+
+TEST(CircularBufferTests, CompressedCapacityCountsCompressedSize)
+{
+   CircularBuffer buffer(1);
+   buffer.SetCompressed(true);
+   ASSERT_TRUE(buffer.Initialize(1, width, height, 1));
+
+   // Noise does not compress, so 4 frames fill the buffer as before
+   std::vector<unsigned char> pixels(width * height);
+   unsigned state = 1;
+   for (size_t i = 0; i < pixels.size(); ++i)
+   {
+      state = state * 1103515245 + 12345;
+      pixels[i] = (unsigned char)(state >> 16);
+   }
+   Metadata md;
+   md.PutImageTag("Camera", "Camera");
+   unsigned inserted = 0;
+   while (inserted < 10 &&
+         buffer.InsertImage(&pixels[0], width, height, 1, &md))
+      ++inserted;
+   EXPECT_EQ(3u, inserted); // The frames have a small header
+   EXPECT_TRUE(buffer.Overflow());
+   EXPECT_EQ(0u, buffer.GetFreeSize());
+}
+
+TEST(CircularBufferTests, PinnedCompressedImageSurvivesReading)
+{
+   CircularBuffer buffer(1);
+   buffer.SetCompressed(true);
+   ASSERT_TRUE(buffer.Initialize(1, width, height, 1));
+
+   Insert(buffer, 6);
+   const unsigned char* pixels = buffer.GetNextImageBufferPinned(0)->GetPixels();
+   for (int i = 0; i < 8; ++i)
+   {
+      Insert(buffer, 7);
+      buffer.GetNextImage();
+   }
+   EXPECT_EQ(6, pixels[0]);
+   EXPECT_TRUE(buffer.UnpinImage(pixels));
+
+   buffer.SetCompressed(false);
+   EXPECT_EQ(0u, buffer.GetRemainingImageCount());
+   ASSERT_TRUE(buffer.Initialize(1, width, height, 1));
+   EXPECT_EQ(4u, buffer.GetSize());
+}
+
+TEST(CircularBufferTests, CompressedImageSurvivesReadsFromOtherThreads)
+{
+   CircularBuffer buffer(1);
+   buffer.SetCompressed(true);
+   ASSERT_TRUE(buffer.Initialize(1, width, height, 1));
+
+   for (unsigned char v = 1; v <= 10; ++v)
+      Insert(buffer, v);
+   const unsigned char* top = buffer.GetTopImage();
+   ASSERT_TRUE(top != 0);
+
+   boost::thread reader(boost::bind(&ReadFromTop, &buffer, 10));
+   reader.join();
+   EXPECT_EQ(10, top[0]);
+   EXPECT_EQ(10, top[width * height - 1]);
+
+   // Reads from the same thread recycle the oldest decompressed images
+   ReadFromTop(&buffer, 10);
+   const unsigned char* again = buffer.GetTopImage();
+   ASSERT_TRUE(again != 0);
+   EXPECT_EQ(10, again[0]);
+}
+
+TEST(CircularBufferTests, PinnedCompressedImageSurvivesManyReadingThreads)
+{
+   CircularBuffer buffer(1);
+   buffer.SetCompressed(true);
+   ASSERT_TRUE(buffer.Initialize(1, width, height, 1));
+
+   for (unsigned char v = 1; v <= 10; ++v)
+      Insert(buffer, v);
+   const mm::ImgBuffer* pinned = buffer.GetTopImageBufferPinned(0);
+   ASSERT_TRUE(pinned != 0);
+   const unsigned char* pixels = pinned->GetPixels();
+
+   // More reading threads than the buffer keeps decompression caches for;
+   // the cache of the first thread is dropped
+   const int nReaders = 20;
+   boost::barrier done(nReaders);
+   boost::thread_group readers;
+   for (int t = 0; t < nReaders; ++t)
+      readers.create_thread(boost::bind(&ReadFromTopAndWait, &buffer, 10, &done));
+   readers.join_all();
+   EXPECT_EQ(10, pixels[0]);
+   EXPECT_EQ(1u, buffer.GetPinnedImageCount());
+   EXPECT_TRUE(buffer.UnpinImage(pixels));
+
+   const unsigned char* top = buffer.GetTopImage();
+   ASSERT_TRUE(top != 0);
+   EXPECT_EQ(10, top[0]);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+
+#include "ConfigFileReader.h"
+
+#include <string>
+#include <vector>
+
+using mm::ConfigFileReader;
+
+namespace
+{
+   std::vector<std::string> Strings(const std::vector<const char*>& fields)
+   {
+      return std::vector<std::string>(fields.begin(), fields.end());
+   }
+}
+
+
+TEST(ConfigFileReaderTests, EmptyContents)
+{
+   ConfigFileReader reader;
+   std::vector<const char*> fields;
+   EXPECT_FALSE(reader.NextLine(fields, ","));
+
+   reader.SetContents("");
+   EXPECT_FALSE(reader.NextLine(fields, ","));
+}
+
+TEST(ConfigFileReaderTests, SplitsFieldsLikeTokenize)
+{
+   ConfigFileReader reader;
+   reader.SetContents("Device,Camera,DemoCamera,DCam\n,Property,,Camera,,Binning,1,\n");
+   std::vector<const char*> fields;
+
+   ASSERT_TRUE(reader.NextLine(fields, ","));
+   std::vector<std::string> expected;
+   expected.push_back("Device");
+   expected.push_back("Camera");
+   expected.push_back("DemoCamera");
+   expected.push_back("DCam");
+   EXPECT_EQ(expected, Strings(fields));
+   EXPECT_EQ(1u, reader.GetLineNumber());
+   EXPECT_EQ("Device,Camera,DemoCamera,DCam", reader.GetLine());
+
+   ASSERT_TRUE(reader.NextLine(fields, ","));
+   expected.clear();
+   expected.push_back("Property");
+   expected.push_back("Camera");
+   expected.push_back("Binning");
+   expected.push_back("1");
+   EXPECT_EQ(expected, Strings(fields));
+   EXPECT_EQ(",Property,,Camera,,Binning,1,", reader.GetLine());
+
+   EXPECT_FALSE(reader.NextLine(fields, ","));
+}
+
+TEST(ConfigFileReaderTests, SkipsCommentsAndEmptyLines)
+{
+   ConfigFileReader reader;
+   reader.SetContents("# comment\r\n\r\n\nLabel,Wheel,0,Open\r\n# Device,A,B,C");
+   std::vector<const char*> fields;
+
+   ASSERT_TRUE(reader.NextLine(fields, ","));
+   ASSERT_EQ(4u, fields.size());
+   EXPECT_STREQ("Label", fields[0]);
+   EXPECT_STREQ("Open", fields[3]);
+   EXPECT_EQ(4u, reader.GetLineNumber());
+   EXPECT_EQ("Label,Wheel,0,Open", reader.GetLine());
+
+   EXPECT_FALSE(reader.NextLine(fields, ","));
+}
+
+TEST(ConfigFileReaderTests, LineOfDelimitersHasNoFields)
+{
+   ConfigFileReader reader;
+   reader.SetContents(",,,\n");
+   std::vector<const char*> fields;
+
+   ASSERT_TRUE(reader.NextLine(fields, ","));
+   EXPECT_TRUE(fields.empty());
+   EXPECT_EQ(",,,", reader.GetLine());
+}
+
+TEST(ConfigFileReaderTests, LongLine)
+{
+   std::string value(10000, 'x');
+   ConfigFileReader reader;
+   reader.SetContents("Property,Dev,Prop," + value + "\nDelay,Dev,5\n");
+   std::vector<const char*> fields;
+
+   ASSERT_TRUE(reader.NextLine(fields, ","));
+   ASSERT_EQ(4u, fields.size());
+   EXPECT_EQ(value, fields[3]);
+
+   ASSERT_TRUE(reader.NextLine(fields, ","));
+   ASSERT_EQ(3u, fields.size());
+   EXPECT_STREQ("Delay", fields[0]);
+   EXPECT_EQ(2u, reader.GetLineNumber());
+}
+
+TEST(ConfigFileReaderTests, MissingFile)
+{
+   ConfigFileReader reader;
+   EXPECT_FALSE(reader.Open("ConfigFileReader-Tests-no-such-file.cfg"));
+}
+
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+
+#include "DeviceAdapterMetadataCache.h"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using mm::AvailableDeviceInfo;
+using mm::DeviceAdapterMetadataCache;
+
+namespace
+{
+   const char* const AdapterFile = "DeviceAdapterMetadataCache-Tests.adapter";
+   const char* const CacheFile = "DeviceAdapterMetadataCache-Tests.cache";
+
+   void WriteFile(const char* filename, const std::string& contents)
+   {
+      std::ofstream out(filename, std::ios_base::out | std::ios_base::binary);
+      out << contents;
+   }
+
+   std::vector<AvailableDeviceInfo> TestDevices()
+   {
+      std::vector<AvailableDeviceInfo> devices;
+      AvailableDeviceInfo camera;
+      camera.name = "DCam";
+      camera.type = MM::CameraDevice;
+      camera.description = "Demo camera";
+      devices.push_back(camera);
+      AvailableDeviceInfo shutter;
+      shutter.name = "DShutter";
+      shutter.type = MM::ShutterDevice;
+      shutter.description = "Tab\there, newline\nhere, backslash\\here";
+      devices.push_back(shutter);
+      return devices;
+   }
+
+   void ExpectSameDevices(const std::vector<AvailableDeviceInfo>& expected,
+         const std::vector<AvailableDeviceInfo>& actual)
+   {
+      ASSERT_EQ(expected.size(), actual.size());
+      for (size_t i = 0; i < expected.size(); ++i)
+      {
+         EXPECT_EQ(expected[i].name, actual[i].name);
+         EXPECT_EQ(expected[i].type, actual[i].type);
+         EXPECT_EQ(expected[i].description, actual[i].description);
+      }
+   }
+
+   class DeviceAdapterMetadataCacheTests : public ::testing::Test
+   {
+   protected:
+      virtual void SetUp() { WriteFile(AdapterFile, "adapter"); }
+      virtual void TearDown()
+      {
+         std::remove(AdapterFile);
+         std::remove(CacheFile);
+      }
+   };
+}
+
+
+TEST_F(DeviceAdapterMetadataCacheTests, PutAndGet)
+{
+   DeviceAdapterMetadataCache cache;
+   std::vector<AvailableDeviceInfo> devices;
+   EXPECT_FALSE(cache.Get(AdapterFile, devices));
+
+   EXPECT_TRUE(cache.Put(AdapterFile, TestDevices()));
+   EXPECT_FALSE(cache.Put(AdapterFile, TestDevices()));
+   ASSERT_TRUE(cache.Get(AdapterFile, devices));
+   ExpectSameDevices(TestDevices(), devices);
+
+   cache.Clear();
+   EXPECT_FALSE(cache.Get(AdapterFile, devices));
+}
+
+TEST_F(DeviceAdapterMetadataCacheTests, MissingFileIsNotCached)
+{
+   DeviceAdapterMetadataCache cache;
+   std::vector<AvailableDeviceInfo> devices;
+   EXPECT_FALSE(cache.Put("DeviceAdapterMetadataCache-Tests.missing", TestDevices()));
+   EXPECT_FALSE(cache.Get("DeviceAdapterMetadataCache-Tests.missing", devices));
+}
+
+TEST_F(DeviceAdapterMetadataCacheTests, ChangedFileIsStale)
+{
+   DeviceAdapterMetadataCache cache;
+   ASSERT_TRUE(cache.Put(AdapterFile, TestDevices()));
+
+   WriteFile(AdapterFile, "rebuilt adapter");
+   std::vector<AvailableDeviceInfo> devices;
+   EXPECT_FALSE(cache.Get(AdapterFile, devices));
+   EXPECT_TRUE(cache.Put(AdapterFile, std::vector<AvailableDeviceInfo>()));
+   ASSERT_TRUE(cache.Get(AdapterFile, devices));
+   EXPECT_TRUE(devices.empty());
+}
+
+TEST_F(DeviceAdapterMetadataCacheTests, SaveAndLoad)
+{
+   DeviceAdapterMetadataCache cache;
+   ASSERT_TRUE(cache.Put(AdapterFile, TestDevices()));
+   ASSERT_TRUE(cache.Save(CacheFile));
+
+   DeviceAdapterMetadataCache loaded;
+   ASSERT_TRUE(loaded.Load(CacheFile));
+   std::vector<AvailableDeviceInfo> devices;
+   ASSERT_TRUE(loaded.Get(AdapterFile, devices));
+   ExpectSameDevices(TestDevices(), devices);
+}
+
+TEST_F(DeviceAdapterMetadataCacheTests, InvalidCacheFile)
+{
+   DeviceAdapterMetadataCache cache;
+   ASSERT_TRUE(cache.Put(AdapterFile, TestDevices()));
+
+   std::vector<AvailableDeviceInfo> devices;
+   EXPECT_FALSE(cache.Load("DeviceAdapterMetadataCache-Tests.missing"));
+   EXPECT_FALSE(cache.Get(AdapterFile, devices));
+
+   WriteFile(CacheFile, "Not a cache file\n");
+   EXPECT_FALSE(cache.Load(CacheFile));
+
+   WriteFile(CacheFile, "MMDeviceAdapterMetadataCache 1\nD\tDCam\t2\tOrphan\n");
+   EXPECT_FALSE(cache.Load(CacheFile));
+   EXPECT_FALSE(cache.Get(AdapterFile, devices));
+}
+
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+
+#include "FrameCodec.h"
+
+#include <cstdlib>
+#include <vector>
+
+using mm::FrameCodec;
+
+namespace
+{
+   void ExpectRoundTrip(FrameCodec& codec,
+         const std::vector<unsigned char>& data, unsigned bytesPerSample)
+   {
+      std::vector<unsigned char> compressed;
+      codec.Compress(data.empty() ? 0 : &data[0], data.size(), bytesPerSample,
+            compressed);
+
+      // One more byte, which must stay untouched
+      std::vector<unsigned char> out(data.size() + 1, 0xcd);
+      ASSERT_TRUE(codec.Decompress(compressed, &out[0], data.size()));
+      EXPECT_EQ(0xcd, out.back());
+      out.pop_back();
+      EXPECT_TRUE(data == out);
+   }
+}
+
+TEST(FrameCodecTests, RoundTripOfSampleSizes)
+{
+   FrameCodec codec;
+   std::srand(7);
+   const unsigned sampleSizes[] = { 1, 2, 4, 8 };
+   for (unsigned k = 0; k < 4; ++k)
+   {
+      unsigned bytesPerSample = sampleSizes[k];
+      // Sizes below, at and above the block size
+      const size_t sampleCounts[] = { 0, 1, 5, 1000, 65536 / bytesPerSample, 100003 };
+      for (unsigned n = 0; n < 6; ++n)
+      {
+         std::vector<unsigned char> data(sampleCounts[n] * bytesPerSample);
+         for (size_t i = 0; i < data.size(); ++i)
+            data[i] = (i % bytesPerSample == 0) ? (unsigned char)(std::rand() % 16) : 0;
+         ExpectRoundTrip(codec, data, bytesPerSample);
+      }
+   }
+}
+
+TEST(FrameCodecTests, DimImagesCompress)
+{
+   FrameCodec codec;
+   std::srand(11);
+   std::vector<unsigned short> image(1024 * 1024);
+   for (size_t i = 0; i < image.size(); ++i)
+   {
+      image[i] = (unsigned short)(100 + std::rand() % 8);
+      if (std::rand() % 50 == 0)
+         image[i] += (unsigned short)(std::rand() % 2000);
+   }
+   const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&image[0]);
+   std::vector<unsigned char> data(bytes, bytes + 2 * image.size());
+
+   std::vector<unsigned char> compressed;
+   codec.Compress(&data[0], data.size(), 2, compressed);
+   EXPECT_LT(compressed.size(), data.size() / 2);
+   ExpectRoundTrip(codec, data, 2);
+}
+
+TEST(FrameCodecTests, NoiseIsStored)
+{
+   FrameCodec codec;
+   std::srand(13);
+   std::vector<unsigned char> data(200000);
+   for (size_t i = 0; i < data.size(); ++i)
+      data[i] = (unsigned char)std::rand();
+
+   std::vector<unsigned char> compressed;
+   codec.Compress(&data[0], data.size(), 1, compressed);
+   EXPECT_GE(compressed.size(), data.size());
+   EXPECT_LT(compressed.size(), data.size() + 64);
+   ExpectRoundTrip(codec, data, 1);
+}
+
+TEST(FrameCodecTests, CorruptDataIsRejected)
+{
+   FrameCodec codec;
+   std::vector<unsigned char> data(100000);
+   for (size_t i = 0; i < data.size(); ++i)
+      data[i] = (unsigned char)(i / 100);
+
+   std::vector<unsigned char> compressed;
+   codec.Compress(&data[0], data.size(), 1, compressed);
+   std::vector<unsigned char> out(data.size());
+   EXPECT_FALSE(codec.Decompress(compressed, &out[0], data.size() - 1));
+
+   compressed.pop_back();
+   EXPECT_FALSE(codec.Decompress(compressed, &out[0], data.size()));
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,160 @@
+#include <gtest/gtest.h>
+
+#include "ImageStatisticsCalculator.h"
+
+#include <cstdlib>
+#include <vector>
+
+using mm::ImageStatisticsCalculator;
+
+namespace
+{
+   Metadata MetadataWithBitDepth(unsigned bitDepth)
+   {
+      Metadata md;
+      md.PutImageTag(MM::g_Keyword_Metadata_BitDepth, bitDepth);
+      md.PutImageTag(MM::g_Keyword_Metadata_ImageNumber, 5);
+      md.PutImageTag("Camera", "Cam");
+      return md;
+   }
+}
+
+TEST(ImageStatisticsTests, Gray8)
+{
+   const unsigned width = 37, height = 3;
+   std::vector<unsigned char> pixels(width * height);
+   for (size_t i = 0; i < pixels.size(); ++i)
+      pixels[i] = (unsigned char)(i % 4 + 10);
+   pixels[7] = 255;
+   pixels[8] = 2;
+
+   ImageStatisticsCalculator calculator(256);
+   ImageStatistics stats;
+   EXPECT_FALSE(calculator.GetLastStatistics(stats));
+
+   Metadata md = MetadataWithBitDepth(8);
+   ASSERT_TRUE(calculator.Compute(&pixels[0], width, height, 1, 1, md));
+   ASSERT_TRUE(calculator.GetLastStatistics(stats));
+   EXPECT_EQ("Cam", stats.getCameraLabel());
+   EXPECT_EQ(5, stats.getImageNumber());
+   EXPECT_EQ(2, stats.getMin());
+   EXPECT_EQ(255, stats.getMax());
+   EXPECT_EQ(1, stats.getSaturatedCount());
+   ASSERT_EQ(256u, stats.getBinCount());
+   EXPECT_EQ(1u, stats.getBinWidth());
+
+   std::vector<long> histogram = stats.getHistogram();
+   long total = 0;
+   double sum = 0;
+   for (size_t i = 0; i < histogram.size(); ++i)
+   {
+      total += histogram[i];
+      sum += (double)i * histogram[i];
+   }
+   EXPECT_EQ((long)(width * height), total);
+   EXPECT_EQ(1, histogram[255]);
+   EXPECT_DOUBLE_EQ(sum / total, stats.getMean());
+
+   EXPECT_EQ("255", md.GetSingleTag("Statistics-Max").GetValue());
+   EXPECT_TRUE(md.HasTag("Statistics-Histogram"));
+}
+
+TEST(ImageStatisticsTests, Gray16AtCameraBitDepth)
+{
+   const unsigned width = 1000, height = 600; // Large enough for workers
+   std::vector<unsigned short> pixels(width * height);
+   std::srand(3);
+   for (size_t i = 0; i < pixels.size(); ++i)
+      pixels[i] = (unsigned short)(std::rand() % 4096);
+   pixels[12345] = 4095;
+   pixels[54321] = 5000; // Out of range, counted in the last bin
+
+   unsigned long long sum = 0;
+   long saturated = 0;
+   std::vector<long> expected(1024, 0);
+   for (size_t i = 0; i < pixels.size(); ++i)
+   {
+      sum += pixels[i];
+      saturated += pixels[i] >= 4095;
+      expected[std::min(pixels[i] / 4, 1023)]++;
+   }
+
+   ImageStatisticsCalculator calculator(1024);
+   Metadata md = MetadataWithBitDepth(12);
+   ASSERT_TRUE(calculator.Compute(reinterpret_cast<unsigned char*>(&pixels[0]),
+            width, height, 2, 1, md));
+   ImageStatistics stats;
+   ASSERT_TRUE(calculator.GetLastStatistics(stats));
+   EXPECT_EQ(4u, stats.getBinWidth());
+   EXPECT_EQ(5000, stats.getMax());
+   EXPECT_EQ(saturated, stats.getSaturatedCount());
+   EXPECT_DOUBLE_EQ((double)sum / pixels.size(), stats.getMean());
+   EXPECT_TRUE(expected == stats.getHistogram());
+}
+
+TEST(ImageStatisticsTests, StartAndFinishLargeThenSmallImage)
+{
+   ImageStatisticsCalculator calculator(256);
+
+   std::vector<unsigned char> large(1000 * 600, 7);
+   large[600 * 1000 - 1] = 200;
+   Metadata md = MetadataWithBitDepth(8);
+   ASSERT_TRUE(calculator.Start(&large[0], 1000, 600, 1, 1, md));
+   EXPECT_FALSE(md.HasTag("Statistics-Max"));
+   calculator.Finish(md);
+   EXPECT_EQ("200", md.GetSingleTag("Statistics-Max").GetValue());
+   ImageStatistics stats;
+   ASSERT_TRUE(calculator.GetLastStatistics(stats));
+   EXPECT_EQ(7, stats.getMin());
+   EXPECT_EQ(599999, stats.getHistogram()[7]);
+
+   std::vector<unsigned char> small(16, 3);
+   Metadata smallMd = MetadataWithBitDepth(8);
+   ASSERT_TRUE(calculator.Start(&small[0], 4, 4, 1, 1, smallMd));
+   calculator.Finish(smallMd);
+   ASSERT_TRUE(calculator.GetLastStatistics(stats));
+   EXPECT_EQ(3, stats.getMin());
+   EXPECT_EQ(3, stats.getMax());
+   EXPECT_EQ(16, stats.getHistogram()[3]);
+   EXPECT_EQ(0, stats.getHistogram()[7]);
+}
+
+TEST(ImageStatisticsTests, BinsAreLimitedByBitDepth)
+{
+   std::vector<unsigned char> pixels(64, 3);
+   ImageStatisticsCalculator calculator(65536);
+   Metadata md = MetadataWithBitDepth(8);
+   ASSERT_TRUE(calculator.Compute(&pixels[0], 8, 8, 1, 1, md));
+   ImageStatistics stats;
+   ASSERT_TRUE(calculator.GetLastStatistics(stats));
+   EXPECT_EQ(256u, stats.getBinCount());
+}
+
+TEST(ImageStatisticsTests, RGB32IgnoresFourthComponent)
+{
+   // B, G, R, A
+   unsigned char pixels[] = { 1, 2, 3, 255, 4, 5, 6, 255 };
+   ImageStatisticsCalculator calculator(256);
+   Metadata md = MetadataWithBitDepth(8);
+   ASSERT_TRUE(calculator.Compute(pixels, 2, 1, 4, 4, md));
+   ImageStatistics stats;
+   ASSERT_TRUE(calculator.GetLastStatistics(stats));
+   EXPECT_EQ(1, stats.getMin());
+   EXPECT_EQ(6, stats.getMax());
+   EXPECT_DOUBLE_EQ(3.5, stats.getMean());
+   EXPECT_EQ(0, stats.getSaturatedCount());
+}
+
+TEST(ImageStatisticsTests, Gray32IsNotSupported)
+{
+   std::vector<unsigned char> pixels(4 * 16);
+   ImageStatisticsCalculator calculator(256);
+   Metadata md;
+   EXPECT_FALSE(calculator.Compute(&pixels[0], 4, 4, 4, 1, md));
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,127 @@
+#include <gtest/gtest.h>
+
+#include "CircularBuffer.h"
+#include "PreviewGenerator.h"
+
+#include <boost/thread/thread.hpp>
+
+#include <vector>
+
+using mm::PreviewGenerator;
+using mm::PreviewImage;
+
+namespace
+{
+   Metadata CameraMetadata()
+   {
+      Metadata md;
+      md.PutImageTag("Camera", "Camera");
+      return md;
+   }
+}
+
+TEST(PreviewGeneratorTests, DownsamplesByAveraging)
+{
+   PreviewGenerator preview(0.0, 8);
+   EXPECT_TRUE(preview.GetLastPreview().get() == 0);
+
+   // Odd width leaves a scalar tail; the last 3 columns are dropped
+   std::vector<unsigned short> image(83 * 16);
+   for (size_t i = 0; i < image.size(); ++i)
+      image[i] = (unsigned short)(i % 83);
+   ASSERT_TRUE(preview.Offer(reinterpret_cast<unsigned char*>(&image[0]),
+            83, 16, 2, 1, CameraMetadata()));
+
+   boost::shared_ptr<const PreviewImage> last = preview.GetLastPreview();
+   ASSERT_TRUE(last.get() != 0);
+   EXPECT_EQ(10u, last->width);
+   EXPECT_EQ(2u, last->height);
+   EXPECT_EQ(2u, last->byteDepth);
+   ASSERT_EQ(2u * 10 * 2, last->pixels.size());
+   const unsigned short* pixels =
+      reinterpret_cast<const unsigned short*>(&last->pixels[0]);
+   for (unsigned x = 0; x < 10; ++x)
+   {
+      // Mean of 8x, ..., 8x + 7, rounded
+      EXPECT_EQ(8 * x + 4, pixels[x]);
+      EXPECT_EQ(8 * x + 4, pixels[10 + x]);
+   }
+
+   EXPECT_EQ("10", last->metadata.GetSingleTag("Width").GetValue());
+   EXPECT_EQ("GRAY16", last->metadata.GetSingleTag("PixelType").GetValue());
+   EXPECT_EQ("8", last->metadata.GetSingleTag("PreviewDownsampling").GetValue());
+}
+
+TEST(PreviewGeneratorTests, ConvertsTo8Bits)
+{
+   PreviewGenerator preview(0.0, 1);
+   preview.Set8BitRange(1000, 2020);
+   unsigned min, max;
+   ASSERT_TRUE(preview.Get8BitRange(min, max));
+   EXPECT_EQ(1000u, min);
+   EXPECT_EQ(2020u, max);
+
+   unsigned short image[] = { 0, 1000, 1002, 1510, 2020, 65535 };
+   ASSERT_TRUE(preview.Offer(reinterpret_cast<unsigned char*>(image),
+            6, 1, 2, 1, CameraMetadata()));
+   boost::shared_ptr<const PreviewImage> last = preview.GetLastPreview();
+   EXPECT_EQ(1u, last->byteDepth);
+   ASSERT_EQ(6u, last->pixels.size());
+   EXPECT_EQ(0, last->pixels[0]);
+   EXPECT_EQ(0, last->pixels[1]);
+   EXPECT_EQ(1, last->pixels[2]);
+   EXPECT_EQ(128, last->pixels[3]);
+   EXPECT_EQ(255, last->pixels[4]);
+   EXPECT_EQ(255, last->pixels[5]);
+   EXPECT_EQ("GRAY8", last->metadata.GetSingleTag("PixelType").GetValue());
+
+   // 8-bit images are kept as they are
+   unsigned char image8[] = { 7, 200 };
+   ASSERT_TRUE(preview.Offer(image8, 2, 1, 1, 1, CameraMetadata()));
+   last = preview.GetLastPreview();
+   ASSERT_EQ(2u, last->pixels.size());
+   EXPECT_EQ(7, last->pixels[0]);
+
+   preview.Clear8BitRange();
+   EXPECT_FALSE(preview.Get8BitRange(min, max));
+}
+
+TEST(PreviewGeneratorTests, SkipsImagesAboveMaxRate)
+{
+   PreviewGenerator preview(20.0, 1);
+   unsigned char image[] = { 1, 2, 3, 4 };
+   EXPECT_TRUE(preview.Offer(image, 2, 2, 1, 1, CameraMetadata()));
+   EXPECT_FALSE(preview.Offer(image, 2, 2, 1, 1, CameraMetadata()));
+   boost::this_thread::sleep(boost::posix_time::milliseconds(60));
+   EXPECT_TRUE(preview.Offer(image, 2, 2, 1, 1, CameraMetadata()));
+}
+
+TEST(PreviewGeneratorTests, CircularBufferFeedsPreview)
+{
+   CircularBuffer buffer(1);
+   boost::shared_ptr<PreviewGenerator> preview(new PreviewGenerator(0.0, 2));
+   buffer.SetPreview(preview);
+   ASSERT_TRUE(buffer.Initialize(1, 64, 32, 1));
+
+   std::vector<unsigned char> image(64 * 32, 10);
+   Metadata md = CameraMetadata();
+   ASSERT_TRUE(buffer.InsertImage(&image[0], 64, 32, 1, &md));
+   image[0] = 50;
+   ASSERT_TRUE(buffer.InsertImage(&image[0], 64, 32, 1, &md));
+
+   boost::shared_ptr<const PreviewImage> last = preview->GetLastPreview();
+   ASSERT_TRUE(last.get() != 0);
+   EXPECT_EQ(32u, last->width);
+   EXPECT_EQ(16u, last->height);
+   EXPECT_EQ(20, last->pixels[0]);
+   EXPECT_EQ("1", last->metadata.GetSingleTag("ImageNumber").GetValue());
+
+   // The images stay in the buffer
+   EXPECT_EQ(2ul, buffer.GetRemainingImageCount());
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
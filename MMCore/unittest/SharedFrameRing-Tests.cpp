@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+
+#include "SharedFrameRing.h"
+#include "SharedFrameRingReader.h"
+
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using mm::SharedFrameRing;
+using mm::SharedFrameRingReader;
+
+namespace
+{
+   const unsigned width = 64;
+   const unsigned height = 32;
+
+   std::string RingName()
+   {
+      std::ostringstream name;
+      name << "/mmcore-test-" << getpid();
+      return name.str();
+   }
+
+   bool Publish(SharedFrameRing& ring, unsigned char value)
+   {
+      std::vector<unsigned char> pixels(width * height, value);
+      std::string metadata(1, (char)value);
+      return ring.Publish(&pixels[0], width, height, 1, 1, 0, metadata);
+   }
+}
+
+TEST(SharedFrameRingTests, FramesAreReadInOrder)
+{
+   SharedFrameRing ring(RingName(), 4, width * height, 16);
+   SharedFrameRingReader reader;
+   ASSERT_TRUE(reader.Open(RingName()));
+   EXPECT_TRUE(reader.IsWriterActive());
+
+   SharedFrameRingReader::Frame frame;
+   EXPECT_FALSE(reader.NextFrame(frame));
+
+   ASSERT_TRUE(Publish(ring, 1));
+   ASSERT_TRUE(Publish(ring, 2));
+
+   ASSERT_TRUE(reader.NextFrame(frame));
+   EXPECT_EQ(0u, frame.frameNumber);
+   EXPECT_EQ(width, frame.width);
+   EXPECT_EQ(height, frame.height);
+   EXPECT_EQ(width * height, frame.pixelBytes);
+   EXPECT_EQ(1, frame.pixels[width * height - 1]);
+   ASSERT_EQ(1u, frame.metadataBytes);
+   EXPECT_EQ(1, frame.metadata[0]);
+   EXPECT_TRUE(reader.IsValid(frame));
+
+   ASSERT_TRUE(reader.NextFrame(frame));
+   EXPECT_EQ(1u, frame.frameNumber);
+   EXPECT_EQ(2, frame.pixels[0]);
+   EXPECT_FALSE(reader.NextFrame(frame));
+   EXPECT_EQ(0u, reader.GetDroppedCount());
+}
+
+TEST(SharedFrameRingTests, OverwrittenFramesAreDetected)
+{
+   SharedFrameRing ring(RingName(), 4, width * height, 16);
+   SharedFrameRingReader reader;
+   ASSERT_TRUE(reader.Open(RingName()));
+
+   ASSERT_TRUE(Publish(ring, 1));
+   SharedFrameRingReader::Frame frame;
+   ASSERT_TRUE(reader.NextFrame(frame));
+   for (int i = 0; i < 4; ++i)
+      ASSERT_TRUE(Publish(ring, 2));
+   EXPECT_FALSE(reader.IsValid(frame));
+}
+
+TEST(SharedFrameRingTests, SlowReaderDropsFrames)
+{
+   SharedFrameRing ring(RingName(), 4, width * height, 16);
+   SharedFrameRingReader reader;
+   ASSERT_TRUE(reader.Open(RingName()));
+
+   for (unsigned char i = 0; i < 10; ++i)
+      ASSERT_TRUE(Publish(ring, i));
+
+   SharedFrameRingReader::Frame frame;
+   ASSERT_TRUE(reader.NextFrame(frame));
+   EXPECT_EQ(7u, frame.frameNumber);
+   EXPECT_EQ(7, frame.pixels[0]);
+   EXPECT_EQ(7u, reader.GetDroppedCount());
+
+   ASSERT_TRUE(Publish(ring, 10));
+   ASSERT_TRUE(reader.LatestFrame(frame));
+   EXPECT_EQ(10u, frame.frameNumber);
+   EXPECT_FALSE(reader.NextFrame(frame));
+}
+
+TEST(SharedFrameRingTests, OversizedFramesAreSkipped)
+{
+   SharedFrameRing ring(RingName(), 4, width * height / 2, 16);
+   SharedFrameRingReader reader;
+   ASSERT_TRUE(reader.Open(RingName()));
+
+   EXPECT_FALSE(Publish(ring, 1));
+   EXPECT_EQ(1u, reader.GetSkippedCount());
+   SharedFrameRingReader::Frame frame;
+   EXPECT_FALSE(reader.NextFrame(frame));
+}
+
+TEST(SharedFrameRingTests, RingIsRemovedWithWriter)
+{
+   SharedFrameRingReader reader;
+   {
+      SharedFrameRing ring(RingName(), 2, width * height, 16);
+      ASSERT_TRUE(reader.Open(RingName()));
+      ASSERT_TRUE(Publish(ring, 3));
+   }
+   EXPECT_FALSE(reader.IsWriterActive());
+   SharedFrameRingReader::Frame frame;
+   ASSERT_TRUE(reader.NextFrame(frame));
+   EXPECT_EQ(3, frame.pixels[0]);
+
+   SharedFrameRingReader other;
+   EXPECT_FALSE(other.Open(RingName()));
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
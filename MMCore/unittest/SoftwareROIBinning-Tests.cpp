@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+
+#include "CircularBuffer.h"
+#include "SoftwareROIBinning.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+using mm::SoftwareROIBinning;
+
+namespace
+{
+   // Straightforward binning of the region at x, y
+   template <typename SampleType>
+   std::vector<SampleType> ReferenceBin(const std::vector<SampleType>& image,
+         unsigned imageWidth, unsigned samplesPerPixel, unsigned x, unsigned y,
+         unsigned outWidth, unsigned outHeight, unsigned binning, bool average)
+   {
+      const unsigned maxValue = (SampleType)~0;
+      std::vector<SampleType> out;
+      for (unsigned oy = 0; oy < outHeight; ++oy)
+         for (unsigned ox = 0; ox < outWidth; ++ox)
+            for (unsigned c = 0; c < samplesPerPixel; ++c)
+            {
+               unsigned sum = 0;
+               for (unsigned by = 0; by < binning; ++by)
+                  for (unsigned bx = 0; bx < binning; ++bx)
+                     sum += image[((y + oy * binning + by) * imageWidth +
+                           x + ox * binning + bx) * samplesPerPixel + c];
+               unsigned n = binning * binning;
+               out.push_back((SampleType)(average ?
+                        (sum + n / 2) / n : std::min(sum, maxValue)));
+            }
+      return out;
+   }
+
+   template <typename SampleType>
+   void ExpectMatchesReference(unsigned imageWidth, unsigned imageHeight,
+         unsigned samplesPerPixel, const SoftwareROIBinning& roiBinning,
+         unsigned maxSample)
+   {
+      std::vector<SampleType> image(imageWidth * imageHeight * samplesPerPixel);
+      for (size_t i = 0; i < image.size(); ++i)
+         image[i] = (SampleType)(std::rand() % (maxSample + 1));
+
+      unsigned x, y, width, height, outWidth, outHeight;
+      ASSERT_TRUE(roiBinning.GetRegion(imageWidth, imageHeight, x, y, width, height));
+      ASSERT_TRUE(roiBinning.GetOutputSize(imageWidth, imageHeight, outWidth, outHeight));
+
+      const unsigned byteDepth = sizeof(SampleType) * samplesPerPixel;
+      std::vector<SampleType> out(outWidth * outHeight * samplesPerPixel);
+      roiBinning.Apply(reinterpret_cast<const unsigned char*>(&image[0]),
+            imageWidth, imageHeight, byteDepth, samplesPerPixel,
+            reinterpret_cast<unsigned char*>(&out[0]));
+
+      EXPECT_TRUE(out == ReferenceBin(image, imageWidth, samplesPerPixel, x, y,
+               outWidth, outHeight, roiBinning.GetBinning(),
+               roiBinning.IsAveraging()));
+   }
+}
+
+TEST(SoftwareROIBinningTests, RegionIsClippedToImageAndBinning)
+{
+   SoftwareROIBinning roiBinning(10, 20, 100, 100, 4, false);
+   unsigned x, y, width, height;
+   ASSERT_TRUE(roiBinning.GetRegion(64, 64, x, y, width, height));
+   EXPECT_EQ(10u, x);
+   EXPECT_EQ(20u, y);
+   EXPECT_EQ(52u, width);
+   EXPECT_EQ(44u, height);
+
+   unsigned outWidth, outHeight;
+   ASSERT_TRUE(roiBinning.GetOutputSize(64, 64, outWidth, outHeight));
+   EXPECT_EQ(13u, outWidth);
+   EXPECT_EQ(11u, outHeight);
+
+   EXPECT_FALSE(roiBinning.GetRegion(10, 64, x, y, width, height));
+   EXPECT_FALSE(SoftwareROIBinning(0, 0, 3, 3, 4, true).GetRegion(64, 64, x, y, width, height));
+
+   // No ROI
+   ASSERT_TRUE(SoftwareROIBinning(5, 5, 0, 0, 2, true).GetOutputSize(65, 64, outWidth, outHeight));
+   EXPECT_EQ(32u, outWidth);
+   EXPECT_EQ(32u, outHeight);
+}
+
+TEST(SoftwareROIBinningTests, CropOnly)
+{
+   std::srand(1);
+   ExpectMatchesReference<unsigned short>(50, 40, 1,
+         SoftwareROIBinning(3, 7, 21, 13, 1, false), 65535);
+}
+
+TEST(SoftwareROIBinningTests, MatchesReference)
+{
+   std::srand(2);
+   const unsigned binnings[] = { 2, 4, 8 };
+   for (unsigned b = 0; b < 3; ++b)
+   {
+      for (int average = 0; average < 2; ++average)
+      {
+         // Odd widths leave scalar tails after the vector loops
+         SoftwareROIBinning whole(0, 0, 0, 0, binnings[b], average != 0);
+         SoftwareROIBinning roi(5, 3, 77, 37, binnings[b], average != 0);
+         ExpectMatchesReference<unsigned char>(131, 45, 1, whole, 255);
+         ExpectMatchesReference<unsigned char>(131, 45, 1, roi, 255);
+         ExpectMatchesReference<unsigned short>(131, 45, 1, whole, 65535);
+         ExpectMatchesReference<unsigned short>(131, 45, 1, roi, 4095);
+         // RGB32 and RGB64
+         ExpectMatchesReference<unsigned char>(67, 21, 4, roi, 255);
+         ExpectMatchesReference<unsigned short>(67, 21, 4, whole, 65535);
+      }
+   }
+}
+
+TEST(SoftwareROIBinningTests, Gray32CannotBeBinned)
+{
+   EXPECT_FALSE(SoftwareROIBinning(0, 0, 0, 0, 2, false).IsSupportedPixelType(4, 1));
+   EXPECT_TRUE(SoftwareROIBinning(0, 0, 0, 0, 2, false).IsSupportedPixelType(4, 4));
+   EXPECT_TRUE(SoftwareROIBinning(0, 0, 8, 8, 1, false).IsSupportedPixelType(4, 1));
+}
+
+TEST(SoftwareROIBinningTests, CircularBufferStoresBinnedImages)
+{
+   CircularBuffer buffer(1);
+   buffer.SetSoftwareROIBinning(boost::shared_ptr<const SoftwareROIBinning>(
+            new SoftwareROIBinning(16, 0, 64, 32, 2, true)));
+   ASSERT_TRUE(buffer.Initialize(1, 128, 64, 2));
+   EXPECT_EQ(32u, buffer.Width());
+   EXPECT_EQ(16u, buffer.Height());
+
+   std::vector<unsigned short> image(128 * 64, 1000);
+   image[16] = 1004; // Top left of the region
+   Metadata md;
+   md.PutImageTag("Camera", "Camera");
+   ASSERT_TRUE(buffer.InsertImage(reinterpret_cast<unsigned char*>(&image[0]),
+            128, 64, 2, &md));
+
+   const mm::ImgBuffer* img = buffer.GetTopImageBuffer(0);
+   ASSERT_TRUE(img != 0);
+   EXPECT_EQ(32u, img->Width());
+   const unsigned short* pixels = reinterpret_cast<const unsigned short*>(img->GetPixels());
+   EXPECT_EQ(1001, pixels[0]);
+   EXPECT_EQ(1000, pixels[1]);
+
+   const Metadata& stored = img->GetMetadata();
+   EXPECT_EQ("32", stored.GetSingleTag("Width").GetValue());
+   EXPECT_EQ("16", stored.GetSingleTag("SoftwareROI-X-start").GetValue());
+   EXPECT_EQ("2", stored.GetSingleTag("SoftwareBinning").GetValue());
+   EXPECT_EQ("Mean", stored.GetSingleTag("SoftwareBinning-Mode").GetValue());
+
+   std::vector<unsigned short> wrongSize(64 * 64);
+   EXPECT_THROW(buffer.InsertImage(reinterpret_cast<unsigned char*>(&wrongSize[0]),
+            64, 64, 2, &md), CMMError);
+}
+
+int main(int argc, char **argv)
+{
+   ::testing::InitGoogleTest(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -387,9 +387,7 @@
 // change default SWIG mapping of void* return values
 // to return CObject containing array of pixel values
 //
-// Assumes that class has the following methods defined:
-// unsigned GetImageWidth()
-// unsigned GetImageHeight()
+// The number of pixels is given by GetReturnedImagePixelCount(), below.
 
 %typemap(jni) void*        "jobject"
 %typemap(jtype) void*      "Object"
@@ -399,7 +397,7 @@
 }
 %typemap(out) void*
 {
-   long lSize = (arg1)->getImageWidth() * (arg1)->getImageHeight();
+   long lSize = GetReturnedImagePixelCount(arg1, "$symname");
    
    if ((arg1)->getBytesPerPixel() == 1)
    {
@@ -506,15 +504,69 @@
    }
 }
 
+// Preview images have their own size and pixel type, which are available
+// once the image has been returned
+%typemap(out) void* getLastPreviewImage, void* getLastPreviewImageMD
+{
+   unsigned numComponents = (arg1)->getPreviewImageNumberOfComponents();
+   long lSize = (arg1)->getPreviewImageWidth() *
+      (arg1)->getPreviewImageHeight() * (numComponents > 1 ? numComponents : 1);
+   unsigned bytesPerSample = (arg1)->getPreviewImageBytesPerPixel() /
+      (numComponents > 1 ? numComponents : 1);
+
+   if (bytesPerSample == 1)
+   {
+      jbyteArray data = JCALL1(NewByteArray, jenv, lSize);
+      if (data == 0)
+      {
+         jclass excep = jenv->FindClass("java/lang/OutOfMemoryError");
+         if (excep)
+            jenv->ThrowNew(excep, "The system ran out of memory!");
+         $result = 0;
+         return $result;
+      }
+      JCALL4(SetByteArrayRegion, jenv, data, 0, lSize, (jbyte*)result);
+      $result = data;
+   }
+   else if (bytesPerSample == 2)
+   {
+      jshortArray data = JCALL1(NewShortArray, jenv, lSize);
+      if (data == 0)
+      {
+         jclass excep = jenv->FindClass("java/lang/OutOfMemoryError");
+         if (excep)
+            jenv->ThrowNew(excep, "The system ran out of memory!");
+         $result = 0;
+         return $result;
+      }
+      JCALL4(SetShortArrayRegion, jenv, data, 0, lSize, (jshort*)result);
+      $result = data;
+   }
+   else if (bytesPerSample == 4)
+   {
+      jfloatArray data = JCALL1(NewFloatArray, jenv, lSize);
+      if (data == 0)
+      {
+         jclass excep = jenv->FindClass("java/lang/OutOfMemoryError");
+         if (excep)
+            jenv->ThrowNew(excep, "The system ran out of memory!");
+         $result = 0;
+         return $result;
+      }
+      JCALL4(SetFloatArrayRegion, jenv, data, 0, lSize, (jfloat*)result);
+      $result = data;
+   }
+   else
+   {
+      $result = 0;
+   }
+}
+
 // Java typemap
 // change default SWIG mapping of void* return values
 // to return CObject containing array of pixel values
 //
-// Assumes that class has the following methods defined:
-// unsigned GetImageWidth()
-// unsigned GetImageHeight()
-// unsigned GetImageDepth()
-// unsigned GetNumberOfComponents()
+// The number of pixels is given by GetReturnedImagePixelCount(), below.
 
 
 %typemap(jni) unsigned int* "jobject"
@@ -525,7 +577,7 @@
 }
 %typemap(out) unsigned int*
 {
-   long lSize = (arg1)->getImageWidth() * (arg1)->getImageHeight();
+   long lSize = GetReturnedImagePixelCount(arg1, "$symname");
    unsigned numComponents = (arg1)->getNumberOfComponents();
    
    if ((arg1)->getBytesPerPixel() == 1 && numComponents == 4)
@@ -628,130 +680,81 @@
 %ignore MetadataKeyError;
 %ignore MetadataIndexError;
 
+// The void* typemaps copy the pixels, so pinned images could never be
+// unpinned from Java. The *TaggedImageDirect methods below are used instead.
+%ignore getLastImagePinned;
+%ignore getLastImagePinnedMD;
+%ignore popNextImagePinned;
+%ignore popNextImagePinnedMD;
+%ignore unpinImage;
+
 
 %typemap(javaimports) CMMCore %{
    import mmcorej.org.json.JSONObject;
    import java.awt.geom.Point2D;
    import java.awt.Rectangle;
+   import java.lang.ref.ReferenceQueue;
+   import java.lang.ref.WeakReference;
+   import java.nio.ByteBuffer;
+   import java.nio.ByteOrder;
    import java.util.ArrayList;
+   import java.util.HashSet;
    import java.util.List;
+   import java.util.Set;
 %}
 
 %typemap(javacode) CMMCore %{
-   private JSONObject metadataToMap(Metadata md) {
-      JSONObject tags = new JSONObject();
-      for (String key:md.GetKeys()) {
-         try {
-            tags.put(key, md.GetSingleTag(key).GetValue());
-         } catch (Exception e) {} 
-      }
-      return tags;
-   }
-
-   private String getROITag() throws java.lang.Exception {
-      String roi = "";
-      int [] x = new int[1];
-      int [] y = new int[1];
-      int [] xSize = new int[1];
-      int [] ySize = new int[1];
-      getROI(x, y, xSize, ySize);
-      roi += x[0] + "-" + y[0] + "-" + xSize[0] + "-" + ySize[0];
-      return roi;
-   }
-
-   private String getPixelType() {
-      int depth = (int) getBytesPerPixel();
-      int numComponents = (int) getNumberOfComponents();
-      switch (depth) {
-         case 1:
-            return "GRAY8";
-         case 2:
-            return "GRAY16";
-         case 4: {
-            if (numComponents == 1)
-               return "GRAY32";
-            else
-               return "RGB32";
-            }
-         case 8:
-            return "RGB64";
-     }
-     return "";
-   }
-
-   private String getMultiCameraChannel(JSONObject tags, int cameraChannelIndex) {
-	  try {
-	  String camera = tags.getString("Core-Camera");
-	  String physCamKey = camera + "-Physical Camera " + (1 + cameraChannelIndex);
-	  if (tags.has(physCamKey)) {
-		 try {
-			return tags.getString(physCamKey);
-		 } catch (Exception e2) {
-			return null;
-		 }
-	  } else {
-		 return null;
-	  }
-	 } catch (Exception e) {
-	   return null;
-	 }
+   private TaggedImage createTaggedImage(Object pixels, Metadata md, int cameraChannelIndex) throws java.lang.Exception {
+      return new TaggedImage(pixels, new JSONObject(getTaggedImageTags_(md, cameraChannelIndex)));
+   }
 
+   private TaggedImage createTaggedImage(Object pixels, Metadata md) throws java.lang.Exception {
+      return createTaggedImage(pixels, md, -1);
    }
 
-   private TaggedImage createTaggedImage(Object pixels, Metadata md, int cameraChannelIndex) throws java.lang.Exception {
-      TaggedImage image = createTaggedImage(pixels, md);
-      JSONObject tags = image.tags;
-      
-      if (!tags.has("CameraChannelIndex")) {
-         tags.put("CameraChannelIndex", cameraChannelIndex);
-         tags.put("ChannelIndex", cameraChannelIndex);
+   // A direct image that has not been released. Its image is released when
+   // the pixel buffer is garbage collected, if it was not released before.
+   private static class DirectImageReference extends WeakReference<ByteBuffer> {
+      final long address;
+
+      DirectImageReference(ByteBuffer pixels, long address, ReferenceQueue<ByteBuffer> queue) {
+         super(pixels, queue);
+         this.address = address;
       }
-      if (!tags.has("Camera")) {
-         String physicalCamera = getMultiCameraChannel(tags, cameraChannelIndex);
-         if (physicalCamera != null) {
-            tags.put("Camera", physicalCamera);
-            tags.put("Channel",physicalCamera);
+   }
+
+   private final Set<DirectImageReference> directImages_ = new HashSet<DirectImageReference>();
+   private final ReferenceQueue<ByteBuffer> collectedDirectImages_ = new ReferenceQueue<ByteBuffer>();
+
+   // Releases the images whose pixel buffers were garbage collected
+   private void releaseCollectedDirectImages() throws java.lang.Exception {
+      DirectImageReference image;
+      while ((image = (DirectImageReference) collectedDirectImages_.poll()) != null) {
+         boolean unreleased;
+         synchronized (directImages_) {
+            unreleased = directImages_.remove(image);
+         }
+         if (unreleased) {
+            releaseDirectImage_(image.address);
          }
       }
-      return image;
    }
 
-   private TaggedImage createTaggedImage(Object pixels, Metadata md) throws java.lang.Exception {
-      JSONObject tags = metadataToMap(md);
-      PropertySetting setting;
-      Configuration config = getSystemStateCache();
-      for (int i = 0; i < config.size(); ++i) {
-         setting = config.getSetting(i);
-         String key = setting.getDeviceLabel() + "-" + setting.getPropertyName();
-         String value = setting.getPropertyValue();
-          tags.put(key, value);
+   private TaggedImage createDirectTaggedImage(Object[] image) throws java.lang.Exception {
+      ByteBuffer pixels = (ByteBuffer) image[0];
+      long address = directBufferAddress_(pixels);
+      pixels.order(ByteOrder.nativeOrder());
+      TaggedImage taggedImage;
+      try {
+         taggedImage = new TaggedImage(pixels, new JSONObject((String) image[1]));
+      } catch (Exception e) {
+         releaseDirectImage_(address);
+         throw e;
       }
-      tags.put("BitDepth", getImageBitDepth());
-      tags.put("PixelSizeUm", getPixelSizeUm(true));
-      tags.put("PixelSizeAffine", getPixelSizeAffineAsString());
-      tags.put("ROI", getROITag());
-      tags.put("Width", getImageWidth());
-      tags.put("Height", getImageHeight());
-      tags.put("PixelType", getPixelType());
-      tags.put("Frame", 0);
-      tags.put("FrameIndex", 0);
-      tags.put("Position", "Default");
-      tags.put("PositionIndex", 0);
-      tags.put("Slice", 0);
-      tags.put("SliceIndex", 0);
-      String channel = getCurrentConfigFromCache(getPropertyFromCache("Core","ChannelGroup"));
-      if ((channel == null) || (channel.length() == 0)) {
-         channel = "Default";
+      synchronized (directImages_) {
+         directImages_.add(new DirectImageReference(pixels, address, collectedDirectImages_));
       }
-      tags.put("Channel", channel);
-      tags.put("ChannelIndex", 0);
-
-
-      try {
-         tags.put("Binning", getProperty(getCameraDevice(), "Binning"));
-      } catch (Exception ex) {}
-      
-      return new TaggedImage(pixels, tags);	
+      return taggedImage;
    }
 
    public TaggedImage getTaggedImage(int cameraChannelIndex) throws java.lang.Exception {
@@ -790,6 +793,64 @@
       return popNextTaggedImage(0);
    }
 
+   /**
+    * Like getLastTaggedImage(), but the pixels are not copied: they are a
+    * direct ByteBuffer (in native byte order) over the image in the
+    * circular buffer. The image is kept until it is released with
+    * releaseTaggedImage(). An image that is not released is released
+    * after its pixel buffer has been garbage collected, on a later call
+    * to one of these methods.
+    */
+   public TaggedImage getLastTaggedImageDirect(int cameraChannelIndex) throws java.lang.Exception {
+      releaseCollectedDirectImages();
+      return createDirectTaggedImage(getLastTaggedImageDirect_(cameraChannelIndex));
+   }
+
+   public TaggedImage getLastTaggedImageDirect() throws java.lang.Exception {
+      return getLastTaggedImageDirect(0);
+   }
+
+   /**
+    * Like popNextTaggedImage(), but the pixels are not copied. See
+    * getLastTaggedImageDirect().
+    */
+   public TaggedImage popNextTaggedImageDirect(int cameraChannelIndex) throws java.lang.Exception {
+      releaseCollectedDirectImages();
+      return createDirectTaggedImage(popNextTaggedImageDirect_(cameraChannelIndex));
+   }
+
+   public TaggedImage popNextTaggedImageDirect() throws java.lang.Exception {
+      return popNextTaggedImageDirect(0);
+   }
+
+   /**
+    * Releases an image returned by one of the *TaggedImageDirect methods.
+    * The limit of its pixel buffer is set to 0, so that the pixels can no
+    * longer be read through it; copies of the buffer must not be used
+    * either.
+    */
+   public void releaseTaggedImage(TaggedImage image) throws java.lang.Exception {
+      ByteBuffer pixels = (ByteBuffer) image.pix;
+      DirectImageReference released = null;
+      synchronized (directImages_) {
+         for (DirectImageReference reference : directImages_) {
+            if (reference.get() == pixels) {
+               released = reference;
+               break;
+            }
+         }
+         if (released != null) {
+            directImages_.remove(released);
+         }
+      }
+      if (released == null) {
+         throw new IllegalArgumentException("Not a direct image, or already released.");
+      }
+      pixels.limit(0);
+      releaseDirectImage_(released.address);
+      releaseCollectedDirectImages();
+   }
+
    // convenience functions follow
    
    /*
@@ -812,6 +873,16 @@
       return new Rectangle(a[0][0], a[1][0], a[2][0], a[3][0]);
    }
 
+   /*
+    * Convenience function. Returns the software ROI in a java.awt.Rectangle
+    * (of zero size if none is set).
+    */
+   public Rectangle getSoftwareROI() throws java.lang.Exception {
+      int[][] a = new int[4][1];
+      getSoftwareROI(a[0], a[1], a[2], a[3]);
+      return new Rectangle(a[0][0], a[1][0], a[2][0], a[3][0]);
+   }
+
    /*
     * Convenience function: returns multiple ROIs of the current camera as a
     * list of java.awt.Rectangles.
@@ -902,11 +973,380 @@
 %{
 #include "../MMDevice/MMDeviceConstants.h"
 #include "../MMCore/Configuration.h"
+#include "../MMCore/ImageStatistics.h"
 #include "../MMDevice/ImageMetadata.h"
 #include "../MMCore/MMEventCallback.h"
 #include "../MMCore/MMCore.h"
 %}
 
+%{
+// Number of pixels of the image returned by the given function. The images
+// in the circular buffer have their own size, which differs from that of the
+// camera when a software ROI or binning is set.
+static long GetReturnedImagePixelCount(CMMCore* core, const std::string& function)
+{
+   if (function.compare(0, 12, "getLastImage") == 0 ||
+         function.compare(0, 12, "popNextImage") == 0 ||
+         function.compare(0, 19, "getNBeforeLastImage") == 0)
+      return (long) core->getBufferedImageWidth() * core->getBufferedImageHeight();
+   return (long) core->getImageWidth() * core->getImageHeight();
+}
+%}
+
+
+//
+// TaggedImage support in C++: the tags are built and serialized to JSON
+// in a single call, instead of calling back into C++ for every tag, and
+// the *TaggedImageDirect methods hand out the pixels of pinned circular
+// buffer images as direct ByteBuffers, without copying.
+//
+
+%{
+#include <cstdio>
+#include <map>
+#include <sstream>
+
+class TaggedImageTags
+{
+public:
+   void PutString(const std::string& key, const std::string& value)
+   {
+      strings_[key] = value;
+      json_[key] = Quote(value);
+   }
+
+   void PutNumber(const std::string& key, long value)
+   {
+      std::ostringstream os;
+      os << value;
+      strings_.erase(key);
+      json_[key] = os.str();
+   }
+
+   void PutNumber(const std::string& key, double value)
+   {
+      strings_.erase(key);
+      json_[key] = FormatDouble(value);
+   }
+
+   bool Has(const std::string& key) const
+   {
+      return json_.find(key) != json_.end();
+   }
+
+   bool GetString(const std::string& key, std::string& value) const
+   {
+      std::map<std::string, std::string>::const_iterator it = strings_.find(key);
+      if (it == strings_.end())
+         return false;
+      value = it->second;
+      return true;
+   }
+
+   std::string Serialize() const
+   {
+      std::string result = "{";
+      for (std::map<std::string, std::string>::const_iterator it = json_.begin();
+            it != json_.end(); ++it)
+      {
+         if (it != json_.begin())
+            result += ",";
+         result += Quote(it->first) + ":" + it->second;
+      }
+      return result + "}";
+   }
+
+   // Keeps a decimal point, so that Java reads the value back as a Double
+   static std::string FormatDouble(double value)
+   {
+      std::ostringstream os;
+      os.precision(17);
+      os << value;
+      std::string text = os.str();
+      if (text.find_first_of(".eEn") == std::string::npos)
+         text += ".0";
+      return text;
+   }
+
+private:
+   static std::string Quote(const std::string& s)
+   {
+      std::string result = "\"";
+      for (std::string::const_iterator it = s.begin(); it != s.end(); ++it)
+      {
+         unsigned char c = *it;
+         if (c == '"' || c == '\\')
+         {
+            result += '\\';
+            result += c;
+         }
+         else if (c < 0x20)
+         {
+            char escaped[8];
+            sprintf(escaped, "\\u%04x", c);
+            result += escaped;
+         }
+         else
+            result += c;
+      }
+      return result + "\"";
+   }
+
+   std::map<std::string, std::string> json_;
+   std::map<std::string, std::string> strings_;
+};
+
+// Returns false if the tag is missing or not a number
+static bool GetLongTag(const Metadata& md, const char* key, long& value)
+{
+   try
+   {
+      std::istringstream is(md.GetSingleTag(key).GetValue());
+      return (bool)(is >> value);
+   }
+   catch (const MetadataKeyError&)
+   {
+      return false;
+   }
+}
+
+static std::string GetPixelTypeTag(CMMCore* core)
+{
+   switch (core->getBytesPerPixel())
+   {
+      case 1:
+         return "GRAY8";
+      case 2:
+         return "GRAY16";
+      case 4:
+         return core->getNumberOfComponents() == 1 ? "GRAY32" : "RGB32";
+      case 8:
+         return "RGB64";
+   }
+   return "";
+}
+
+// Same tags as the Java createTaggedImage() used to build. A negative
+// cameraChannelIndex skips the camera channel tags.
+static std::string GetTaggedImageTags(CMMCore* core, const Metadata& md,
+      int cameraChannelIndex) throw (CMMError)
+{
+   TaggedImageTags tags;
+
+   std::vector<std::string> keys = md.GetKeys();
+   for (std::vector<std::string>::const_iterator it = keys.begin(); it != keys.end(); ++it)
+   {
+      try
+      {
+         tags.PutString(*it, md.GetSingleTag(it->c_str()).GetValue());
+      }
+      catch (const MetadataKeyError&)
+      {
+      }
+   }
+
+   Configuration config = core->getSystemStateCache();
+   for (size_t i = 0; i < config.size(); ++i)
+   {
+      PropertySetting setting = config.getSetting(i);
+      tags.PutString(setting.getDeviceLabel() + "-" + setting.getPropertyName(),
+            setting.getPropertyValue());
+   }
+
+   tags.PutNumber("BitDepth", (long) core->getImageBitDepth());
+   tags.PutNumber("PixelSizeUm", core->getPixelSizeUm(true));
+
+   std::string affine;
+   std::vector<double> aff = core->getPixelSizeAffine(true);
+   if (aff.size() == 6)
+   {
+      for (size_t i = 0; i < 6; ++i)
+      {
+         if (i > 0)
+            affine += ";";
+         affine += TaggedImageTags::FormatDouble(aff[i]);
+      }
+   }
+   tags.PutString("PixelSizeAffine", affine);
+
+   int x, y, xSize, ySize;
+   core->getROI(x, y, xSize, ySize);
+   std::ostringstream roi;
+   roi << x << "-" << y << "-" << xSize << "-" << ySize;
+   tags.PutString("ROI", roi.str());
+
+   // Images from the circular buffer carry their own size, which differs
+   // from the camera's when a software ROI or binning is set
+   long width, height;
+   if (!GetLongTag(md, "Width", width))
+      width = (long) core->getImageWidth();
+   if (!GetLongTag(md, "Height", height))
+      height = (long) core->getImageHeight();
+   tags.PutNumber("Width", width);
+   tags.PutNumber("Height", height);
+   tags.PutString("PixelType", GetPixelTypeTag(core));
+   tags.PutNumber("Frame", 0L);
+   tags.PutNumber("FrameIndex", 0L);
+   tags.PutString("Position", "Default");
+   tags.PutNumber("PositionIndex", 0L);
+   tags.PutNumber("Slice", 0L);
+   tags.PutNumber("SliceIndex", 0L);
+   std::string channel = core->getCurrentConfigFromCache(
+         core->getPropertyFromCache("Core", "ChannelGroup").c_str());
+   if (channel.empty())
+      channel = "Default";
+   tags.PutString("Channel", channel);
+   tags.PutNumber("ChannelIndex", 0L);
+
+   try
+   {
+      tags.PutString("Binning", core->getProperty(core->getCameraDevice().c_str(), "Binning"));
+   }
+   catch (const CMMError&)
+   {
+   }
+
+   if (cameraChannelIndex >= 0)
+   {
+      if (!tags.Has("CameraChannelIndex"))
+      {
+         tags.PutNumber("CameraChannelIndex", (long) cameraChannelIndex);
+         tags.PutNumber("ChannelIndex", (long) cameraChannelIndex);
+      }
+      std::string camera, physicalCamera;
+      if (!tags.Has("Camera") && tags.GetString("Core-Camera", camera))
+      {
+         std::ostringstream key;
+         key << camera << "-Physical Camera " << (1 + cameraChannelIndex);
+         if (tags.GetString(key.str(), physicalCamera))
+         {
+            tags.PutString("Camera", physicalCamera);
+            tags.PutString("Channel", physicalCamera);
+         }
+      }
+   }
+
+   return tags.Serialize();
+}
+
+// A pinned image and its serialized tags, returned to Java as
+// Object[] { ByteBuffer, String }
+struct DirectTaggedImage
+{
+   void* pixels;
+   long bytes;
+   std::string tags;
+};
+
+// width, height and bytesPerPixel are those the core returned with the
+// pinned image
+static DirectTaggedImage MakeDirectTaggedImage(CMMCore* core, void* pixels,
+      unsigned width, unsigned height, unsigned bytesPerPixel,
+      const Metadata& md, int cameraChannelIndex) throw (CMMError)
+{
+   DirectTaggedImage image;
+   image.pixels = pixels;
+   image.bytes = (long)width * height * bytesPerPixel;
+   try
+   {
+      image.tags = GetTaggedImageTags(core, md, cameraChannelIndex);
+   }
+   catch (const CMMError&)
+   {
+      core->unpinImage(pixels);
+      throw;
+   }
+   return image;
+}
+%}
+
+%typemap(jni) DirectTaggedImage "jobjectArray"
+%typemap(jtype) DirectTaggedImage "Object[]"
+%typemap(jstype) DirectTaggedImage "Object[]"
+%typemap(javaout) DirectTaggedImage {
+   return $jnicall;
+}
+%typemap(out) DirectTaggedImage
+{
+   jobject buffer = JCALL2(NewDirectByteBuffer, jenv, $1.pixels, $1.bytes);
+   jstring tags = buffer ? JCALL1(NewStringUTF, jenv, $1.tags.c_str()) : 0;
+   jclass objectClass = tags ? JCALL1(FindClass, jenv, "java/lang/Object") : 0;
+   jobjectArray data = objectClass ? JCALL3(NewObjectArray, jenv, 2, objectClass, 0) : 0;
+   if (data == 0)
+   {
+      (arg1)->unpinImage($1.pixels);
+      if (!JCALL0(ExceptionCheck, jenv))
+      {
+         jclass excep = jenv->FindClass("java/lang/UnsupportedOperationException");
+         if (excep)
+            jenv->ThrowNew(excep, "Direct buffers are not supported by this JVM.");
+      }
+      return $null;
+   }
+   JCALL3(SetObjectArrayElement, jenv, data, 0, buffer);
+   JCALL3(SetObjectArrayElement, jenv, data, 1, tags);
+   $result = data;
+}
+
+%typemap(jni) const void* directBuffer "jobject"
+%typemap(jtype) const void* directBuffer "java.nio.ByteBuffer"
+%typemap(jstype) const void* directBuffer "java.nio.ByteBuffer"
+%typemap(javain) const void* directBuffer "$javainput"
+%typemap(in) const void* directBuffer
+{
+   $1 = JCALL1(GetDirectBufferAddress, jenv, $input);
+   if ($1 == 0)
+   {
+      jclass excep = jenv->FindClass("java/lang/IllegalArgumentException");
+      if (excep)
+         jenv->ThrowNew(excep, "Not a direct buffer.");
+      return $null;
+   }
+}
+
+%javamethodmodifiers CMMCore::getTaggedImageTags_ "private";
+%javamethodmodifiers CMMCore::getLastTaggedImageDirect_ "private";
+%javamethodmodifiers CMMCore::popNextTaggedImageDirect_ "private";
+%javamethodmodifiers CMMCore::directBufferAddress_ "private";
+%javamethodmodifiers CMMCore::releaseDirectImage_ "private";
+%extend CMMCore {
+   std::string getTaggedImageTags_(Metadata& md, int cameraChannelIndex) throw (CMMError)
+   {
+      return GetTaggedImageTags(self, md, cameraChannelIndex);
+   }
+
+   DirectTaggedImage getLastTaggedImageDirect_(int cameraChannelIndex) throw (CMMError)
+   {
+      Metadata md;
+      unsigned width, height, bytesPerPixel;
+      void* pixels = self->getLastImagePinnedMD(cameraChannelIndex, md,
+            width, height, bytesPerPixel);
+      return MakeDirectTaggedImage(self, pixels, width, height, bytesPerPixel,
+            md, cameraChannelIndex);
+   }
+
+   DirectTaggedImage popNextTaggedImageDirect_(int cameraChannelIndex) throw (CMMError)
+   {
+      Metadata md;
+      unsigned width, height, bytesPerPixel;
+      void* pixels = self->popNextImagePinnedMD(cameraChannelIndex, md,
+            width, height, bytesPerPixel);
+      return MakeDirectTaggedImage(self, pixels, width, height, bytesPerPixel,
+            md, cameraChannelIndex);
+   }
+
+   // The address identifies the image once the buffer has been collected
+   long long directBufferAddress_(const void* directBuffer)
+   {
+      return (long long) (size_t) directBuffer;
+   }
+
+   void releaseDirectImage_(long long address) throw (CMMError)
+   {
+      self->unpinImage((const void*) (size_t) address);
+   }
+}
+
 
 // instantiate STL mappings
 
@@ -1220,6 +1660,7 @@ namespace std {
 
 %include "../MMDevice/MMDeviceConstants.h"
 %include "../MMCore/Configuration.h"
+%include "../MMCore/ImageStatistics.h"
 %include "../MMCore/MMCore.h"
 %include "../MMDevice/ImageMetadata.h"
 %include "../MMCore/MMEventCallback.h"
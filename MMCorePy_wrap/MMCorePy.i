@@ -30,10 +30,18 @@
 
 
 
-%module (directors="1") MMCorePy
+%module (directors="1", threads="1") MMCorePy
 %feature("director") MMEventCallback;
 %feature("autodoc", "3");
 
+// The GIL is released during every call into the core, since most calls can
+// block on devices (snapImage, waitForDevice, sleep, ...). Functions below
+// that use the Python API keep it.
+%feature("nothreadallow") CMMCore::setSLMImage_pywrap;
+%feature("nothreadallow") CMMCore::getLastImageView_pywrap;
+%feature("nothreadallow") CMMCore::popNextImageView_pywrap;
+%feature("nothreadallow") CMMCore::popNextImageViewMD_pywrap;
+
 %include std_string.i
 %include std_vector.i
 %include std_map.i
@@ -58,8 +66,7 @@ import_array();
 %typemap(out) void*
 {
    npy_intp dims[2];
-   dims[0] = (arg1)->getImageHeight();
-   dims[1] = (arg1)->getImageWidth();
+   GetReturnedImageSize(arg1, "$symname", dims);
    npy_intp pixelCount = dims[0] * dims[1];
 
    if ((arg1)->getBytesPerPixel() == 1)
@@ -101,8 +108,7 @@ import_array();
 {
    //Here we assume we are getting RGBA (32 bits).
    npy_intp dims[3];
-   dims[0] = (arg1)->getImageHeight();
-   dims[1] = (arg1)->getImageWidth();
+   GetReturnedImageSize(arg1, "$symname", dims);
    dims[2] = 3; // RGB
    unsigned numChannels = (arg1)->getNumberOfComponents();
    unsigned char * pyBuf;
@@ -184,6 +190,144 @@ import_array();
     }
 }
 
+%{
+#define SWIG_FILE_WITH_INIT
+#include "../MMDevice/MMDeviceConstants.h"
+#include "../MMCore/Error.h"
+#include "../MMCore/Configuration.h"
+#include "../MMCore/ImageStatistics.h"
+#include "../MMDevice/ImageMetadata.h"
+#include "../MMCore/MMEventCallback.h"
+#include "../MMCore/MMCore.h"
+%}
+
+%{
+// Height and width of the image returned by the given function. The images
+// in the circular buffer have their own size, which differs from that of the
+// camera when a software ROI or binning is set.
+static void GetReturnedImageSize(CMMCore* core, const std::string& function, npy_intp* dims)
+{
+   if (function.compare(0, 12, "getLastImage") == 0 ||
+         function.compare(0, 12, "popNextImage") == 0 ||
+         function.compare(0, 19, "getNBeforeLastImage") == 0)
+   {
+      dims[0] = core->getBufferedImageHeight();
+      dims[1] = core->getBufferedImageWidth();
+   }
+   else
+   {
+      dims[0] = core->getImageHeight();
+      dims[1] = core->getImageWidth();
+   }
+}
+%}
+
+// Zero-copy access to the circular buffer. The returned arrays are read-only
+// views of the buffer; the image stays pinned in the core (and is not
+// overwritten) until the array is deleted.
+%{
+static void ReleasePinnedImage(PyObject* capsule)
+{
+   CMMCore* core = static_cast<CMMCore*>(PyCapsule_GetContext(capsule));
+   void* pixels = PyCapsule_GetPointer(capsule, "MMCorePy.PinnedImage");
+   try
+   {
+      core->unpinImage(pixels);
+   }
+   catch (CMMError&)
+   {
+   }
+}
+
+// width, height and bytesPerPixel are those the core returned with the
+// pinned image; the camera settings may have changed since it was taken
+static PyObject* PinnedImageArray(CMMCore* core, PyObject* coreObject, void* pixels,
+      unsigned width, unsigned height, unsigned bytesPerPixel)
+{
+   npy_intp dims[2];
+   dims[0] = height;
+   dims[1] = width;
+
+   int type;
+   switch (bytesPerPixel)
+   {
+      case 1: type = NPY_UINT8; break;
+      case 2: type = NPY_UINT16; break;
+      case 4: type = NPY_UINT32; break;
+      case 8: type = NPY_UINT64; break;
+      default:
+         core->unpinImage(pixels);
+         PyErr_SetString(PyExc_TypeError, "Unsupported pixel type.");
+         return NULL;
+   }
+
+   PyObject * numpyArray = PyArray_SimpleNewFromData(2, dims, type, pixels);
+   if (numpyArray == NULL)
+   {
+      core->unpinImage(pixels);
+      return NULL;
+   }
+   PyArray_CLEARFLAGS((PyArrayObject *) numpyArray, NPY_ARRAY_WRITEABLE);
+
+   PyObject * capsule = PyCapsule_New(pixels, "MMCorePy.PinnedImage", ReleasePinnedImage);
+   PyCapsule_SetContext(capsule, core);
+   // The base also holds the core, so that the core outlives the array.
+   // Tuple items are released last to first: the image is unpinned before
+   // the core can go away.
+   PyObject * base = Py_BuildValue("(ON)", coreObject, capsule);
+   PyArray_SetBaseObject((PyArrayObject *) numpyArray, base);
+   return numpyArray;
+}
+%}
+
+%rename(_getLastImageView) getLastImageView_pywrap;
+%rename(_popNextImageView) popNextImageView_pywrap;
+%rename(_popNextImageViewMD) popNextImageViewMD_pywrap;
+%extend CMMCore {
+PyObject *getLastImageView_pywrap(PyObject* coreObject) throw (CMMError)
+{
+   unsigned width, height, bytesPerPixel;
+   void* pixels = self->getLastImagePinned(width, height, bytesPerPixel);
+   return PinnedImageArray(self, coreObject, pixels, width, height, bytesPerPixel);
+}
+
+PyObject *popNextImageView_pywrap(PyObject* coreObject) throw (CMMError)
+{
+   unsigned width, height, bytesPerPixel;
+   void* pixels = self->popNextImagePinned(width, height, bytesPerPixel);
+   return PinnedImageArray(self, coreObject, pixels, width, height, bytesPerPixel);
+}
+
+PyObject *popNextImageViewMD_pywrap(PyObject* coreObject, Metadata& md) throw (CMMError)
+{
+   unsigned width, height, bytesPerPixel;
+   void* pixels = self->popNextImagePinnedMD(md, width, height, bytesPerPixel);
+   return PinnedImageArray(self, coreObject, pixels, width, height, bytesPerPixel);
+}
+
+%pythoncode %{
+def getLastImageView(self):
+    """Like getLastImage(), but returns a read-only view of the circular
+    buffer instead of a copy. The image is kept until the array is deleted."""
+    return self._getLastImageView(self)
+
+def popNextImageView(self):
+    """Like popNextImage(), but returns a read-only view of the circular
+    buffer instead of a copy. The image is kept until the array is deleted."""
+    return self._popNextImageView(self)
+
+def popNextImageViewMD(self, md):
+    """Like popNextImageMD(), but returns a read-only view of the circular
+    buffer instead of a copy. The image is kept until the array is deleted."""
+    return self._popNextImageViewMD(self, md)
+%}
+}
+%ignore getLastImagePinned;
+%ignore getLastImagePinnedMD;
+%ignore popNextImagePinned;
+%ignore popNextImagePinnedMD;
+%ignore unpinImage;
+
 %rename(setSLMImage) setSLMImage_pywrap;
 %apply (char *STRING, int LENGTH) { (char *pixels, int receivedLength) };
 %extend CMMCore {
@@ -210,16 +354,6 @@ PyObject *setSLMImage_pywrap(const char* slmLabel, char *pixels, int receivedLen
 }
 %ignore setSLMImage;
 
-%{
-#define SWIG_FILE_WITH_INIT
-#include "../MMDevice/MMDeviceConstants.h"
-#include "../MMCore/Error.h"
-#include "../MMCore/Configuration.h"
-#include "../MMDevice/ImageMetadata.h"
-#include "../MMCore/MMEventCallback.h"
-#include "../MMCore/MMCore.h"
-%}
-
 // Extend exception objects to return the exception object message in python.
 // __str__ method gets printed in the traceback, so it should contain the core error message string.
 
@@ -278,6 +412,7 @@ namespace std {
 %include "../MMDevice/MMDeviceConstants.h"
 %include "../MMCore/Error.h"
 %include "../MMCore/Configuration.h"
+%include "../MMCore/ImageStatistics.h"
 %include "../MMCore/MMCore.h"
 %include "../MMDevice/ImageMetadata.h"
 %include "../MMCore/MMEventCallback.h"
@@ -80,6 +80,7 @@ const char* const g_Msg_DEVICE_DUPLICATE_LIBRARY="Duplicate Device Library Name"
 const char* const g_Msg_DEVICE_PROPERTY_NOT_SEQUENCEABLE="This property is not sequenceable";
 const char* const g_Msg_DEVICE_SEQUENCE_TOO_LARGE="Sequence is too large for this device";
 const char* const g_Msg_DEVICE_NOT_YET_IMPLEMENTED="This command has not yet been implemented for this device.";
+const char* const g_Msg_DEVICE_IMAGE_HELD_BY_PROCESSOR="The image was held back by the image processor";
 
 inline long nint( double value )
 {
@@ -956,6 +957,7 @@ protected:
       SetErrorText(DEVICE_PROPERTY_NOT_SEQUENCEABLE, g_Msg_DEVICE_PROPERTY_NOT_SEQUENCEABLE);
       SetErrorText(DEVICE_SEQUENCE_TOO_LARGE, g_Msg_DEVICE_SEQUENCE_TOO_LARGE);
       SetErrorText(DEVICE_NOT_YET_IMPLEMENTED, g_Msg_DEVICE_NOT_YET_IMPLEMENTED);
+      SetErrorText(DEVICE_IMAGE_HELD_BY_PROCESSOR, g_Msg_DEVICE_IMAGE_HELD_BY_PROCESSOR);
    }
 
    /**
@@ -2077,6 +2079,14 @@ class CAutoFocusBase : public CDeviceBase<MM::AutoFocus, U>
 template <class U>
 class CImageProcessorBase : public CDeviceBase<MM::ImageProcessor, U>
 {
+   /**
+   * Processors that do not keep state across images treat all streams alike
+   */
+   virtual int ProcessStreamImage(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth,
+         unsigned /*nComponents*/, const char* /*cameraLabel*/, unsigned /*channel*/)
+   {
+      return this->Process(buffer, width, height, byteDepth);
+   }
 };
 
 /**
@@ -27,7 +27,7 @@
 // Header version
 // If any of the class definitions changes, the interface version
 // must be incremented
-#define DEVICE_INTERFACE_VERSION 69
+#define DEVICE_INTERFACE_VERSION 70
 ///////////////////////////////////////////////////////////////////////////////
 
 
@@ -876,7 +876,16 @@ namespace MM {
       static const DeviceType Type;
 
       // image processor API
+      // Processes the image in place. During sequence acquisition, a return
+      // value of DEVICE_IMAGE_HELD_BY_PROCESSOR tells the core not to insert
+      // the image (e.g. because it was folded into a later one).
       virtual int Process(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth) = 0;
+      // Like Process(), for one channel of an image inserted by a camera.
+      // cameraLabel and channel (the CameraChannelIndex of the image)
+      // identify the stream the image belongs to; nComponents is that of
+      // the camera, e.g. 4 for RGB32 and 1 for GRAY32.
+      virtual int ProcessStreamImage(unsigned char* buffer, unsigned width, unsigned height, unsigned byteDepth,
+            unsigned nComponents, const char* cameraLabel, unsigned channel) = 0;
 
 
    };
@@ -78,6 +78,7 @@
 #define DEVICE_SEQUENCE_TOO_LARGE      39
 #define DEVICE_OUT_OF_MEMORY           40
 #define DEVICE_NOT_YET_IMPLEMENTED     41
+#define DEVICE_IMAGE_HELD_BY_PROCESSOR 42 // not an error: the image was consumed
 
 
 namespace MM {
@@ -150,6 +151,7 @@ namespace MM {
    const char* const g_Keyword_Metadata_ROI_X       = "ROI-X-start";
    const char* const g_Keyword_Metadata_ROI_Y       = "ROI-Y-start";
    const char* const g_Keyword_Metadata_TimeInCore  = "TimeReceivedByCore";
+   const char* const g_Keyword_Metadata_BitDepth    = "BitDepth";
 
    // configuration file format constants
    const char* const g_FieldDelimiters = ",";
@@ -158,6 +160,7 @@ namespace MM {
    const char* const g_CFGCommand_Property = "Property";
    const char* const g_CFGCommand_Configuration = "Config";
    const char* const g_CFGCommand_ConfigGroup = "ConfigGroup";
+   const char* const g_CFGCommand_ConfigGroupAlwaysApply = "ConfigGroupAlwaysApply";
    const char* const g_CFGCommand_Equipment = "Equipment";
    const char* const g_CFGCommand_Delay = "Delay";
    const char* const g_CFGCommand_ImageSynchro = "ImageSynchro";
@@ -266,6 +269,13 @@ namespace MM {
       CanCommunicate = 1     // -- communication verified, parameters have been set to valid values.
    };
 
+   // Thread safety of the devices of a module (see SetModuleThreadSafety())
+   enum ModuleThreadSafety {
+      ThreadSafetyModule = 0,   // -- calls into all devices of the module are serialized (default)
+      ThreadSafetyDevice = 1,   // -- calls into each device are serialized, but different devices may be called concurrently
+      ThreadSafetyReentrant = 2 // -- any device may be called concurrently from any thread
+   };
+
 } // namespace MM
 
 #endif //_MMDEVICE_CONSTANTS_H_
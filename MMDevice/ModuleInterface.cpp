@@ -58,6 +58,8 @@ public:
 // Registered devices in this module (device adapter library)
 static std::vector<DeviceInfo> g_registeredDevices;
 
+static MM::ModuleThreadSafety g_threadSafety = MM::ThreadSafetyModule;
+
 
 MODULE_API long GetModuleVersion()
 {
@@ -119,6 +121,11 @@ MODULE_API bool GetDeviceDescription(const char* deviceName, char* description,
    return true;
 }
 
+MODULE_API long GetModuleThreadSafety()
+{
+   return static_cast<long>(g_threadSafety);
+}
+
 void RegisterDevice(const char* deviceName, MM::DeviceType deviceType, const char* deviceDescription)
 {
    if (!deviceName)
@@ -135,3 +142,8 @@ void RegisterDevice(const char* deviceName, MM::DeviceType deviceType, const cha
 
    g_registeredDevices.push_back(DeviceInfo(deviceName, deviceType, deviceDescription));
 }
+
+void SetModuleThreadSafety(MM::ModuleThreadSafety safety)
+{
+   g_threadSafety = safety;
+}
@@ -104,6 +104,7 @@ extern "C" {
    MODULE_API bool GetDeviceName(unsigned deviceIndex, char* name, unsigned bufferLength);
    MODULE_API bool GetDeviceType(const char* deviceName, int* type);
    MODULE_API bool GetDeviceDescription(const char* deviceName, char* name, unsigned bufferLength);
+   MODULE_API long GetModuleThreadSafety();
 
    // Function pointer types for module interface functions
    // (Not for use by device adapters)
@@ -117,6 +118,7 @@ extern "C" {
    typedef bool (*fnGetDeviceName)(unsigned, char*, unsigned);
    typedef bool (*fnGetDeviceType)(const char*, int*);
    typedef bool (*fnGetDeviceDescription)(const char*, char*, unsigned);
+   typedef long (*fnGetModuleThreadSafety)();
 #endif
 }
 
@@ -137,5 +139,20 @@ extern "C" {
  */
 void RegisterDevice(const char* deviceName, MM::DeviceType deviceType, const char* description);
 
+/**
+ * May be called in the device adapter module's implementation of
+ * InitializeModuleData().
+ *
+ * By default, the Core serializes all calls into all devices of a module, so
+ * that devices can share unsynchronized state (for example a hub and its
+ * peripherals). A module whose devices synchronize any shared state
+ * themselves can declare MM::ThreadSafetyDevice, so that the Core only
+ * serializes calls into each device, or MM::ThreadSafetyReentrant, so that
+ * the Core does not serialize calls at all.
+ *
+ * \see InitializeModuleData()
+ */
+void SetModuleThreadSafety(MM::ModuleThreadSafety safety);
+
 
 #endif //_MODULE_INTERFACE_H_
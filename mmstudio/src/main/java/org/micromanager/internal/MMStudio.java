@@ -108,6 +108,7 @@ import org.micromanager.internal.script.ScriptPanel;
 import org.micromanager.internal.utils.DaytimeNighttime;
 import org.micromanager.internal.utils.DefaultAutofocusManager;
 import org.micromanager.internal.utils.HotKeys;
+import org.micromanager.internal.utils.JavaUtils;
 import org.micromanager.internal.utils.UserProfileManager;
 import org.micromanager.internal.utils.FileDialogs;
 import org.micromanager.internal.utils.GUIUtils;
@@ -340,6 +341,8 @@ public final class MMStudio implements Studio, CompatibilityInterface, PositionL
       
       // Tell Core to start logging
       initializeLogging(core_);
+
+      initializeDeviceAdapterMetadataCache(core_);
       
       // We need to be subscribed to the global event bus for plugin loading
       events().registerForEvents(this);
@@ -537,6 +540,26 @@ public final class MMStudio implements Studio, CompatibilityInterface, PositionL
       // enable only when debug logging is turned on (from the GUI).
       UIMonitor.enable(OptionsDlg.getIsDebugLogEnabled(studio_));
    }
+
+   /**
+    * Keep the Core's cache of device adapter metadata in the application
+    * data directory, so that listing the available devices does not load
+    * every unchanged adapter again in each session.
+    */
+   private void initializeDeviceAdapterMetadataCache(CMMCore core) {
+      String appDataPath = JavaUtils.getApplicationDataPath();
+      if (appDataPath == null) {
+         return;
+      }
+      JavaUtils.createApplicationDataPathIfNeeded();
+      File cacheFile = new File(appDataPath, "DeviceAdapterMetadataCache.txt");
+      try {
+         core.setDeviceAdapterMetadataCacheFile(cacheFile.getAbsolutePath());
+      }
+      catch (Exception e) {
+         ReportingUtils.logError(e, "Failed to set device adapter metadata cache file");
+      }
+   }
   
    public void showPipelineFrame() {
       pipelineFrame_.setVisible(true);
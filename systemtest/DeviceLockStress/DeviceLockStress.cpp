@@ -0,0 +1,426 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DeviceLockStress.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     systemtest
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Hardware-free concurrency test for device locking. Loads
+//                several devices from one simulated device adapter module
+//                into a headless CMMCore, calls into each of them from its
+//                own thread, and reports failed calls, the longest call per
+//                device, and deadlocks.
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "../../MMCore/CoreUtils.h"
+#include "../../MMCore/MMCore.h"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <cstdlib>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+
+namespace {
+
+const char* const g_CameraLabel = "Camera";
+const char* const g_XYStageLabel = "XYStage";
+const char* const g_ZStageLabel = "ZStage";
+const char* const g_ShutterLabel = "Shutter";
+
+// Time allowed for the device threads to finish their last call
+const double g_GraceS = 10.0;
+
+
+double WallSeconds()
+{
+   return GetMMTimeNow().getMsec() / 1000.0;
+}
+
+
+// Calls one device over and over until stopped. Written only by its own
+// thread until the thread has been joined.
+class DeviceWorker
+{
+public:
+   DeviceWorker(CMMCore& core, const std::string& label,
+         volatile bool& stop) :
+      core_(core), label_(label), stop_(stop),
+      calls_(0), failures_(0), maxCallMs_(0.0)
+   {}
+   virtual ~DeviceWorker() {}
+
+   void operator()()
+   {
+      for (unsigned long i = 0; !stop_; ++i)
+      {
+         double t0 = GetMMTimeNow().getMsec();
+         try
+         {
+            Call(i);
+         }
+         catch (const CMMError& e)
+         {
+            if (failures_++ == 0)
+               firstFailure_ = e.getFullMsg();
+         }
+         double callMs = GetMMTimeNow().getMsec() - t0;
+         if (callMs > maxCallMs_)
+            maxCallMs_ = callMs;
+         ++calls_;
+      }
+   }
+
+   const std::string& Label() const { return label_; }
+   unsigned long Calls() const { return calls_; }
+   unsigned long Failures() const { return failures_; }
+   const std::string& FirstFailure() const { return firstFailure_; }
+   double MaxCallMs() const { return maxCallMs_; }
+
+protected:
+   // One call into the device; the iteration number can be used to vary it
+   virtual void Call(unsigned long iteration) = 0;
+
+   CMMCore& core_;
+   const std::string label_;
+
+private:
+   volatile bool& stop_;
+   unsigned long calls_;
+   unsigned long failures_;
+   std::string firstFailure_;
+   double maxCallMs_;
+};
+
+
+class CameraWorker : public DeviceWorker
+{
+public:
+   CameraWorker(CMMCore& core, volatile bool& stop) :
+      DeviceWorker(core, g_CameraLabel, stop)
+   {}
+
+protected:
+   virtual void Call(unsigned long iteration)
+   {
+      if (iteration % 2 == 0)
+      {
+         core_.snapImage();
+         core_.getImage();
+      }
+      else
+      {
+         core_.getProperty(label_.c_str(), MM::g_Keyword_Exposure);
+      }
+   }
+};
+
+
+class XYStageWorker : public DeviceWorker
+{
+public:
+   XYStageWorker(CMMCore& core, volatile bool& stop) :
+      DeviceWorker(core, g_XYStageLabel, stop)
+   {}
+
+protected:
+   virtual void Call(unsigned long iteration)
+   {
+      double x, y;
+      switch (iteration % 3)
+      {
+         case 0:
+            // Moves are only started once the previous move has finished
+            if (!core_.deviceBusy(label_.c_str()))
+               core_.setXYPosition(label_.c_str(),
+                     (iteration % 2) ? 10.0 : 0.0, 0.0);
+            break;
+         case 1:
+            core_.getXYPosition(label_.c_str(), x, y);
+            break;
+         default:
+            core_.deviceBusy(label_.c_str());
+            break;
+      }
+   }
+};
+
+
+class ZStageWorker : public DeviceWorker
+{
+public:
+   ZStageWorker(CMMCore& core, volatile bool& stop) :
+      DeviceWorker(core, g_ZStageLabel, stop)
+   {}
+
+protected:
+   virtual void Call(unsigned long iteration)
+   {
+      switch (iteration % 3)
+      {
+         case 0:
+            if (!core_.deviceBusy(label_.c_str()))
+               core_.setPosition(label_.c_str(), (iteration % 2) ? 1.0 : 0.0);
+            break;
+         case 1:
+            core_.getPosition(label_.c_str());
+            break;
+         default:
+            core_.deviceBusy(label_.c_str());
+            break;
+      }
+   }
+};
+
+
+class ShutterWorker : public DeviceWorker
+{
+public:
+   ShutterWorker(CMMCore& core, volatile bool& stop) :
+      DeviceWorker(core, g_ShutterLabel, stop)
+   {}
+
+protected:
+   virtual void Call(unsigned long iteration)
+   {
+      if (iteration % 2 == 0)
+         core_.setShutterOpen(label_.c_str(), (iteration % 4) == 0);
+      else
+         core_.getShutterOpen(label_.c_str());
+   }
+};
+
+
+// Wrapper so that boost::thread does not copy the worker, whose counts are
+// read after the thread is joined.
+class WorkerRef
+{
+   boost::shared_ptr<DeviceWorker> worker_;
+public:
+   explicit WorkerRef(boost::shared_ptr<DeviceWorker> w) : worker_(w) {}
+   void operator()() { (*worker_)(); }
+};
+
+
+void LoadDevices(CMMCore& core, const std::string& module)
+{
+   if (module == "DemoCamera")
+   {
+      core.loadDevice(g_CameraLabel, "DemoCamera", "DCam");
+      core.loadDevice(g_XYStageLabel, "DemoCamera", "DXYStage");
+      core.loadDevice(g_ZStageLabel, "DemoCamera", "DStage");
+      core.loadDevice(g_ShutterLabel, "DemoCamera", "DShutter");
+      core.initializeAllDevices();
+      core.setProperty(g_CameraLabel, "OnCameraCCDXSize", 256L);
+      core.setProperty(g_CameraLabel, "OnCameraCCDYSize", 256L);
+   }
+   else if (module == "SequenceTester")
+   {
+      core.loadDevice("THub", "SequenceTester", "THub");
+      core.loadDevice(g_CameraLabel, "SequenceTester", "TCamera-0");
+      core.loadDevice(g_XYStageLabel, "SequenceTester", "TXYStage-0");
+      core.loadDevice(g_ZStageLabel, "SequenceTester", "TZStage-0");
+      core.loadDevice(g_ShutterLabel, "SequenceTester", "TShutter-0");
+      core.setParentLabel(g_CameraLabel, "THub");
+      core.setParentLabel(g_XYStageLabel, "THub");
+      core.setParentLabel(g_ZStageLabel, "THub");
+      core.setParentLabel(g_ShutterLabel, "THub");
+      core.initializeAllDevices();
+   }
+   else
+   {
+      throw std::runtime_error("Unknown module: " + module);
+   }
+
+   core.setCameraDevice(g_CameraLabel);
+   core.setExposure(10.0);
+   // Keep the camera from calling into the shutter
+   core.setAutoShutter(false);
+}
+
+
+void PrintWorker(std::ostream& out, const DeviceWorker& w, double seconds)
+{
+   out << std::fixed << std::setprecision(2);
+   out << "   " << std::left << std::setw(10) << w.Label() << std::right <<
+      std::setw(8) << w.Calls() << " calls (" <<
+      (seconds > 0.0 ? w.Calls() / seconds : 0.0) << "/s), " <<
+      w.Failures() << " failed, longest " << w.MaxCallMs() << " ms\n";
+   if (w.Failures() > 0)
+      out << "      first failure: " << w.FirstFailure() << "\n";
+}
+
+
+// Returns the number of failed calls
+unsigned long RunModule(const std::string& module,
+      const std::vector<std::string>& searchPaths, double durationS)
+{
+   CMMCore core;
+   core.enableStderrLog(false);
+   core.setDeviceAdapterSearchPaths(searchPaths);
+   LoadDevices(core, module);
+
+   volatile bool stop = false;
+   std::vector< boost::shared_ptr<DeviceWorker> > workers;
+   workers.push_back(boost::shared_ptr<DeviceWorker>(
+            new CameraWorker(core, stop)));
+   workers.push_back(boost::shared_ptr<DeviceWorker>(
+            new XYStageWorker(core, stop)));
+   workers.push_back(boost::shared_ptr<DeviceWorker>(
+            new ZStageWorker(core, stop)));
+   workers.push_back(boost::shared_ptr<DeviceWorker>(
+            new ShutterWorker(core, stop)));
+
+   std::vector< boost::shared_ptr<boost::thread> > threads;
+   double t0 = WallSeconds();
+   for (size_t i = 0; i < workers.size(); ++i)
+   {
+      threads.push_back(boost::shared_ptr<boost::thread>(
+               new boost::thread(WorkerRef(workers[i]))));
+   }
+
+   boost::this_thread::sleep(boost::posix_time::milliseconds(
+            static_cast<long>(durationS * 1000.0)));
+   stop = true;
+
+   for (size_t i = 0; i < threads.size(); ++i)
+   {
+      if (!threads[i]->timed_join(boost::posix_time::milliseconds(
+                  static_cast<long>(g_GraceS * 1000.0))))
+      {
+         // The core cannot be shut down with a thread stuck in a device
+         std::cout << "[" << module << "] " << workers[i]->Label() <<
+            " thread did not finish (deadlock?)\n";
+         std::cout.flush();
+         _exit(1);
+      }
+   }
+   double seconds = WallSeconds() - t0;
+
+   std::cout << "[" << module << "] " << workers.size() <<
+      " devices for " << std::fixed << std::setprecision(2) << seconds <<
+      " s\n";
+   unsigned long failures = 0;
+   for (size_t i = 0; i < workers.size(); ++i)
+   {
+      PrintWorker(std::cout, *workers[i], seconds);
+      failures += workers[i]->Failures();
+   }
+
+   core.unloadAllDevices();
+   return failures;
+}
+
+
+void Usage(const char* argv0)
+{
+   std::cerr << "Usage: " << argv0 <<
+      " [-p adapter_search_path]... [-t seconds] [module]...\n\n"
+      "Modules are DemoCamera and SequenceTester (default: both). If no -p\n"
+      "is given, the colon-separated MMTEST_ADAPTER_PATH environment\n"
+      "variable is used. See readme.txt.\n";
+}
+
+
+std::vector<std::string> SplitPathList(const std::string& list)
+{
+   std::vector<std::string> result;
+   std::istringstream iss(list);
+   std::string path;
+   while (std::getline(iss, path, ':'))
+   {
+      if (!path.empty())
+         result.push_back(path);
+   }
+   return result;
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char** argv)
+{
+   std::vector<std::string> searchPaths;
+   std::vector<std::string> modules;
+   double durationS = 5.0;
+   for (int i = 1; i < argc; ++i)
+   {
+      std::string arg(argv[i]);
+      if (arg == "-p" && i + 1 < argc)
+         searchPaths.push_back(argv[++i]);
+      else if (arg == "-t" && i + 1 < argc)
+         durationS = std::atof(argv[++i]);
+      else if (arg == "-h" || arg == "--help")
+      {
+         Usage(argv[0]);
+         return 0;
+      }
+      else
+         modules.push_back(arg);
+   }
+   if (durationS <= 0.0)
+   {
+      Usage(argv[0]);
+      return 2;
+   }
+   if (modules.empty())
+   {
+      modules.push_back("DemoCamera");
+      modules.push_back("SequenceTester");
+   }
+   if (searchPaths.empty())
+   {
+      const char* env = std::getenv("MMTEST_ADAPTER_PATH");
+      if (env)
+         searchPaths = SplitPathList(env);
+   }
+
+   int failures = 0;
+   for (std::vector<std::string>::const_iterator it = modules.begin(),
+         end = modules.end(); it != end; ++it)
+   {
+      try
+      {
+         if (RunModule(*it, searchPaths, durationS) > 0)
+         {
+            std::cout << "   FAILED: device calls failed\n";
+            ++failures;
+         }
+      }
+      catch (const CMMError& e)
+      {
+         std::cerr << "[" << *it << "] " << e.getFullMsg() << "\n";
+         ++failures;
+      }
+      catch (const std::exception& e)
+      {
+         std::cerr << "[" << *it << "] " << e.what() << "\n";
+         ++failures;
+      }
+   }
+   return failures ? 1 : 0;
+}
@@ -0,0 +1,190 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Scenario.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     systemtest
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Scenario file format for the sequence throughput harness.
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "Scenario.h"
+
+#include <boost/lexical_cast.hpp>
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+
+Scenario::Scenario() :
+   camera("DemoCamera"),
+   width(512),
+   height(512),
+   bitDepth(16),
+   fps(100.0),
+   frames(0),
+   durationS(10.0),
+   consumers(1),
+   copyFrames(true),
+   bufferMB(1024),
+   stopOnOverflow(false),
+   maxDropped(-1)
+{
+}
+
+
+namespace {
+
+std::string Trim(const std::string& s)
+{
+   const char* ws = " \t\r\n";
+   std::string::size_type first = s.find_first_not_of(ws);
+   if (first == std::string::npos)
+      return std::string();
+   std::string::size_type last = s.find_last_not_of(ws);
+   return s.substr(first, last - first + 1);
+}
+
+
+class ParseError : public std::runtime_error
+{
+public:
+   ParseError(const std::string& file, int line, const std::string& msg) :
+      std::runtime_error(Format(file, line, msg))
+   {}
+
+private:
+   static std::string Format(const std::string& file, int line,
+         const std::string& msg)
+   {
+      std::ostringstream oss;
+      oss << file << ":" << line << ": " << msg;
+      return oss.str();
+   }
+};
+
+
+template <typename T>
+T ParseValue(const std::string& file, int line, const std::string& key,
+      const std::string& value)
+{
+   try
+   {
+      return boost::lexical_cast<T>(value);
+   }
+   catch (const boost::bad_lexical_cast&)
+   {
+      throw ParseError(file, line, "Invalid value for " + key + ": " + value);
+   }
+}
+
+
+bool ParseBool(const std::string& file, int line, const std::string& key,
+      const std::string& value)
+{
+   if (value == "1" || value == "true" || value == "yes")
+      return true;
+   if (value == "0" || value == "false" || value == "no")
+      return false;
+   throw ParseError(file, line, "Invalid boolean for " + key + ": " + value);
+}
+
+
+void SetKey(Scenario& s, const std::string& file, int line,
+      const std::string& key, const std::string& value)
+{
+   if (key == "camera")
+   {
+      if (value != "DemoCamera" && value != "SequenceTester")
+         throw ParseError(file, line, "Unsupported camera: " + value);
+      s.camera = value;
+   }
+   else if (key == "width")
+      s.width = ParseValue<long>(file, line, key, value);
+   else if (key == "height")
+      s.height = ParseValue<long>(file, line, key, value);
+   else if (key == "bitdepth")
+      s.bitDepth = ParseValue<long>(file, line, key, value);
+   else if (key == "fps")
+      s.fps = ParseValue<double>(file, line, key, value);
+   else if (key == "frames")
+      s.frames = ParseValue<long>(file, line, key, value);
+   else if (key == "duration")
+      s.durationS = ParseValue<double>(file, line, key, value);
+   else if (key == "consumers")
+      s.consumers = ParseValue<int>(file, line, key, value);
+   else if (key == "copy")
+      s.copyFrames = ParseBool(file, line, key, value);
+   else if (key == "buffer_mb")
+      s.bufferMB = ParseValue<unsigned>(file, line, key, value);
+   else if (key == "stop_on_overflow")
+      s.stopOnOverflow = ParseBool(file, line, key, value);
+   else if (key == "max_dropped")
+      s.maxDropped = ParseValue<long>(file, line, key, value);
+   else if (key == "property")
+   {
+      // property = <name> <value>; the value may contain spaces
+      std::string::size_type sep = value.find_first_of(" \t");
+      if (sep == std::string::npos)
+         throw ParseError(file, line, "Expected 'property = <name> <value>'");
+      s.properties.push_back(std::make_pair(value.substr(0, sep),
+               Trim(value.substr(sep))));
+   }
+   else
+      throw ParseError(file, line, "Unknown key: " + key);
+}
+
+} // anonymous namespace
+
+
+std::vector<Scenario> ParseScenarioFile(const std::string& filename)
+{
+   std::ifstream ifs(filename.c_str());
+   if (!ifs)
+      throw std::runtime_error("Cannot open scenario file: " + filename);
+
+   std::vector<Scenario> scenarios;
+   Scenario defaults;
+   Scenario* current = &defaults;
+
+   std::string rawLine;
+   int lineNr = 0;
+   while (std::getline(ifs, rawLine))
+   {
+      ++lineNr;
+      std::string line = Trim(rawLine);
+      if (line.empty() || line[0] == '#')
+         continue;
+
+      if (line[0] == '[')
+      {
+         if (line[line.size() - 1] != ']' || line.size() < 3)
+            throw ParseError(filename, lineNr, "Malformed section header");
+         scenarios.push_back(defaults);
+         scenarios.back().name = Trim(line.substr(1, line.size() - 2));
+         current = &scenarios.back();
+         continue;
+      }
+
+      std::string::size_type eq = line.find('=');
+      if (eq == std::string::npos)
+         throw ParseError(filename, lineNr, "Expected 'key = value'");
+      SetKey(*current, filename, lineNr, Trim(line.substr(0, eq)),
+            Trim(line.substr(eq + 1)));
+   }
+
+   if (scenarios.empty())
+      throw std::runtime_error("No scenarios in " + filename);
+   return scenarios;
+}
@@ -0,0 +1,63 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Scenario.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     systemtest
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Scenario file format for the sequence throughput harness.
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+
+/**
+ * One load test run.
+ *
+ * A scenario file consists of sections, each starting with a [name] line and
+ * followed by "key = value" lines. Keys appearing before the first section
+ * set defaults for all sections. Blank lines and lines starting with '#' are
+ * ignored. See readme.txt for the list of keys.
+ */
+struct Scenario
+{
+   Scenario();
+
+   std::string name;
+   std::string camera;     // "DemoCamera" or "SequenceTester"
+   long width;
+   long height;
+   long bitDepth;
+   double fps;             // 0: as fast as the camera can go
+   long frames;            // 0: derive from durationS * fps
+   double durationS;
+   int consumers;
+   bool copyFrames;        // consumers memcpy each frame, like a writer
+   unsigned bufferMB;
+   bool stopOnOverflow;
+   long maxDropped;        // < 0: do not fail on dropped frames
+
+   // Additional camera properties, applied after the standard ones
+   std::vector<std::pair<std::string, std::string> > properties;
+};
+
+
+/**
+ * Parse a scenario file. Throws std::runtime_error (with file name and line
+ * number) on syntax errors and unknown keys.
+ */
+std::vector<Scenario> ParseScenarioFile(const std::string& filename);
@@ -0,0 +1,480 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          SequenceThroughput.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     systemtest
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Hardware-free sequence acquisition load test. Loads a
+//                simulated camera (DemoCamera or SequenceTester) into a
+//                headless CMMCore, streams according to the scenarios in a
+//                scenario file, and reports sustained throughput, dropped
+//                frames, frame latency and CPU use.
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "Scenario.h"
+
+#include "../../MMCore/CoreUtils.h"
+#include "../../MMCore/MMCore.h"
+#include "../../MMDevice/ImageMetadata.h"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#include <sys/time.h>
+#endif
+
+
+namespace {
+
+const char* const g_CameraLabel = "Camera";
+
+
+// Process CPU time (user + system) in seconds.
+double ProcessCPUSeconds()
+{
+#ifdef _WIN32
+   FILETIME creation, exit, kernel, user;
+   if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+      return 0.0;
+   ULARGE_INTEGER k, u;
+   k.LowPart = kernel.dwLowDateTime;
+   k.HighPart = kernel.dwHighDateTime;
+   u.LowPart = user.dwLowDateTime;
+   u.HighPart = user.dwHighDateTime;
+   return (k.QuadPart + u.QuadPart) * 1e-7;
+#else
+   struct rusage usage;
+   if (getrusage(RUSAGE_SELF, &usage) != 0)
+      return 0.0;
+   return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 +
+      usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+#endif
+}
+
+
+double WallSeconds()
+{
+   return GetMMTimeNow().getMsec() / 1000.0;
+}
+
+
+// Shared between the consumer threads and the main thread.
+class ConsumerStats
+{
+public:
+   ConsumerStats() : frames_(0), bytes_(0) {}
+
+   void Record(size_t bytes, bool haveLatency, double latencyMs)
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      ++frames_;
+      bytes_ += bytes;
+      if (haveLatency)
+         latenciesMs_.push_back(latencyMs);
+   }
+
+   long Frames() const
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      return frames_;
+   }
+
+   unsigned long long Bytes() const
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      return bytes_;
+   }
+
+   std::vector<double> Latencies() const
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      return latenciesMs_;
+   }
+
+private:
+   mutable boost::mutex mutex_;
+   long frames_;
+   unsigned long long bytes_;
+   std::vector<double> latenciesMs_;
+};
+
+
+// Frame latency: time from the Core inserting the frame into the circular
+// buffer (the TimeInCore tag, which the Core writes with the local clock
+// when it inserts each frame) to the moment a consumer obtained it.
+bool FrameLatencyMs(Metadata& md, const boost::posix_time::ptime& now,
+      double& latencyMs)
+{
+   if (!md.HasTag(MM::g_Keyword_Metadata_TimeInCore))
+      return false;
+   boost::posix_time::ptime inserted;
+   try
+   {
+      inserted = boost::posix_time::time_from_string(md.GetSingleTag(
+               MM::g_Keyword_Metadata_TimeInCore).GetValue());
+   }
+   catch (const std::exception&)
+   {
+      return false;
+   }
+   if (inserted.is_special())
+      return false;
+   latencyMs = (now - inserted).total_microseconds() / 1000.0;
+   return true;
+}
+
+
+class Consumer
+{
+public:
+   Consumer(CMMCore& core, ConsumerStats& stats, size_t frameBytes,
+         bool copyFrames, volatile bool& stop) :
+      core_(core), stats_(stats), stop_(stop), frameBytes_(frameBytes),
+      copyFrames_(copyFrames)
+   {
+      if (copyFrames_)
+         scratch_.resize(frameBytes_);
+   }
+
+   void operator()()
+   {
+      for (;;)
+      {
+         if (core_.getRemainingImageCount() == 0)
+         {
+            if (stop_)
+               return;
+            // Yield rather than sleep, so that frames are popped as soon as
+            // they arrive and the latency is not that of a polling interval
+            boost::this_thread::yield();
+            continue;
+         }
+
+         Metadata md;
+         void* pixels;
+         try
+         {
+            pixels = core_.popNextImageMD(md);
+         }
+         catch (const CMMError&)
+         {
+            // Another consumer got there first
+            continue;
+         }
+         boost::posix_time::ptime now =
+            boost::posix_time::microsec_clock::local_time();
+
+         // Simulate a writer that must copy the frame out of the ring
+         if (copyFrames_)
+            std::memcpy(&scratch_[0], pixels, scratch_.size());
+
+         double latencyMs = 0.0;
+         bool haveLatency = FrameLatencyMs(md, now, latencyMs);
+         stats_.Record(frameBytes_, haveLatency, latencyMs);
+      }
+   }
+
+private:
+   CMMCore& core_;
+   ConsumerStats& stats_;
+   volatile bool& stop_;
+   size_t frameBytes_;
+   bool copyFrames_;
+   std::vector<unsigned char> scratch_;
+};
+
+
+// Wrapper so that boost::thread does not copy the consumer (and its scratch
+// buffer).
+class ConsumerRef
+{
+   boost::shared_ptr<Consumer> consumer_;
+public:
+   explicit ConsumerRef(boost::shared_ptr<Consumer> c) : consumer_(c) {}
+   void operator()() { (*consumer_)(); }
+};
+
+
+void LoadCamera(CMMCore& core, const Scenario& s)
+{
+   if (s.camera == "DemoCamera")
+   {
+      core.loadDevice(g_CameraLabel, "DemoCamera", "DCam");
+      core.initializeAllDevices();
+      core.setProperty(g_CameraLabel, "OnCameraCCDXSize", s.width);
+      core.setProperty(g_CameraLabel, "OnCameraCCDYSize", s.height);
+      if (s.bitDepth <= 8)
+         core.setProperty(g_CameraLabel, MM::g_Keyword_PixelType, "8bit");
+      else if (s.bitDepth <= 16)
+         core.setProperty(g_CameraLabel, MM::g_Keyword_PixelType, "16bit");
+      else
+         core.setProperty(g_CameraLabel, MM::g_Keyword_PixelType, "32bit");
+      core.setProperty(g_CameraLabel, "BitDepth", s.bitDepth);
+   }
+   else if (s.camera == "SequenceTester")
+   {
+      // TesterCamera is 8-bit only and produces frames as fast as it can;
+      // its size is a pre-init property.
+      core.loadDevice("THub", "SequenceTester", "THub");
+      core.loadDevice(g_CameraLabel, "SequenceTester", "TCamera-0");
+      core.setParentLabel(g_CameraLabel, "THub");
+      core.setProperty(g_CameraLabel, "ImageMode", "MachineReadable");
+      core.setProperty(g_CameraLabel, "ImageWidth", s.width);
+      core.setProperty(g_CameraLabel, "ImageHeight", s.height);
+      core.initializeAllDevices();
+   }
+   else
+   {
+      throw std::runtime_error("Unknown camera: " + s.camera);
+   }
+
+   for (std::vector<std::pair<std::string, std::string> >::const_iterator
+         it = s.properties.begin(), end = s.properties.end(); it != end; ++it)
+   {
+      core.setProperty(g_CameraLabel, it->first.c_str(), it->second.c_str());
+   }
+
+   core.setCameraDevice(g_CameraLabel);
+   if (s.fps > 0.0 && s.camera == "DemoCamera")
+      core.setExposure(1000.0 / s.fps);
+}
+
+
+double Percentile(const std::vector<double>& sorted, double p)
+{
+   if (sorted.empty())
+      return 0.0;
+   size_t idx = static_cast<size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+   return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+
+struct Result
+{
+   double seconds;
+   long expected;
+   long received;
+   unsigned long long bytes;
+   bool overflowed;
+   double cpuPercent;
+   std::vector<double> latenciesMs; // sorted
+};
+
+
+Result RunScenario(const Scenario& s, const std::vector<std::string>& searchPaths)
+{
+   CMMCore core;
+   core.enableStderrLog(false);
+   core.setDeviceAdapterSearchPaths(searchPaths);
+   LoadCamera(core, s);
+   core.setCircularBufferMemoryFootprint(s.bufferMB);
+
+   const size_t frameBytes = static_cast<size_t>(core.getImageBufferSize());
+   long frames = s.frames;
+   if (frames <= 0)
+      frames = static_cast<long>(s.durationS * s.fps + 0.5);
+   if (frames <= 0)
+      throw std::runtime_error("Scenario " + s.name +
+            ": set 'frames', or both 'duration' and 'fps'");
+
+   ConsumerStats stats;
+   volatile bool stop = false;
+   boost::thread_group consumers;
+   for (int i = 0; i < s.consumers; ++i)
+   {
+      boost::shared_ptr<Consumer> c(new Consumer(core, stats, frameBytes,
+               s.copyFrames, stop));
+      consumers.create_thread(ConsumerRef(c));
+   }
+
+   double cpu0 = ProcessCPUSeconds();
+   double t0 = WallSeconds();
+   core.startSequenceAcquisition(frames, 0.0, s.stopOnOverflow);
+
+   // Generous timeout: twice the nominal duration plus startup slack
+   double timeoutS = 10.0 + (s.fps > 0.0 ? 2.0 * frames / s.fps : 60.0);
+   while (core.isSequenceRunning() && WallSeconds() - t0 < timeoutS)
+      boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+   if (core.isSequenceRunning())
+      core.stopSequenceAcquisition();
+
+   stop = true;
+   consumers.join_all();
+   double t1 = WallSeconds();
+   double cpu1 = ProcessCPUSeconds();
+
+   Result r;
+   r.seconds = t1 - t0;
+   r.expected = frames;
+   r.received = stats.Frames();
+   r.bytes = stats.Bytes();
+   r.overflowed = core.isBufferOverflowed();
+   unsigned nCPU = boost::thread::hardware_concurrency();
+   r.cpuPercent = (r.seconds > 0.0) ?
+      100.0 * (cpu1 - cpu0) / r.seconds / (nCPU ? nCPU : 1) : 0.0;
+   r.latenciesMs = stats.Latencies();
+   std::sort(r.latenciesMs.begin(), r.latenciesMs.end());
+
+   core.unloadAllDevices();
+   return r;
+}
+
+
+void PrintResult(std::ostream& out, const Scenario& s, const Result& r)
+{
+   double mb = r.bytes / (1024.0 * 1024.0);
+   out << std::fixed << std::setprecision(2);
+   out << "[" << s.name << "] " << s.camera << " " <<
+      s.width << "x" << s.height << "x" << s.bitDepth << "bit, " <<
+      (s.fps > 0.0 ? s.fps : 0.0) << " fps requested, " <<
+      s.consumers << " consumer(s)\n";
+   out << "   frames:      " << r.received << " of " << r.expected <<
+      " received, " << (r.expected - r.received) << " dropped" <<
+      (r.overflowed ? " (buffer overflowed)" : "") << "\n";
+   out << "   throughput:  " << (r.seconds > 0.0 ? mb / r.seconds : 0.0) <<
+      " MB/s, " << (r.seconds > 0.0 ? r.received / r.seconds : 0.0) <<
+      " fps over " << r.seconds << " s\n";
+   if (r.latenciesMs.empty())
+   {
+      out << "   latency:     n/a (frames have no TimeInCore tag)\n";
+   }
+   else
+   {
+      out << "   latency ms:  p50 " << Percentile(r.latenciesMs, 50) <<
+         ", p90 " << Percentile(r.latenciesMs, 90) <<
+         ", p99 " << Percentile(r.latenciesMs, 99) <<
+         ", max " << r.latenciesMs.back() << "\n";
+   }
+   out << "   cpu:         " << r.cpuPercent << "% of " <<
+      boost::thread::hardware_concurrency() << " cores\n";
+}
+
+
+void Usage(const char* argv0)
+{
+   std::cerr << "Usage: " << argv0 <<
+      " [-p adapter_search_path]... scenario_file [scenario_name]...\n\n"
+      "If no -p is given, the colon-separated MMTEST_ADAPTER_PATH environment\n"
+      "variable is used. If scenario names are given, only those scenarios\n"
+      "are run. See readme.txt for the scenario file format.\n";
+}
+
+
+std::vector<std::string> SplitPathList(const std::string& list)
+{
+   std::vector<std::string> result;
+   std::istringstream iss(list);
+   std::string path;
+   while (std::getline(iss, path, ':'))
+   {
+      if (!path.empty())
+         result.push_back(path);
+   }
+   return result;
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char** argv)
+{
+   std::vector<std::string> searchPaths;
+   std::string scenarioFile;
+   std::vector<std::string> selected;
+   for (int i = 1; i < argc; ++i)
+   {
+      std::string arg(argv[i]);
+      if (arg == "-p" && i + 1 < argc)
+         searchPaths.push_back(argv[++i]);
+      else if (arg == "-h" || arg == "--help")
+      {
+         Usage(argv[0]);
+         return 0;
+      }
+      else if (scenarioFile.empty())
+         scenarioFile = arg;
+      else
+         selected.push_back(arg);
+   }
+   if (scenarioFile.empty())
+   {
+      Usage(argv[0]);
+      return 2;
+   }
+   if (searchPaths.empty())
+   {
+      const char* env = std::getenv("MMTEST_ADAPTER_PATH");
+      if (env)
+         searchPaths = SplitPathList(env);
+   }
+
+   std::vector<Scenario> scenarios;
+   try
+   {
+      scenarios = ParseScenarioFile(scenarioFile);
+   }
+   catch (const std::exception& e)
+   {
+      std::cerr << e.what() << "\n";
+      return 2;
+   }
+
+   int failures = 0;
+   for (std::vector<Scenario>::const_iterator it = scenarios.begin(),
+         end = scenarios.end(); it != end; ++it)
+   {
+      if (!selected.empty() &&
+            std::find(selected.begin(), selected.end(), it->name) ==
+            selected.end())
+         continue;
+
+      try
+      {
+         Result r = RunScenario(*it, searchPaths);
+         PrintResult(std::cout, *it, r);
+         if (it->maxDropped >= 0 && r.expected - r.received > it->maxDropped)
+         {
+            std::cout << "   FAILED: more than " << it->maxDropped <<
+               " frame(s) dropped\n";
+            ++failures;
+         }
+      }
+      catch (const CMMError& e)
+      {
+         std::cerr << "[" << it->name << "] " << e.getFullMsg() << "\n";
+         ++failures;
+      }
+      catch (const std::exception& e)
+      {
+         std::cerr << "[" << it->name << "] " << e.what() << "\n";
+         ++failures;
+      }
+   }
+   return failures ? 1 : 0;
+}
@@ -0,0 +1,336 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          TCPIPPortEcho.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     systemtest
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Round-trip test for the TCPIPPort device adapter. Runs a
+//                local TCP echo server, connects a TCPIPPort to it through
+//                a headless CMMCore, and checks and times command/answer
+//                round trips, binary writes and reads, and concurrent
+//                writers.
+//
+// COPYRIGHT:     Micro-Manager contributors, 2026
+//
+// LICENSE:       This file is distributed under the "Lesser GPL" (LGPL) license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "../../MMCore/CoreUtils.h"
+#include "../../MMCore/MMCore.h"
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+const char* const g_PortLabel = "Port";
+const char* const g_PortModule = "TCPIPPort";
+const char* const g_PortDevice = "TCP/IP serial port adapter (0)";
+
+// Lines sent by each of the concurrent writers
+const int g_LinesPerWriter = 200;
+
+
+double WallSeconds()
+{
+   return GetMMTimeNow().getMsec() / 1000.0;
+}
+
+
+// Accepts one connection on an ephemeral loopback port and sends back
+// everything it receives, until the client disconnects
+class EchoServer
+{
+public:
+   EchoServer() :
+      acceptor_(ios_, boost::asio::ip::tcp::endpoint(
+               boost::asio::ip::address_v4::loopback(), 0))
+   {}
+
+   unsigned short Port() const { return acceptor_.local_endpoint().port(); }
+
+   void operator()()
+   {
+      try
+      {
+         boost::asio::ip::tcp::socket sock(ios_);
+         acceptor_.accept(sock);
+         char data[4096];
+         for (;;)
+         {
+            boost::system::error_code ec;
+            std::size_t n = sock.read_some(boost::asio::buffer(data), ec);
+            if (ec)
+               break;
+            boost::asio::write(sock, boost::asio::buffer(data, n));
+         }
+      }
+      catch (const std::exception& e)
+      {
+         std::cerr << "echo server: " << e.what() << "\n";
+      }
+   }
+
+private:
+   boost::asio::io_service ios_;
+   boost::asio::ip::tcp::acceptor acceptor_;
+};
+
+
+struct EchoServerRef
+{
+   EchoServer* server;
+   void operator()() { (*server)(); }
+};
+
+
+class Checker
+{
+public:
+   Checker() : failures_(0) {}
+
+   void Check(bool ok, const std::string& what)
+   {
+      std::cout << (ok ? "   ok      " : "   FAILED  ") << what << "\n";
+      if (!ok)
+         ++failures_;
+   }
+
+   int Failures() const { return failures_; }
+
+private:
+   int failures_;
+};
+
+
+// Command/answer round trips of growing length; returns the mean round
+// trip in microseconds
+double CheckRoundTrips(CMMCore& core, Checker& checker, int repetitions)
+{
+   bool allEqual = true;
+   double t0 = WallSeconds();
+   for (int i = 0; i < repetitions; ++i)
+   {
+      std::string command = "CMD" + boost::lexical_cast<std::string>(i) +
+         std::string(i % 200, 'x');
+      core.setSerialPortCommand(g_PortLabel, command.c_str(), "\r\n");
+      std::string answer = core.getSerialPortAnswer(g_PortLabel, "\r\n");
+      if (answer != command)
+         allEqual = false;
+   }
+   double meanUs = (WallSeconds() - t0) * 1e6 / repetitions;
+   checker.Check(allEqual, boost::lexical_cast<std::string>(repetitions) +
+         " command/answer round trips");
+   return meanUs;
+}
+
+
+void CheckBinary(CMMCore& core, Checker& checker)
+{
+   std::vector<char> data;
+   for (int i = 0; i < 1000; ++i)
+      data.push_back(static_cast<char>(i % 256));
+   core.writeToSerialPort(g_PortLabel, data);
+
+   std::vector<char> received;
+   double deadline = WallSeconds() + 2.0;
+   while (received.size() < data.size() && WallSeconds() < deadline)
+   {
+      std::vector<char> chunk = core.readFromSerialPort(g_PortLabel);
+      received.insert(received.end(), chunk.begin(), chunk.end());
+      if (chunk.empty())
+         boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+   }
+   checker.Check(received == data, "binary write and read, including NUL bytes");
+}
+
+
+struct LineWriter
+{
+   CMMCore* core;
+   char id;
+   bool failed;
+
+   void operator()()
+   {
+      try
+      {
+         for (int i = 0; i < g_LinesPerWriter; ++i)
+         {
+            // Long enough that unserialized writes would interleave
+            std::string line(300, id);
+            line += boost::lexical_cast<std::string>(i);
+            core->setSerialPortCommand(g_PortLabel, line.c_str(), "\n");
+         }
+      }
+      catch (const CMMError&)
+      {
+         failed = true;
+      }
+   }
+};
+
+
+// Writers on several threads: every line must come back whole
+void CheckConcurrentWriters(CMMCore& core, Checker& checker)
+{
+   const int nWriters = 4;
+   std::vector<LineWriter> writers(nWriters);
+   std::vector<boost::thread*> threads;
+   for (int w = 0; w < nWriters; ++w)
+   {
+      writers[w].core = &core;
+      writers[w].id = static_cast<char>('a' + w);
+      writers[w].failed = false;
+   }
+   for (int w = 0; w < nWriters; ++w)
+      threads.push_back(new boost::thread(boost::ref(writers[w])));
+   bool writeFailed = false;
+   for (int w = 0; w < nWriters; ++w)
+   {
+      threads[w]->join();
+      delete threads[w];
+      writeFailed = writeFailed || writers[w].failed;
+   }
+   checker.Check(!writeFailed, "concurrent writes succeed");
+
+   std::set<std::string> expected;
+   for (int w = 0; w < nWriters; ++w)
+   {
+      for (int i = 0; i < g_LinesPerWriter; ++i)
+         expected.insert(std::string(300, static_cast<char>('a' + w)) +
+               boost::lexical_cast<std::string>(i));
+   }
+   bool allWhole = true;
+   for (int n = 0; n < nWriters * g_LinesPerWriter; ++n)
+   {
+      std::string line;
+      try
+      {
+         line = core.getSerialPortAnswer(g_PortLabel, "\n");
+      }
+      catch (const CMMError&)
+      {
+         allWhole = false;
+         break;
+      }
+      if (expected.erase(line) != 1)
+         allWhole = false;
+   }
+   checker.Check(allWhole && expected.empty(),
+         "lines from concurrent writers are echoed whole");
+}
+
+
+void Usage(const char* argv0)
+{
+   std::cerr << "Usage: " << argv0 <<
+      " [-p adapter_search_path]... [-n round_trips]\n\n"
+      "If no -p is given, the colon-separated MMTEST_ADAPTER_PATH\n"
+      "environment variable is used. See readme.txt.\n";
+}
+
+
+std::vector<std::string> SplitPathList(const std::string& list)
+{
+   std::vector<std::string> result;
+   std::istringstream iss(list);
+   std::string path;
+   while (std::getline(iss, path, ':'))
+   {
+      if (!path.empty())
+         result.push_back(path);
+   }
+   return result;
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char** argv)
+{
+   std::vector<std::string> searchPaths;
+   int repetitions = 1000;
+   for (int i = 1; i < argc; ++i)
+   {
+      std::string arg(argv[i]);
+      if (arg == "-p" && i + 1 < argc)
+         searchPaths.push_back(argv[++i]);
+      else if (arg == "-n" && i + 1 < argc)
+         repetitions = std::atoi(argv[++i]);
+      else
+      {
+         Usage(argv[0]);
+         return arg == "-h" || arg == "--help" ? 0 : 2;
+      }
+   }
+   if (repetitions < 1)
+   {
+      Usage(argv[0]);
+      return 2;
+   }
+   if (searchPaths.empty())
+   {
+      const char* env = std::getenv("MMTEST_ADAPTER_PATH");
+      if (env)
+         searchPaths = SplitPathList(env);
+   }
+
+   EchoServer server;
+   EchoServerRef serverRef = { &server };
+   boost::thread serverThread(serverRef);
+
+   Checker checker;
+   try
+   {
+      CMMCore core;
+      core.enableStderrLog(false);
+      core.setDeviceAdapterSearchPaths(searchPaths);
+      core.loadDevice(g_PortLabel, g_PortModule, g_PortDevice);
+      core.setProperty(g_PortLabel, "TCP Port",
+            boost::lexical_cast<std::string>(server.Port()).c_str());
+      core.initializeDevice(g_PortLabel);
+      std::cout << "connected to echo server on port " << server.Port() << "\n";
+
+      double meanUs = CheckRoundTrips(core, checker, repetitions);
+      CheckBinary(core, checker);
+      CheckConcurrentWriters(core, checker);
+
+      std::cout << "mean round trip " << std::fixed << std::setprecision(1) <<
+         meanUs << " us\n";
+
+      // Closes the connection, which ends the server
+      core.unloadAllDevices();
+   }
+   catch (const CMMError& e)
+   {
+      std::cerr << e.getFullMsg() << "\n";
+      std::cout << "FAILED\n";
+      // The server is still waiting for a connection
+      std::exit(1);
+   }
+
+   serverThread.join();
+   std::cout << (checker.Failures() == 0 ? "PASSED" : "FAILED") << "\n";
+   return checker.Failures() == 0 ? 0 : 1;
+}